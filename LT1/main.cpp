@@ -6,11 +6,16 @@
 #include <optional>
 #include <cstdint>
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <iterator>
 #include <iomanip>
 #include <fstream>
 #include <chrono>
 #include <functional>
 #include <queue>
+#include <deque>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -21,6 +26,25 @@
 #include <pwd.h>
 #include <grp.h>
 #include <sys/statvfs.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <csignal>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unordered_map>
+#include <array>
+#include <set>
+#include <string_view>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/sendfile.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
 
 namespace fs = std::filesystem;
 
@@ -30,6 +54,7 @@ private:
     std::string logFilePath;
     std::ofstream logFile;
     bool loggingEnabled;
+    std::mutex logMutex;  // workers of ThreadPool log concurrently
 
 public:
     FileAccessLogger() 
@@ -74,6 +99,7 @@ public:
     }
 
     void logUnreadableFile(const std::string& filePath, const std::string& operation, const std::string& errorMsg) {
+        std::lock_guard<std::mutex> lock(logMutex);  // std::localtime and logFile are shared
         auto now = std::chrono::system_clock::now();
         auto time_t = std::chrono::system_clock::to_time_t(now);
         
@@ -113,6 +139,7 @@ public:
     }
 
     void logFileModification(const std::string& filePath, const std::string& operation, const std::string& details = "") {
+        std::lock_guard<std::mutex> lock(logMutex);  // std::localtime and logFile are shared
         auto now = std::chrono::system_clock::now();
         auto time_t = std::chrono::system_clock::to_time_t(now);
         
@@ -172,6 +199,15 @@ struct FileInfo {
     bool isDirectory;
     std::uintmax_t actualSize;    // размер данных
     std::uintmax_t allocatedSize; // фактически занимаемое место
+    dev_t device = 0;             // st_dev, identifies the inode together with st_ino
+    ino_t inode = 0;
+    mode_t mode = 0;              // raw st_mode (type + permission bits)
+    uid_t uid = 0;                // st_uid / st_gid, for the per-owner statistics
+    gid_t gid = 0;
+    nlink_t linkCount = 1;        // st_nlink
+    bool isExtraLink = false;     // hardlink to an inode already counted by an earlier row
+    time_t mtime = 0;             // st_mtim, kept raw for checksum cache keys
+    long mtimeNsec = 0;
 };
 
 // Structure to track cell editing state
@@ -193,6 +229,31 @@ struct CellEditState {
     }
 };
 
+// One-line prompt drawn above the page info (selection filter, batch and file operations)
+struct InputPrompt {
+    enum class Purpose { None, SelectPattern, BatchChmod, BatchRename, Copy, Move, Delete };
+    Purpose purpose = Purpose::None;
+    std::string label;
+    std::string value;
+    bool skipNextChar = false;  // the key that opened the prompt also arrives as TextEntered
+    
+    bool isActive() const { return purpose != Purpose::None; }
+    
+    void open(Purpose what, const std::string& text) {
+        purpose = what;
+        label = text;
+        value.clear();
+        skipNextChar = true;
+    }
+    
+    void reset() {
+        purpose = Purpose::None;
+        label.clear();
+        value.clear();
+        skipNextChar = false;
+    }
+};
+
 // Helper function to get filesystem block size
 std::uintmax_t getFilesystemBlockSize(const std::string& path) {
     struct statvfs vfs;
@@ -208,13 +269,232 @@ std::uintmax_t calculateAllocatedSize(std::uintmax_t actualSize, std::uintmax_t
     return ((actualSize + blockSize - 1) / blockSize) * blockSize;
 }
 
+// Table-driven formatting for the size, date and permission columns. Everything
+// writes into caller buffers and returns the end pointer; the tables are built
+// once and only read afterwards, so all functions are safe on scan threads.
+class FormatEngine {
+private:
+    struct Tables {
+        char permissions[4096][9];  // rwx triplets indexed by mode & 07777
+        char fileTypes[16];         // indexed by (mode & S_IFMT) >> 12
+        char digitPairs[200];       // "00".."99"
+        
+        Tables() {
+            for (unsigned mode = 0; mode < 4096; mode++) {
+                char* p = permissions[mode];
+                // Setuid/setgid replace the owner/group exec position with s/S, as in ls
+                p[0] = mode & S_IRUSR ? 'r' : '-';
+                p[1] = mode & S_IWUSR ? 'w' : '-';
+                p[2] = mode & S_ISUID ? (mode & S_IXUSR ? 's' : 'S') : (mode & S_IXUSR ? 'x' : '-');
+                p[3] = mode & S_IRGRP ? 'r' : '-';
+                p[4] = mode & S_IWGRP ? 'w' : '-';
+                p[5] = mode & S_ISGID ? (mode & S_IXGRP ? 's' : 'S') : (mode & S_IXGRP ? 'x' : '-');
+                p[6] = mode & S_IROTH ? 'r' : '-';
+                p[7] = mode & S_IWOTH ? 'w' : '-';
+                // Sticky bit replaces the others-exec position with t/T
+                p[8] = mode & S_ISVTX ? (mode & S_IXOTH ? 't' : 'T') : (mode & S_IXOTH ? 'x' : '-');
+            }
+            std::memset(fileTypes, '?', sizeof(fileTypes));
+            fileTypes[S_IFDIR >> 12] = 'd';
+            fileTypes[S_IFLNK >> 12] = 'l';
+            fileTypes[S_IFREG >> 12] = '-';
+            fileTypes[S_IFBLK >> 12] = 'b';
+            fileTypes[S_IFCHR >> 12] = 'c';
+            fileTypes[S_IFIFO >> 12] = 'p';
+            fileTypes[S_IFSOCK >> 12] = 's';
+            for (int i = 0; i < 100; i++) {
+                digitPairs[2 * i] = static_cast<char>('0' + i / 10);
+                digitPairs[2 * i + 1] = static_cast<char>('0' + i % 10);
+            }
+        }
+    };
+    
+    static const Tables& tables() {
+        static const Tables instance;
+        return instance;
+    }
+    
+    // Day cache: one slot per UTC day (direct-mapped, 4096 days ~ 11 years), packed
+    // into a single atomic word: day + bias | UTC offset | "offset changes that day".
+    // Races only ever store the same value, so relaxed atomics are enough.
+    static constexpr std::int64_t kDayBias = std::int64_t(1) << 39;
+    static constexpr int kOffsetBias = 1 << 17;
+    static std::array<std::atomic<std::uint64_t>, 4096>& dayCache() {
+        static std::array<std::atomic<std::uint64_t>, 4096> slots{};
+        return slots;
+    }
+    
+    static inline std::atomic<int> currentYear{0};
+    static inline std::atomic<bool> humanReadable{false};
+    
+    static std::int64_t floorDiv(std::int64_t a, std::int64_t b) {
+        return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+    }
+    
+    // UTC offset valid for the whole UTC day, or false on a DST switch day
+    static bool uniformOffset(std::int64_t day, long& offset) {
+        auto& slot = dayCache()[static_cast<size_t>(day) & 4095];
+        std::uint64_t packed = slot.load(std::memory_order_relaxed);
+        if ((packed >> 24) != static_cast<std::uint64_t>(day + kDayBias)) {
+            time_t first = static_cast<time_t>(day * 86400);
+            time_t last = first + 86399;
+            std::tm a{}, b{};
+            localtime_r(&first, &a);
+            localtime_r(&last, &b);
+            bool mixed = a.tm_gmtoff != b.tm_gmtoff;
+            packed = (static_cast<std::uint64_t>(day + kDayBias) << 24) |
+                     (static_cast<std::uint64_t>(a.tm_gmtoff + kOffsetBias) << 1) | (mixed ? 1 : 0);
+            slot.store(packed, std::memory_order_relaxed);
+        }
+        offset = static_cast<long>((packed >> 1) & 0x7FFFFF) - kOffsetBias;
+        return (packed & 1) == 0;
+    }
+
+public:
+    struct CalendarFields {
+        int year, month, day, hour, minute;  // month 1..12
+    };
+    
+    // Local calendar fields of a timestamp: integer arithmetic plus one cached
+    // offset per day; localtime_r only on the two DST switch days of a year
+    static CalendarFields toCalendar(time_t t) {
+        CalendarFields fields;
+        long offset = 0;
+        if (!uniformOffset(floorDiv(t, 86400), offset)) {
+            std::tm tm{};
+            localtime_r(&t, &tm);
+            return CalendarFields{tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min};
+        }
+        std::int64_t local = static_cast<std::int64_t>(t) + offset;
+        std::int64_t days = floorDiv(local, 86400);
+        std::int64_t seconds = local - days * 86400;
+        fields.hour = static_cast<int>(seconds / 3600);
+        fields.minute = static_cast<int>(seconds / 60 % 60);
+        
+        // Days since 1970-01-01 to civil date (proleptic Gregorian)
+        days += 719468;
+        std::int64_t era = floorDiv(days, 146097);
+        std::int64_t dayOfEra = days - era * 146097;
+        std::int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        std::int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        std::int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+        fields.day = static_cast<int>(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+        fields.month = static_cast<int>(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+        fields.year = static_cast<int>(yearOfEra + era * 400 + (fields.month <= 2));
+        return fields;
+    }
+    
+    // Re-read the clock (dates of the current year show a time instead of the year)
+    // and forget cached UTC offsets, in case the time zone changed since
+    static void refreshClock() {
+        for (auto& slot : dayCache()) {
+            slot.store(0, std::memory_order_relaxed);
+        }
+        currentYear.store(toCalendar(time(nullptr)).year, std::memory_order_relaxed);
+    }
+    
+    static void setHumanReadable(bool enabled) { humanReadable.store(enabled, std::memory_order_relaxed); }
+    static bool isHumanReadable() { return humanReadable.load(std::memory_order_relaxed); }
+    
+    // Shortest decimal form; at most 20 characters
+    static char* writeUnsigned(std::uint64_t value, char* out) {
+        int length = 1;
+        for (std::uint64_t v = value; v >= 10; v /= 10) {
+            length++;
+        }
+        char* p = out + length;
+        const char* pairs = tables().digitPairs;
+        while (value >= 100) {
+            unsigned pair = static_cast<unsigned>(value % 100) * 2;
+            value /= 100;
+            *--p = pairs[pair + 1];
+            *--p = pairs[pair];
+        }
+        if (value >= 10) {
+            *--p = pairs[value * 2 + 1];
+            *--p = pairs[value * 2];
+        } else {
+            *--p = static_cast<char>('0' + value);
+        }
+        return out + length;
+    }
+    
+    // ls -h style: 999, 1.5K, 12K, 3.4G; at most 6 characters
+    static char* writeHumanSize(std::uint64_t bytes, char* out) {
+        static const char units[] = "KMGTPE";
+        if (bytes < 1024) {
+            return writeUnsigned(bytes, out);
+        }
+        int unit = 0;
+        std::uint64_t scaled = bytes;
+        while (scaled >= 1024 * 1024 && unit < 5) {
+            scaled /= 1024;
+            unit++;
+        }
+        // scaled is in [1024, 1024^2): tenths of the next unit, rounded up like ls
+        std::uint64_t tenths = (scaled * 10 + 1023) / 1024;
+        if (tenths >= 100 && (tenths + 9) / 10 >= 1024 && unit < 5) {
+            // Rounding reached the next unit: 1024K is written 1.0M
+            tenths = 10;
+            unit++;
+        }
+        if (tenths >= 100) {
+            out = writeUnsigned((tenths + 9) / 10, out);
+        } else {
+            out = writeUnsigned(tenths / 10, out);
+            *out++ = '.';
+            *out++ = static_cast<char>('0' + tenths % 10);
+        }
+        *out++ = units[unit];
+        return out;
+    }
+    
+    // "data/allocated" in bytes, or in units when human-readable output is on
+    static char* writeSizeInfo(std::uint64_t actualSize, std::uint64_t allocatedSize, char* out) {
+        bool human = isHumanReadable();
+        out = human ? writeHumanSize(actualSize, out) : writeUnsigned(actualSize, out);
+        *out++ = '/';
+        return human ? writeHumanSize(allocatedSize, out) : writeUnsigned(allocatedSize, out);
+    }
+    
+    // "drwxr-xr-x": exactly 10 characters
+    static char* writePermissions(mode_t mode, char* out) {
+        const Tables& t = tables();
+        *out++ = t.fileTypes[(mode & S_IFMT) >> 12];
+        std::memcpy(out, t.permissions[mode & 07777], 9);
+        return out + 9;
+    }
+    
+    // ls -l style "Mar  5 14:07", or "Mar  5  2019" outside the current year; 12 characters
+    static char* writeDate(time_t mtime, char* out) {
+        static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+        CalendarFields f = toCalendar(mtime);
+        const char* pairs = tables().digitPairs;
+        std::memcpy(out, months + (f.month - 1) * 3, 3);
+        out[3] = ' ';
+        out[4] = f.day < 10 ? ' ' : pairs[f.day * 2];
+        out[5] = pairs[f.day * 2 + 1];
+        out[6] = ' ';
+        int year = currentYear.load(std::memory_order_relaxed);
+        if (year == 0) {
+            refreshClock();
+            year = currentYear.load(std::memory_order_relaxed);
+        }
+        if (f.year == year) {
+            std::memcpy(out + 7, pairs + f.hour * 2, 2);
+            out[9] = ':';
+            std::memcpy(out + 10, pairs + f.minute * 2, 2);
+            return out + 12;
+        }
+        out[7] = ' ';
+        return writeUnsigned(static_cast<std::uint64_t>(f.year < 0 ? 0 : f.year), out + 8);
+    }
+};
+
 // Helper function to format size with both actual and allocated sizes
 std::string formatSizeInfo(std::uintmax_t actualSize, std::uintmax_t allocatedSize) {
-    // For performance, just return the actual size as string
-    // Pre-allocate string to avoid reallocation
-    std::string result;
-    result.reserve(16);  // Reserve space for typical size strings
-    return std::to_string(actualSize) + "/" + std::to_string(allocatedSize);
+    char buf[48];
+    return std::string(buf, FormatEngine::writeSizeInfo(actualSize, allocatedSize, buf));
 }
 
 // REMOVED: Recursive directory size calculation - too slow for large directories
@@ -235,53 +515,8 @@ std::uintmax_t getDirectorySize(const fs::path& path, FileAccessLogger* logger =
 
 // Optimized version that reuses existing stat data
 std::string getFilePermissionsFromStat(const struct stat& statBuf) {
-    std::string result;
-    result.reserve(10);  // Pre-allocate for efficiency
-    
-    // File type
-    if (S_ISDIR(statBuf.st_mode)) {
-        result += 'd';
-    } else if (S_ISLNK(statBuf.st_mode)) {
-        result += 'l';
-    } else if (S_ISREG(statBuf.st_mode)) {
-        result += '-';
-    } else if (S_ISBLK(statBuf.st_mode)) {
-        result += 'b';
-    } else if (S_ISCHR(statBuf.st_mode)) {
-        result += 'c';
-    } else if (S_ISFIFO(statBuf.st_mode)) {
-        result += 'p';
-    } else if (S_ISSOCK(statBuf.st_mode)) {
-        result += 's';
-    } else {
-        result += '?';
-    }
-    
-    // Owner permissions
-    result += (statBuf.st_mode & S_IRUSR) ? "r" : "-";
-    result += (statBuf.st_mode & S_IWUSR) ? "w" : "-";
-    result += (statBuf.st_mode & S_IXUSR) ? "x" : "-";
-    
-    // Group permissions
-    result += (statBuf.st_mode & S_IRGRP) ? "r" : "-";
-    result += (statBuf.st_mode & S_IWGRP) ? "w" : "-";
-    result += (statBuf.st_mode & S_IXGRP) ? "x" : "-";
-    
-    // Others permissions with sticky bit consideration
-    bool has_others_exec = (statBuf.st_mode & S_IXOTH) != 0;
-    bool has_sticky_bit = (statBuf.st_mode & S_ISVTX) != 0;
-    
-    result += (statBuf.st_mode & S_IROTH) ? "r" : "-";
-    result += (statBuf.st_mode & S_IWOTH) ? "w" : "-";
-    
-    // Replace last character (others_exec) with t/T if sticky bit is set
-    if (has_sticky_bit) {
-        result += has_others_exec ? "t" : "T";
-    } else {
-        result += has_others_exec ? "x" : "-";
-    }
-    
-    return result;
+    char buf[10];
+    return std::string(buf, FormatEngine::writePermissions(statBuf.st_mode, buf));
 }
 
 // Функция для получения прав доступа к файлу (старая версия, оставлена для совместимости)
@@ -298,65 +533,20 @@ std::string getFilePermissions(const fs::path& path, FileAccessLogger* logger =
     return getFilePermissionsFromStat(statBuf);
 }
 
-// Static cache for current year to avoid repeated time() calls
-static time_t cached_now = 0;
-static int cached_current_year = 0;
-
 // Optimized date formatting function
 std::string formatDate(time_t mtime, FileAccessLogger* logger = nullptr, const std::string& filePath = "") {
-    try {
-        std::tm* tm = std::localtime(&mtime);
-        if (!tm) {
-            if (logger && !filePath.empty()) {
-                logger->logUnreadableFile(filePath, "date_format", "Failed to convert time_t to tm");
-            }
-            return "Jan  1  1970";
-        }
-        
-        // Cache current year to avoid repeated time() calls
-        time_t now = time(nullptr);
-        if (now - cached_now > 3600) {  // Update cache every hour
-            cached_now = now;
-            std::tm* now_tm = std::localtime(&now);
-            cached_current_year = now_tm ? now_tm->tm_year : 0;
-        }
-        
-        std::string result;
-        result.reserve(12);  // Pre-allocate for efficiency
-        
-        // Month names like ls -l
-        const char* months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
-                               "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
-        
-        result += months[tm->tm_mon];
-        result += " ";
-        
-        // Day with appropriate spacing (ls -l style)
-        if (tm->tm_mday < 10) {
-            result += " ";
-            result += std::to_string(tm->tm_mday);
-        } else {
-            result += std::to_string(tm->tm_mday);
-        }
-        result += " ";
-        
-        // If file is from this year, show time; otherwise show year
-        if (cached_current_year > 0 && tm->tm_year == cached_current_year) {
-            char timeBuf[6];
-            snprintf(timeBuf, sizeof(timeBuf), "%02d:%02d", tm->tm_hour, tm->tm_min);
-            result += timeBuf;
-        } else {
-            result += " ";
-            result += std::to_string(tm->tm_year + 1900);
-        }
-        
-        return result;
-    } catch (const std::exception& e) {
-        if (logger && !filePath.empty()) {
-            logger->logUnreadableFile(filePath, "date_format", e.what());
-        }
-        return "Jan  1  1970";
-    }
+    (void)logger;    // the table-driven formatter cannot fail
+    (void)filePath;
+    char buf[16];
+    return std::string(buf, FormatEngine::writeDate(mtime, buf));
+}
+
+// Size, date and permission strings of a row that arrived with raw fields only
+void formatDisplayFields(FileInfo& info) {
+    info.size = formatSizeInfo(info.actualSize, info.allocatedSize);
+    info.date = formatDate(info.mtime);
+    char permissions[10];
+    info.permissions.assign(permissions, FormatEngine::writePermissions(info.mode, permissions));
 }
 
 // Overload for filesystem compatibility (if needed)
@@ -374,403 +564,7929 @@ std::string formatDate(const fs::file_time_type& ftime, FileAccessLogger* logger
     }
 }
 
-class FileManager {
+// Fixed-size worker pool. The number of workers doubles as the bound on
+// concurrent I/O for hashing jobs, so keep it small on spinning disks.
+class ThreadPool {
 private:
-    std::vector<FileInfo> files;
-    std::string directoryPath;
-    std::unique_ptr<FileAccessLogger> logger;
-    bool scanInterrupted = false;
-    sf::RenderWindow* window = nullptr;  // Reference to window for event handling
-    
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskReady;
+    std::condition_variable allDone;
+    size_t pending = 0;  // queued + running
+    bool stopping = false;
+
+    void workerLoop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                taskReady.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            
+            task();
+            
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0) {
+                allDone.notify_all();
+            }
+        }
+    }
+
 public:
-    FileManager(const std::string& path, sf::RenderWindow* win = nullptr) 
-        : directoryPath(path), window(win) {
-        // Initialize logger
-        try {
-            logger = std::make_unique<FileAccessLogger>();
-        } catch (const std::exception& e) {
-            std::cerr << "Warning: Could not initialize file access logger: " << e.what() << std::endl;
-            logger = nullptr;
+    explicit ThreadPool(size_t threadCount) {
+        threadCount = std::max<size_t>(1, threadCount);
+        workers.reserve(threadCount);
+        for (size_t i = 0; i < threadCount; i++) {
+            workers.emplace_back([this] { workerLoop(); });
         }
-        loadFiles();
     }
     
-    // Method to reload a single file's information
-    bool reloadSingleFile(const std::string& filePath) {
-        // Find the file in the files vector
-        auto it = std::find_if(files.begin(), files.end(), 
-            [&filePath](const FileInfo& info) { return info.name == filePath; });
-        
-        if (it == files.end()) {
-            if (logger) {
-                logger->logUnreadableFile(filePath, "reload_single_file", "File not found in list");
-            }
-            return false;
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        taskReady.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push(std::move(task));
+            pending++;
         }
+        taskReady.notify_one();
+    }
+    
+    // Returns true once every submitted task has finished
+    bool waitIdleFor(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return allDone.wait_for(lock, timeout, [this] { return pending == 0; });
+    }
+    
+    void waitIdle() {
+        std::unique_lock<std::mutex> lock(mutex);
+        allDone.wait(lock, [this] { return pending == 0; });
+    }
+    
+    size_t size() const {
+        return workers.size();
+    }
+};
+
+// Streaming XXH64 (same digest as the reference xxHash implementation).
+// Fast enough to keep up with sequential disk reads on a single core.
+class Xxh64Hasher {
+private:
+    static constexpr std::uint64_t P1 = 11400714785074694791ULL;
+    static constexpr std::uint64_t P2 = 14029467366897019727ULL;
+    static constexpr std::uint64_t P3 = 1609587929392839161ULL;
+    static constexpr std::uint64_t P4 = 9650029242287828579ULL;
+    static constexpr std::uint64_t P5 = 2870177450012600261ULL;
+    
+    std::uint64_t seed;
+    std::uint64_t v1, v2, v3, v4;
+    std::uint64_t totalLength = 0;
+    unsigned char buffer[32];
+    size_t bufferSize = 0;
+    
+    static std::uint64_t rotl(std::uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+    
+    static std::uint64_t read64(const unsigned char* p) {
+        std::uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    
+    static std::uint32_t read32(const unsigned char* p) {
+        std::uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    
+    static std::uint64_t round(std::uint64_t acc, std::uint64_t input) {
+        acc += input * P2;
+        acc = rotl(acc, 31);
+        return acc * P1;
+    }
+    
+    static std::uint64_t mergeRound(std::uint64_t acc, std::uint64_t val) {
+        acc ^= round(0, val);
+        return acc * P1 + P4;
+    }
+    
+    void consumeStripe(const unsigned char* p) {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+    }
+
+public:
+    explicit Xxh64Hasher(std::uint64_t seedValue = 0) : seed(seedValue) {
+        reset();
+    }
+    
+    void reset() {
+        v1 = seed + P1 + P2;
+        v2 = seed + P2;
+        v3 = seed;
+        v4 = seed - P1;
+        totalLength = 0;
+        bufferSize = 0;
+    }
+    
+    void update(const void* data, size_t length) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        const unsigned char* end = p + length;
+        totalLength += length;
         
-        // Reload file information
-        struct stat statBuf;
-        if (lstat(filePath.c_str(), &statBuf) == -1) {
-            if (logger) {
-                logger->logUnreadableFile(filePath, "reload_single_file_lstat", std::string("lstat failed: ") + strerror(errno));
-            }
-            return false;
+        if (bufferSize + length < 32) {
+            std::memcpy(buffer + bufferSize, p, length);
+            bufferSize += length;
+            return;
         }
         
-        // Get filesystem block size
-        std::uintmax_t blockSize = getFilesystemBlockSize(fs::path(filePath).parent_path().string());
+        if (bufferSize > 0) {
+            size_t fill = 32 - bufferSize;
+            std::memcpy(buffer + bufferSize, p, fill);
+            consumeStripe(buffer);
+            p += fill;
+            bufferSize = 0;
+        }
         
-        // Update file info
-        it->isDirectory = S_ISDIR(statBuf.st_mode);
-        it->actualSize = statBuf.st_size;
+        while (p + 32 <= end) {
+            consumeStripe(p);
+            p += 32;
+        }
         
-        if (it->isDirectory) {
-            it->allocatedSize = calculateAllocatedSize(statBuf.st_size, blockSize);
-            it->size = formatSizeInfo(it->actualSize, it->allocatedSize);
+        bufferSize = static_cast<size_t>(end - p);
+        std::memcpy(buffer, p, bufferSize);
+    }
+    
+    std::uint64_t digest() const {
+        std::uint64_t h;
+        if (totalLength >= 32) {
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = mergeRound(h, v1);
+            h = mergeRound(h, v2);
+            h = mergeRound(h, v3);
+            h = mergeRound(h, v4);
         } else {
-            it->allocatedSize = calculateAllocatedSize(statBuf.st_size, blockSize);
-            it->size = formatSizeInfo(it->actualSize, it->allocatedSize);
+            h = seed + P5;
         }
+        h += totalLength;
         
-        it->date = formatDate(statBuf.st_mtime, logger.get(), filePath);
-        it->permissions = getFilePermissionsFromStat(statBuf);
+        const unsigned char* p = buffer;
+        const unsigned char* end = buffer + bufferSize;
+        while (p + 8 <= end) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * P1 + P4;
+            p += 8;
+        }
+        if (p + 4 <= end) {
+            h ^= static_cast<std::uint64_t>(read32(p)) * P1;
+            h = rotl(h, 23) * P2 + P3;
+            p += 4;
+        }
+        while (p < end) {
+            h ^= (*p) * P5;
+            h = rotl(h, 11) * P1;
+            p++;
+        }
         
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+};
+
+// Size of the aligned buffer used for streaming reads (one per worker thread)
+constexpr size_t kHashReadBufferSize = 1 << 20;
+
+// --polite, process-wide: idle I/O class (the disk serves us only when nobody else
+// wants it) and no page-cache residue from reading file contents
+class PoliteIo {
+private:
+    static std::atomic<bool>& flag() {
+        static std::atomic<bool> value{false};
+        return value;
+    }
+    
+    // ioprio_set(2) has no glibc wrapper or header constants
+    static constexpr int kWhoProcess = 1;
+    static constexpr int kClassIdle = 3;
+    static constexpr int kClassShift = 13;
+
+public:
+    // Call before any thread is started: threads inherit the I/O priority
+    static bool enable() {
+        flag() = true;
+        return syscall(SYS_ioprio_set, kWhoProcess, 0, kClassIdle << kClassShift) == 0;
+    }
+    
+    static bool enabled() {
+        return flag();
+    }
+    
+    // Whether any page of [offset, offset + length) is cached now (mincore over a
+    // throwaway mapping of just that range)
+    static bool hasCachedPages(int fd, std::uintmax_t offset, std::uintmax_t length) {
+        if (length == 0) {
+            return false;
+        }
+        std::uintmax_t pageSize = static_cast<std::uintmax_t>(sysconf(_SC_PAGESIZE));
+        std::uintmax_t start = offset / pageSize * pageSize;
+        size_t span = static_cast<size_t>(offset + length - start);
+        void* map = mmap(nullptr, span, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(start));
+        if (map == MAP_FAILED) {
+            return true;  // unknown: treat as someone else's cache
+        }
+        std::vector<unsigned char> resident((span + pageSize - 1) / pageSize);
+        bool cached = mincore(map, span, resident.data()) != 0 ||
+                      std::any_of(resident.begin(), resident.end(), [](unsigned char page) { return page & 1; });
+        munmap(map, span);
+        return cached;
+    }
+    
+    // Reader side: cold = !hasCachedPages() over the range before reading it. Only
+    // pages this read brought in are dropped; a file that was already warm stays warm
+    // for its users. A length of 0 means up to the end of the file.
+    static void releasePages(int fd, bool cold, std::uintmax_t offset = 0, std::uintmax_t length = 0) {
+        if (!enabled() || !cold) {
+            return;
+        }
+        // The kernel keeps partly covered pages; those were checked as cold too
+        std::uintmax_t pageSize = static_cast<std::uintmax_t>(sysconf(_SC_PAGESIZE));
+        std::uintmax_t start = offset / pageSize * pageSize;
+        std::uintmax_t span = length == 0 ? 0 : (offset + length - start + pageSize - 1) / pageSize * pageSize;
+        posix_fadvise(fd, static_cast<off_t>(start), static_cast<off_t>(span), POSIX_FADV_DONTNEED);
+    }
+};
+
+// Open a file for hashing without touching its atime when we are allowed to
+int openForHashing(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if (fd == -1 && errno == EPERM) {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);  // O_NOATIME needs file ownership
+    }
+    return fd;
+}
+
+// Hash the whole file with large aligned sequential reads.
+// bytesRead (optional) is advanced as data comes in, for progress reporting.
+bool hashFileContents(const std::string& path, std::uint64_t& hashOut, FileAccessLogger* logger = nullptr,
+                      std::atomic<std::uint64_t>* bytesRead = nullptr) {
+    int fd = openForHashing(path);
+    if (fd == -1) {
         if (logger) {
-            logger->logFileModification(filePath, "file_info_reloaded", "Successfully updated file information");
+            logger->logUnreadableFile(path, "hash_open", std::string("open failed: ") + strerror(errno));
+        }
+        return false;
+    }
+    
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    // Polite mode checks each block just before reading it, so the mincore mapping
+    // and its vector stay one block long however large the file is
+    struct stat statBuf;
+    bool polite = PoliteIo::enabled() && fstat(fd, &statBuf) == 0;
+    std::uintmax_t fileSize = polite ? static_cast<std::uintmax_t>(statBuf.st_size) : 0;
+    std::uintmax_t offset = 0;
+    
+    struct AlignedBuffer {
+        void* data = nullptr;
+        AlignedBuffer() {
+            if (posix_memalign(&data, 4096, kHashReadBufferSize) != 0) {
+                data = nullptr;
+            }
+        }
+        ~AlignedBuffer() { free(data); }
+    };
+    thread_local AlignedBuffer readBuffer;
+    if (!readBuffer.data) {
+        close(fd);
+        return false;
+    }
+    
+    Xxh64Hasher hasher;
+    bool ok = true;
+    for (;;) {
+        std::uintmax_t blockLength = offset < fileSize ? std::min<std::uintmax_t>(kHashReadBufferSize, fileSize - offset) : 0;
+        bool cold = polite && !PoliteIo::hasCachedPages(fd, offset, blockLength);
+        ssize_t n = read(fd, readBuffer.data, kHashReadBufferSize);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (logger) {
+                logger->logUnreadableFile(path, "hash_read", std::string("read failed: ") + strerror(errno));
+            }
+            ok = false;
+            break;
+        }
+        hasher.update(readBuffer.data, static_cast<size_t>(n));
+        PoliteIo::releasePages(fd, cold, offset, static_cast<std::uintmax_t>(n));
+        offset += static_cast<std::uintmax_t>(n);
+        if (bytesRead) {
+            *bytesRead += static_cast<std::uint64_t>(n);
+        }
+    }
+    
+    close(fd);
+    if (ok) {
+        hashOut = hasher.digest();
+    }
+    return ok;
+}
+
+// Set of (st_dev, st_ino) pairs used to count every inode once.
+// Open addressing over packed 64-bit keys: the device is replaced by a small
+// index stored in the top 16 bits, so each entry costs 8 bytes (~11 bytes per
+// inode at the 0.7 load limit, i.e. about 110 MB for 10M hardlinked files).
+// Inode numbers that do not fit in 48 bits fall back to a std::set.
+class InodeSet {
+private:
+    static constexpr int kInodeBits = 48;
+    static constexpr std::uint64_t kInodeMask = (1ULL << kInodeBits) - 1;
+    
+    std::vector<std::uint64_t> slots;  // 0 = empty; keys are never 0 (device index starts at 1)
+    size_t count = 0;
+    std::vector<dev_t> devices;
+    size_t lastDevice = 0;
+    std::set<std::pair<dev_t, ino_t>> overflow;
+    
+    static std::uint64_t mix(std::uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xBF58476D1CE4E5B9ULL;
+        x ^= x >> 27;
+        x *= 0x94D049BB133111EBULL;
+        x ^= x >> 31;
+        return x;
+    }
+    
+    // 0 when the pair cannot be packed
+    std::uint64_t pack(dev_t device, ino_t inode) {
+        if (static_cast<std::uint64_t>(inode) > kInodeMask) {
+            return 0;
+        }
+        if (lastDevice >= devices.size() || devices[lastDevice] != device) {
+            auto it = std::find(devices.begin(), devices.end(), device);
+            if (it == devices.end()) {
+                if (devices.size() >= 0xFFFF) {
+                    return 0;
+                }
+                devices.push_back(device);
+                it = devices.end() - 1;
+            }
+            lastDevice = static_cast<size_t>(it - devices.begin());
+        }
+        return (static_cast<std::uint64_t>(lastDevice + 1) << kInodeBits) | static_cast<std::uint64_t>(inode);
+    }
+    
+    void grow() {
+        std::vector<std::uint64_t> old;
+        old.swap(slots);
+        slots.assign(old.empty() ? 1024 : old.size() * 2, 0);
+        size_t mask = slots.size() - 1;
+        for (std::uint64_t key : old) {
+            if (key != 0) {
+                size_t i = mix(key) & mask;
+                while (slots[i] != 0) {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = key;
+            }
+        }
+    }
+
+public:
+    // Returns true if the inode was not in the set yet
+    bool insert(dev_t device, ino_t inode) {
+        std::uint64_t key = pack(device, inode);
+        if (key == 0) {
+            return overflow.emplace(device, inode).second;
+        }
+        
+        if ((count + 1) * 10 > slots.size() * 7) {
+            grow();
         }
         
+        size_t mask = slots.size() - 1;
+        size_t i = mix(key) & mask;
+        while (slots[i] != 0) {
+            if (slots[i] == key) {
+                return false;
+            }
+            i = (i + 1) & mask;
+        }
+        slots[i] = key;
+        count++;
         return true;
     }
     
-    // Method to update file metadata (name, permissions, etc.)
-    bool updateFileMetadata(const std::string& filePath, int columnIndex, const std::string& newValue) {
-        try {
-            switch (columnIndex) {
-                case 0: // Name - rename file
-                {
+    size_t size() const {
+        return count + overflow.size();
+    }
+    
+    void clear() {
+        slots.clear();
+        count = 0;
+        devices.clear();
+        lastDevice = 0;
+        overflow.clear();
+    }
+};
+
+// Rows and fields in the binary layout shared by the scan daemon protocol and the
+// spill files of --memory-limit (see IndexRequest for the row layout)
+class WireWriter {
+private:
+    std::string buffer;
+
+public:
+    template <typename T>
+    void put(T value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    
+    void putBytes(const char* data, size_t size) {
+        buffer.append(data, size);
+    }
+    
+    void putString(std::string_view text) {
+        std::uint16_t length = static_cast<std::uint16_t>(std::min<size_t>(text.size(), UINT16_MAX));
+        put(length);
+        buffer.append(text.data(), length);
+    }
+    
+    void putRow(const FileInfo& info) {
+        put<std::uint64_t>(info.actualSize);
+        put<std::uint64_t>(info.allocatedSize);
+        put<std::int64_t>(info.mtime);
+        put<std::uint32_t>(static_cast<std::uint32_t>(info.mtimeNsec));
+        put<std::uint32_t>(info.mode);
+        put<std::uint32_t>(static_cast<std::uint32_t>(info.linkCount));
+        put<std::uint8_t>((info.isDirectory ? 1 : 0) | (info.isExtraLink ? 2 : 0));
+        put<std::uint64_t>(info.device);
+        put<std::uint64_t>(info.inode);
+        put<std::uint32_t>(info.uid);
+        put<std::uint32_t>(info.gid);
+        putString(info.name);
+    }
+    
+    const std::string& data() const {
+        return buffer;
+    }
+    
+    size_t size() const {
+        return buffer.size();
+    }
+    
+    void clear() {
+        buffer.clear();
+    }
+};
+
+// Reads fields off a payload or a mapped record; any overrun clears ok() and yields zeros
+class WireReader {
+private:
+    const char* p;
+    const char* end;
+    bool valid = true;
+
+public:
+    explicit WireReader(std::string_view payload) : p(payload.data()), end(payload.data() + payload.size()) {}
+    
+    template <typename T>
+    T get() {
+        T value{};
+        if (end - p < static_cast<std::ptrdiff_t>(sizeof(T))) {
+            valid = false;
+            return value;
+        }
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+    
+    std::string getString() {
+        std::uint16_t length = get<std::uint16_t>();
+        if (end - p < length) {
+            valid = false;
+            return std::string();
+        }
+        std::string text(p, length);
+        p += length;
+        return text;
+    }
+    
+    // Raw row; the display strings are formatted by the caller
+    FileInfo getRow() {
+        FileInfo info;
+        info.actualSize = get<std::uint64_t>();
+        info.allocatedSize = get<std::uint64_t>();
+        info.mtime = static_cast<time_t>(get<std::int64_t>());
+        info.mtimeNsec = get<std::uint32_t>();
+        info.mode = get<std::uint32_t>();
+        info.linkCount = get<std::uint32_t>();
+        std::uint8_t flags = get<std::uint8_t>();
+        info.isDirectory = flags & 1;
+        info.isExtraLink = flags & 2;
+        info.device = get<std::uint64_t>();
+        info.inode = get<std::uint64_t>();
+        info.uid = get<std::uint32_t>();
+        info.gid = get<std::uint32_t>();
+        info.name = getString();
+        return info;
+    }
+    
+    bool ok() const {
+        return valid;
+    }
+    
+    size_t consumed(std::string_view payload) const {
+        return p - payload.data();
+    }
+};
+
+// Rows of one sorted run while a --memory-limit scan spills to disk. The file is
+// unlinked as soon as it is created, so nothing is left behind after a crash.
+class RunFile {
+private:
+    int fd = -1;
+    WireWriter pending;
+    std::uint64_t appended = 0;  // bytes of all rows so far, flushed or not
+    static constexpr size_t kFlushBytes = 1 << 20;
+
+public:
+    RunFile() = default;
+    RunFile(const RunFile&) = delete;
+    RunFile& operator=(const RunFile&) = delete;
+    
+    ~RunFile() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    
+    bool create(const std::string& directory) {
+        std::string pattern = directory + "/table_app-run-XXXXXX";
+        fd = mkstemp(pattern.data());
+        if (fd < 0) {
+            return false;
+        }
+        unlink(pattern.c_str());
+        return true;
+    }
+    
+    // Anonymous memory file that can be sealed and handed to other processes
+    bool createInMemory(const char* name) {
+        fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        return fd >= 0;
+    }
+    
+    bool append(const FileInfo& row) {
+        size_t before = pending.size();
+        pending.putRow(row);
+        appended += pending.size() - before;
+        return pending.size() < kFlushBytes || flush();
+    }
+    
+    std::uint64_t bytesAppended() const {
+        return appended;
+    }
+    
+    bool flush() {
+        const std::string& data = pending.data();
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t written = write(fd, data.data() + done, data.size() - done);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            done += written;
+        }
+        pending.clear();
+        return true;
+    }
+    
+    int descriptor() const {
+        return fd;
+    }
+};
+
+// Sequential reader of a RunFile through a small buffer, for the k-way merge
+class RunCursor {
+private:
+    int fd;
+    off_t position = 0;
+    std::string buffer;
+    size_t begin = 0;
+    bool exhausted = false;
+    static constexpr size_t kReadBytes = 64 * 1024;
+    
+    // At least one whole record at `begin`, unless the run is over
+    bool fill() {
+        while (true) {
+            std::string_view rest(buffer.data() + begin, buffer.size() - begin);
+            WireReader probe(rest);
+            probe.getRow();
+            if (probe.ok()) {
+                return true;
+            }
+            if (exhausted) {
+                return false;
+            }
+            buffer.erase(0, begin);
+            begin = 0;
+            size_t old = buffer.size();
+            buffer.resize(old + kReadBytes);
+            ssize_t got = pread(fd, buffer.data() + old, kReadBytes, position);
+            if (got <= 0) {
+                buffer.resize(old);
+                exhausted = true;
+                continue;
+            }
+            position += got;
+            buffer.resize(old + got);
+        }
+    }
+
+public:
+    explicit RunCursor(int descriptor) : fd(descriptor) {}
+    
+    bool next(FileInfo& row) {
+        if (!fill()) {
+            return false;
+        }
+        std::string_view rest(buffer.data() + begin, buffer.size() - begin);
+        WireReader reader(rest);
+        row = reader.getRow();
+        begin += reader.consumed(rest);
+        return true;
+    }
+};
+
+// K-way merge of sorted runs into `out`, through a heap of the runs' current rows.
+// onRow gets the position of every row in `out` before it is written. The runs
+// are released afterwards.
+bool mergeRuns(std::vector<std::unique_ptr<RunFile>>& runs, RunFile& out,
+               const std::function<bool(const FileInfo&, const FileInfo&)>& less,
+               const std::function<bool(std::uint64_t)>& onRow = nullptr) {
+    std::vector<RunCursor> cursors;
+    std::vector<FileInfo> heads(runs.size());
+    for (size_t r = 0; r < runs.size(); r++) {
+        if (!runs[r]->flush()) {
+            return false;
+        }
+        cursors.emplace_back(runs[r]->descriptor());
+    }
+    auto later = [&](size_t a, size_t b) { return less(heads[b], heads[a]); };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> queue(later);
+    for (size_t r = 0; r < runs.size(); r++) {
+        if (cursors[r].next(heads[r])) {
+            queue.push(r);
+        }
+    }
+    
+    while (!queue.empty()) {
+        size_t r = queue.top();
+        queue.pop();
+        if ((onRow && !onRow(out.bytesAppended())) || !out.append(heads[r])) {
+            return false;
+        }
+        if (cursors[r].next(heads[r])) {
+            queue.push(r);
+        }
+    }
+    runs.clear();  // their space is released now
+    return out.flush();
+}
+
+class FileTable;
+
+// The merged, sorted result of a spilled scan, mapped read-only: a header, every
+// row in WireWriter::putRow layout and a u64 offset per row. Rows are decoded
+// on demand, so only what is looked at has to be resident. The index daemon
+// publishes its tables in the same layout.
+class PagedRows {
+private:
+    int fd = -1;
+    const char* base = nullptr;
+    size_t length = 0;
+    size_t count = 0;
+    const char* offsets = nullptr;  // u64 per row; not 8-byte aligned, so read with memcpy
+    
+    static constexpr char kMagic[8] = {'T', 'B', 'L', 'P', 'A', 'G', 'E', '1'};
+    static constexpr size_t kHeaderBytes = 8 + 8 + 8;  // magic, row count, offset table position
+    static constexpr size_t kFlagsOffset = 8 + 8 + 8 + 4 + 4 + 4;
+    static constexpr size_t kNameOffset = kFlagsOffset + 1 + 8 + 8 + 4 + 4 + 2;  // fields before the name bytes
+
+public:
+    PagedRows(const PagedRows&) = delete;
+    PagedRows& operator=(const PagedRows&) = delete;
+    
+    ~PagedRows() {
+        if (base) {
+            munmap(const_cast<char*>(base), length);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    
+    size_t size() const {
+        return count;
+    }
+    
+    std::uint64_t offsetAt(size_t i) const {
+        std::uint64_t offset;
+        std::memcpy(&offset, offsets + i * sizeof(offset), sizeof(offset));
+        return offset;
+    }
+    
+    std::string_view record(size_t i) const {
+        std::uint64_t begin = offsetAt(i);
+        std::uint64_t end = i + 1 < count ? offsetAt(i + 1) : static_cast<std::uint64_t>(offsets - base);
+        return std::string_view(base + begin, end - begin);
+    }
+    
+    // map() has checked that every record holds at least the fixed fields
+    std::string_view path(size_t i) const {
+        return record(i).substr(kNameOffset);
+    }
+    
+    bool isDirectory(size_t i) const {
+        return record(i)[kFlagsOffset] & 1;
+    }
+    
+    FileInfo row(size_t i) const {
+        WireReader reader(record(i));
+        FileInfo info = reader.getRow();
+        formatDisplayFields(info);
+        return info;
+    }
+    
+    // Merges sorted runs into one mapped file. `less` must be the order the runs were sorted in.
+    static std::shared_ptr<const PagedRows> merge(std::vector<std::unique_ptr<RunFile>>& runs, const std::string& directory,
+                                                  const std::function<bool(const FileInfo&, const FileInfo&)>& less) {
+        RunFile out;
+        if (!out.create(directory)) {
+            return nullptr;
+        }
+        
+        // Header is rewritten with the real numbers once they are known
+        WireWriter header;
+        header.putBytes(kMagic, sizeof(kMagic));
+        header.put<std::uint64_t>(0);
+        header.put<std::uint64_t>(0);
+        if (pwrite(out.descriptor(), header.data().data(), header.size(), 0) != static_cast<ssize_t>(header.size()) ||
+            lseek(out.descriptor(), kHeaderBytes, SEEK_SET) < 0) {
+            return nullptr;
+        }
+        
+        // Offsets are collected in a run file of their own and appended after the rows
+        RunFile offsetRun;
+        if (!offsetRun.create(directory)) {
+            return nullptr;
+        }
+        std::string offsetBuffer;
+        size_t rows = 0;
+        bool merged = mergeRuns(runs, out, less, [&](std::uint64_t position) {
+            std::uint64_t start = kHeaderBytes + position;
+            offsetBuffer.append(reinterpret_cast<const char*>(&start), sizeof(start));
+            rows++;
+            if (offsetBuffer.size() >= (1 << 20)) {
+                if (write(offsetRun.descriptor(), offsetBuffer.data(), offsetBuffer.size()) != static_cast<ssize_t>(offsetBuffer.size())) {
+                    return false;
+                }
+                offsetBuffer.clear();
+            }
+            return true;
+        });
+        if (!merged || 
+            write(offsetRun.descriptor(), offsetBuffer.data(), offsetBuffer.size()) != static_cast<ssize_t>(offsetBuffer.size())) {
+            return nullptr;
+        }
+        
+        // Offset table: copied from its run file behind the rows
+        std::uint64_t tablePosition = kHeaderBytes + out.bytesAppended();
+        std::uint64_t position = tablePosition;
+        std::string copy(1 << 20, '\0');
+        for (off_t from = 0;;) {
+            ssize_t got = pread(offsetRun.descriptor(), copy.data(), copy.size(), from);
+            if (got < 0) {
+                return nullptr;
+            }
+            if (got == 0) {
+                break;
+            }
+            if (pwrite(out.descriptor(), copy.data(), got, position) != got) {
+                return nullptr;
+            }
+            from += got;
+            position += got;
+        }
+        return finish(out, rows, tablePosition) ? map(dup(out.descriptor())) : nullptr;
+    }
+    
+    // The whole table as one row file in memory, sealed so that other processes can
+    // map it without it ever changing or shrinking under them (the index daemon)
+    static std::shared_ptr<const PagedRows> fromTable(const FileTable& files);
+    
+    // Maps a complete row file, e.g. one received from the index daemon; takes the descriptor.
+    // The file may come from another process, so the offset table is checked in full:
+    // records in order, inside the row area, none shorter than the fixed fields.
+    static std::shared_ptr<const PagedRows> map(int fd) {
+        auto result = std::shared_ptr<PagedRows>(new PagedRows());
+        result->fd = fd;
+        struct stat statBuf;
+        char header[kHeaderBytes];
+        if (fd < 0 || fstat(fd, &statBuf) != 0 ||
+            pread(fd, header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+            std::memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+            return nullptr;
+        }
+        WireReader fields(std::string_view(header + sizeof(kMagic), sizeof(header) - sizeof(kMagic)));
+        std::uint64_t rows = fields.get<std::uint64_t>();
+        std::uint64_t tablePosition = fields.get<std::uint64_t>();
+        std::uint64_t length = static_cast<std::uint64_t>(statBuf.st_size);
+        if (tablePosition < kHeaderBytes || tablePosition > length || (length - tablePosition) % 8 != 0 ||
+            (length - tablePosition) / 8 != rows) {
+            return nullptr;
+        }
+        
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            return nullptr;
+        }
+        result->base = static_cast<const char*>(mapped);
+        result->length = length;
+        result->count = rows;
+        result->offsets = result->base + tablePosition;
+        
+        std::uint64_t begin = rows > 0 ? result->offsetAt(0) : tablePosition;
+        if (begin < kHeaderBytes) {
+            return nullptr;
+        }
+        for (size_t i = 0; i < rows; i++) {
+            std::uint64_t end = i + 1 < rows ? result->offsetAt(i + 1) : tablePosition;
+            if (end < begin || end - begin < kNameOffset || end > tablePosition) {
+                return nullptr;
+            }
+            begin = end;
+        }
+        madvise(mapped, length, MADV_RANDOM);
+        return result;
+    }
+    
+    int descriptor() const {
+        return fd;
+    }
+
+private:
+    PagedRows() = default;
+    
+    // Header with the real numbers, once rows and offset table are written
+    static bool finish(const RunFile& out, std::uint64_t rows, std::uint64_t tablePosition) {
+        WireWriter header;
+        header.putBytes(kMagic, sizeof(kMagic));
+        header.put<std::uint64_t>(rows);
+        header.put<std::uint64_t>(tablePosition);
+        return pwrite(out.descriptor(), header.data().data(), header.size(), 0) == static_cast<ssize_t>(header.size());
+    }
+};
+
+// Names stored as (length of the prefix shared with the previous name, rest of
+// the name) in blocks of kBlockNames; the first name of a block is stored whole.
+// Sorted paths share most of their bytes with their neighbour, so this is several
+// times smaller than one std::string per name, and name i is rebuilt from its
+// block start in at most kBlockNames - 1 steps.
+class FrontCodedNames {
+public:
+    static constexpr size_t kBlockNames = 32;
+
+private:
+    std::string bytes;                        // varint shared, varint suffix length, suffix
+    std::vector<std::uint32_t> blockOffsets;  // start of every block in `bytes`
+    std::string last;                         // previous name, while adding
+    size_t count = 0;
+    
+    static void putVarint(std::string& out, size_t value) {
+        while (value >= 0x80) {
+            out += static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+    
+    static size_t getVarint(const char*& p) {
+        size_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            unsigned char byte = static_cast<unsigned char>(*p++);
+            value |= static_cast<size_t>(byte & 0x7F) << shift;
+            if (byte < 0x80) {
+                return value;
+            }
+        }
+    }
+    
+    // Applies the entry at p to `name` (the previous name) and moves p past it
+    static void step(const char*& p, std::string& name) {
+        size_t shared = getVarint(p);
+        size_t suffix = getVarint(p);
+        name.resize(shared);
+        name.append(p, suffix);
+        p += suffix;
+    }
+
+public:
+    void add(std::string_view name) {
+        size_t shared = 0;
+        if (count % kBlockNames == 0) {
+            blockOffsets.push_back(static_cast<std::uint32_t>(bytes.size()));
+        } else {
+            size_t limit = std::min(last.size(), name.size());
+            while (shared < limit && last[shared] == name[shared]) {
+                shared++;
+            }
+        }
+        putVarint(bytes, shared);
+        putVarint(bytes, name.size() - shared);
+        bytes.append(name.data() + shared, name.size() - shared);
+        last.assign(name.data(), name.size());
+        count++;
+    }
+    
+    // Drop the slack left by adding
+    void shrink() {
+        bytes.shrink_to_fit();
+        blockOffsets.shrink_to_fit();
+        last = std::string();
+    }
+    
+    size_t size() const {
+        return count;
+    }
+    
+    // Name i into `out`, reusing its capacity
+    void get(size_t i, std::string& out) const {
+        const char* p = bytes.data() + blockOffsets[i / kBlockNames];
+        out.clear();
+        for (size_t k = i - i % kBlockNames; k <= i; k++) {
+            step(p, out);
+        }
+    }
+    
+    // fn(index, name) for every name in order, one step per name
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        const char* p = bytes.data();
+        std::string name;
+        for (size_t i = 0; i < count; i++) {
+            step(p, name);
+            fn(i, static_cast<const std::string&>(name));
+        }
+    }
+    
+    size_t memoryBytes() const {
+        return bytes.capacity() + blockOffsets.capacity() * sizeof(std::uint32_t);
+    }
+};
+
+// A chunk of FileTable at rest: front-coded names and the raw numbers of each row.
+// The display strings are formatted again when the chunk is decoded.
+struct PackedChunk {
+    struct Row {
+        std::uint64_t actualSize;
+        std::uint64_t allocatedSize;
+        std::int64_t mtime;
+        std::uint64_t device;
+        std::uint64_t inode;
+        std::uint32_t mtimeNsec;
+        std::uint32_t mode;
+        std::uint32_t linkCount;
+        std::uint32_t uid;
+        std::uint32_t gid;
+        std::uint8_t flags;  // 1 = directory, 2 = extra hardlink
+    };
+    
+    FrontCodedNames names;
+    std::vector<Row> rows;
+    
+    explicit PackedChunk(const std::vector<FileInfo>& source) {
+        rows.reserve(source.size());
+        for (const FileInfo& info : source) {
+            names.add(info.name);
+            rows.push_back({info.actualSize, info.allocatedSize, info.mtime, info.device, info.inode,
+                            static_cast<std::uint32_t>(info.mtimeNsec), info.mode, static_cast<std::uint32_t>(info.linkCount),
+                            info.uid, info.gid, static_cast<std::uint8_t>((info.isDirectory ? 1 : 0) | (info.isExtraLink ? 2 : 0))});
+        }
+        names.shrink();
+    }
+    
+    std::shared_ptr<std::vector<FileInfo>> decode() const {
+        auto decoded = std::make_shared<std::vector<FileInfo>>(rows.size());
+        auto& out = *decoded;
+        names.forEach([&](size_t i, const std::string& name) {
+            const Row& row = rows[i];
+            FileInfo& info = out[i];
+            info.name = name;
+            info.actualSize = row.actualSize;
+            info.allocatedSize = row.allocatedSize;
+            info.mtime = static_cast<time_t>(row.mtime);
+            info.mtimeNsec = row.mtimeNsec;
+            info.device = row.device;
+            info.inode = row.inode;
+            info.mode = row.mode;
+            info.linkCount = row.linkCount;
+            info.uid = row.uid;
+            info.gid = row.gid;
+            info.isDirectory = row.flags & 1;
+            info.isExtraLink = row.flags & 2;
+            formatDisplayFields(info);
+        });
+        return decoded;
+    }
+};
+
+// Rows of a scan in fixed-size chunks that are shared between versions. Copying
+// a FileTable copies only the chunk pointers (~1200 for 5M rows); mutableRow()
+// clones the one chunk that is still shared with another version, so a published
+// copy never changes under its holder and an edit costs one chunk, not the table.
+// A compacted table (front-coded names) or one paged from disk (--memory-limit)
+// decodes chunks on first access and drops them again in trimResident(); such
+// tables are read on one thread only. An edit splices only the chunks it lands in,
+// which leaves them uneven; row lookups then go through the chunk start offsets.
+class FileTable {
+public:
+    static constexpr size_t kChunkShift = 12;
+    static constexpr size_t kChunkRows = size_t(1) << kChunkShift;
+    
+    class const_iterator {
+    private:
+        const FileTable* table;
+        size_t index;
+    public:
+        const_iterator(const FileTable* owner, size_t position) : table(owner), index(position) {}
+        const FileInfo& operator*() const { return (*table)[index]; }
+        const FileInfo* operator->() const { return &(*table)[index]; }
+        const_iterator& operator++() { index++; return *this; }
+        bool operator!=(const const_iterator& other) const { return index != other.index; }
+    };
+
+private:
+    mutable std::vector<std::shared_ptr<std::vector<FileInfo>>> chunks;
+    std::vector<std::shared_ptr<const PackedChunk>> packed;  // per chunk after compact(), else empty
+    size_t count = 0;
+    std::shared_ptr<const PagedRows> paged;
+    mutable std::deque<size_t> resident;  // chunks decoded from `packed` or `paged`, oldest first
+    std::vector<size_t> starts;           // first row of each chunk once an edit made them uneven, else empty
+    
+    // Chunk of row i and its place in it
+    std::pair<size_t, size_t> locate(size_t i) const {
+        if (starts.empty()) {
+            return {i >> kChunkShift, i & (kChunkRows - 1)};
+        }
+        size_t c = static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), i) - starts.begin()) - 1;
+        return {c, i - starts[c]};
+    }
+    
+    size_t chunkBegin(size_t c) const {
+        return starts.empty() ? c << kChunkShift : c < starts.size() ? starts[c] : count;
+    }
+    
+    const PackedChunk* packedChunk(size_t chunk) const {
+        return chunk < packed.size() ? packed[chunk].get() : nullptr;
+    }
+    
+    std::vector<FileInfo>& loadChunk(size_t chunk) const {
+        std::shared_ptr<std::vector<FileInfo>> rows;
+        if (const PackedChunk* source = packedChunk(chunk)) {
+            rows = source->decode();
+        } else {
+            rows = std::make_shared<std::vector<FileInfo>>();
+            size_t begin = chunkBegin(chunk);
+            size_t end = std::min(count, chunkBegin(chunk + 1));
+            rows->reserve(end - begin);
+            for (size_t i = begin; i < end; i++) {
+                rows->push_back(paged->row(i));
+            }
+        }
+        chunks[chunk] = rows;
+        resident.push_back(chunk);
+        return *rows;
+    }
+    
+    std::vector<FileInfo>& ownChunk(size_t chunk) {
+        auto& pointer = chunks[chunk];
+        if (!pointer) {
+            loadChunk(chunk);
+        }
+        if (paged || packedChunk(chunk)) {
+            // An edited chunk cannot be decoded again, so it stays
+            resident.erase(std::remove(resident.begin(), resident.end(), chunk), resident.end());
+            if (chunk < packed.size()) {
+                packed[chunk].reset();
+            }
+        }
+        if (pointer.use_count() > 1) {
+            pointer = std::make_shared<std::vector<FileInfo>>(*pointer);
+        }
+        return *pointer;
+    }
+
+public:
+    FileTable() = default;
+    
+    // Takes the rows over without copying their strings
+    explicit FileTable(std::vector<FileInfo>&& rows) {
+        chunks.reserve((rows.size() + kChunkRows - 1) / kChunkRows);
+        for (size_t begin = 0; begin < rows.size(); begin += kChunkRows) {
+            size_t end = std::min(rows.size(), begin + kChunkRows);
+            chunks.push_back(std::make_shared<std::vector<FileInfo>>(
+                std::make_move_iterator(rows.begin() + begin), std::make_move_iterator(rows.begin() + end)));
+        }
+        count = rows.size();
+        rows.clear();
+    }
+    
+    // Rows stay on disk; chunks are decoded when first indexed
+    explicit FileTable(std::shared_ptr<const PagedRows> rows) : count(rows->size()), paged(std::move(rows)) {
+        chunks.resize((count + kChunkRows - 1) / kChunkRows);
+    }
+    
+    void push_back(FileInfo row) {
+        if (starts.empty() ? count % kChunkRows == 0 : count - starts.back() == kChunkRows) {
+            if (!starts.empty()) {
+                starts.push_back(count);
+            }
+            chunks.push_back(std::make_shared<std::vector<FileInfo>>());
+            chunks.back()->reserve(kChunkRows);
+            if (!packed.empty()) {
+                packed.push_back(nullptr);
+            }
+        }
+        ownChunk(chunks.size() - 1).push_back(std::move(row));
+        count++;
+    }
+    
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    
+    const FileInfo& operator[](size_t i) const {
+        auto [c, r] = locate(i);
+        const auto& rows = chunks[c];
+        if (!rows) {
+            return loadChunk(c)[r];
+        }
+        return (*rows)[r];
+    }
+    
+    // Writable row; clones its chunk first if another version still shares it.
+    // Not thread-safe for shared chunks: detach rows up front before writing from workers.
+    FileInfo& mutableRow(size_t i) {
+        auto [c, r] = locate(i);
+        return ownChunk(c)[r];
+    }
+    
+    // Contiguous runs of rows, e.g. for ExportSink::writeRows
+    size_t chunkCount() const { return chunks.size(); }
+    const std::vector<FileInfo>& chunk(size_t c) const { return chunks[c] ? *chunks[c] : loadChunk(c); }
+    
+    // Paged tables: forget decoded chunks beyond the newest maxChunks. References
+    // into dropped chunks dangle, so call this where none are held (between frames).
+    void trimResident(size_t maxChunks) const {
+        while (resident.size() > maxChunks) {
+            chunks[resident.front()].reset();
+            resident.pop_front();
+        }
+    }
+    
+    const PagedRows* pagedRows() const { return paged.get(); }
+    
+    // Drop the rows in `removed` (sorted, disjoint [begin, end) ranges) and put each
+    // added row before the old row numbered by its first (ascending; the end appends).
+    // Only chunks a change lands in are rebuilt, split where they outgrow kChunkRows;
+    // the others stay shared, so an edit costs the chunks it touches plus their starts.
+    void splice(const std::vector<std::pair<size_t, size_t>>& removed, std::vector<std::pair<size_t, FileInfo>> added) {
+        if (removed.empty() && added.empty()) {
+            return;
+        }
+        if (chunks.empty()) {
+            for (auto& [at, row] : added) {
+                push_back(std::move(row));
+            }
+            return;
+        }
+        
+        std::vector<std::shared_ptr<std::vector<FileInfo>>> newChunks;
+        std::vector<std::shared_ptr<const PackedChunk>> newPacked;
+        std::vector<size_t> newStarts;
+        std::vector<size_t> moved(chunks.size(), SIZE_MAX);  // old chunk -> new one, for `resident`
+        size_t nextRemoved = 0, nextAdded = 0, newCount = 0;
+        auto emit = [&](std::shared_ptr<std::vector<FileInfo>> rows, std::shared_ptr<const PackedChunk> pack, size_t size) {
+            newStarts.push_back(newCount);
+            newChunks.push_back(std::move(rows));
+            if (!packed.empty()) {
+                newPacked.push_back(std::move(pack));
+            }
+            newCount += size;
+        };
+        
+        for (size_t c = 0; c < chunks.size(); c++) {
+            size_t begin = chunkBegin(c);
+            size_t end = std::min(count, chunkBegin(c + 1));
+            bool last = c + 1 == chunks.size();
+            bool touched = (nextRemoved < removed.size() && removed[nextRemoved].first < end) ||
+                           (nextAdded < added.size() && (last || added[nextAdded].first < end));
+            if (!touched) {
+                moved[c] = newChunks.size();
+                emit(chunks[c], packedChunk(c) ? packed[c] : nullptr, end - begin);
+                continue;
+            }
+            
+            std::vector<FileInfo> rows;
+            rows.reserve(end - begin);
+            for (size_t i = begin; i < end; i++) {
+                while (nextAdded < added.size() && added[nextAdded].first <= i) {
+                    rows.push_back(std::move(added[nextAdded++].second));
+                }
+                while (nextRemoved < removed.size() && removed[nextRemoved].second <= i) {
+                    nextRemoved++;
+                }
+                if (nextRemoved == removed.size() || i < removed[nextRemoved].first) {
+                    rows.push_back((*this)[i]);
+                }
+            }
+            while (nextRemoved < removed.size() && removed[nextRemoved].second <= end) {
+                nextRemoved++;
+            }
+            while (last && nextAdded < added.size()) {
+                rows.push_back(std::move(added[nextAdded++].second));
+            }
+            for (size_t piece = 0; piece < rows.size(); piece += kChunkRows) {
+                size_t pieceEnd = std::min(rows.size(), piece + kChunkRows);
+                emit(std::make_shared<std::vector<FileInfo>>(std::make_move_iterator(rows.begin() + piece),
+                                                             std::make_move_iterator(rows.begin() + pieceEnd)),
+                     nullptr, pieceEnd - piece);
+            }
+        }
+        
+        std::deque<size_t> kept;
+        for (size_t c : resident) {
+            if (moved[c] != SIZE_MAX) {
+                kept.push_back(moved[c]);
+            }
+        }
+        resident = std::move(kept);
+        chunks = std::move(newChunks);
+        packed = std::move(newPacked);
+        count = newCount;
+        bool even = true;
+        for (size_t c = 0; c + 1 < chunks.size() && even; c++) {
+            even = newStarts[c + 1] - newStarts[c] == kChunkRows;
+        }
+        starts = even ? std::vector<size_t>() : std::move(newStarts);
+    }
+    
+    // Pack every chunk (front-coded names, raw numbers) and drop the decoded rows.
+    // Chunks are decoded again as they are indexed; an edit keeps its chunk decoded.
+    void compact() {
+        if (paged) {
+            return;
+        }
+        packed.resize(chunks.size());
+        for (size_t c = 0; c < chunks.size(); c++) {
+            if (chunks[c]) {
+                if (!packed[c]) {
+                    packed[c] = std::make_shared<const PackedChunk>(*chunks[c]);  // only edited chunks are packed again
+                }
+                chunks[c].reset();
+            }
+        }
+        resident.clear();
+    }
+    
+    // Path of row i without decoding its chunk (scratch holds it when it must be rebuilt)
+    std::string_view nameAt(size_t i, std::string& scratch) const {
+        auto [c, r] = locate(i);
+        if (chunks[c]) {
+            return (*chunks[c])[r].name;
+        }
+        if (const PackedChunk* source = packedChunk(c)) {
+            source->names.get(r, scratch);
+            return scratch;
+        }
+        return paged->path(i);
+    }
+    
+    bool isDirectoryAt(size_t i) const {
+        auto [c, r] = locate(i);
+        if (chunks[c]) {
+            return (*chunks[c])[r].isDirectory;
+        }
+        if (const PackedChunk* source = packedChunk(c)) {
+            return source->rows[r].flags & 1;
+        }
+        return paged->isDirectory(i);
+    }
+    
+    // fn(row, path) for every row in order, without decoding chunks
+    template <typename Fn>
+    void forEachName(Fn&& fn) const {
+        for (size_t c = 0; c < chunks.size(); c++) {
+            size_t base = chunkBegin(c);
+            if (chunks[c]) {
+                const auto& rows = *chunks[c];
+                for (size_t r = 0; r < rows.size(); r++) {
+                    fn(base + r, std::string_view(rows[r].name));
+                }
+            } else if (const PackedChunk* source = packedChunk(c)) {
+                source->names.forEach([&](size_t r, const std::string& name) { fn(base + r, std::string_view(name)); });
+            } else {
+                size_t end = std::min(count, chunkBegin(c + 1));
+                for (size_t i = base; i < end; i++) {
+                    fn(i, paged->path(i));
+                }
+            }
+        }
+    }
+    
+    // The raw fields of a row, for readers that must not decode chunks
+    struct RowFacts {
+        std::string_view name;
+        std::uint64_t actualSize;
+        std::uint64_t allocatedSize;
+        std::int64_t mtime;
+        std::uint32_t mode;
+        std::uint32_t uid;
+        std::uint32_t gid;
+        bool isDirectory;
+        bool isExtraLink;
+    };
+    
+    // fn(row, facts) for every row of chunk c. Touches no cache, so worker threads
+    // may walk different chunks at once as long as nobody modifies the table.
+    template <typename Fn>
+    void forEachFact(size_t c, Fn&& fn) const {
+        size_t base = chunkBegin(c);
+        RowFacts facts;
+        if (const auto& decoded = chunks[c]) {
+            for (size_t r = 0; r < decoded->size(); r++) {
+                const FileInfo& info = (*decoded)[r];
+                facts = {info.name, info.actualSize, info.allocatedSize, static_cast<std::int64_t>(info.mtime),
+                         static_cast<std::uint32_t>(info.mode), info.uid, info.gid, info.isDirectory, info.isExtraLink};
+                fn(base + r, facts);
+            }
+        } else if (const PackedChunk* source = packedChunk(c)) {
+            source->names.forEach([&](size_t r, const std::string& name) {
+                const PackedChunk::Row& row = source->rows[r];
+                facts = {name, row.actualSize, row.allocatedSize, row.mtime, row.mode, row.uid, row.gid,
+                         (row.flags & 1) != 0, (row.flags & 2) != 0};
+                fn(base + r, facts);
+            });
+        } else {
+            size_t end = std::min(count, chunkBegin(c + 1));
+            for (size_t i = base; i < end; i++) {
+                WireReader reader(paged->record(i));
+                facts.actualSize = reader.get<std::uint64_t>();
+                facts.allocatedSize = reader.get<std::uint64_t>();
+                facts.mtime = reader.get<std::int64_t>();
+                reader.get<std::uint32_t>();  // mtimeNsec
+                facts.mode = reader.get<std::uint32_t>();
+                reader.get<std::uint32_t>();  // links
+                std::uint8_t flags = reader.get<std::uint8_t>();
+                reader.get<std::uint64_t>();  // device
+                reader.get<std::uint64_t>();  // inode
+                facts.uid = reader.get<std::uint32_t>();
+                facts.gid = reader.get<std::uint32_t>();
+                facts.isDirectory = flags & 1;
+                facts.isExtraLink = flags & 2;
+                facts.name = paged->path(i);
+                fn(i, facts);
+            }
+        }
+    }
+    
+    // Heap bytes of packed names, and what the same names take as strings
+    std::pair<size_t, size_t> packedNameBytes() const {
+        size_t packedBytes = 0, plainBytes = 0;
+        for (size_t c = 0; c < packed.size(); c++) {
+            if (packed[c]) {
+                packedBytes += packed[c]->names.memoryBytes();
+                packed[c]->names.forEach([&](size_t, const std::string& name) {
+                    plainBytes += sizeof(std::string) + (name.size() > 15 ? name.size() + 1 : 0);
+                });
+            }
+        }
+        return {packedBytes, plainBytes};
+    }
+    
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+};
+
+std::shared_ptr<const PagedRows> PagedRows::fromTable(const FileTable& files) {
+    RunFile out;
+    if (!out.createInMemory("table_app-index") || lseek(out.descriptor(), kHeaderBytes, SEEK_SET) < 0) {
+        return nullptr;
+    }
+    std::vector<std::uint64_t> starts;
+    starts.reserve(files.size());
+    for (size_t c = 0; c < files.chunkCount(); c++) {
+        for (const FileInfo& row : files.chunk(c)) {
+            starts.push_back(kHeaderBytes + out.bytesAppended());
+            if (!out.append(row)) {
+                return nullptr;
+            }
+        }
+        files.trimResident(0);  // a paged table keeps none of the chunks already written
+    }
+    std::uint64_t tablePosition = kHeaderBytes + out.bytesAppended();
+    if (!out.flush()) {
+        return nullptr;
+    }
+    const char* table = reinterpret_cast<const char*>(starts.data());
+    size_t left = starts.size() * sizeof(std::uint64_t);
+    for (std::uint64_t position = tablePosition; left > 0;) {
+        ssize_t written = pwrite(out.descriptor(), table, left, static_cast<off_t>(position));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return nullptr;
+        }
+        table += written;
+        position += written;
+        left -= static_cast<size_t>(written);
+    }
+    if (!finish(out, starts.size(), tablePosition) ||
+        fcntl(out.descriptor(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+        return nullptr;
+    }
+    return map(dup(out.descriptor()));
+}
+
+// Path -> row lookup over a table owned elsewhere. Slots hold 32-bit row numbers
+// only (the paths stay in the rows), linear probing, load kept under 0.75:
+// about 6 bytes per row, i.e. ~64 MB for a 10M-entry table.
+class PathIndex {
+private:
+    static constexpr std::uint32_t kEmpty = UINT32_MAX;
+    std::vector<std::uint32_t> slots;
+    size_t count = 0;
+    
+    static size_t hashOf(std::string_view path) {
+        return std::hash<std::string_view>()(path);
+    }
+    
+    void place(std::string_view name, std::uint32_t row) {
+        size_t mask = slots.size() - 1;
+        size_t i = hashOf(name) & mask;
+        while (slots[i] != kEmpty) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = row;
+    }
+
+public:
+    void rebuild(const FileTable& rows) {
+        size_t capacity = 16;
+        while (capacity * 3 < rows.size() * 4) {
+            capacity *= 2;
+        }
+        slots.assign(capacity, kEmpty);
+        count = rows.size();
+        rows.forEachName([this](size_t row, std::string_view name) { place(name, static_cast<std::uint32_t>(row)); });
+    }
+    
+    // Row with this path, or SIZE_MAX
+    size_t find(const FileTable& rows, std::string_view path) const {
+        if (slots.empty()) {
+            return SIZE_MAX;
+        }
+        size_t mask = slots.size() - 1;
+        std::string scratch;
+        for (size_t i = hashOf(path) & mask; slots[i] != kEmpty; i = (i + 1) & mask) {
+            if (rows.nameAt(slots[i], scratch) == path) {
+                return slots[i];
+            }
+        }
+        return SIZE_MAX;
+    }
+    
+    // Forget row, indexed under path; the row itself may already be gone from rows
+    void erase(const FileTable& rows, size_t row, std::string_view path) {
+        if (slots.empty()) {
+            return;
+        }
+        size_t mask = slots.size() - 1;
+        size_t i = hashOf(path) & mask;
+        while (slots[i] != row) {
+            if (slots[i] == kEmpty) {
+                return;  // was never indexed
+            }
+            i = (i + 1) & mask;
+        }
+        
+        // Backward-shift deletion keeps every probe chain intact without tombstones
+        std::string scratch;
+        for (size_t j = (i + 1) & mask; slots[j] != kEmpty; j = (j + 1) & mask) {
+            size_t home = hashOf(rows.nameAt(slots[j], scratch)) & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                slots[i] = slots[j];
+                i = j;
+            }
+        }
+        slots[i] = kEmpty;
+        count--;
+    }
+    
+    // Index rows that were added to the table; past the load limit the whole index
+    // is rebuilt from rows instead (which takes them in too)
+    void insert(const FileTable& rows, const std::vector<size_t>& added) {
+        if ((count + added.size()) * 4 > slots.size() * 3) {
+            rebuild(rows);
+            return;
+        }
+        std::string scratch;
+        for (size_t row : added) {
+            place(rows.nameAt(row, scratch), static_cast<std::uint32_t>(row));
+        }
+        count += added.size();
+    }
+    
+    // rows[row].name has already changed from oldPath
+    void rename(const FileTable& rows, size_t row, std::string_view oldPath) {
+        size_t before = count;
+        erase(rows, row, oldPath);
+        if (count != before) {
+            std::string scratch;
+            place(rows.nameAt(row, scratch), static_cast<std::uint32_t>(row));
+            count++;
+        }
+    }
+    
+    // Rows shifted by FileTable::splice: slot positions hang on the paths only, so
+    // each entry just takes its new number (erase removed rows first)
+    template <class NewRow>
+    void renumber(NewRow&& newRow) {
+        for (std::uint32_t& slot : slots) {
+            if (slot != kEmpty) {
+                slot = static_cast<std::uint32_t>(newRow(slot));
+            }
+        }
+    }
+    
+    size_t size() const {
+        return count;
+    }
+    
+    void clear() {
+        slots.clear();
+        count = 0;
+    }
+};
+
+// Next code point of a UTF-8 string. Bytes that do not form a valid sequence
+// (file names are arbitrary bytes) decode one at a time as U+FFFD.
+inline char32_t decodeUtf8(const char*& p, const char* end) {
+    unsigned char lead = static_cast<unsigned char>(*p++);
+    if (lead < 0x80) {
+        return lead;
+    }
+    int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+    if (extra < 0 || lead > 0xF4 || end - p < extra) {
+        return 0xFFFD;
+    }
+    char32_t cp = lead & (0x3F >> extra);
+    for (int i = 0; i < extra; i++) {
+        unsigned char next = static_cast<unsigned char>(p[i]);
+        if ((next & 0xC0) != 0x80) {
+            return 0xFFFD;
+        }
+        cp = (cp << 6) | (next & 0x3F);
+    }
+    static const char32_t minimum[] = {0, 0x80, 0x800, 0x10000};
+    if (cp < minimum[extra] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        return 0xFFFD;  // overlong form or surrogate
+    }
+    p += extra;
+    return cp;
+}
+
+// Names are raw bytes; sf::String(std::string) would decode them with the C locale
+inline sf::String utf8ToSfString(std::string_view text) {
+    std::u32string decoded;
+    decoded.reserve(text.size());
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        decoded.push_back(decodeUtf8(p, end));
+    }
+    return sf::String(decoded);
+}
+
+inline void appendUtf8(std::string& out, char32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Backspace: drop the last whole code point
+inline void popUtf8(std::string& text) {
+    while (!text.empty()) {
+        unsigned char last = static_cast<unsigned char>(text.back());
+        text.pop_back();
+        if ((last & 0xC0) != 0x80) {
+            break;
+        }
+    }
+}
+
+// Distinct non-ASCII code points seen in names: a bitmap covers the BMP,
+// the rare code points above it go to a set
+class CodePointSet {
+private:
+    std::vector<std::uint64_t> bmp = std::vector<std::uint64_t>(65536 / 64, 0);
+    std::set<char32_t> astral;
+    size_t count = 0;
+
+public:
+    bool insert(char32_t cp) {
+        if (cp >= 0x10000) {
+            bool added = astral.insert(cp).second;
+            count += added;
+            return added;
+        }
+        std::uint64_t bit = 1ULL << (cp & 63);
+        if (bmp[cp >> 6] & bit) {
+            return false;
+        }
+        bmp[cp >> 6] |= bit;
+        count++;
+        return true;
+    }
+    
+    // ASCII-only names (the common case) cost one pass over the bytes
+    void addUtf8(std::string_view text) {
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end) {
+            if (static_cast<unsigned char>(*p) < 0x80) {
+                p++;
+            } else {
+                insert(decodeUtf8(p, end));
+            }
+        }
+    }
+    
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (size_t word = 0; word < bmp.size(); word++) {
+            for (std::uint64_t bits = bmp[word]; bits != 0; bits &= bits - 1) {
+                fn(static_cast<char32_t>(word * 64 + __builtin_ctzll(bits)));
+            }
+        }
+        for (char32_t cp : astral) {
+            fn(cp);
+        }
+    }
+    
+    size_t size() const {
+        return count;
+    }
+};
+
+// Bytes of the file whose extents the filesystem reports as shared with
+// other files (reflinks / CoW clones, snapshots). Needs FIEMAP support;
+// returns 0 where the filesystem does not provide it.
+std::uintmax_t getSharedExtentBytes(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if (fd == -1 && errno == EPERM) {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd == -1) {
+        return 0;
+    }
+    
+    constexpr unsigned kExtentsPerCall = 64;
+    std::vector<char> request(sizeof(struct fiemap) + kExtentsPerCall * sizeof(struct fiemap_extent));
+    auto* fm = reinterpret_cast<struct fiemap*>(request.data());
+    
+    std::uintmax_t shared = 0;
+    std::uint64_t start = 0;
+    bool last = false;
+    while (!last) {
+        std::memset(request.data(), 0, request.size());
+        fm->fm_start = start;
+        fm->fm_length = FIEMAP_MAX_OFFSET - start;
+        fm->fm_flags = 0;  // FIEMAP_FLAG_SYNC would write back dirty pages during a read-only scan
+        fm->fm_extent_count = kExtentsPerCall;
+        
+        if (ioctl(fd, FS_IOC_FIEMAP, fm) == -1 || fm->fm_mapped_extents == 0) {
+            break;
+        }
+        for (unsigned i = 0; i < fm->fm_mapped_extents; i++) {
+            const struct fiemap_extent& extent = fm->fm_extents[i];
+            if (extent.fe_flags & FIEMAP_EXTENT_SHARED) {
+                shared += extent.fe_length;
+            }
+            if (extent.fe_flags & FIEMAP_EXTENT_LAST) {
+                last = true;
+            }
+            start = extent.fe_logical + extent.fe_length;
+        }
+    }
+    
+    close(fd);
+    return shared;
+}
+
+// Mounted filesystems from /proc/self/mountinfo, looked up by st_dev.
+// Used to stop the scan at mount boundaries and to skip pseudo and
+// (optionally) network filesystems without ever opening them.
+class MountTable {
+public:
+    struct Mount {
+        std::string mountPoint;
+        std::string fsType;
+    };
+
+private:
+    std::unordered_map<dev_t, Mount> mounts;
+    
+    // mountinfo escapes space, tab, newline and backslash as \ooo
+    static std::string unescape(const std::string& field) {
+        std::string result;
+        result.reserve(field.size());
+        for (size_t i = 0; i < field.size(); i++) {
+            if (field[i] == '\\' && i + 3 < field.size() &&
+                field[i + 1] >= '0' && field[i + 1] <= '7') {
+                result += static_cast<char>(std::stoi(field.substr(i + 1, 3), nullptr, 8));
+                i += 3;
+            } else {
+                result += field[i];
+            }
+        }
+        return result;
+    }
+
+public:
+    MountTable() {
+        std::ifstream in("/proc/self/mountinfo");
+        std::string line;
+        while (std::getline(in, line)) {
+            // id parent major:minor root mountpoint options [optional...] - fstype source superoptions
+            std::istringstream fields(line);
+            std::string id, parent, majorMinor, root, mountPoint;
+            if (!(fields >> id >> parent >> majorMinor >> root >> mountPoint)) {
+                continue;
+            }
+            std::string token;
+            while (fields >> token && token != "-") {
+            }
+            std::string fsType;
+            if (!(fields >> fsType)) {
+                continue;
+            }
+            
+            unsigned int major = 0, minor = 0;
+            if (sscanf(majorMinor.c_str(), "%u:%u", &major, &minor) != 2) {
+                continue;
+            }
+            // First entry wins: later ones are bind mounts or overmounts of the same device
+            mounts.emplace(makedev(major, minor), Mount{unescape(mountPoint), fsType});
+        }
+    }
+    
+    const Mount* find(dev_t device) const {
+        auto it = mounts.find(device);
+        return it == mounts.end() ? nullptr : &it->second;
+    }
+    
+    // Kernel-generated trees: huge, volatile and meaningless for disk usage
+    static bool isPseudoFs(const std::string& fsType) {
+        static const std::set<std::string> pseudo = {
+            "proc", "sysfs", "devtmpfs", "devpts", "cgroup", "cgroup2", "debugfs", "tracefs",
+            "securityfs", "pstore", "bpf", "configfs", "fusectl", "mqueue", "hugetlbfs",
+            "autofs", "binfmt_misc", "efivarfs", "nsfs", "rpc_pipefs", "selinuxfs", "nfsd"
+        };
+        return pseudo.count(fsType) > 0;
+    }
+    
+    static bool isNetworkFs(const std::string& fsType) {
+        static const std::set<std::string> network = {
+            "nfs", "nfs4", "cifs", "smb3", "smbfs", "ceph", "glusterfs", "9p", "afs", "lustre",
+            "fuse.sshfs", "fuse.rclone", "fuse.s3fs", "davfs"
+        };
+        return network.count(fsType) > 0;
+    }
+};
+
+// Per-mount totals collected during a scan (one row per filesystem reached)
+struct MountSummary {
+    dev_t device = 0;
+    std::string mountPoint;
+    std::string fsType;
+    size_t entries = 0;
+    std::uintmax_t allocatedBytes = 0;
+    size_t skippedDirs = 0;     // mount points not descended into
+    std::string skipReason;     // empty when the filesystem was scanned
+};
+
+// Compiled form of a wildcard pattern, matched by simulating its NFA.
+// Supports *, ?, [...] / [!...], ** (crosses '/') and **/ (zero or more directories).
+class GlobPattern {
+private:
+    enum class TokenType { Char, AnyChar, CharClass, Star, DoubleStar, DoubleStarSlash };
+    
+    struct Token {
+        TokenType type;
+        char ch = 0;
+        std::array<std::uint64_t, 4> charClass{};  // 256-bit set for CharClass
+    };
+    
+    std::vector<Token> tokens;
+    
+    static void setBit(std::array<std::uint64_t, 4>& set, unsigned char c) {
+        set[c >> 6] |= 1ULL << (c & 63);
+    }
+    
+    static bool testBit(const std::array<std::uint64_t, 4>& set, unsigned char c) {
+        return (set[c >> 6] >> (c & 63)) & 1;
+    }
+    
+    // Positions reachable without consuming input. Stars may match nothing at any
+    // point; "**/" only right after it was entered, otherwise it must end in '/'.
+    void closure(std::vector<char>& states, std::vector<char>& entered) const {
+        for (size_t i = 0; i < tokens.size(); i++) {
+            if (!states[i]) {
+                continue;
+            }
+            TokenType type = tokens[i].type;
+            if (type == TokenType::Star || type == TokenType::DoubleStar ||
+                (type == TokenType::DoubleStarSlash && entered[i])) {
+                states[i + 1] = 1;
+                entered[i + 1] = 1;
+            }
+        }
+    }
+
+    // The ']' closing the class opened at pattern[open], or npos when there is none and
+    // the '[' is a literal. A ']' right after "[", "[!" or "[^" is a member, not the end.
+    static size_t classEnd(const std::string& pattern, size_t open) {
+        size_t first = open + 1;
+        if (first < pattern.size() && (pattern[first] == '!' || pattern[first] == '^')) {
+            first++;
+        }
+        return first < pattern.size() ? pattern.find(']', first + 1) : std::string::npos;
+    }
+
+public:
+    explicit GlobPattern(const std::string& pattern = "") {
+        for (size_t i = 0; i < pattern.size(); i++) {
+            char c = pattern[i];
+            Token token;
+            if (c == '*') {
+                if (i + 1 < pattern.size() && pattern[i + 1] == '*') {
+                    i++;
+                    if (i + 1 < pattern.size() && pattern[i + 1] == '/') {
+                        i++;
+                        token.type = TokenType::DoubleStarSlash;
+                    } else {
+                        token.type = TokenType::DoubleStar;
+                    }
+                } else {
+                    token.type = TokenType::Star;
+                }
+            } else if (c == '?') {
+                token.type = TokenType::AnyChar;
+            } else if (c == '[' && classEnd(pattern, i) != std::string::npos) {
+                token.type = TokenType::CharClass;
+                size_t j = i + 1;
+                bool negate = pattern[j] == '!' || pattern[j] == '^';
+                if (negate) {
+                    j++;
+                }
+                size_t end = classEnd(pattern, i);
+                for (; j < end; j++) {
+                    unsigned char from = static_cast<unsigned char>(pattern[j]);
+                    if (j + 2 < end && pattern[j + 1] == '-') {
+                        unsigned char to = static_cast<unsigned char>(pattern[j + 2]);
+                        for (unsigned v = from; v <= to; v++) {
+                            setBit(token.charClass, static_cast<unsigned char>(v));
+                        }
+                        j += 2;
+                    } else {
+                        setBit(token.charClass, from);
+                    }
+                }
+                if (negate) {
+                    for (auto& word : token.charClass) {
+                        word = ~word;
+                    }
+                }
+                token.charClass['/' >> 6] &= ~(1ULL << ('/' & 63));  // never matches '/'
+                i = end;
+            } else {
+                if (c == '\\' && i + 1 < pattern.size()) {
+                    c = pattern[++i];
+                }
+                token.type = TokenType::Char;
+                token.ch = c;
+            }
+            tokens.push_back(token);
+        }
+    }
+    
+    bool matches(std::string_view text) const {
+        size_t stateCount = tokens.size() + 1;
+        std::vector<char> states(stateCount, 0), entered(stateCount, 0);
+        std::vector<char> next(stateCount, 0), nextEntered(stateCount, 0);
+        states[0] = 1;
+        entered[0] = 1;
+        closure(states, entered);
+        
+        for (char c : text) {
+            std::fill(next.begin(), next.end(), 0);
+            std::fill(nextEntered.begin(), nextEntered.end(), 0);
+            bool any = false;
+            auto advance = [&](size_t i) {
+                next[i + 1] = 1;
+                nextEntered[i + 1] = 1;
+                any = true;
+            };
+            for (size_t i = 0; i < tokens.size(); i++) {
+                if (!states[i]) {
+                    continue;
+                }
+                const Token& token = tokens[i];
+                switch (token.type) {
+                    case TokenType::Char:
+                        if (c == token.ch) advance(i);
+                        break;
+                    case TokenType::AnyChar:
+                        if (c != '/') advance(i);
+                        break;
+                    case TokenType::CharClass:
+                        if (testBit(token.charClass, static_cast<unsigned char>(c))) advance(i);
+                        break;
+                    case TokenType::Star:
+                        if (c != '/') { next[i] = 1; any = true; }
+                        break;
+                    case TokenType::DoubleStar:
+                        next[i] = 1;
+                        any = true;
+                        break;
+                    case TokenType::DoubleStarSlash:
+                        next[i] = 1;
+                        any = true;
+                        if (c == '/') advance(i);
+                        break;
+                }
+            }
+            if (!any) {
+                return false;
+            }
+            closure(next, nextEntered);
+            states.swap(next);
+            entered.swap(nextEntered);
+        }
+        return states[tokens.size()] != 0;
+    }
+};
+
+// gitignore-style include/exclude rules compiled for the scanner's hot loop.
+// Later rules win; "!pattern" re-includes; a trailing '/' limits a rule to
+// directories; a pattern containing '/' is anchored at the scan root,
+// otherwise it is matched against the entry name at any depth.
+// Rules are sorted into, cheapest first: exact names (hash set), "*suffix"
+// and "prefix*" tables, exact relative paths, and finally compiled globs.
+class ExclusionMatcher {
+public:
+    enum class Decision { None, Exclude, Include };
+
+private:
+    struct Rule {
+        std::string pattern;  // without '!', leading '/' and trailing '/'
+        bool include = false;
+        bool dirOnly = false;
+        bool anchored = false;
+    };
+    
+    // Highest rule index per key, separately for rules that also apply to files
+    struct Best {
+        int anyEntry = -1;
+        int dirOnly = -1;
+        
+        void add(int index, bool forDirsOnly) {
+            int& slot = forDirsOnly ? dirOnly : anyEntry;
+            slot = std::max(slot, index);
+        }
+        
+        int get(bool isDir) const {
+            return isDir ? std::max(anyEntry, dirOnly) : anyEntry;
+        }
+    };
+    
+    using Table = std::unordered_map<std::string_view, Best>;
+    
+    std::vector<Rule> rules;
+    bool compiled = false;
+    Table literalNames;
+    Table literalPaths;
+    std::vector<std::pair<size_t, Table>> suffixTables;  // by suffix length
+    std::vector<std::pair<size_t, Table>> prefixTables;  // by prefix length
+    std::vector<std::pair<int, GlobPattern>> nameGlobs;  // descending rule index
+    std::vector<std::pair<int, GlobPattern>> pathGlobs;
+    
+    static bool hasWildcards(std::string_view s) {
+        return s.find_first_of("*?[\\") != std::string_view::npos;
+    }
+    
+    static Table& tableFor(std::vector<std::pair<size_t, Table>>& tables, size_t length) {
+        for (auto& [len, table] : tables) {
+            if (len == length) {
+                return table;
+            }
+        }
+        tables.emplace_back(length, Table());
+        return tables.back().second;
+    }
+    
+    void consider(const Table& table, std::string_view key, bool isDir, int& best) const {
+        auto it = table.find(key);
+        if (it != table.end()) {
+            best = std::max(best, it->second.get(isDir));
+        }
+    }
+
+public:
+    // One rule in .gitignore syntax; blank lines and comments are ignored
+    void addRule(std::string line, bool forceInclude = false) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            return;
+        }
+        
+        Rule rule;
+        rule.include = forceInclude;
+        if (line[0] == '!') {
+            rule.include = true;
+            line.erase(0, 1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            rule.dirOnly = true;
+            line.pop_back();
+        }
+        if (line.compare(0, 3, "**/") == 0 && line.find('/', 3) == std::string::npos) {
+            line.erase(0, 3);  // "**/name" is the same as "name"
+        }
+        if (!line.empty() && line[0] == '/') {
+            rule.anchored = true;
+            line.erase(0, 1);
+        }
+        if (line.find('/') != std::string::npos) {
+            rule.anchored = true;
+        }
+        if (line.empty()) {
+            return;
+        }
+        
+        rule.pattern = std::move(line);
+        rules.push_back(std::move(rule));
+        compiled = false;
+    }
+    
+    bool loadRulesFile(const std::string& path) {
+        std::ifstream in(path);
+        if (!in.is_open()) {
+            return false;
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            addRule(line);
+        }
+        return true;
+    }
+    
+    // Build the lookup tables; must run after the last addRule and before match
+    void compile() {
+        literalNames.clear();
+        literalPaths.clear();
+        suffixTables.clear();
+        prefixTables.clear();
+        nameGlobs.clear();
+        pathGlobs.clear();
+        
+        for (int i = 0; i < static_cast<int>(rules.size()); i++) {
+            const Rule& rule = rules[i];
+            std::string_view p = rule.pattern;  // views stay valid: rules is not modified after compile
+            
+            if (rule.anchored) {
+                if (hasWildcards(p)) {
+                    pathGlobs.emplace_back(i, GlobPattern(rule.pattern));
+                } else {
+                    literalPaths[p].add(i, rule.dirOnly);
+                }
+                continue;
+            }
+            
+            if (!hasWildcards(p)) {
+                literalNames[p].add(i, rule.dirOnly);
+            } else if (p[0] == '*' && p.size() > 1 && !hasWildcards(p.substr(1))) {
+                tableFor(suffixTables, p.size() - 1)[p.substr(1)].add(i, rule.dirOnly);
+            } else if (p.back() == '*' && p.size() > 1 && !hasWildcards(p.substr(0, p.size() - 1))) {
+                tableFor(prefixTables, p.size() - 1)[p.substr(0, p.size() - 1)].add(i, rule.dirOnly);
+            } else {
+                nameGlobs.emplace_back(i, GlobPattern(rule.pattern));
+            }
+        }
+        
+        auto byIndexDesc = [](const auto& a, const auto& b) { return a.first > b.first; };
+        std::sort(nameGlobs.begin(), nameGlobs.end(), byIndexDesc);
+        std::sort(pathGlobs.begin(), pathGlobs.end(), byIndexDesc);
+        compiled = true;
+    }
+    
+    bool empty() const {
+        return rules.empty();
+    }
+    
+    // Whether match() needs the path relative to the scan root
+    bool needsRelativePath() const {
+        return !literalPaths.empty() || !pathGlobs.empty();
+    }
+    
+    // relativePath is only consulted when needsRelativePath() is true
+    Decision match(std::string_view relativePath, std::string_view name, bool isDir) const {
+        if (!compiled || rules.empty()) {
+            return Decision::None;
+        }
+        
+        int best = -1;
+        consider(literalNames, name, isDir, best);
+        for (const auto& [length, table] : suffixTables) {
+            if (name.size() >= length) {
+                consider(table, name.substr(name.size() - length), isDir, best);
+            }
+        }
+        for (const auto& [length, table] : prefixTables) {
+            if (name.size() >= length) {
+                consider(table, name.substr(0, length), isDir, best);
+            }
+        }
+        if (!literalPaths.empty()) {
+            consider(literalPaths, relativePath, isDir, best);
+        }
+        
+        // Globs are the expensive part: only try rules that could still win
+        for (const auto& [index, glob] : nameGlobs) {
+            if (index <= best) {
+                break;
+            }
+            if ((isDir || !rules[index].dirOnly) && glob.matches(name)) {
+                best = index;
+                break;
+            }
+        }
+        for (const auto& [index, glob] : pathGlobs) {
+            if (index <= best) {
+                break;
+            }
+            if ((isDir || !rules[index].dirOnly) && glob.matches(relativePath)) {
+                best = index;
+                break;
+            }
+        }
+        
+        if (best < 0) {
+            return Decision::None;
+        }
+        return rules[best].include ? Decision::Include : Decision::Exclude;
+    }
+};
+
+// Appends to a file through a large buffer so that exports cost a few
+// big write(2) calls instead of one per row
+class BufferedFileWriter {
+private:
+    int fd = -1;
+    std::vector<char> buffer;
+    size_t used = 0;
+    std::uint64_t written = 0;  // bytes handed to the kernel so far
+    bool failed = false;
+    
+    // write(2) until everything is out or the file fails
+    void writeAll(const char* data, size_t length) {
+        while (length > 0 && !failed) {
+            ssize_t n = ::write(fd, data, length);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                failed = true;
+                break;
+            }
+            data += n;
+            length -= static_cast<size_t>(n);
+            written += static_cast<std::uint64_t>(n);
+        }
+    }
+
+public:
+    explicit BufferedFileWriter(size_t bufferSize = 1 << 20) : buffer(bufferSize) {}
+    
+    ~BufferedFileWriter() {
+        close();
+    }
+    
+    bool open(const std::string& path) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        return fd != -1;
+    }
+    
+    bool flush() {
+        writeAll(buffer.data(), used);
+        used = 0;
+        return !failed;
+    }
+    
+    void append(const void* data, size_t length) {
+        if (used + length > buffer.size()) {
+            flush();
+            if (length > buffer.size()) {  // too big to buffer: write straight through
+                writeAll(static_cast<const char*>(data), length);
+                return;
+            }
+        }
+        std::memcpy(buffer.data() + used, data, length);
+        used += length;
+    }
+    
+    void append(std::string_view text) {
+        append(text.data(), text.size());
+    }
+    
+    void appendChar(char c) {
+        if (used == buffer.size()) {
+            flush();
+        }
+        buffer[used++] = c;
+    }
+    
+    // Current logical position in the file (written + buffered)
+    std::uint64_t position() const {
+        return written + used;
+    }
+    
+    bool close() {
+        if (fd == -1) {
+            return !failed;
+        }
+        flush();
+        if (::close(fd) != 0) {
+            failed = true;
+        }
+        fd = -1;
+        return !failed;
+    }
+    
+    bool ok() const {
+        return !failed;
+    }
+};
+
+// Receives scanned rows batch by batch (one directory at a time during a
+// scan) and writes them out immediately; nothing is kept after writeRows.
+class ExportSink {
+public:
+    virtual ~ExportSink() = default;
+    virtual void writeRows(const FileInfo* rows, size_t count) = 0;
+    virtual bool finish() = 0;
+    
+    size_t getRowCount() const {
+        return rowCount;
+    }
+
+protected:
+    size_t rowCount = 0;
+};
+
+// Shortest decimal form into a small stack buffer
+inline std::string_view formatUnsigned(std::uint64_t value, char (&buf)[24]) {
+    char* p = buf + 1;  // room for formatSigned's '-'
+    return std::string_view(p, static_cast<size_t>(FormatEngine::writeUnsigned(value, p) - p));
+}
+
+inline std::string_view formatSigned(std::int64_t value, char (&buf)[24]) {
+    if (value >= 0) {
+        return formatUnsigned(static_cast<std::uint64_t>(value), buf);
+    }
+    std::string_view digits = formatUnsigned(static_cast<std::uint64_t>(-(value + 1)) + 1, buf);
+    char* p = const_cast<char*>(digits.data()) - 1;
+    *p = '-';
+    return std::string_view(p, digits.size() + 1);
+}
+
+// RFC 4180 CSV: path,type,size,allocated,mtime,mode,permissions,links,device,inode
+class CsvExportSink : public ExportSink {
+private:
+    BufferedFileWriter out;
+
+    void writeField(std::string_view value) {
+        if (value.find_first_of(",\"\r\n") == std::string_view::npos) {
+            out.append(value);
+            return;
+        }
+        out.appendChar('"');
+        for (char c : value) {
+            if (c == '"') {
+                out.appendChar('"');
+            }
+            out.appendChar(c);
+        }
+        out.appendChar('"');
+    }
+
+public:
+    bool open(const std::string& path) {
+        if (!out.open(path)) {
+            return false;
+        }
+        out.append(std::string_view("path,type,size,allocated,mtime,mode,permissions,links,device,inode\n"));
+        return true;
+    }
+    
+    void writeRows(const FileInfo* rows, size_t count) override {
+        char buf[24];
+        for (size_t i = 0; i < count; i++) {
+            const FileInfo& info = rows[i];
+            writeField(info.name);
+            out.append(std::string_view(info.isDirectory ? ",dir," : ",file,"));
+            out.append(formatUnsigned(info.actualSize, buf));
+            out.appendChar(',');
+            out.append(formatUnsigned(info.allocatedSize, buf));
+            out.appendChar(',');
+            out.append(formatSigned(info.mtime, buf));
+            out.appendChar(',');
+            out.append(formatUnsigned(info.mode, buf));
+            out.appendChar(',');
+            out.append(info.permissions);
+            out.appendChar(',');
+            out.append(formatUnsigned(info.linkCount, buf));
+            out.appendChar(',');
+            out.append(formatUnsigned(info.device, buf));
+            out.appendChar(',');
+            out.append(formatUnsigned(info.inode, buf));
+            out.appendChar('\n');
+        }
+        rowCount += count;
+    }
+    
+    bool finish() override {
+        return out.close();
+    }
+};
+
+// One JSON object per line, same fields as the CSV
+class NdjsonExportSink : public ExportSink {
+private:
+    BufferedFileWriter out;
+
+    void writeString(std::string_view value) {
+        static const char hex[] = "0123456789abcdef";
+        out.appendChar('"');
+        for (char c : value) {
+            unsigned char u = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\') {
+                out.appendChar('\\');
+                out.appendChar(c);
+            } else if (u < 0x20) {
+                char escaped[6] = {'\\', 'u', '0', '0', hex[u >> 4], hex[u & 15]};
+                out.append(escaped, sizeof(escaped));
+            } else {
+                out.appendChar(c);  // file names are passed through byte for byte
+            }
+        }
+        out.appendChar('"');
+    }
+    
+    void writeNumberField(std::string_view key, std::string_view number) {
+        out.append(key);
+        out.append(number);
+    }
+
+public:
+    bool open(const std::string& path) {
+        return out.open(path);
+    }
+    
+    void writeRows(const FileInfo* rows, size_t count) override {
+        char buf[24];
+        for (size_t i = 0; i < count; i++) {
+            const FileInfo& info = rows[i];
+            out.append(std::string_view("{\"path\":"));
+            writeString(info.name);
+            out.append(std::string_view(info.isDirectory ? ",\"type\":\"dir\"" : ",\"type\":\"file\""));
+            writeNumberField(",\"size\":", formatUnsigned(info.actualSize, buf));
+            writeNumberField(",\"allocated\":", formatUnsigned(info.allocatedSize, buf));
+            writeNumberField(",\"mtime\":", formatSigned(info.mtime, buf));
+            writeNumberField(",\"mode\":", formatUnsigned(info.mode, buf));
+            out.append(std::string_view(",\"permissions\":"));
+            writeString(info.permissions);
+            writeNumberField(",\"links\":", formatUnsigned(info.linkCount, buf));
+            writeNumberField(",\"device\":", formatUnsigned(info.device, buf));
+            writeNumberField(",\"inode\":", formatUnsigned(info.inode, buf));
+            out.append(std::string_view("}\n"));
+        }
+        rowCount += count;
+    }
+    
+    bool finish() override {
+        return out.close();
+    }
+};
+
+// Column-oriented binary layout that can be mmap'ed and read without parsing.
+//
+//   header:  "TBLCOL01"
+//   chunk:   u64 rowCount, u64 nameBytes, then 8-byte aligned columns
+//            u64 size[rows], u64 allocated[rows], i64 mtime[rows], u64 device[rows],
+//            u64 inode[rows], u32 mode[rows], u32 links[rows] (each padded to 8),
+//            u64 nameOffset[rows + 1], name bytes (padded to 8)
+//   footer:  u64 chunkOffset[chunks], u64 chunkCount, "TBLCOLIX"
+//
+// Little-endian host order. Rows are buffered only up to one chunk.
+class ColumnarExportSink : public ExportSink {
+private:
+    static constexpr size_t kRowsPerChunk = 65536;
+    
+    BufferedFileWriter out;
+    std::vector<std::uint64_t> sizes, allocated, devices, inodes;
+    std::vector<std::int64_t> mtimes;
+    std::vector<std::uint32_t> modes, links;
+    std::vector<std::uint64_t> nameOffsets;
+    std::string names;
+    std::vector<std::uint64_t> chunkOffsets;
+    
+    template <typename T>
+    void writeColumn(const std::vector<T>& column) {
+        out.append(column.data(), column.size() * sizeof(T));
+        pad();
+    }
+    
+    void pad() {
+        static const char zeros[8] = {};
+        size_t misalignment = out.position() % 8;
+        if (misalignment) {
+            out.append(zeros, 8 - misalignment);
+        }
+    }
+    
+    void flushChunk() {
+        if (sizes.empty()) {
+            return;
+        }
+        chunkOffsets.push_back(out.position());
+        std::uint64_t header[2] = {sizes.size(), names.size()};
+        out.append(header, sizeof(header));
+        writeColumn(sizes);
+        writeColumn(allocated);
+        writeColumn(mtimes);
+        writeColumn(devices);
+        writeColumn(inodes);
+        writeColumn(modes);
+        writeColumn(links);
+        nameOffsets.push_back(names.size());
+        writeColumn(nameOffsets);
+        out.append(names.data(), names.size());
+        pad();
+        
+        sizes.clear();
+        allocated.clear();
+        mtimes.clear();
+        devices.clear();
+        inodes.clear();
+        modes.clear();
+        links.clear();
+        nameOffsets.clear();
+        names.clear();
+    }
+
+public:
+    bool open(const std::string& path) {
+        if (!out.open(path)) {
+            return false;
+        }
+        out.append("TBLCOL01", 8);
+        return true;
+    }
+    
+    void writeRows(const FileInfo* rows, size_t count) override {
+        for (size_t i = 0; i < count; i++) {
+            const FileInfo& info = rows[i];
+            sizes.push_back(info.actualSize);
+            allocated.push_back(info.allocatedSize);
+            mtimes.push_back(info.mtime);
+            devices.push_back(info.device);
+            inodes.push_back(info.inode);
+            modes.push_back(info.mode);
+            links.push_back(static_cast<std::uint32_t>(info.linkCount));
+            nameOffsets.push_back(names.size());
+            names += info.name;
+            if (sizes.size() == kRowsPerChunk) {
+                flushChunk();
+            }
+        }
+        rowCount += count;
+    }
+    
+    bool finish() override {
+        flushChunk();
+        out.append(chunkOffsets.data(), chunkOffsets.size() * sizeof(std::uint64_t));
+        std::uint64_t chunkCount = chunkOffsets.size();
+        out.append(&chunkCount, sizeof(chunkCount));
+        out.append("TBLCOLIX", 8);
+        return out.close();
+    }
+};
+
+// Pick the sink from an explicit format name or from the file extension
+std::unique_ptr<ExportSink> createExportSink(const std::string& path, std::string format = "") {
+    if (format.empty()) {
+        std::string ext = fs::path(path).extension().string();
+        format = ext == ".ndjson" || ext == ".jsonl" ? "ndjson" : ext == ".tcol" ? "columnar" : "csv";
+    }
+    
+    if (format == "csv") {
+        auto sink = std::make_unique<CsvExportSink>();
+        return sink->open(path) ? std::move(sink) : nullptr;
+    }
+    if (format == "ndjson") {
+        auto sink = std::make_unique<NdjsonExportSink>();
+        return sink->open(path) ? std::move(sink) : nullptr;
+    }
+    if (format == "columnar") {
+        auto sink = std::make_unique<ColumnarExportSink>();
+        return sink->open(path) ? std::move(sink) : nullptr;
+    }
+    return nullptr;
+}
+
+// Paces the scan's metadata syscalls (opendir, lstat) for --polite: a token bucket
+// whose rate adapts to their latency. When a window of calls is much slower than the
+// fastest window seen lately, the disk is busy with someone else: halve the rate.
+// Otherwise creep back up towards the configured rate (AIMD, as in TCP).
+class PoliteThrottle {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    struct Stats {
+        std::uint64_t operations = 0;
+        std::uint64_t waits = 0;       // calls that had to sleep for a token
+        Clock::duration slept{};       // total time spent sleeping
+        std::uint64_t backoffs = 0;    // times the rate was halved
+        double rate = 0;               // current operations per second
+    };
+
+private:
+    static constexpr size_t kWindow = 64;            // calls per latency sample
+    static constexpr double kSlowFactor = 4.0;       // window mean vs baseline that counts as contention
+    static constexpr double kMinSlowSeconds = 200e-6;  // page-cache hits are never contention
+    static constexpr double kBaselineDrift = 1.01;   // lets the baseline follow a slower disk
+    
+    double maxRate;
+    double minRate;
+    double tokens;
+    Clock::time_point lastRefill;
+    double windowSeconds = 0;
+    size_t windowCalls = 0;
+    double baseline = 0;  // fastest recent window mean, seconds per call
+    Stats stats;
+    
+    void refill(Clock::time_point now) {
+        double elapsed = std::chrono::duration<double>(now - lastRefill).count();
+        lastRefill = now;
+        tokens = std::min(std::max(1.0, stats.rate / 10), tokens + elapsed * stats.rate);  // bursts of 100 ms at most
+    }
+
+public:
+    explicit PoliteThrottle(double opsPerSecond)
+        : maxRate(opsPerSecond), minRate(std::min(opsPerSecond, 20.0)), tokens(1), lastRefill(Clock::now()) {
+        stats.rate = opsPerSecond;
+    }
+    
+    // Before each syscall; sleeps until a token is available
+    void acquire() {
+        stats.operations++;
+        refill(Clock::now());
+        if (tokens < 1) {
+            auto wait = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((1 - tokens) / stats.rate));
+            std::this_thread::sleep_for(wait);
+            stats.waits++;
+            stats.slept += wait;
+            refill(Clock::now());
+        }
+        tokens -= 1;
+    }
+    
+    // After each syscall, with how long it took
+    void record(Clock::duration latency) {
+        windowSeconds += std::chrono::duration<double>(latency).count();
+        if (++windowCalls < kWindow) {
+            return;
+        }
+        double mean = windowSeconds / windowCalls;
+        windowSeconds = 0;
+        windowCalls = 0;
+        baseline = baseline == 0 ? mean : std::min(baseline * kBaselineDrift, mean);
+        if (mean > baseline * kSlowFactor && mean > kMinSlowSeconds) {
+            stats.rate = std::max(minRate, stats.rate / 2);
+            stats.backoffs++;
+        } else {
+            stats.rate = std::min(maxRate, stats.rate + maxRate / 16);
+        }
+    }
+    
+    const Stats& getStats() const {
+        return stats;
+    }
+};
+
+// Options that change how FileManager walks the tree
+struct ScanOptions {
+    bool reflinkAccounting = false;  // query FIEMAP for shared extents of every regular file
+    bool oneFileSystem = false;      // never leave the filesystem of the scan root
+    bool skipPseudoFs = true;        // do not descend into /proc, /sys and friends
+    bool skipNetworkFs = false;      // do not descend into NFS/CIFS/sshfs mounts
+    std::shared_ptr<const ExclusionMatcher> exclusions;  // compiled; null = keep everything
+    std::shared_ptr<ExportSink> exportSink;  // receives every directory's rows as soon as they are read
+    bool retainEntries = true;               // false: export-only scan, the table stays empty
+    const std::atomic<bool>* cancel = nullptr;  // set from another thread to stop a scan early
+    std::uintmax_t memoryLimit = 0;  // bytes of rows held while scanning; 0 = no limit, else spill sorted runs
+    std::string spillDirectory;      // where the runs go; empty = $TMPDIR or /tmp
+    bool compactNames = false;       // keep the table front-coded (FileTable::compact); single-threaded readers only
+    bool inodeOrder = false;         // lstat a directory's entries by ascending d_ino instead of readdir order
+    double politeRate = 0;           // --polite: opendir/lstat calls per second at most; 0 = unthrottled
+};
+
+// Space usage of the scanned table. Apparent bytes count every row;
+// unique bytes count each inode once, so hardlinked trees are not inflated.
+struct SpaceTotals {
+    std::uintmax_t apparentBytes = 0;
+    std::uintmax_t uniqueBytes = 0;
+    std::uintmax_t sharedExtentBytes = 0;  // only with ScanOptions::reflinkAccounting
+    size_t extraLinks = 0;                 // rows that point at an inode counted before
+};
+
+// Parse "drwxr-xr-x" (the type character is ignored) or octal "755" / "0644"
+bool parsePermissionString(const std::string& text, mode_t& mode) {
+    mode = 0;
+    if (!text.empty() && text.size() <= 4 && text.find_first_not_of("01234567") == std::string::npos) {
+        mode = static_cast<mode_t>(std::stoul(text, nullptr, 8));
+        return true;
+    }
+    if (text.length() != 10) {
+        return false;
+    }
+    
+    // Owner permissions
+    if (text[1] == 'r') mode |= S_IRUSR;
+    if (text[2] == 'w') mode |= S_IWUSR;
+    if (text[3] == 'x' || text[3] == 's') mode |= S_IXUSR;
+    
+    // Group permissions
+    if (text[4] == 'r') mode |= S_IRGRP;
+    if (text[5] == 'w') mode |= S_IWGRP;
+    if (text[6] == 'x' || text[6] == 's') mode |= S_IXGRP;
+    
+    // Others permissions
+    if (text[7] == 'r') mode |= S_IROTH;
+    if (text[8] == 'w') mode |= S_IWOTH;
+    if (text[9] == 'x' || text[9] == 't') mode |= S_IXOTH;
+    
+    // Setuid, setgid and sticky bits
+    if (text[3] == 's' || text[3] == 'S') mode |= S_ISUID;
+    if (text[6] == 's' || text[6] == 'S') mode |= S_ISGID;
+    if (text[9] == 't' || text[9] == 'T') mode |= S_ISVTX;
+    return true;
+}
+
+// One operation applied to every selected row
+struct BatchOperation {
+    enum class Kind { Chmod, Rename };
+    Kind kind = Kind::Chmod;
+    mode_t mode = 0;      // Chmod
+    std::string find;     // Rename: replace every `find` in the name with `replace`;
+    std::string replace;  // with an empty `find`, `replace` is a template where * is the old name
+    
+    // "old/new" replaces substrings ('/' cannot occur in names), anything else is a template
+    static BatchOperation rename(const std::string& spec) {
+        BatchOperation op;
+        op.kind = Kind::Rename;
+        size_t slash = spec.find('/');
+        if (slash != std::string::npos && slash > 0) {
+            op.find = spec.substr(0, slash);
+            op.replace = spec.substr(slash + 1);
+        } else {
+            op.replace = spec;
+        }
+        return op;
+    }
+    
+    // New name for an entry, or "" when it stays as it is
+    std::string newName(const std::string& name) const {
+        std::string result;
+        if (find.empty()) {
+            for (char c : replace) {
+                if (c == '*') {
+                    result += name;
+                } else {
+                    result += c;
+                }
+            }
+        } else {
+            size_t from = 0;
+            for (size_t hit; (hit = name.find(find, from)) != std::string::npos; from = hit + find.size()) {
+                result.append(name, from, hit - from).append(replace);
+            }
+            result.append(name, from, std::string::npos);
+        }
+        if (result == name || result.empty() || result == "." || result == ".." ||
+            result.find('/') != std::string::npos) {
+            return "";
+        }
+        return result;
+    }
+    
+    std::string describe() const {
+        if (kind == Kind::Chmod) {
+            std::ostringstream oss;
+            oss << "chmod " << std::oct << (mode & 07777);
+            return oss.str();
+        }
+        return find.empty() ? "rename to " + replace : "rename " + find + " -> " + replace;
+    }
+};
+
+// renameat() that refuses to replace an existing target
+int renameNoReplaceAt(int fromDirFd, const char* from, int toDirFd, const char* to) {
+    if (renameat2(fromDirFd, from, toDirFd, to, RENAME_NOREPLACE) == 0) {
+        return 0;
+    }
+    if (errno != EINVAL && errno != ENOSYS) {
+        return -1;
+    }
+    // Filesystem without RENAME_NOREPLACE: check first (racy, like the single-file rename)
+    struct stat statBuf;
+    if (fstatat(toDirFd, to, &statBuf, AT_SYMLINK_NOFOLLOW) == 0) {
+        errno = EEXIST;
+        return -1;
+    }
+    return renameat(fromDirFd, from, toDirFd, to);
+}
+
+int renameNoReplaceAt(int dirFd, const char* from, const char* to) {
+    return renameNoReplaceAt(dirFd, from, dirFd, to);
+}
+
+// One directory's entries, read in full before any of them is stat'ed.
+// Names live in a single buffer; records are 16 bytes so sorting moves little.
+class DirentBatch {
+public:
+    struct Record {
+        std::uint64_t inode;
+        std::uint32_t nameOffset;
+        std::uint8_t type;  // d_type
+    };
+    
+    std::vector<Record> records;
+    std::string names;  // NUL-terminated names
+    
+    void clear() {
+        records.clear();
+        names.clear();
+    }
+    
+    void add(const struct dirent* entry) {
+        records.push_back({static_cast<std::uint64_t>(entry->d_ino), static_cast<std::uint32_t>(names.size()), entry->d_type});
+        names.append(entry->d_name).push_back('\0');
+    }
+    
+    const char* name(const Record& record) const {
+        return names.data() + record.nameOffset;
+    }
+    
+    // Ascending inode order: on ext4 and similar this walks the inode table forward
+    // instead of in htree hash order, so lstat() seeks only one way on a rotating disk.
+    // LSD radix sort over the bytes that actually differ; small batches use std::sort.
+    void sortByInode() {
+        if (records.size() < 128) {
+            std::sort(records.begin(), records.end(), [](const Record& a, const Record& b) { return a.inode < b.inode; });
+            return;
+        }
+        std::uint64_t differing = 0;
+        for (const Record& record : records) {
+            differing |= record.inode ^ records[0].inode;
+        }
+        scratch.resize(records.size());
+        for (int shift = 0; shift < 64 && (differing >> shift) != 0; shift += 8) {
+            if (((differing >> shift) & 0xff) == 0) {
+                continue;
+            }
+            size_t counts[257] = {};
+            for (const Record& record : records) {
+                counts[((record.inode >> shift) & 0xff) + 1]++;
+            }
+            for (int b = 0; b < 256; b++) {
+                counts[b + 1] += counts[b];
+            }
+            for (const Record& record : records) {
+                scratch[counts[(record.inode >> shift) & 0xff]++] = record;
+            }
+            records.swap(scratch);
+        }
+    }
+
+private:
+    std::vector<Record> scratch;
+};
+
+struct BatchResult {
+    size_t succeeded = 0;
+    size_t failed = 0;
+    size_t unchanged = 0;        // the rename pattern did not apply
+    bool pathsRewritten = false; // a directory was renamed, rows below it changed too
+};
+
+// Sorted "path/" keys for a set of paths, minus those inside another one. A path is
+// at or below one of them exactly when the greatest key not above path + "/" is its
+// prefix: with no key a prefix of another, nothing can sort in between.
+std::vector<std::string> subtreeKeys(std::vector<std::string> paths) {
+    for (std::string& path : paths) {
+        if (path.empty() || path.back() != '/') {
+            path += '/';
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    std::vector<std::string> keys;
+    for (std::string& path : paths) {
+        if (keys.empty() || path.compare(0, keys.back().size(), keys.back()) != 0) {
+            keys.push_back(std::move(path));
+        }
+    }
+    return keys;
+}
+
+// Index of the key covering `probe` (a path with '/' appended), or SIZE_MAX
+size_t coveringKey(const std::vector<std::string>& keys, const std::string& probe) {
+    auto it = std::upper_bound(keys.begin(), keys.end(), probe);
+    if (it == keys.begin() || probe.compare(0, (it - 1)->size(), *(it - 1)) != 0) {
+        return SIZE_MAX;
+    }
+    return static_cast<size_t>(it - keys.begin()) - 1;
+}
+
+// What a file operation changed on disk, for FileManager::applyEdit to mirror in the table
+struct TableEdit {
+    std::vector<std::string> removed;                          // gone, with everything below
+    std::vector<std::pair<std::string, std::string>> moved;    // subtrees renamed from -> to
+    std::vector<std::pair<std::string, struct stat>> created;  // new entries and their stat
+    
+    bool empty() const {
+        return removed.empty() && moved.empty() && created.empty();
+    }
+};
+
+// Rows at or below a set of paths, summed from the table without touching the disk
+struct SubtreeTotals {
+    size_t entries = 0;
+    std::uint64_t bytes = 0;           // file data
+    std::uint64_t allocatedBytes = 0;  // what removing them frees (hardlinks counted once)
+};
+
+// A file operation running on worker threads while the window keeps drawing. The UI
+// polls takeEdit() to keep the table in step and progressText() for the page info.
+class FileJob {
+protected:
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> done{false};
+    std::atomic<size_t> failures{0};
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    std::shared_ptr<FileAccessLogger> logger;
+    std::mutex editMutex;
+    TableEdit edit;
+    std::thread runner;  // started by the derived constructor, joined by its destructor
+    
+    explicit FileJob(std::shared_ptr<FileAccessLogger> log) : logger(std::move(log)) {}
+    
+    static std::string join(const std::string& directory, const std::string& name) {
+        return directory.back() == '/' ? directory + name : directory + "/" + name;
+    }
+    
+    static std::string human(std::uint64_t bytes) {
+        char buf[24];
+        return std::string(buf, FormatEngine::writeHumanSize(bytes, buf));
+    }
+    
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    }
+    
+    // ", 250M/s, ETA 0:09" once there is a rate to extrapolate from
+    void appendRate(std::ostream& out, std::uint64_t amount, std::uint64_t total, bool bytes) const {
+        double elapsed = seconds();
+        if (elapsed < 1.0 || amount == 0) {
+            return;
+        }
+        double rate = amount / elapsed;
+        out << ", " << (bytes ? human(static_cast<std::uint64_t>(rate)) : std::to_string(static_cast<std::uint64_t>(rate))) << "/s";
+        if (amount < total) {
+            auto eta = static_cast<std::uint64_t>((total - amount) / rate);
+            out << ", ETA " << eta / 60 << ":" << std::setw(2) << std::setfill('0') << eta % 60 << std::setfill(' ');
+        }
+    }
+    
+    void fail(const std::string& path, const char* operation, const std::string& message) {
+        failures++;
+        if (logger) {
+            logger->logUnreadableFile(path, operation, message);
+        }
+    }
+    
+    void recordRemoved(const std::string& path) {
+        std::lock_guard<std::mutex> lock(editMutex);
+        edit.removed.push_back(path);
+    }
+
+public:
+    virtual ~FileJob() = default;
+    
+    FileJob(const FileJob&) = delete;
+    FileJob& operator=(const FileJob&) = delete;
+    
+    void cancel() { cancelled = true; }
+    bool isDone() const { return done; }
+    
+    // Changes since the last call
+    TableEdit takeEdit() {
+        std::lock_guard<std::mutex> lock(editMutex);
+        TableEdit taken = std::move(edit);
+        edit = TableEdit();
+        return taken;
+    }
+    
+    virtual std::string progressText() const = 0;
+    virtual std::string summary() const = 0;
+};
+
+// Copy or move of table entries into a directory, on worker threads while the window
+// keeps drawing. File data stays in the kernel: a reflink (FICLONE) when both ends share
+// a filesystem, else copy_file_range, else sendfile, with read/write as the last resort.
+// Every directory is one pool task working relative to its two descriptors, and the
+// bytes of files being copied at once are bounded.
+class TransferJob : public FileJob {
+public:
+    enum class Kind { Copy, Move };
+    struct Source {
+        std::string path;
+        SubtreeTotals expected;  // from the table, for the progress line
+    };
+
+private:
+    static constexpr std::uint64_t kInFlightLimit = std::uint64_t(64) << 20;
+    static constexpr size_t kStep = size_t(8) << 20;  // per copy call, so progress and cancel stay live
+    static constexpr size_t kFilesPerTask = 256;      // larger directories are split across workers
+    
+    // A directory being copied, shared by the tasks of its files
+    struct DirectoryPair {
+        int source = -1;
+        int target = -1;
+        std::string sourcePath;
+        std::string targetPath;
+        
+        ~DirectoryPair() {
+            if (source != -1) {
+                close(source);
+            }
+            if (target != -1) {
+                close(target);
+            }
+        }
+    };
+    
+    // Created directories get their final mode (and for moves their times) once
+    // everything inside exists; a moved source directory is removed then
+    struct CreatedDirectory {
+        std::string sourcePath;
+        std::string targetPath;
+        struct stat source;
+        size_t depth;
+    };
+    
+    Kind kind;
+    std::vector<Source> sources;
+    std::string target;
+    SubtreeTotals expected;
+    dev_t targetDevice = 0;
+    
+    std::atomic<bool> cloneSupported{true};
+    std::atomic<std::uint64_t> bytesDone{0};
+    std::atomic<size_t> entriesDone{0};
+    std::atomic<size_t> reflinks{0};
+    
+    std::mutex budgetMutex;
+    std::condition_variable budgetFreed;
+    std::uint64_t inFlight = 0;
+    
+    std::vector<CreatedDirectory> directories;  // under editMutex
+    std::unique_ptr<ThreadPool> pool;
+    
+    void recordCreated(int dirFd, const std::string& name, const std::string& path) {
+        struct stat statBuf;
+        if (fstatat(dirFd, name.c_str(), &statBuf, AT_SYMLINK_NOFOLLOW) == 0) {
+            std::lock_guard<std::mutex> lock(editMutex);
+            edit.created.emplace_back(path, statBuf);
+        }
+    }
+    
+    // A file larger than the limit still goes, just alone
+    void reserve(std::uint64_t bytes) {
+        std::unique_lock<std::mutex> lock(budgetMutex);
+        budgetFreed.wait(lock, [&] { return inFlight == 0 || inFlight + bytes <= kInFlightLimit; });
+        inFlight += bytes;
+    }
+    
+    void release(std::uint64_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(budgetMutex);
+            inFlight -= bytes;
+        }
+        budgetFreed.notify_all();
+    }
+    
+    // Everything from `in` to `out`, whatever size the source claims; false with errno set
+    bool pump(int in, int out) {
+        enum class Method { Range, Sendfile, Buffered } method = Method::Range;
+        std::vector<char> buffer;
+        std::uint64_t copied = 0;
+        for (;;) {
+            if (cancelled) {
+                errno = ECANCELED;
+                return false;
+            }
+            ssize_t n;
+            if (method == Method::Range) {
+                n = copy_file_range(in, nullptr, out, nullptr, kStep, 0);
+                // Older kernels refuse other filesystems, some filesystems refuse it all
+                if (n == -1 && copied == 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+                    method = Method::Sendfile;
+                    continue;
+                }
+            } else if (method == Method::Sendfile) {
+                n = sendfile(out, in, nullptr, kStep);
+                if (n == -1 && copied == 0 && (errno == EINVAL || errno == ENOSYS)) {
+                    method = Method::Buffered;
+                    continue;
+                }
+            } else {
+                buffer.resize(size_t(1) << 20);
+                n = read(in, buffer.data(), buffer.size());
+                for (ssize_t written = 0; n > 0 && written < n;) {
+                    ssize_t part = write(out, buffer.data() + written, n - written);
+                    if (part == -1 && errno != EINTR) {
+                        return false;
+                    }
+                    written += std::max<ssize_t>(part, 0);
+                }
+            }
+            if (n == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            if (n == 0) {
+                return true;
+            }
+            copied += n;
+            bytesDone += n;
+        }
+    }
+    
+    bool copyData(int in, int out, const struct stat& source) {
+        if (cloneSupported && source.st_dev == targetDevice && source.st_size > 0) {
+            if (ioctl(out, FICLONE, in) == 0) {
+                reflinks++;
+                bytesDone += source.st_size;
+                return true;
+            }
+            if (errno == EOPNOTSUPP || errno == ENOTTY) {
+                cloneSupported = false;  // a property of the filesystem: stop asking
+            }
+        }
+        std::uint64_t size = static_cast<std::uint64_t>(source.st_size);
+        reserve(size);
+        bool copied = pump(in, out);
+        int error = errno;
+        release(size);
+        errno = error;
+        return copied;
+    }
+    
+    // Moves keep what mv keeps: times, and the owner where permitted
+    void keepAttributes(int fd, const struct stat& source) {
+        struct timespec times[2] = {source.st_atim, source.st_mtim};
+        futimens(fd, times);
+        if (fchown(fd, source.st_uid, source.st_gid) == 0) {
+            fchmod(fd, source.st_mode & 07777);  // chown dropped setuid/setgid
+        }
+    }
+    
+    void copyFile(DirectoryPair& dir, const std::string& name) {
+        std::string sourcePath = join(dir.sourcePath, name);
+        std::string targetPath = join(dir.targetPath, name);
+        int in = openat(dir.source, name.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        struct stat source;
+        if (in == -1 || fstat(in, &source) == -1) {
+            fail(sourcePath, "copy_open", std::string("open failed: ") + strerror(errno));
+            if (in != -1) {
+                close(in);
+            }
+            return;
+        }
+        int out = openat(dir.target, name.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, source.st_mode & 07777);
+        if (out == -1) {
+            fail(targetPath, "copy_create", std::string("create failed: ") + strerror(errno));
+            close(in);
+            return;
+        }
+        
+        bool copied = copyData(in, out, source);
+        std::string error = copied ? "" : strerror(errno);
+        if (copied && kind == Kind::Move) {
+            keepAttributes(out, source);
+        }
+        close(in);
+        if (close(out) == -1 && copied) {  // delayed write errors of network filesystems
+            copied = false;
+            error = strerror(errno);
+        }
+        if (!copied) {
+            unlinkat(dir.target, name.c_str(), 0);  // no partial files left behind
+            fail(sourcePath, "copy_data", "copy to " + targetPath + " failed: " + error);
+            return;
+        }
+        
+        entriesDone++;
+        recordCreated(dir.target, name, targetPath);
+        if (kind == Kind::Move) {
+            if (unlinkat(dir.source, name.c_str(), 0) == 0) {
+                recordRemoved(sourcePath);
+            } else {
+                fail(sourcePath, "move_unlink", std::string("copied, but the source stays: ") + strerror(errno));
+            }
+        }
+    }
+    
+    void copySymlink(DirectoryPair& dir, const std::string& name) {
+        std::string sourcePath = join(dir.sourcePath, name);
+        std::string targetPath = join(dir.targetPath, name);
+        std::vector<char> link(PATH_MAX + 1);
+        ssize_t length = readlinkat(dir.source, name.c_str(), link.data(), PATH_MAX);
+        if (length == -1) {
+            fail(sourcePath, "copy_readlink", std::string("readlink failed: ") + strerror(errno));
+            return;
+        }
+        link[length] = '\0';
+        if (symlinkat(link.data(), dir.target, name.c_str()) == -1) {
+            fail(targetPath, "copy_symlink", std::string("symlink failed: ") + strerror(errno));
+            return;
+        }
+        entriesDone++;
+        recordCreated(dir.target, name, targetPath);
+        if (kind == Kind::Move) {
+            if (unlinkat(dir.source, name.c_str(), 0) == 0) {
+                recordRemoved(sourcePath);
+            } else {
+                fail(sourcePath, "move_unlink", std::string("copied, but the source stays: ") + strerror(errno));
+            }
+        }
+    }
+    
+    // Create the copy of a subdirectory and queue its walk. It stays writable for us
+    // until finishDirectories() gives it the source's mode.
+    void startDirectory(DirectoryPair& dir, const std::string& name, size_t depth) {
+        std::string sourcePath = join(dir.sourcePath, name);
+        std::string targetPath = join(dir.targetPath, name);
+        struct stat source;
+        if (fstatat(dir.source, name.c_str(), &source, AT_SYMLINK_NOFOLLOW) == -1) {
+            fail(sourcePath, "copy_stat", std::string("stat failed: ") + strerror(errno));
+            return;
+        }
+        if (mkdirat(dir.target, name.c_str(), (source.st_mode & 07777) | S_IRWXU) == -1) {
+            fail(targetPath, "copy_mkdir", std::string("mkdir failed: ") + strerror(errno));
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(editMutex);
+            directories.push_back({sourcePath, targetPath, source, depth});
+        }
+        entriesDone++;
+        pool->submit([this, sourcePath, targetPath, depth]() { copyDirectory(sourcePath, targetPath, depth + 1); });
+    }
+    
+    void copyEntry(DirectoryPair& dir, const std::string& name, unsigned char type, size_t depth) {
+        if (type == DT_UNKNOWN) {
+            struct stat statBuf;
+            if (fstatat(dir.source, name.c_str(), &statBuf, AT_SYMLINK_NOFOLLOW) == -1) {
+                fail(join(dir.sourcePath, name), "copy_stat", std::string("stat failed: ") + strerror(errno));
+                return;
+            }
+            type = S_ISREG(statBuf.st_mode) ? DT_REG : S_ISDIR(statBuf.st_mode) ? DT_DIR : S_ISLNK(statBuf.st_mode) ? DT_LNK : DT_FIFO;
+        }
+        switch (type) {
+            case DT_REG: copyFile(dir, name); break;
+            case DT_DIR: startDirectory(dir, name, depth); break;
+            case DT_LNK: copySymlink(dir, name); break;
+            default: fail(join(dir.sourcePath, name), "copy_type", "devices, fifos and sockets are not copied");
+        }
+    }
+    
+    void copyFiles(std::shared_ptr<DirectoryPair> dir, std::shared_ptr<std::vector<std::string>> names, size_t begin, size_t end) {
+        for (size_t i = begin; i < end && !cancelled; i++) {
+            copyFile(*dir, (*names)[i]);
+        }
+    }
+    
+    void copyDirectory(const std::string& sourcePath, const std::string& targetPath, size_t depth) {
+        if (cancelled) {
+            return;
+        }
+        auto dir = std::make_shared<DirectoryPair>();
+        dir->sourcePath = sourcePath;
+        dir->targetPath = targetPath;
+        dir->source = open(sourcePath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        dir->target = open(targetPath.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        int listed = dir->source == -1 ? -1 : dup(dir->source);
+        DIR* stream = listed == -1 ? nullptr : fdopendir(listed);
+        if (!stream || dir->target == -1) {
+            fail(stream ? targetPath : sourcePath, "copy_opendir", std::string("open failed: ") + strerror(errno));
+            if (stream) {
+                closedir(stream);
+            } else if (listed != -1) {
+                close(listed);
+            }
+            return;
+        }
+        
+        // Subdirectories are queued as they are met; plain files are copied in batches
+        auto files = std::make_shared<std::vector<std::string>>();
+        while (struct dirent* entry = readdir(stream)) {
+            if (cancelled) {
+                break;
+            }
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            if (entry->d_type == DT_REG) {
+                files->emplace_back(entry->d_name);
+            } else {
+                copyEntry(*dir, entry->d_name, entry->d_type, depth);
+            }
+        }
+        closedir(stream);
+        
+        for (size_t begin = kFilesPerTask; begin < files->size(); begin += kFilesPerTask) {
+            size_t end = std::min(files->size(), begin + kFilesPerTask);
+            pool->submit([this, dir, files, begin, end]() { copyFiles(dir, files, begin, end); });
+        }
+        copyFiles(dir, files, 0, std::min(files->size(), kFilesPerTask));
+    }
+    
+    void startSource(const Source& source) {
+        size_t slash = source.path.rfind('/');
+        std::string name = source.path.substr(slash + 1);
+        std::string targetPath = join(target, name);
+        if ((target + "/").compare(0, source.path.size() + 1, source.path + "/") == 0) {
+            fail(source.path, "copy_target", "the target " + target + " is inside it");
+            return;
+        }
+        
+        DirectoryPair dir;
+        dir.sourcePath = slash == 0 ? "/" : source.path.substr(0, slash);
+        dir.targetPath = target;
+        dir.source = open(dir.sourcePath.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        dir.target = open(target.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (dir.source == -1 || dir.target == -1) {
+            fail(dir.source == -1 ? dir.sourcePath : target, "copy_open_parent", std::string("open failed: ") + strerror(errno));
+            return;
+        }
+        
+        // Within one filesystem a move is a rename, whatever the size of the subtree
+        if (kind == Kind::Move) {
+            if (renameNoReplaceAt(dir.source, name.c_str(), dir.target, name.c_str()) == 0) {
+                entriesDone += source.expected.entries;
+                bytesDone += source.expected.bytes;
+                std::lock_guard<std::mutex> lock(editMutex);
+                edit.moved.emplace_back(source.path, targetPath);
+                return;
+            }
+            if (errno != EXDEV) {
+                fail(source.path, "move_rename", "move to " + targetPath + " failed: " + strerror(errno));
+                return;
+            }
+        }
+        
+        // The parent was opened O_PATH: enough for the *at calls, while readdir needs its own
+        copyEntry(dir, name, DT_UNKNOWN, 0);
+    }
+    
+    // Deepest first, so a directory's times are set after its children stopped changing it
+    void finishDirectories() {
+        std::sort(directories.begin(), directories.end(),
+                  [](const CreatedDirectory& a, const CreatedDirectory& b) { return a.depth > b.depth; });
+        for (const CreatedDirectory& created : directories) {
+            chmod(created.targetPath.c_str(), created.source.st_mode & 07777);
+            if (kind == Kind::Move) {
+                struct timespec times[2] = {created.source.st_atim, created.source.st_mtim};
+                lchown(created.targetPath.c_str(), created.source.st_uid, created.source.st_gid);
+                utimensat(AT_FDCWD, created.targetPath.c_str(), times, AT_SYMLINK_NOFOLLOW);
+                // Still holds whatever failed to copy; that is logged already
+                if (rmdir(created.sourcePath.c_str()) == 0) {
+                    recordRemoved(created.sourcePath);
+                }
+            }
+            struct stat statBuf;
+            if (lstat(created.targetPath.c_str(), &statBuf) == 0) {
+                std::lock_guard<std::mutex> lock(editMutex);
+                edit.created.emplace_back(created.targetPath, statBuf);
+            }
+        }
+    }
+    
+    void run() {
+        struct stat targetStat;
+        if (stat(target.c_str(), &targetStat) == -1 || !S_ISDIR(targetStat.st_mode)) {
+            fail(target, "copy_target", "not a directory");
+        } else {
+            targetDevice = targetStat.st_dev;
+            pool = std::make_unique<ThreadPool>(std::max<size_t>(4, std::thread::hardware_concurrency()));
+            for (const Source& source : sources) {
+                pool->submit([this, &source]() { startSource(source); });
+            }
+            pool->waitIdle();
+            pool.reset();
+            finishDirectories();
+        }
+        if (logger) {
+            logger->logFileModification(target, kind == Kind::Copy ? "copy" : "move", summary());
+        }
+        done = true;
+    }
+
+public:
+    TransferJob(Kind what, std::vector<Source> list, const std::string& into, std::shared_ptr<FileAccessLogger> log)
+        : FileJob(std::move(log)), kind(what), sources(std::move(list)), target(into) {
+        for (const Source& source : sources) {
+            expected.entries += source.expected.entries;
+            expected.bytes += source.expected.bytes;
+        }
+        runner = std::thread([this]() { run(); });
+    }
+    
+    ~TransferJob() override {
+        cancel();
+        runner.join();
+    }
+    
+    // "Copying: 120/3400 entries, 1.2G of 3.4G, 250M/s, ETA 0:09"
+    std::string progressText() const override {
+        std::uint64_t bytes = bytesDone;
+        std::ostringstream oss;
+        oss << (kind == Kind::Copy ? "Copying: " : "Moving: ") << entriesDone;
+        // Sources outside the scanned directory have no rows to estimate from
+        if (expected.entries > 0) {
+            oss << "/" << expected.entries << " entries, " << human(bytes) << " of " << human(expected.bytes);
+        } else {
+            oss << " entries, " << human(bytes);
+        }
+        appendRate(oss, bytes, expected.bytes, true);
+        if (failures > 0) {
+            oss << ", " << failures << " failed";
+        }
+        if (cancelled && !done) {
+            oss << " (stopping)";
+        }
+        return oss.str();
+    }
+    
+    std::string summary() const override {
+        std::ostringstream oss;
+        oss << (kind == Kind::Copy ? "copy" : "move") << " of " << sources.size() << " entries to " << target << ": "
+            << entriesDone << " done (" << reflinks << " reflinked), " << failures << " failed, " << bytesDone
+            << " bytes in " << std::fixed << std::setprecision(2) << seconds() << "s" << (cancelled ? ", stopped" : "");
+        return oss.str();
+    }
+};
+
+// Recursive delete of table entries. Every directory is emptied relative to its own
+// descriptor (unlinkat, no path lookups) and removed from its parent's once the last
+// subdirectory below it is gone. Subdirectories go to the pool while it has room and
+// are otherwise emptied depth-first by the same worker, which keeps the number of open
+// descriptors bounded. Other filesystems mounted below are left alone.
+class DeleteJob : public FileJob {
+private:
+    struct Directory {
+        std::shared_ptr<Directory> parent;  // null for the parent of a selected directory
+        std::string path;
+        std::string name;
+        int fd = -1;
+        dev_t device = 0;
+        std::atomic<size_t> pending{1};         // its own listing + subdirectories not done yet
+        std::atomic<bool> incomplete{false};    // something below could not be removed
+        std::vector<std::string> removedFiles;  // reported one by one if the directory stays
+        
+        ~Directory() {
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+    };
+    
+    std::vector<std::string> roots;
+    SubtreeTotals expected;
+    std::atomic<size_t> entriesDone{0};
+    std::atomic<size_t> queued{0};
+    size_t maxQueued = 0;
+    std::unique_ptr<ThreadPool> pool;
+    
+    // Called when the listing of `dir` is over and whenever a subdirectory of it finishes
+    void finish(const std::shared_ptr<Directory>& dir) {
+        if (--dir->pending > 0) {
+            return;
+        }
+        bool removed = false;
+        if (!dir->incomplete) {
+            removed = unlinkat(dir->parent->fd, dir->name.c_str(), AT_REMOVEDIR) == 0;
+            if (!removed) {
+                fail(dir->path, "delete_rmdir", std::string("rmdir failed: ") + strerror(errno));
+            }
+        }
+        if (removed) {
+            entriesDone++;
+            recordRemoved(dir->path);
+        } else {
+            // What did go is still reported, so the table keeps exactly what is left
+            std::lock_guard<std::mutex> lock(editMutex);
+            for (const std::string& name : dir->removedFiles) {
+                edit.removed.push_back(join(dir->path, name));
+            }
+            dir->parent->incomplete = true;
+        }
+        dir->removedFiles = std::vector<std::string>();
+        if (dir->parent->parent) {
+            finish(dir->parent);
+        }
+    }
+    
+    void subdirectory(const std::shared_ptr<Directory>& parent, const char* name) {
+        auto child = std::make_shared<Directory>();
+        child->parent = parent;
+        child->path = join(parent->path, name);
+        child->name = name;
+        child->device = parent->device;
+        parent->pending++;
+        if (queued < maxQueued) {
+            queued++;
+            pool->submit([this, child]() {
+                queued--;
+                empty(child);
+            });
+        } else {
+            empty(child);
+        }
+    }
+    
+    void empty(const std::shared_ptr<Directory>& dir) {
+        struct stat statBuf;
+        dir->fd = openat(dir->parent->fd, dir->name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        int listed = dir->fd == -1 ? -1 : dup(dir->fd);
+        DIR* stream = listed == -1 ? nullptr : fdopendir(listed);
+        if (!stream) {
+            fail(dir->path, "delete_opendir", std::string("open failed: ") + strerror(errno));
+            if (listed != -1) {
+                close(listed);
+            }
+            dir->incomplete = true;
+        } else if (fstat(dir->fd, &statBuf) == 0 && statBuf.st_dev != dir->device) {
+            fail(dir->path, "delete_mount", "another filesystem is mounted here; not descending");
+            closedir(stream);
+            dir->incomplete = true;
+        } else {
+            while (struct dirent* entry = readdir(stream)) {
+                if (cancelled) {
+                    dir->incomplete = true;
+                    break;
+                }
+                const char* name = entry->d_name;
+                if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+                    continue;
+                }
+                if (entry->d_type == DT_DIR) {
+                    subdirectory(dir, name);
+                } else if (unlinkat(dir->fd, name, 0) == 0) {
+                    entriesDone++;
+                    dir->removedFiles.emplace_back(name);
+                } else if (errno == EISDIR) {
+                    subdirectory(dir, name);  // DT_UNKNOWN
+                } else {
+                    fail(join(dir->path, name), "delete_unlink", std::string("unlink failed: ") + strerror(errno));
+                    dir->incomplete = true;
+                }
+            }
+            closedir(stream);
+        }
+        finish(dir);
+    }
+    
+    void startRoot(const std::string& path) {
+        size_t slash = path.rfind('/');
+        auto parent = std::make_shared<Directory>();
+        parent->path = slash == 0 ? "/" : path.substr(0, slash);
+        parent->fd = open(parent->path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        std::string name = path.substr(slash + 1);
+        struct stat statBuf;
+        if (parent->fd == -1 || fstatat(parent->fd, name.c_str(), &statBuf, AT_SYMLINK_NOFOLLOW) == -1) {
+            fail(path, "delete_stat", std::string("stat failed: ") + strerror(errno));
+            return;
+        }
+        if (!S_ISDIR(statBuf.st_mode)) {
+            if (unlinkat(parent->fd, name.c_str(), 0) == 0) {
+                entriesDone++;
+                recordRemoved(path);
+            } else {
+                fail(path, "delete_unlink", std::string("unlink failed: ") + strerror(errno));
+            }
+            return;
+        }
+        auto dir = std::make_shared<Directory>();
+        dir->parent = parent;
+        dir->path = path;
+        dir->name = name;
+        dir->device = statBuf.st_dev;
+        empty(dir);
+    }
+    
+    void run() {
+        pool = std::make_unique<ThreadPool>(std::max<size_t>(4, std::thread::hardware_concurrency()));
+        maxQueued = pool->size() * 2;
+        for (const std::string& root : roots) {
+            pool->submit([this, &root]() { startRoot(root); });
+        }
+        pool->waitIdle();
+        pool.reset();
+        if (logger) {
+            logger->logFileModification(roots.size() == 1 ? roots.front() : "(selection)", "delete", summary());
+        }
+        done = true;
+    }
+
+public:
+    // `paths` hold no path below another one (see subtreeKeys)
+    DeleteJob(std::vector<std::string> paths, const SubtreeTotals& fromTable, std::shared_ptr<FileAccessLogger> log)
+        : FileJob(std::move(log)), roots(std::move(paths)), expected(fromTable) {
+        runner = std::thread([this]() { run(); });
+    }
+    
+    ~DeleteJob() override {
+        cancel();
+        runner.join();
+    }
+    
+    // "Deleting: 12000/50000 entries, 8000/s, ETA 0:05"
+    std::string progressText() const override {
+        std::ostringstream oss;
+        oss << "Deleting: " << entriesDone << "/" << expected.entries << " entries";
+        appendRate(oss, entriesDone, expected.entries, false);
+        if (failures > 0) {
+            oss << ", " << failures << " failed";
+        }
+        if (cancelled && !done) {
+            oss << " (stopping)";
+        }
+        return oss.str();
+    }
+    
+    std::string summary() const override {
+        std::ostringstream oss;
+        oss << "delete of " << roots.size() << " entries: " << entriesDone << " removed, " << failures << " failed in "
+            << std::fixed << std::setprecision(2) << seconds() << "s" << (cancelled ? ", stopped" : "");
+        return oss.str();
+    }
+};
+
+class FileManager {
+private:
+    FileTable files;                  // published to the UI by sharing chunks
+    std::vector<FileInfo> scanRows;   // rows collected while a scan runs
+    DirentBatch dirents;              // the directory being read, reused across directories
+    std::unique_ptr<PoliteThrottle> throttle;  // per scan, with ScanOptions::politeRate
+    std::string directoryPath;
+    std::shared_ptr<FileAccessLogger> logger;  // shared with background services
+    bool scanInterrupted = false;
+    sf::RenderWindow* window = nullptr;  // Reference to window for event handling
+    ScanOptions options;
+    InodeSet seenInodes;  // multiply-linked inodes already counted
+    SpaceTotals totals;
+    MountTable mountTable;
+    dev_t rootDevice = 0;
+    std::vector<MountSummary> mountSummaries;
+    std::unordered_map<dev_t, size_t> mountIndex;
+    dev_t lastMountDevice = 0;
+    size_t lastMountIndex = SIZE_MAX;
+    size_t prunedEntries = 0;  // dropped by exclusion rules before any syscall
+    size_t scannedEntries = 0; // rows produced, whether or not they are retained
+    PathIndex pathIndex;       // path -> row of `files`, kept in step with every edit
+    bool inTableOrder = true;  // false once a batch rename changed paths in place
+    CodePointSet codePoints;   // non-ASCII characters of all scanned names
+    std::shared_ptr<const sf::Font> progressFont;  // for the in-window scan progress
+    std::vector<std::unique_ptr<RunFile>> spillRuns;  // sorted runs written under --memory-limit
+    static constexpr size_t kMaxSpillRuns = 64;
+    std::uintmax_t scanRowBytes = 0;                  // estimated heap use of scanRows
+    bool spillFailed = false;
+    size_t pagedDirectories = SIZE_MAX;               // paged tables: rows before the first file
+    
+    // Table order: directories first, then by path
+    static bool tableOrder(const FileInfo& a, const FileInfo& b) {
+        if (a.isDirectory != b.isDirectory) {
+            return a.isDirectory > b.isDirectory;
+        }
+        return a.name < b.name;
+    }
+    
+    std::string spillDirectory() const {
+        if (!options.spillDirectory.empty()) {
+            return options.spillDirectory;
+        }
+        const char* tmp = getenv("TMPDIR");
+        return tmp && *tmp ? tmp : "/tmp";
+    }
+    
+    // Sort what has been collected so far and move it to a run file
+    void spillRun() {
+        if (scanRows.empty() || spillFailed) {
+            return;
+        }
+        std::sort(scanRows.begin(), scanRows.end(), tableOrder);
+        auto run = std::make_unique<RunFile>();
+        bool written = run->create(spillDirectory());
+        for (size_t i = 0; written && i < scanRows.size(); i++) {
+            written = run->append(scanRows[i]);
+        }
+        if (!written || !run->flush()) {
+            // Keep going in memory rather than lose rows
+            if (logger) {
+                logger->logUnreadableFile(spillDirectory(), "spill_run", std::string("cannot write sorted run: ") + strerror(errno));
+            }
+            spillFailed = true;
+            return;
+        }
+        spillRuns.push_back(std::move(run));
+        scanRows.clear();
+        scanRows.shrink_to_fit();
+        scanRowBytes = 0;
+        
+        // Bounded fan-in: descriptors and merge buffers stay few however small the limit
+        if (spillRuns.size() >= kMaxSpillRuns) {
+            auto merged = std::make_unique<RunFile>();
+            if (!merged->create(spillDirectory()) || !mergeRuns(spillRuns, *merged, tableOrder)) {
+                if (logger) {
+                    logger->logUnreadableFile(spillDirectory(), "spill_merge", std::string("cannot merge sorted runs: ") + strerror(errno));
+                }
+                spillFailed = true;
+                return;
+            }
+            spillRuns.clear();
+            spillRuns.push_back(std::move(merged));
+        }
+    }
+    
+    // Row of a paged table with this path: binary search in the directory block and the file block
+    size_t findPagedRow(const PagedRows& rows, std::string_view path) {
+        if (pagedDirectories == SIZE_MAX) {
+            size_t low = 0, high = rows.size();
+            while (low < high) {
+                size_t mid = low + (high - low) / 2;
+                rows.isDirectory(mid) ? low = mid + 1 : high = mid;
+            }
+            pagedDirectories = low;
+        }
+        for (auto [low, high] : {std::make_pair(size_t(0), pagedDirectories), std::make_pair(pagedDirectories, rows.size())}) {
+            while (low < high) {
+                size_t mid = low + (high - low) / 2;
+                rows.path(mid) < path ? low = mid + 1 : high = mid;
+            }
+            if (low < rows.size() && rows.path(low) == path) {
+                return low;
+            }
+        }
+        return SIZE_MAX;
+    }
+    
+    size_t locate(const std::string& path) {
+        if (const PagedRows* paged = files.pagedRows()) {
+            return findPagedRow(*paged, path);
+        }
+        return pathIndex.find(files, path);
+    }
+    
+    // Tables paged from disk are for browsing; their rows are not edited in place
+    bool refuseEditOfPagedTable(const std::string& path, const char* operation) {
+        if (!files.pagedRows()) {
+            return false;
+        }
+        if (logger) {
+            logger->logUnreadableFile(path, operation, "table is paged (--memory-limit or --connect); edits are disabled");
+        }
+        return true;
+    }
+    
+    // True when the exclusion rules drop this entry (and, for directories, its subtree)
+    bool isExcluded(const std::string& fullPath, const char* name, bool isDir) const {
+        const ExclusionMatcher& rules = *options.exclusions;
+        std::string_view relative;
+        if (rules.needsRelativePath() && fullPath.size() > directoryPath.size()) {
+            relative = std::string_view(fullPath).substr(directoryPath.size() + (directoryPath.back() == '/' ? 0 : 1));
+        }
+        return rules.match(relative, name, isDir) == ExclusionMatcher::Decision::Exclude;
+    }
+    
+    // Summary row of the filesystem a path lives on (created on first sight)
+    MountSummary& mountSummaryFor(dev_t device, const std::string& path) {
+        if (lastMountIndex != SIZE_MAX && device == lastMountDevice) {
+            return mountSummaries[lastMountIndex];  // consecutive rows nearly always share a device
+        }
+        auto [it, inserted] = mountIndex.emplace(device, mountSummaries.size());
+        if (inserted) {
+            MountSummary summary;
+            summary.device = device;
+            if (const MountTable::Mount* mount = mountTable.find(device)) {
+                summary.mountPoint = mount->mountPoint;
+                summary.fsType = mount->fsType;
+            } else {
+                summary.mountPoint = path;  // e.g. btrfs subvolumes have anonymous devices
+                summary.fsType = "unknown";
+            }
+            mountSummaries.push_back(std::move(summary));
+        }
+        lastMountDevice = device;
+        lastMountIndex = it->second;
+        return mountSummaries[it->second];
+    }
+    
+    // Why a directory on this device must not be entered, or nullptr
+    const char* mountSkipReason(dev_t device) const {
+        if (device == rootDevice) {
+            return nullptr;
+        }
+        if (options.oneFileSystem) {
+            return "other filesystem";
+        }
+        if (const MountTable::Mount* mount = mountTable.find(device)) {
+            if (options.skipPseudoFs && MountTable::isPseudoFs(mount->fsType)) {
+                return "pseudo filesystem";
+            }
+            if (options.skipNetworkFs && MountTable::isNetworkFs(mount->fsType)) {
+                return "network filesystem";
+            }
+        }
+        return nullptr;
+    }
+    
+    // Add a freshly stat'ed row to the totals; marks repeated hardlinks
+    void accountSpace(FileInfo& info) {
+        totals.apparentBytes += info.allocatedSize;
+        
+        // Directories cannot be hardlinked and st_nlink == 1 cannot repeat,
+        // so only a small subset of rows ever touches the set
+        if (!info.isDirectory && info.linkCount > 1 && !seenInodes.insert(info.device, info.inode)) {
+            info.isExtraLink = true;
+            totals.extraLinks++;
+            return;
+        }
+        
+        totals.uniqueBytes += info.allocatedSize;
+        if (options.reflinkAccounting && S_ISREG(info.mode) && info.actualSize > 0) {
+            totals.sharedExtentBytes += getSharedExtentBytes(info.name);
+        }
+    }
+    
+    // Refresh a row from a stat result (name, totals and hardlink flags stay as they are)
+    void applyStat(FileInfo& info, const struct stat& statBuf, std::uintmax_t blockSize) {
+        info.isDirectory = S_ISDIR(statBuf.st_mode);
+        info.device = statBuf.st_dev;
+        info.inode = statBuf.st_ino;
+        info.mode = statBuf.st_mode;
+        info.uid = statBuf.st_uid;
+        info.gid = statBuf.st_gid;
+        info.linkCount = statBuf.st_nlink;
+        info.mtime = statBuf.st_mtim.tv_sec;
+        info.mtimeNsec = statBuf.st_mtim.tv_nsec;
+        info.actualSize = statBuf.st_size;
+        info.allocatedSize = calculateAllocatedSize(statBuf.st_size, blockSize);
+        info.size = formatSizeInfo(info.actualSize, info.allocatedSize);
+        info.date = formatDate(statBuf.st_mtime, logger.get(), info.name);
+        info.permissions = getFilePermissionsFromStat(statBuf);
+    }
+    
+public:
+    FileManager(const std::string& path, sf::RenderWindow* win = nullptr, const ScanOptions& opts = ScanOptions(),
+                std::shared_ptr<const sf::Font> font = nullptr) 
+        : directoryPath(path), window(win), options(opts), progressFont(std::move(font)) {
+        // Initialize logger
+        try {
+            logger = std::make_shared<FileAccessLogger>();
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: Could not initialize file access logger: " << e.what() << std::endl;
+            logger = nullptr;
+        }
+        loadFiles();
+    }
+    
+    // Table served by a scan daemon: nothing is scanned; the rows are the daemon's mapped
+    // index, paged like a spilled scan. Glyphs of its names are not warmed ahead, since
+    // that would read every name.
+    FileManager(const std::string& path, std::shared_ptr<const PagedRows> rows, const SpaceTotals& servedTotals)
+        : directoryPath(path), totals(servedTotals) {
+        try {
+            logger = std::make_shared<FileAccessLogger>();
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: Could not initialize file access logger: " << e.what() << std::endl;
+            logger = nullptr;
+        }
+        codePoints.addUtf8(directoryPath);
+        scannedEntries = rows->size();
+        files = FileTable(std::move(rows));
+    }
+    
+    // Method to reload a single file's information
+    bool reloadSingleFile(const std::string& filePath) {
+        // Find the file in the files vector
+        size_t row = locate(filePath);
+        
+        if (row == SIZE_MAX) {
+            if (logger) {
+                logger->logUnreadableFile(filePath, "reload_single_file", "File not found in list");
+            }
+            return false;
+        }
+        
+        // Reload file information
+        struct stat statBuf;
+        if (lstat(filePath.c_str(), &statBuf) == -1) {
+            if (logger) {
+                logger->logUnreadableFile(filePath, "reload_single_file_lstat", std::string("lstat failed: ") + strerror(errno));
+            }
+            return false;
+        }
+        
+        // Get filesystem block size
+        std::uintmax_t blockSize = getFilesystemBlockSize(fs::path(filePath).parent_path().string());
+        FileInfo* it = &files.mutableRow(row);
+        
+        // Take the old size out of the totals, the new one goes in below
+        totals.apparentBytes -= it->allocatedSize;
+        if (!it->isExtraLink) {
+            totals.uniqueBytes -= it->allocatedSize;
+        }
+        
+        applyStat(*it, statBuf, blockSize);
+        
+        totals.apparentBytes += it->allocatedSize;
+        if (!it->isExtraLink) {
+            totals.uniqueBytes += it->allocatedSize;
+        }
+        
+        if (logger) {
+            logger->logFileModification(filePath, "file_info_reloaded", "Successfully updated file information");
+        }
+        
+        return true;
+    }
+    
+    // Method to update file metadata (name, permissions, etc.)
+    bool updateFileMetadata(const std::string& filePath, int columnIndex, const std::string& newValue) {
+        if (refuseEditOfPagedTable(filePath, "update_metadata")) {
+            return false;
+        }
+        try {
+            switch (columnIndex) {
+                case 0: // Name - rename file
+                {
                     fs::path oldPath(filePath);
                     fs::path newPath = oldPath.parent_path() / newValue;
                     
-                    if (fs::exists(newPath)) {
-                        if (logger) {
-                            logger->logUnreadableFile(filePath, "rename", "Target file already exists: " + newPath.string());
+                    if (fs::exists(newPath)) {
+                        if (logger) {
+                            logger->logUnreadableFile(filePath, "rename", "Target file already exists: " + newPath.string());
+                        }
+                        return false;
+                    }
+                    
+                    fs::rename(oldPath, newPath);
+                    
+                    // Update in files vector
+                    size_t row = pathIndex.find(files, filePath);
+                    if (row != SIZE_MAX) {
+                        files.mutableRow(row).name = newPath.string();
+                        pathIndex.rename(files, row, filePath);
+                    }
+                    
+                    if (logger) {
+                        logger->logFileModification(filePath, "rename", "Renamed to: " + newPath.string());
+                    }
+                    
+                    return reloadSingleFile(newPath.string());
+                }
+                
+                case 3: // Permissions
+                {
+                    // Parse permissions string (e.g., "drwxr-xr-x")
+                    mode_t mode = 0;
+                    if (!parsePermissionString(newValue, mode)) {
+                        if (logger) {
+                            logger->logUnreadableFile(filePath, "chmod", "Invalid permissions format: " + newValue);
+                        }
+                        return false;
+                    }
+                    
+                    if (chmod(filePath.c_str(), mode) == -1) {
+                        if (logger) {
+                            logger->logUnreadableFile(filePath, "chmod", std::string("chmod failed: ") + strerror(errno));
+                        }
+                        return false;
+                    }
+                    
+                    if (logger) {
+                        logger->logFileModification(filePath, "chmod", "Changed permissions to: " + newValue);
+                    }
+                    
+                    return reloadSingleFile(filePath);
+                }
+                
+                default:
+                    if (logger) {
+                        logger->logUnreadableFile(filePath, "update_metadata", 
+                            "Cannot modify column " + std::to_string(columnIndex) + " (read-only)");
+                    }
+                    return false;
+            }
+        } catch (const std::exception& e) {
+            if (logger) {
+                logger->logUnreadableFile(filePath, "update_metadata", e.what());
+            }
+            return false;
+        }
+    }
+    
+    // Apply one chmod/rename to many rows on a thread pool. Rows are grouped by parent
+    // directory and each group works relative to one directory fd, so the path is
+    // resolved once per directory instead of once per file. Directories go last,
+    // deepest first: nothing is renamed (or made untraversable) before the rows
+    // below it are done. Rows are updated in place; one summary goes to the log.
+    BatchResult applyBatch(const std::vector<size_t>& rows, const BatchOperation& op) {
+        BatchResult result;
+        if (refuseEditOfPagedTable(directoryPath, "batch")) {
+            result.failed = rows.size();
+            return result;
+        }
+        std::vector<size_t> plainRows;
+        std::map<size_t, std::vector<size_t>, std::greater<size_t>> directoryRowsByDepth;
+        for (size_t row : rows) {
+            if (row >= files.size()) {
+                continue;
+            }
+            const std::string& name = files[row].name;
+            if (files[row].isDirectory) {
+                directoryRowsByDepth[std::count(name.begin(), name.end(), '/')].push_back(row);
+            } else {
+                plainRows.push_back(row);
+            }
+        }
+        
+        // Workers write rows concurrently, so every chunk they touch is made private here
+        for (size_t row : rows) {
+            if (row < files.size()) {
+                files.mutableRow(row);
+            }
+        }
+        
+        std::mutex resultMutex;
+        std::int64_t apparentDelta = 0;
+        std::int64_t uniqueDelta = 0;
+        std::unordered_map<std::string, std::string> renamedDirectories;  // original path -> new name
+        std::vector<std::pair<size_t, std::string>> renamedRows;          // row -> new path
+        
+        auto parentOf = [](const std::string& path) {
+            size_t slash = path.rfind('/');
+            return slash == 0 ? std::string("/") : path.substr(0, slash);
+        };
+        
+        // Rows [begin, end) of `list` share one parent directory
+        auto runGroup = [&](const std::vector<size_t>& list, size_t begin, size_t end) {
+            std::string parent = parentOf(files[list[begin]].name);
+            BatchResult local;
+            std::int64_t localApparent = 0;
+            std::int64_t localUnique = 0;
+            std::vector<std::pair<std::string, std::string>> localRenamed;
+            std::vector<std::pair<size_t, std::string>> localRenamedRows;
+            
+            int dirFd = open(parent.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+            if (dirFd == -1) {
+                if (logger) {
+                    logger->logUnreadableFile(parent, "batch_open_parent", std::string("open failed: ") + strerror(errno));
+                }
+                local.failed = end - begin;
+            } else {
+                std::uintmax_t blockSize = getFilesystemBlockSize(parent);
+                for (size_t i = begin; i < end; i++) {
+                    FileInfo& info = files.mutableRow(list[i]);
+                    std::string name = info.name.substr(info.name.rfind('/') + 1);
+                    std::string target = name;
+                    
+                    if (op.kind == BatchOperation::Kind::Chmod) {
+                        if (fchmodat(dirFd, name.c_str(), op.mode, 0) == -1) {
+                            if (logger) {
+                                logger->logUnreadableFile(info.name, "batch_chmod", std::string("chmod failed: ") + strerror(errno));
+                            }
+                            local.failed++;
+                            continue;
+                        }
+                    } else {
+                        target = op.newName(name);
+                        if (target.empty()) {
+                            local.unchanged++;
+                            continue;
+                        }
+                        if (renameNoReplaceAt(dirFd, name.c_str(), target.c_str()) == -1) {
+                            if (logger) {
+                                logger->logUnreadableFile(info.name, "batch_rename", "Rename to " + target + " failed: " + strerror(errno));
+                            }
+                            local.failed++;
+                            continue;
+                        }
+                        // Names change after the pool is done, so the path index stays valid meanwhile
+                        if (info.isDirectory) {
+                            localRenamed.emplace_back(info.name, target);
+                        } else {
+                            localRenamedRows.emplace_back(list[i], (parent == "/" ? "" : parent) + "/" + target);
+                        }
+                    }
+                    
+                    struct stat statBuf;
+                    if (fstatat(dirFd, target.c_str(), &statBuf, AT_SYMLINK_NOFOLLOW) == 0) {
+                        std::int64_t before = static_cast<std::int64_t>(info.allocatedSize);
+                        applyStat(info, statBuf, blockSize);
+                        localApparent += static_cast<std::int64_t>(info.allocatedSize) - before;
+                        if (!info.isExtraLink) {
+                            localUnique += static_cast<std::int64_t>(info.allocatedSize) - before;
+                        }
+                    }
+                    local.succeeded++;
+                }
+                close(dirFd);
+            }
+            
+            std::lock_guard<std::mutex> lock(resultMutex);
+            result.succeeded += local.succeeded;
+            result.failed += local.failed;
+            result.unchanged += local.unchanged;
+            apparentDelta += localApparent;
+            uniqueDelta += localUnique;
+            for (auto& renamed : localRenamed) {
+                renamedDirectories.emplace(std::move(renamed.first), std::move(renamed.second));
+            }
+            std::move(localRenamedRows.begin(), localRenamedRows.end(), std::back_inserter(renamedRows));
+        };
+        
+        ThreadPool pool(std::max<size_t>(4, std::thread::hardware_concurrency()));
+        const size_t maxRowsPerTask = 1024;
+        auto runLevel = [&](std::vector<size_t>& list) {
+            std::sort(list.begin(), list.end(), [&](size_t a, size_t b) {
+                return parentOf(files[a].name) < parentOf(files[b].name);
+            });
+            size_t begin = 0;
+            while (begin < list.size()) {
+                std::string parent = parentOf(files[list[begin]].name);
+                size_t end = begin + 1;
+                while (end < list.size() && end - begin < maxRowsPerTask && parentOf(files[list[end]].name) == parent) {
+                    end++;
+                }
+                pool.submit([&list, begin, end, &runGroup]() { runGroup(list, begin, end); });
+                begin = end;
+            }
+            pool.waitIdle();
+        };
+        
+        runLevel(plainRows);
+        for (auto& [depth, level] : directoryRowsByDepth) {
+            runLevel(level);
+        }
+        
+        totals.apparentBytes += apparentDelta;
+        totals.uniqueBytes += uniqueDelta;
+        
+        inTableOrder = inTableOrder && renamedRows.empty() && renamedDirectories.empty();  // rows keep their place
+        for (auto& [row, newPath] : renamedRows) {
+            FileInfo& info = files.mutableRow(row);
+            std::string oldPath = std::move(info.name);
+            info.name = std::move(newPath);
+            pathIndex.rename(files, row, oldPath);
+        }
+        
+        // A renamed directory moves every row below it: rebuild those paths
+        // component by component, swapping in the new names
+        if (!renamedDirectories.empty()) {
+            std::string key, rebuilt;
+            for (size_t row = 0; row < files.size(); row++) {
+                const std::string& name = files[row].name;
+                bool changed = false;
+                size_t copied = 0;
+                rebuilt.clear();
+                for (size_t end = 1; end <= name.size(); end++) {
+                    if (end < name.size() && name[end] != '/') {
+                        continue;
+                    }
+                    key.assign(name, 0, end);
+                    auto it = renamedDirectories.find(key);
+                    if (it != renamedDirectories.end()) {
+                        size_t componentBegin = name.rfind('/', end - 1) + 1;
+                        rebuilt.append(name, copied, componentBegin - copied).append(it->second);
+                        copied = end;
+                        changed = true;
+                    }
+                }
+                if (changed) {
+                    rebuilt.append(name, copied, std::string::npos);
+                    files.mutableRow(row).name = rebuilt;  // only chunks with moved rows are cloned
+                }
+            }
+            pathIndex.rebuild(files);
+            result.pathsRewritten = true;
+        }
+        
+        if (logger) {
+            logger->logFileModification(directoryPath, op.kind == BatchOperation::Kind::Chmod ? "batch_chmod" : "batch_rename",
+                op.describe() + ": " + std::to_string(result.succeeded) + " done, " + std::to_string(result.failed) +
+                " failed, " + std::to_string(result.unchanged) + " unchanged");
+        }
+        return result;
+    }
+    
+    // First row not before (isDirectory, name) in table order, without decoding chunks
+    size_t lowerBound(bool isDirectory, std::string_view name) const {
+        size_t low = 0, high = files.size();
+        std::string scratch;
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            bool midDirectory = files.isDirectoryAt(mid);
+            bool before = midDirectory != isDirectory ? midDirectory : files.nameAt(mid, scratch) < name;
+            before ? low = mid + 1 : high = mid;
+        }
+        return low;
+    }
+    
+    struct RowRange {
+        size_t begin, end;
+        size_t key;
+    };
+    
+    // Rows at or below each of `keys` (see subtreeKeys) as sorted, disjoint ranges. In
+    // table order a subtree is its own row plus one run of directories and one of files
+    // under "path/", so binary searches find it; after a batch rename moved paths in
+    // place the rows are walked instead.
+    std::vector<RowRange> subtreeRanges(const std::vector<std::string>& keys) const {
+        std::vector<RowRange> ranges;
+        if (keys.empty()) {
+            return ranges;
+        }
+        std::string scratch;
+        if (!inTableOrder) {
+            std::string probe;
+            for (size_t row = 0; row < files.size(); row++) {
+                probe.assign(files.nameAt(row, scratch)).push_back('/');
+                size_t key = coveringKey(keys, probe);
+                if (key == SIZE_MAX) {
+                    continue;
+                }
+                if (!ranges.empty() && ranges.back().end == row && ranges.back().key == key) {
+                    ranges.back().end++;
+                } else {
+                    ranges.push_back({row, row + 1, key});
+                }
+            }
+            return ranges;
+        }
+        
+        for (size_t key = 0; key < keys.size(); key++) {
+            std::string_view path(keys[key].data(), keys[key].size() - 1);
+            std::string past = keys[key];
+            past.back() = '/' + 1;  // just after every "path/..." name
+            for (bool isDirectory : {true, false}) {
+                size_t self = lowerBound(isDirectory, path);
+                if (self < files.size() && files.isDirectoryAt(self) == isDirectory && files.nameAt(self, scratch) == path) {
+                    ranges.push_back({self, self + 1, key});
+                }
+                size_t begin = lowerBound(isDirectory, keys[key]);
+                size_t end = lowerBound(isDirectory, past);
+                if (begin < end) {
+                    ranges.push_back({begin, end, key});
+                }
+            }
+        }
+        std::sort(ranges.begin(), ranges.end(), [](const RowRange& a, const RowRange& b) { return a.begin < b.begin; });
+        return ranges;
+    }
+    
+    // Calls fn(row, key index) for every row at or below one of `keys` (see subtreeKeys)
+    template <class Fn>
+    void forEachRowUnder(const std::vector<std::string>& keys, Fn&& fn) const {
+        for (const RowRange& range : subtreeRanges(keys)) {
+            for (size_t row = range.begin; row < range.end; row++) {
+                fn(row, range.key);
+            }
+        }
+    }
+    
+    // Per key: the rows of that subtree as the table has them
+    std::vector<SubtreeTotals> measureSubtrees(const std::vector<std::string>& keys) const {
+        std::vector<SubtreeTotals> result(keys.size());
+        forEachRowUnder(keys, [&](size_t row, size_t key) {
+            const FileInfo& info = files[row];
+            result[key].entries++;
+            if (!info.isDirectory) {
+                result[key].bytes += info.actualSize;
+            }
+            if (!info.isExtraLink) {
+                result[key].allocatedBytes += info.allocatedSize;
+            }
+        });
+        return result;
+    }
+    
+    // Mirror a file operation in the table: rows at or below removed paths go, moved
+    // subtrees come back under their new path if that is inside the scanned directory,
+    // created entries under it are added from their stat. Returns whether rows changed.
+    bool applyEdit(const TableEdit& edit) {
+        if (edit.empty() || refuseEditOfPagedTable(directoryPath, "table_edit")) {
+            return false;
+        }
+        std::string rootKey = directoryPath.back() == '/' ? directoryPath : directoryPath + "/";
+        auto insideRoot = [&](const std::string& path) { return path.compare(0, rootKey.size(), rootKey) == 0; };
+        
+        std::vector<std::string> roots = edit.removed;
+        for (const auto& [from, to] : edit.moved) {
+            roots.push_back(from);
+        }
+        std::vector<std::string> keys = subtreeKeys(std::move(roots));
+        std::vector<const std::string*> destinations(keys.size(), nullptr);
+        for (const auto& [from, to] : edit.moved) {
+            size_t key = coveringKey(keys, from + "/");
+            if (key != SIZE_MAX && keys[key].size() == from.size() + 1 && insideRoot(to)) {
+                destinations[key] = &to;
+            }
+        }
+        
+        std::vector<std::pair<size_t, size_t>> removed;
+        std::vector<FileInfo> added;
+        for (const RowRange& range : subtreeRanges(keys)) {
+            if (!removed.empty() && removed.back().second == range.begin) {
+                removed.back().second = range.end;
+            } else {
+                removed.emplace_back(range.begin, range.end);
+            }
+            for (size_t row = range.begin; row < range.end; row++) {
+                const FileInfo& info = files[row];
+                totals.apparentBytes -= info.allocatedSize;
+                if (info.isExtraLink) {
+                    totals.extraLinks--;
+                } else {
+                    totals.uniqueBytes -= info.allocatedSize;
+                }
+                if (destinations[range.key]) {
+                    // Same inode under its new name: totals go back as they were
+                    FileInfo moved = info;
+                    moved.name = *destinations[range.key] + moved.name.substr(keys[range.key].size() - 1);
+                    totals.apparentBytes += moved.allocatedSize;
+                    if (moved.isExtraLink) {
+                        totals.extraLinks++;
+                    } else {
+                        totals.uniqueBytes += moved.allocatedSize;
+                    }
+                    added.push_back(std::move(moved));
+                }
+            }
+        }
+        
+        std::unordered_map<dev_t, std::uintmax_t> blockSizes;
+        for (const auto& [path, statBuf] : edit.created) {
+            if (!insideRoot(path)) {
+                continue;
+            }
+            auto [it, fresh] = blockSizes.emplace(statBuf.st_dev, 0);
+            if (fresh) {
+                it->second = getFilesystemBlockSize(path.substr(0, path.rfind('/')));
+            }
+            FileInfo info;
+            info.name = path;
+            applyStat(info, statBuf, it->second);
+            accountSpace(info);
+            codePoints.addUtf8(path.substr(path.rfind('/') + 1));
+            added.push_back(std::move(info));
+        }
+        if (removed.empty() && added.empty()) {
+            return false;
+        }
+        
+        // Where each new row goes among the old ones, then the index loses the removed
+        // rows while their neighbours can still be read
+        std::sort(added.begin(), added.end(), tableOrder);
+        std::vector<std::pair<size_t, FileInfo>> placed;
+        placed.reserve(added.size());
+        for (FileInfo& info : added) {
+            size_t at = lowerBound(info.isDirectory, info.name);
+            placed.emplace_back(at, std::move(info));
+        }
+        std::string scratch;
+        for (const auto& [begin, end] : removed) {
+            for (size_t row = begin; row < end; row++) {
+                pathIndex.erase(files, row, files.nameAt(row, scratch));
+            }
+        }
+        
+        // An old row moves up by the rows removed before it and down by the new rows placed
+        // at or before it: a step function of the row, one step per range end and new row
+        std::vector<std::pair<size_t, std::ptrdiff_t>> steps;  // from row, shift change
+        for (const auto& [begin, end] : removed) {
+            steps.emplace_back(end, -static_cast<std::ptrdiff_t>(end - begin));
+        }
+        for (const auto& [at, info] : placed) {
+            steps.emplace_back(at, 1);
+        }
+        std::sort(steps.begin(), steps.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        std::vector<std::pair<size_t, std::ptrdiff_t>> shifts{{0, 0}};  // from row on, the total shift
+        for (const auto& [from, change] : steps) {
+            if (shifts.back().first != from) {
+                shifts.emplace_back(from, shifts.back().second);
+            }
+            shifts.back().second += change;
+        }
+        // Slots come in hash order, so the search is written without branches to mispredict
+        pathIndex.renumber([&](size_t row) {
+            const std::pair<size_t, std::ptrdiff_t>* step = shifts.data();
+            for (size_t n = shifts.size(); n > 1; n -= n / 2) {
+                step = step[n / 2].first <= row ? step + n / 2 : step;
+            }
+            return static_cast<size_t>(static_cast<std::ptrdiff_t>(row) + step->second);
+        });
+        
+        // A new row lands at its position less the removed rows before that, after the new rows ahead of it
+        std::vector<size_t> addedRows;
+        addedRows.reserve(placed.size());
+        size_t range = 0, removedAhead = 0;
+        for (size_t i = 0; i < placed.size(); i++) {
+            size_t at = placed[i].first;
+            while (range < removed.size() && removed[range].second <= at) {
+                removedAhead += removed[range].second - removed[range].first;
+                range++;
+            }
+            size_t inside = range < removed.size() && removed[range].first < at ? at - removed[range].first : 0;
+            addedRows.push_back(at - removedAhead - inside + i);
+        }
+        
+        files.splice(removed, std::move(placed));
+        if (options.compactNames) {
+            files.compact();  // packs only the chunks the splice rebuilt
+        }
+        pathIndex.insert(files, addedRows);
+        return true;
+    }
+    
+    void interruptScan() { scanInterrupted = true; }
+    
+    void loadFilesRecursive(const std::string& path, std::queue<std::pair<std::string, int>>& dirsToProcess, int currentDepth = 0) {
+        // Check for interruption
+        if (scanInterrupted) {
+            return;
+        }
+        
+        if (throttle) {
+            throttle->acquire();
+        }
+        auto opened = PoliteThrottle::Clock::now();
+        DIR* dir = opendir(path.c_str());
+        
+        if (!dir) {
+            if (logger) {
+                logger->logUnreadableFile(path, "opendir", std::string("Failed to open directory: ") + strerror(errno));
+            }
+            return;
+        }
+        
+        // Get filesystem block size for this directory
+        std::uintmax_t blockSize = getFilesystemBlockSize(path);
+        
+        // Pre-allocate space to avoid frequent reallocations
+        std::vector<FileInfo> localFiles;
+        localFiles.reserve(1000);  // Reserve space for efficiency
+        
+        // Read the whole directory first: the descriptor is released before the
+        // stat phase, and the entries can be reordered for it
+        dirents.clear();
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            // Skip . and ..
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                dirents.add(entry);
+            }
+        }
+        closedir(dir);
+        if (throttle) {
+            throttle->record(PoliteThrottle::Clock::now() - opened);  // opendir and the getdents calls
+        }
+        if (options.inodeOrder) {
+            dirents.sortByInode();
+        }
+        
+        for (const DirentBatch::Record& record : dirents.records) {
+            if (scanInterrupted) {
+                break;
+            }
+            const char* entryName = dirents.name(record);
+            
+            // The scan root may be "/" itself
+            std::string fullPath = path.back() == '/' ? path + entryName : path + "/" + entryName;
+            struct stat statBuf;
+            
+            // Exclusion rules run on the dirent alone, so a pruned entry costs no lstat
+            // and a pruned directory is never queued. Only DT_UNKNOWN needs the stat first.
+            bool typeKnown = record.type != DT_UNKNOWN;
+            if (options.exclusions && typeKnown && isExcluded(fullPath, entryName, record.type == DT_DIR)) {
+                prunedEntries++;
+                continue;
+            }
+            
+            // Use lstat instead of stat for better performance (doesn't follow symlinks)
+            if (throttle) {
+                throttle->acquire();
+            }
+            auto statStart = PoliteThrottle::Clock::now();
+            int statResult = lstat(fullPath.c_str(), &statBuf);
+            if (throttle) {
+                throttle->record(PoliteThrottle::Clock::now() - statStart);
+            }
+            if (statResult == -1) {
+                if (logger) {
+                    logger->logUnreadableFile(fullPath, "lstat", std::string("lstat failed: ") + strerror(errno));
+                }
+                continue;
+            }
+            
+            if (options.exclusions && !typeKnown && isExcluded(fullPath, entryName, S_ISDIR(statBuf.st_mode))) {
+                prunedEntries++;
+                continue;
+            }
+            
+            codePoints.addUtf8(entryName);  // for the glyph warmer
+            
+            FileInfo info;
+            info.name = fullPath;
+            info.isDirectory = S_ISDIR(statBuf.st_mode);
+            info.device = statBuf.st_dev;
+            info.inode = statBuf.st_ino;
+            info.mode = statBuf.st_mode;
+            info.uid = statBuf.st_uid;
+            info.gid = statBuf.st_gid;
+            info.linkCount = statBuf.st_nlink;
+            info.mtime = statBuf.st_mtim.tv_sec;
+            info.mtimeNsec = statBuf.st_mtim.tv_nsec;
+            
+            // Get actual and allocated file sizes
+            info.actualSize = statBuf.st_size;
+            if (info.isDirectory) {
+                // For directories, just use the directory entry size (don't calculate recursive size)
+                info.allocatedSize = calculateAllocatedSize(statBuf.st_size, blockSize);
+                info.size = formatSizeInfo(info.actualSize, info.allocatedSize);
+                
+                // Add directory to queue for recursive processing if accessible.
+                // Mount points of skipped filesystems are listed but never opened.
+                if (const char* reason = mountSkipReason(info.device)) {
+                    MountSummary& mount = mountSummaryFor(info.device, fullPath);
+                    mount.skippedDirs++;
+                    mount.skipReason = reason;
+                } else if (access(fullPath.c_str(), R_OK | X_OK) == 0) {
+                    dirsToProcess.push({fullPath, currentDepth + 1});
+                } else if (logger) {
+                    logger->logUnreadableFile(fullPath, "subdirectory_access_test", std::string("access denied: ") + strerror(errno));
+                }
+            } else {
+                // Regular file or other file type
+                info.allocatedSize = calculateAllocatedSize(statBuf.st_size, blockSize);
+                info.size = formatSizeInfo(info.actualSize, info.allocatedSize);
+            }
+            
+            // Get file modification time
+            info.date = formatDate(statBuf.st_mtime, logger.get(), fullPath);
+            
+            // Simplified permissions (reuse stat data)
+            info.permissions = getFilePermissionsFromStat(statBuf);
+            
+            accountSpace(info);
+            
+            MountSummary& mount = mountSummaryFor(info.device, fullPath);
+            mount.entries++;
+            mount.allocatedBytes += info.allocatedSize;
+            
+            localFiles.push_back(std::move(info));
+        }
+        
+        scannedEntries += localFiles.size();
+        
+        // Stream the batch out while the scan is still running
+        if (options.exportSink) {
+            options.exportSink->writeRows(localFiles.data(), localFiles.size());
+        }
+        
+        // Batch append to main files vector
+        if (options.retainEntries) {
+            if (options.memoryLimit > 0) {
+                for (const FileInfo& row : localFiles) {
+                    scanRowBytes += sizeof(FileInfo) + row.name.capacity() + row.size.capacity() +
+                                    row.date.capacity() + row.permissions.capacity();
+                }
+            }
+            scanRows.insert(scanRows.end(), std::make_move_iterator(localFiles.begin()), 
+                            std::make_move_iterator(localFiles.end()));
+            if (options.memoryLimit > 0 && scanRowBytes > options.memoryLimit) {
+                spillRun();
+            }
+        }
+    }
+    
+    void loadFiles() {
+        FormatEngine::refreshClock();
+        codePoints.addUtf8(directoryPath);
+        files = FileTable();
+        inTableOrder = true;
+        scanRows.clear();
+        spillRuns.clear();
+        scanRowBytes = 0;
+        spillFailed = false;
+        pagedDirectories = SIZE_MAX;
+        seenInodes.clear();
+        totals = SpaceTotals();
+        throttle.reset();
+        if (options.politeRate > 0) {
+            throttle = std::make_unique<PoliteThrottle>(options.politeRate);
+        }
+        
+        // Check if directory exists and is accessible
+        struct stat statBuf;
+        if (stat(directoryPath.c_str(), &statBuf) == -1) {
+            if (logger) {
+                logger->logUnreadableFile(directoryPath, "directory_exists_check", std::string("stat failed: ") + strerror(errno));
+            }
+            return;
+        }
+        
+        if (!S_ISDIR(statBuf.st_mode)) {
+            if (logger) {
+                logger->logUnreadableFile(directoryPath, "directory_type_check", "Not a directory");
+            }
+            return;
+        }
+        
+        rootDevice = statBuf.st_dev;
+        prunedEntries = 0;
+        scannedEntries = 0;
+        mountSummaries.clear();
+        mountIndex.clear();
+        lastMountIndex = SIZE_MAX;
+        mountSummaryFor(rootDevice, directoryPath);
+        
+        // Test basic directory access
+        if (access(directoryPath.c_str(), R_OK | X_OK) != 0) {
+            if (logger) {
+                logger->logUnreadableFile(directoryPath, "directory_access_test", std::string("access denied: ") + strerror(errno));
+            }
+            std::cerr << "Cannot access directory: " << directoryPath << " - " << strerror(errno) << std::endl;
+            return;
+        }
+        
+        try {
+            std::cout << "Scanning directory tree: " << directoryPath << std::endl;
+            
+            // Pre-allocate memory for better performance
+            scanRows.reserve(10000);  // Reserve space for 10k files initially
+            
+            // Use queue-based approach to handle recursion and catch all permission errors
+            std::queue<std::pair<std::string, int>> dirsToProcess;
+            dirsToProcess.push({directoryPath, 0});
+            
+            int processedDirs = 0;
+            auto startTime = std::chrono::steady_clock::now();
+            
+            while (!dirsToProcess.empty() && !scanInterrupted) {
+                if (options.cancel && *options.cancel) {
+                    scanInterrupted = true;
+                    break;
+                }
+                auto [currentDir, depth] = dirsToProcess.front();
+                dirsToProcess.pop();
+                processedDirs++;
+                
+                // Handle window events every 10 directories to prevent "not responding" dialog
+                if (window && processedDirs % 10 == 0) {
+                    while (auto eventOpt = window->pollEvent()) {
+                        if (!eventOpt) break;
+                        const sf::Event& event = *eventOpt;
+                        
+                        if (event.is<sf::Event::Closed>()) {
+                            scanInterrupted = true;
+                            break;
+                        }
+                        
+                        if (event.is<sf::Event::KeyPressed>()) {
+                            if(const auto* keyPressed = event.getIf<sf::Event::KeyPressed>()){
+                                if (keyPressed->scancode == sf::Keyboard::Scancode::Escape) {
+                                    scanInterrupted = true;
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                    
+                    // Update window display to show we're still alive
+                    if (window->isOpen()) {
+                        window->clear(sf::Color::Black);
+                        
+                        // Show progress text (the font is opened once, not on every redraw)
+                        if (!progressFont) {
+                            auto opened = std::make_shared<sf::Font>();
+                            if (opened->openFromFile("assets/Sansation-Regular.ttf")) {
+                                progressFont = opened;
+                            }
                         }
-                        return false;
+                        if (progressFont) {
+                            sf::Text progressText(*progressFont, "Scanning: " + std::to_string(processedDirs) + 
+                                                " dirs, " + std::to_string(scannedEntries) + " files\nPress ESC to stop", 24);
+                            progressText.setFillColor(sf::Color::White);
+                            progressText.setPosition(sf::Vector2f(50, 50));
+                            window->draw(progressText);
+                        }
+                        
+                        window->display();
                     }
-                    
-                    fs::rename(oldPath, newPath);
-                    
-                    // Update in files vector
-                    auto it = std::find_if(files.begin(), files.end(), 
-                        [&filePath](const FileInfo& info) { return info.name == filePath; });
-                    if (it != files.end()) {
-                        it->name = newPath.string();
+                }
+                
+                // Progress feedback every 100 directories for console output
+                if (processedDirs % 100 == 0) {
+                    auto currentTime = std::chrono::steady_clock::now();
+                    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime).count();
+                    std::cout << "\rProcessed " << processedDirs << " directories, found " << scannedEntries 
+                              << " files, depth " << depth << " (" << elapsed << "ms)";
+                    if (throttle) {
+                        std::cout << " " << static_cast<long>(throttle->getStats().rate) << " ops/s";
                     }
-                    
+                    std::cout << " [Press ESC to stop]" << std::flush;
+                }
+                
+                try {
+                    loadFilesRecursive(currentDir, dirsToProcess, depth);
+                } catch (const std::exception& e) {
                     if (logger) {
-                        logger->logFileModification(filePath, "rename", "Renamed to: " + newPath.string());
+                        logger->logUnreadableFile(currentDir, "directory_processing", e.what());
                     }
-                    
-                    return reloadSingleFile(newPath.string());
                 }
+            }
+            
+            auto endTime = std::chrono::steady_clock::now();
+            auto totalTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+            
+            if (scanInterrupted) {
+                std::cout << "\rScan interrupted: " << processedDirs << " directories, " << scannedEntries 
+                          << " files in " << totalTime << "ms (partial results)" << std::endl;
+            } else {
+                std::cout << "\rScan complete: " << processedDirs << " directories, " << scannedEntries 
+                          << " files in " << totalTime << "ms" << std::endl;
+            }
+            if (prunedEntries > 0) {
+                std::cout << "Excluded by rules: " << prunedEntries << " entries (subtrees not entered)" << std::endl;
+            }
+            if (throttle) {
+                const PoliteThrottle::Stats& polite = throttle->getStats();
+                auto sleptMs = std::chrono::duration_cast<std::chrono::milliseconds>(polite.slept).count();
+                std::cout << "Polite: " << polite.operations << " calls, " << polite.waits << " waited, throttled "
+                          << sleptMs << "ms (" << (totalTime > 0 ? sleptMs * 100 / totalTime : 0) << "% of the scan), "
+                          << polite.backoffs << " back-offs, final rate " << static_cast<long>(polite.rate) << " ops/s" << std::endl;
+            }
+            
+            // Сортировка: сначала каталоги, потом файлы
+            if (spillRuns.empty()) {
+                std::cout << "Sorting files..." << std::flush;
+                std::sort(scanRows.begin(), scanRows.end(), tableOrder);
+                std::cout << " done!" << std::endl;
+            }
+            
+        } catch (const std::exception& e) {
+            if (logger) {
+                logger->logUnreadableFile(directoryPath, "general_error", e.what());
+            }
+            std::cerr << "Error reading directory: " << e.what() << std::endl;
+        }
+        
+        if (!spillRuns.empty()) {
+            // External sort: the last run is spilled too and all runs are merged into one mapped file
+            spillRun();
+            std::cout << "Merging " << spillRuns.size() << " sorted runs..." << std::flush;
+            auto merged = spillFailed ? nullptr : PagedRows::merge(spillRuns, spillDirectory(), tableOrder);
+            if (merged) {
+                files = FileTable(merged);
+                std::cout << " done!" << std::endl;
+                spillRuns.clear();
+                scanRows = std::vector<FileInfo>();
+                pathIndex.clear();  // paged rows are found by binary search instead
+                return;
+            }
+            if (logger) {
+                logger->logUnreadableFile(spillDirectory(), "merge_runs", "cannot spill or merge sorted runs; " +
+                                          std::to_string(spillRuns.size()) + " runs are missing from the table");
+            }
+            std::cerr << " failed: showing only the rows still in memory (see the log)" << std::endl;
+            spillRuns.clear();
+            std::sort(scanRows.begin(), scanRows.end(), tableOrder);
+        }
+        files = FileTable(std::move(scanRows));
+        scanRows = std::vector<FileInfo>();
+        if (options.compactNames) {
+            files.compact();
+            auto [packedBytes, plainBytes] = files.packedNameBytes();
+            std::cout << "Names: " << packedBytes / 1024 << " KiB front-coded (" << plainBytes / 1024 << " KiB as strings)" << std::endl;
+        }
+        pathIndex.rebuild(files);
+    }
+    
+    // Current version of the table. Copies are cheap and never change: edits made
+    // afterwards go into new chunks, so hold a copy instead of re-copying rows.
+    const FileTable& getFiles() const {
+        return files;
+    }
+    
+    size_t getFileCount() const {
+        return files.size();
+    }
+    
+    const CodePointSet& getCodePoints() const {
+        return codePoints;
+    }
+    
+    // Row of `files` with this full path, or SIZE_MAX (constant time)
+    size_t findRow(const std::string& path) {
+        return locate(path);
+    }
+    
+    std::string getLogFilePath() const {
+        return logger ? logger->getLogFilePath() : "";
+    }
+    
+    bool isLoggingEnabled() const {
+        return logger ? logger->isLoggingEnabled() : false;
+    }
+    
+    size_t getScannedCount() const {
+        return scannedEntries;
+    }
+    
+    size_t getPrunedCount() const {
+        return prunedEntries;
+    }
+    
+    const std::vector<MountSummary>& getMountSummaries() const {
+        return mountSummaries;
+    }
+    
+    const SpaceTotals& getSpaceTotals() const {
+        return totals;
+    }
+    
+    FileAccessLogger* getLogger() const {
+        return logger.get();
+    }
+    
+    std::shared_ptr<FileAccessLogger> getSharedLogger() const {
+        return logger;
+    }
+};
+
+// Result of a duplicate search: each group lists rows of the scanned table
+// whose contents hash identically (same size, same XXH64 of all bytes)
+struct DuplicateGroup {
+    std::uintmax_t size = 0;
+    std::uintmax_t allocatedSize = 0;
+    std::uint64_t hash = 0;
+    std::vector<size_t> rows;  // indices into the table passed to DuplicateFinder::find
+};
+
+struct DuplicateReport {
+    std::vector<DuplicateGroup> groups;
+    std::uintmax_t reclaimableBytes = 0;  // allocated bytes freed by keeping one copy per group
+    size_t duplicateFiles = 0;            // files beyond the first in every group
+    bool cancelled = false;
+};
+
+struct DuplicateProgress {
+    const char* stage = "";
+    size_t done = 0;
+    size_t total = 0;
+    std::uint64_t bytesHashed = 0;
+};
+
+// Staged duplicate detection over an already scanned table:
+//   1. group regular files by actualSize (no I/O),
+//   2. hash the first and last 4 KiB of every file in a same-size group,
+//   3. stream the whole file only for files that still collide.
+// Hashing runs on a ThreadPool whose size bounds the number of files read at once.
+class DuplicateFinder {
+private:
+    static constexpr size_t kEdgeBytes = 4096;
+    static constexpr size_t kBatchSize = 64;  // files per pool task
+    
+    FileAccessLogger* logger;
+    size_t ioConcurrency;
+    
+    // Hash of the head and tail of the file; sets wholeFile when that covered every byte
+    bool hashEdges(const std::string& path, std::uintmax_t size, std::uint64_t& hashOut, bool& wholeFile,
+                   std::atomic<std::uint64_t>& bytesHashed) {
+        int fd = openForHashing(path);
+        if (fd == -1) {
+            if (logger) {
+                logger->logUnreadableFile(path, "dup_hash_open", std::string("open failed: ") + strerror(errno));
+            }
+            return false;
+        }
+        
+        unsigned char buf[kEdgeBytes * 2];
+        size_t wanted = size <= sizeof(buf) ? static_cast<size_t>(size) : sizeof(buf);
+        size_t got = 0;
+        bool ok = true;
+        // Only the head and tail about to be read are checked, and dropped afterwards
+        std::uintmax_t headBytes = size <= sizeof(buf) ? size : kEdgeBytes;
+        std::uintmax_t tailOffset = size <= sizeof(buf) ? size : size - kEdgeBytes;
+        bool cold = PoliteIo::enabled() && !PoliteIo::hasCachedPages(fd, 0, headBytes) &&
+                    !PoliteIo::hasCachedPages(fd, tailOffset, size - tailOffset);
+        
+        while (got < wanted) {
+            // First half from offset 0, second half from the end of the file
+            off_t offset = got < kEdgeBytes || size <= sizeof(buf)
+                ? static_cast<off_t>(got)
+                : static_cast<off_t>(size - (wanted - got));
+            size_t chunk = got < kEdgeBytes && size > sizeof(buf) ? kEdgeBytes - got : wanted - got;
+            ssize_t n = pread(fd, buf + got, chunk, offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {  // error or file shrank since the scan
+                ok = false;
+                if (logger) {
+                    logger->logUnreadableFile(path, "dup_hash_read", n < 0 ? strerror(errno) : "unexpected end of file");
+                }
+                break;
+            }
+            got += static_cast<size_t>(n);
+        }
+        PoliteIo::releasePages(fd, cold, 0, headBytes);
+        if (size > tailOffset) {
+            PoliteIo::releasePages(fd, cold, tailOffset, size - tailOffset);
+        }
+        close(fd);
+        
+        if (ok) {
+            Xxh64Hasher hasher;
+            hasher.update(buf, got);
+            hashOut = hasher.digest();
+            wholeFile = size <= sizeof(buf);
+            bytesHashed += got;
+        }
+        return ok;
+    }
+    
+    // Run work(i) for i in [0, count) on the pool, reporting progress while waiting
+    template <typename Work>
+    bool runStage(ThreadPool& pool, const char* stage, size_t count, Work work,
+                  std::atomic<size_t>& done, std::atomic<std::uint64_t>& bytesHashed, std::atomic<bool>& cancel,
+                  const std::function<bool(const DuplicateProgress&)>& onProgress) {
+        done = 0;
+        for (size_t begin = 0; begin < count; begin += kBatchSize) {
+            size_t end = std::min(count, begin + kBatchSize);
+            pool.submit([&, begin, end] {
+                for (size_t i = begin; i < end && !cancel; i++) {
+                    work(i);
+                    done++;
+                }
+            });
+        }
+        
+        while (!pool.waitIdleFor(std::chrono::milliseconds(100))) {
+            if (onProgress && !cancel) {
+                DuplicateProgress progress{stage, done.load(), count, bytesHashed.load()};
+                if (!onProgress(progress)) {
+                    cancel = true;
+                }
+            }
+        }
+        return !cancel;
+    }
+
+public:
+    explicit DuplicateFinder(FileAccessLogger* log = nullptr, size_t maxConcurrentIo = 0)
+        : logger(log), ioConcurrency(maxConcurrentIo) {
+        if (ioConcurrency == 0) {
+            ioConcurrency = std::min<size_t>(8, std::max(2u, std::thread::hardware_concurrency()));
+        }
+    }
+    
+    // onProgress is called from the calling thread roughly every 100 ms; return false to cancel
+    DuplicateReport find(const FileTable& files,
+                         const std::function<bool(const DuplicateProgress&)>& onProgress = nullptr) {
+        DuplicateReport report;
+        
+        // Stage 1: same-size buckets. Hardlinks to one inode are the same data,
+        // not duplicates, so only the first row of every (dev, ino) takes part.
+        std::unordered_map<std::uintmax_t, std::vector<size_t>> bySize;
+        {
+            InodeSet seenInodes;
+            for (size_t i = 0; i < files.size(); i++) {
+                const FileInfo& info = files[i];
+                if (!S_ISREG(info.mode) || info.actualSize == 0) {
+                    continue;
+                }
+                if (info.linkCount > 1 && !seenInodes.insert(info.device, info.inode)) {
+                    continue;
+                }
+                bySize[info.actualSize].push_back(i);
+            }
+        }
+        
+        std::vector<size_t> candidates;
+        for (auto& [size, rows] : bySize) {
+            if (rows.size() > 1) {
+                candidates.insert(candidates.end(), rows.begin(), rows.end());
+            }
+        }
+        bySize.clear();
+        
+        // Workers read these copies, never the table (which may decode chunks lazily)
+        std::vector<std::string> candidatePaths(candidates.size());
+        std::vector<std::uintmax_t> candidateSizes(candidates.size());
+        for (size_t i = 0; i < candidates.size(); i++) {
+            const FileInfo& info = files[candidates[i]];
+            candidatePaths[i] = info.name;
+            candidateSizes[i] = info.actualSize;
+        }
+        
+        ThreadPool pool(ioConcurrency);
+        std::atomic<size_t> done{0};
+        std::atomic<std::uint64_t> bytesHashed{0};
+        std::atomic<bool> cancel{false};
+        
+        // Stage 2: head + tail hash of every candidate
+        std::vector<std::uint64_t> edgeHash(candidates.size(), 0);
+        std::vector<char> edgeOk(candidates.size(), 0);
+        std::vector<char> edgeWasWhole(candidates.size(), 0);
+        bool finished = runStage(pool, "Hashing file edges", candidates.size(), [&](size_t i) {
+            bool whole = false;
+            edgeOk[i] = hashEdges(candidatePaths[i], candidateSizes[i], edgeHash[i], whole, bytesHashed);
+            edgeWasWhole[i] = whole;
+        }, done, bytesHashed, cancel, onProgress);
+        
+        if (!finished) {
+            report.cancelled = true;
+            return report;
+        }
+        
+        // Regroup by (size, edge hash); singletons are unique
+        struct SizeHashKey {
+            std::uintmax_t size;
+            std::uint64_t hash;
+            bool operator==(const SizeHashKey& o) const { return size == o.size && hash == o.hash; }
+        };
+        struct SizeHashKeyHash {
+            size_t operator()(const SizeHashKey& k) const { return static_cast<size_t>(k.hash ^ (k.size * 0x9E3779B97F4A7C15ULL)); }
+        };
+        
+        std::unordered_map<SizeHashKey, std::vector<size_t>, SizeHashKeyHash> byEdge;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            if (edgeOk[i]) {
+                byEdge[{candidateSizes[i], edgeHash[i]}].push_back(i);
+            }
+        }
+        
+        // Small files were hashed completely in stage 2 and are final already
+        std::unordered_map<SizeHashKey, std::vector<size_t>, SizeHashKeyHash> byContent;
+        std::vector<size_t> survivors;
+        for (auto& [key, members] : byEdge) {
+            if (members.size() < 2) {
+                continue;
+            }
+            if (edgeWasWhole[members.front()]) {
+                auto& group = byContent[key];
+                for (size_t m : members) {
+                    group.push_back(candidates[m]);
+                }
+            } else {
+                survivors.insert(survivors.end(), members.begin(), members.end());
+            }
+        }
+        byEdge.clear();
+        
+        // Stage 3: full streaming hash only for files that still collide
+        std::vector<std::uint64_t> fullHash(survivors.size(), 0);
+        std::vector<char> fullOk(survivors.size(), 0);
+        finished = runStage(pool, "Hashing full contents", survivors.size(), [&](size_t i) {
+            fullOk[i] = hashFileContents(candidatePaths[survivors[i]], fullHash[i], logger, &bytesHashed);
+        }, done, bytesHashed, cancel, onProgress);
+        
+        if (!finished) {
+            report.cancelled = true;
+            return report;
+        }
+        
+        for (size_t i = 0; i < survivors.size(); i++) {
+            if (fullOk[i]) {
+                size_t row = candidates[survivors[i]];
+                byContent[{files[row].actualSize, fullHash[i]}].push_back(row);
+            }
+        }
+        
+        for (auto& [key, rows] : byContent) {
+            if (rows.size() < 2) {
+                continue;
+            }
+            std::sort(rows.begin(), rows.end());
+            DuplicateGroup group;
+            group.size = key.size;
+            group.allocatedSize = files[rows.front()].allocatedSize;
+            group.hash = key.hash;
+            group.rows = std::move(rows);
+            report.duplicateFiles += group.rows.size() - 1;
+            report.reclaimableBytes += group.allocatedSize * (group.rows.size() - 1);
+            report.groups.push_back(std::move(group));
+        }
+        
+        // Biggest savings first
+        std::sort(report.groups.begin(), report.groups.end(), [](const DuplicateGroup& a, const DuplicateGroup& b) {
+            std::uintmax_t wasteA = a.allocatedSize * (a.rows.size() - 1);
+            std::uintmax_t wasteB = b.allocatedSize * (b.rows.size() - 1);
+            if (wasteA != wasteB) {
+                return wasteA > wasteB;
+            }
+            return a.rows.front() < b.rows.front();
+        });
+        
+        return report;
+    }
+};
+
+// Identity of a file's contents for caching purposes: if none of these
+// changed, the bytes are assumed unchanged and the file is not read again
+struct ChecksumKey {
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    std::uint64_t size = 0;
+    std::int64_t mtimeSec = 0;
+    std::int64_t mtimeNsec = 0;
+    
+    bool operator==(const ChecksumKey& o) const {
+        return device == o.device && inode == o.inode && size == o.size &&
+               mtimeSec == o.mtimeSec && mtimeNsec == o.mtimeNsec;
+    }
+    
+    static ChecksumKey fromFileInfo(const FileInfo& info) {
+        return {static_cast<std::uint64_t>(info.device), static_cast<std::uint64_t>(info.inode),
+                static_cast<std::uint64_t>(info.actualSize), static_cast<std::int64_t>(info.mtime),
+                static_cast<std::int64_t>(info.mtimeNsec)};
+    }
+};
+
+struct ChecksumKeyHash {
+    size_t operator()(const ChecksumKey& k) const {
+        std::uint64_t h = k.inode * 0x9E3779B97F4A7C15ULL;
+        h ^= k.device + 0x7F4A7C159E3779B9ULL + (h << 6) + (h >> 2);
+        h ^= k.size + (h << 6) + (h >> 2);
+        h ^= static_cast<std::uint64_t>(k.mtimeSec) + (h << 6) + (h >> 2);
+        h ^= static_cast<std::uint64_t>(k.mtimeNsec) + (h << 6) + (h >> 2);
+        return static_cast<size_t>(h);
+    }
+};
+
+// Computes content checksums (XXH64) in the background and remembers them
+// in an append-only cache file, keyed by (st_dev, st_ino, st_size, st_mtime).
+// Rows ask for their checksum when they become visible; bulk requests queue
+// the whole table. The UI polls takeUpdates() to know when to redraw.
+class ChecksumService {
+private:
+    struct CacheRecord {
+        ChecksumKey key;
+        std::uint64_t hash;
+    };
+    
+    static constexpr size_t kFlushThreshold = 64 * 1024 / sizeof(CacheRecord);
+    // A failure is only remembered for a while: permissions can change without
+    // touching size or mtime, so an unreadable file may become readable.
+    static constexpr std::chrono::seconds kRetryFailedAfter{30};
+    
+    std::string cachePath;
+    
+    std::mutex mutex;  // guards everything below
+    std::shared_ptr<FileAccessLogger> logger;  // replaced on rescan, so copied under mutex
+    std::unordered_map<ChecksumKey, std::uint64_t, ChecksumKeyHash> cache;
+    std::unordered_map<ChecksumKey, bool, ChecksumKeyHash> inFlight;
+    std::unordered_map<ChecksumKey, std::chrono::steady_clock::time_point, ChecksumKeyHash> failed;  // never saved
+    std::vector<CacheRecord> unsaved;
+    
+    std::atomic<bool> updated{false};
+    std::atomic<size_t> queued{0};
+    std::atomic<size_t> completed{0};
+    std::atomic<std::uint64_t> bytesHashed{0};
+    
+    // Declared last so workers are joined before the maps they use go away
+    std::unique_ptr<ThreadPool> pool;
+    
+    void loadCache() {
+        int fd = open(cachePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return;  // first run
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        
+        std::vector<CacheRecord> records(8192);
+        for (;;) {
+            ssize_t n = read(fd, records.data(), records.size() * sizeof(CacheRecord));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            size_t count = static_cast<size_t>(n) / sizeof(CacheRecord);
+            for (size_t i = 0; i < count; i++) {
+                cache[records[i].key] = records[i].hash;  // later records win
+            }
+            if (static_cast<size_t>(n) % sizeof(CacheRecord) != 0) {
+                break;  // truncated tail from an interrupted write
+            }
+        }
+        close(fd);
+    }
+    
+    // Caller holds mutex
+    void flushLocked() {
+        if (unsaved.empty()) {
+            return;
+        }
+        int fd = open(cachePath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            if (logger) {
+                logger->logUnreadableFile(cachePath, "checksum_cache_write", std::string("open failed: ") + strerror(errno));
+            }
+            unsaved.clear();
+            return;
+        }
+        const char* data = reinterpret_cast<const char*>(unsaved.data());
+        size_t left = unsaved.size() * sizeof(CacheRecord);
+        while (left > 0) {
+            ssize_t n = write(fd, data, left);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            data += n;
+            left -= static_cast<size_t>(n);
+        }
+        close(fd);
+        unsaved.clear();
+    }
+    
+    void compute(const std::string& path, const ChecksumKey& key) {
+        std::shared_ptr<FileAccessLogger> log;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            log = logger;
+        }
+        std::uint64_t hash = 0;
+        bool ok = hashFileContents(path, hash, log.get(), &bytesHashed);
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight.erase(key);
+        if (ok) {
+            cache[key] = hash;
+            unsaved.push_back({key, hash});
+            if (unsaved.size() >= kFlushThreshold) {
+                flushLocked();
+            }
+        } else {
+            failed[key] = std::chrono::steady_clock::now();
+        }
+        completed++;
+        updated = true;
+    }
+
+public:
+    explicit ChecksumService(std::shared_ptr<FileAccessLogger> log = nullptr,
+                             const std::string& path = "checksum_cache.dat", size_t maxConcurrentIo = 0)
+        : cachePath(path), logger(std::move(log)) {
+        static_assert(sizeof(CacheRecord) == 48, "cache file layout must stay stable");
+        if (maxConcurrentIo == 0) {
+            maxConcurrentIo = std::min<size_t>(4, std::max(2u, std::thread::hardware_concurrency()));
+        }
+        loadCache();
+        pool = std::make_unique<ThreadPool>(maxConcurrentIo);
+    }
+    
+    ~ChecksumService() {
+        pool.reset();  // finish running jobs first
+        std::lock_guard<std::mutex> lock(mutex);
+        flushLocked();
+    }
+    
+    // Called on rescan, which is also when earlier failures are tried again
+    void setLogger(std::shared_ptr<FileAccessLogger> log) {
+        std::lock_guard<std::mutex> lock(mutex);
+        logger = std::move(log);
+        failed.clear();
+    }
+    
+    // Returns the checksum if known; otherwise schedules it (once) and returns nullopt.
+    // failedOut is set when the file could not be read.
+    std::optional<std::uint64_t> request(const FileInfo& info, bool* failedOut = nullptr) {
+        if (failedOut) {
+            *failedOut = false;
+        }
+        if (!S_ISREG(info.mode)) {
+            return std::nullopt;
+        }
+        
+        ChecksumKey key = ChecksumKey::fromFileInfo(info);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = cache.find(key);
+            if (it != cache.end()) {
+                return it->second;
+            }
+            auto failure = failed.find(key);
+            if (failure != failed.end()) {
+                if (std::chrono::steady_clock::now() - failure->second < kRetryFailedAfter) {
+                    if (failedOut) {
+                        *failedOut = true;
+                    }
+                    return std::nullopt;
+                }
+                failed.erase(failure);
+            }
+            if (!inFlight.emplace(key, true).second) {
+                return std::nullopt;
+            }
+        }
+        
+        queued++;
+        std::string path = info.name;
+        pool->submit([this, path, key] { compute(path, key); });
+        return std::nullopt;
+    }
+    
+    // Queue every regular file of the table
+    void requestAll(const FileTable& files) {
+        for (const auto& info : files) {
+            request(info);
+        }
+    }
+    
+    // True once after new checksums arrived
+    bool takeUpdates() {
+        return updated.exchange(false);
+    }
+    
+    size_t pendingCount() const {
+        return queued.load() - completed.load();
+    }
+    
+    std::uint64_t getBytesHashed() const {
+        return bytesHashed.load();
+    }
+    
+    static std::string toHex(std::uint64_t hash) {
+        char buf[17];
+        snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(hash));
+        return buf;
+    }
+};
+
+// Contents of one file for the preview pane, read through mmap windows on a background
+// thread so the render loop never waits for the disk. Text is indexed lazily: the start
+// of every 64th line is remembered as far as the user has scrolled, so a large log costs
+// only the windows that were looked at. Binaries show as a hex dump, 16 bytes a line,
+// which needs no index. A newer request abandons the one being served; asking for
+// another file also drops the one being read.
+class FilePreview {
+public:
+    enum class Mode { None, Text, Hex, Message };
+    struct View {
+        Mode mode = Mode::None;
+        std::string path;
+        std::uint64_t size = 0;
+        size_t firstLine = 0;
+        std::vector<std::string> lines;  // the visible ones, from firstLine
+        size_t knownLines = 0;           // text: lines indexed so far; hex: all of them
+        bool complete = false;           // knownLines is the whole file
+        std::string message;             // Mode::Message: why there is nothing to show
+    };
+
+private:
+    static constexpr size_t kWindow = size_t(1) << 20;
+    static constexpr size_t kCheckpoint = 64;       // lines per index entry
+    static constexpr size_t kMaxLineBytes = 1024;   // longer lines are cut for display
+    static constexpr size_t kSniffBytes = 64 * 1024;
+    static constexpr size_t kHexWidth = 16;
+    
+    struct Request {
+        std::string path;
+        size_t firstLine = 0;
+        size_t lineCount = 0;
+    };
+    
+    std::mutex mutex;  // guards the request and `published`
+    std::condition_variable wake;
+    Request wanted;
+    bool pending = false;
+    bool stopping = false;
+    View published;
+    std::atomic<bool> updated{false};
+    std::atomic<std::uint64_t> generation{0};  // bumped whenever another file is asked for
+    std::atomic<std::uint64_t> requests{0};    // bumped by every show(): a newer request abandons indexing
+    
+    // Loader thread only
+    int fd = -1;
+    std::string openPath;
+    std::uint64_t fileSize = 0;
+    int offsetDigits = 8;  // hex: wide enough for the last offset
+    Mode mode = Mode::None;
+    const char* window = nullptr;
+    std::uint64_t windowOffset = 0;
+    size_t windowLength = 0;
+    std::vector<std::uint64_t> checkpoints;  // offset of line k * kCheckpoint
+    std::uint64_t scanOffset = 0;
+    size_t newlines = 0;
+    bool indexed = false;
+    
+    std::thread loader;  // last: starts once everything above exists
+    
+    void unmap() {
+        if (window) {
+            munmap(const_cast<char*>(window), windowLength);
+            window = nullptr;
+        }
+    }
+    
+    void closeFile() {
+        unmap();
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+        openPath.clear();
+        checkpoints.assign(1, 0);
+        scanOffset = 0;
+        newlines = 0;
+        indexed = false;
+    }
+    
+    // Bytes from `offset` to the end of the window holding it, mapping one if needed
+    std::string_view bytesAt(std::uint64_t offset) {
+        if (!window || offset < windowOffset || offset >= windowOffset + windowLength) {
+            unmap();
+            // The file may have shrunk since: never map beyond its end (SIGBUS)
+            struct stat statBuf;
+            if (fstat(fd, &statBuf) == 0) {
+                fileSize = std::min<std::uint64_t>(fileSize, statBuf.st_size);
+            }
+            if (offset >= fileSize) {
+                return {};
+            }
+            static const std::uint64_t page = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+            windowOffset = offset - offset % page;
+            windowLength = static_cast<size_t>(std::min<std::uint64_t>(kWindow, fileSize - windowOffset));
+            void* mapped = mmap(nullptr, windowLength, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(windowOffset));
+            if (mapped == MAP_FAILED) {
+                return {};
+            }
+            window = static_cast<const char*>(mapped);
+            madvise(mapped, windowLength, MADV_SEQUENTIAL);
+        }
+        size_t skip = static_cast<size_t>(offset - windowOffset);
+        return std::string_view(window + skip, windowLength - skip);
+    }
+    
+    // Valid UTF-8 without the control bytes binaries are full of
+    bool looksLikeText(std::string_view sample, bool truncated) {
+        const char* p = sample.data();
+        const char* end = p + sample.size();
+        size_t controls = 0;
+        while (p < end) {
+            unsigned char c = static_cast<unsigned char>(*p);
+            if (c == 0) {
+                return false;
+            }
+            if (c < 0x20 && c != '\n' && c != '\r' && c != '\t' && c != '\f' && c != 0x1B) {
+                controls++;
+            }
+            if (c < 0x80) {
+                p++;
+                continue;
+            }
+            const char* start = p;
+            if (decodeUtf8(p, end) == 0xFFFD && !(end - start >= 3 && memcmp(start, "\xEF\xBF\xBD", 3) == 0)) {
+                // A sequence cut by the end of the sample is not an error
+                if (truncated && end - start < 4 && static_cast<unsigned char>(*start) >= 0xC0) {
+                    break;
+                }
+                return false;
+            }
+        }
+        return controls * 100 <= sample.size();
+    }
+    
+    bool openFile(const std::string& path, std::string& message) {
+        closeFile();
+        fd = open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+        struct stat statBuf;
+        if (fd == -1 || fstat(fd, &statBuf) == -1) {
+            message = std::string("cannot open: ") + strerror(errno);
+            return false;
+        }
+        if (!S_ISREG(statBuf.st_mode)) {
+            message = S_ISDIR(statBuf.st_mode) ? "directory" : "not a regular file";
+            return false;
+        }
+        openPath = path;
+        fileSize = statBuf.st_size;
+        std::string_view sample = bytesAt(0);
+        sample = sample.substr(0, kSniffBytes);
+        mode = looksLikeText(sample, fileSize > sample.size()) ? Mode::Text : Mode::Hex;
+        offsetDigits = 8;
+        while (offsetDigits < 16 && fileSize > 0 && ((fileSize - 1) >> (offsetDigits * 4)) != 0) {
+            offsetDigits++;
+        }
+        return true;
+    }
+    
+    // Index text lines until `line` is known or the file ends; false when abandoned for a
+    // newer request (the lines indexed so far are kept for it)
+    bool indexUpTo(size_t line, std::uint64_t myGeneration, std::uint64_t myRequest) {
+        while (!indexed && newlines < line) {
+            if (generation != myGeneration || requests != myRequest) {
+                return false;
+            }
+            std::string_view bytes = bytesAt(scanOffset);
+            if (bytes.empty()) {
+                indexed = true;
+                break;
+            }
+            const char* p = bytes.data();
+            const char* end = p + bytes.size();
+            while (const char* hit = static_cast<const char*>(memchr(p, '\n', end - p))) {
+                newlines++;
+                if (newlines % kCheckpoint == 0) {
+                    checkpoints.push_back(scanOffset + (hit + 1 - bytes.data()));
+                }
+                p = hit + 1;
+            }
+            scanOffset += bytes.size();
+            indexed = scanOffset >= fileSize;
+        }
+        return true;
+    }
+    
+    // Lines indexed so far; a last line without '\n' counts once the file is done
+    size_t knownLines() {
+        if (!indexed) {
+            return newlines;
+        }
+        std::string_view last = fileSize > 0 ? bytesAt(fileSize - 1) : std::string_view();
+        return newlines + (!last.empty() && last[0] != '\n');
+    }
+    
+    std::string textLine(size_t line) {
+        std::uint64_t offset = checkpoints[line / kCheckpoint];
+        for (size_t skip = line % kCheckpoint; skip > 0;) {
+            std::string_view bytes = bytesAt(offset);
+            if (bytes.empty()) {
+                return {};
+            }
+            const char* hit = static_cast<const char*>(memchr(bytes.data(), '\n', bytes.size()));
+            if (!hit) {
+                offset += bytes.size();
+                continue;
+            }
+            offset += hit + 1 - bytes.data();
+            skip--;
+        }
+        
+        std::string text;
+        while (text.size() < kMaxLineBytes) {
+            std::string_view bytes = bytesAt(offset);
+            if (bytes.empty()) {
+                break;
+            }
+            bytes = bytes.substr(0, kMaxLineBytes - text.size());
+            size_t end = bytes.find('\n');
+            text.append(bytes.substr(0, end));
+            if (end != std::string_view::npos) {
+                break;
+            }
+            offset += bytes.size();
+        }
+        std::string shown;
+        for (char c : text) {
+            if (c == '\t') {
+                shown.append(4 - shown.size() % 4, ' ');
+            } else if (c != '\r') {
+                shown += static_cast<unsigned char>(c) < 0x20 ? '.' : c;
+            }
+        }
+        return shown;
+    }
+    
+    std::string hexLine(size_t line) {
+        static const char digits[] = "0123456789abcdef";
+        std::uint64_t offset = static_cast<std::uint64_t>(line) * kHexWidth;
+        std::string_view bytes = bytesAt(offset);
+        if (bytes.size() < kHexWidth && offset + bytes.size() < fileSize) {
+            // Straddles two windows: map again from this line on
+            unmap();
+            bytes = bytesAt(offset);
+        }
+        bytes = bytes.substr(0, kHexWidth);
+        char text[16 + 2 + kHexWidth * 3 + 2 + kHexWidth + 2];
+        char* out = text;
+        for (int shift = (offsetDigits - 1) * 4; shift >= 0; shift -= 4) {
+            *out++ = digits[(offset >> shift) & 15];
+        }
+        *out++ = ' ';
+        for (size_t i = 0; i < kHexWidth; i++) {
+            *out++ = ' ';
+            bool present = i < bytes.size();
+            unsigned char c = present ? static_cast<unsigned char>(bytes[i]) : 0;
+            *out++ = present ? digits[c >> 4] : ' ';
+            *out++ = present ? digits[c & 15] : ' ';
+        }
+        *out++ = ' ';
+        *out++ = ' ';
+        for (char c : bytes) {
+            *out++ = c >= 0x20 && c < 0x7F ? c : '.';
+        }
+        return std::string(text, out);
+    }
+    
+    void publish(View view, std::uint64_t myGeneration) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (generation == myGeneration) {
+            published = std::move(view);
+            updated = true;
+        }
+    }
+    
+    void serve(const Request& request, std::uint64_t myGeneration, std::uint64_t myRequest) {
+        View view;
+        view.path = request.path;
+        if (request.path != openPath) {
+            std::string message;
+            if (!openFile(request.path, message)) {
+                closeFile();
+                view.mode = Mode::Message;
+                view.message = message;
+                publish(std::move(view), myGeneration);
+                return;
+            }
+        }
+        view.mode = mode;
+        view.size = fileSize;
+        if (mode == Mode::Hex) {
+            view.knownLines = static_cast<size_t>((fileSize + kHexWidth - 1) / kHexWidth);
+            view.complete = true;
+        } else {
+            if (!indexUpTo(request.firstLine + request.lineCount, myGeneration, myRequest)) {
+                return;
+            }
+            view.knownLines = knownLines();
+            view.complete = indexed;
+        }
+        
+        // Past the end: show the last page instead
+        size_t first = request.firstLine;
+        if (view.complete && first + request.lineCount > view.knownLines) {
+            first = view.knownLines > request.lineCount ? view.knownLines - request.lineCount : 0;
+        }
+        view.firstLine = first;
+        for (size_t line = first; line < first + request.lineCount && line < view.knownLines; line++) {
+            view.lines.push_back(mode == Mode::Hex ? hexLine(line) : textLine(line));
+        }
+        publish(std::move(view), myGeneration);
+    }
+    
+    void loaderLoop() {
+        for (;;) {
+            Request request;
+            std::uint64_t myGeneration, myRequest;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || pending; });
+                if (stopping) {
+                    break;
+                }
+                request = wanted;
+                pending = false;
+                myGeneration = generation;
+                myRequest = requests;
+            }
+            serve(request, myGeneration, myRequest);
+        }
+        closeFile();
+    }
+
+public:
+    FilePreview() {
+        checkpoints.assign(1, 0);
+        loader = std::thread([this]() { loaderLoop(); });
+    }
+    
+    ~FilePreview() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            generation++;  // abandon any indexing in progress
+        }
+        wake.notify_one();
+        loader.join();
+    }
+    
+    FilePreview(const FilePreview&) = delete;
+    FilePreview& operator=(const FilePreview&) = delete;
+    
+    // Ask for lineCount lines from firstLine; the answer arrives through takeUpdate()
+    void show(const std::string& path, size_t firstLine, size_t lineCount) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (path != wanted.path) {
+                generation++;
+            }
+            requests++;
+            wanted = {path, firstLine, lineCount};
+            pending = true;
+        }
+        wake.notify_one();
+    }
+    
+    // True once after a new view was published; the view is copied out
+    bool takeUpdate(View& view) {
+        if (!updated.exchange(false)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        view = published;
+        return true;
+    }
+};
+
+// Aggregates for the statistics view. Every field is a sum or a bounded top list,
+// so results for disjoint row ranges merge into the result for their union.
+// Bytes are allocated bytes with hardlinks counted once, as in the unique total.
+struct TableStatistics {
+    struct Bucket {
+        std::uint64_t count = 0;
+        std::uint64_t bytes = 0;
+        
+        void add(std::uint64_t size) {
+            count++;
+            bytes += size;
+        }
+        
+        void merge(const Bucket& other) {
+            count += other.count;
+            bytes += other.bytes;
+        }
+    };
+    
+    static constexpr int kSizeBuckets = 48;  // 0 = empty, k = [2^(k-1), 2^k) bytes, the last one open-ended
+    static constexpr int kAgeBuckets = 8;
+    static constexpr size_t kTop = 20;
+    
+    size_t rows = 0;
+    Bucket files;
+    Bucket directories;
+    std::array<Bucket, kSizeBuckets> sizes{};  // files only
+    std::array<Bucket, kAgeBuckets> ages{};
+    std::unordered_map<std::string, Bucket> extensions;  // lower case, "" = none
+    std::unordered_map<std::uint32_t, Bucket> owners;
+    std::unordered_map<std::uint32_t, Bucket> groups;
+    std::vector<std::pair<std::uint64_t, size_t>> largestFiles;             // (bytes, row), largest first
+    std::vector<std::pair<std::uint64_t, std::string>> largestDirectories;  // (bytes below it, path), largest first
+    
+    static int sizeBucket(std::uint64_t size) {
+        int bits = 0;
+        for (; size != 0 && bits < kSizeBuckets - 1; size >>= 1) {
+            bits++;
+        }
+        return bits;
+    }
+    
+    static const char* ageLabel(int bucket) {
+        static const char* const labels[kAgeBuckets] = {"in the future", "< 1 day", "< 1 week", "< 1 month",
+                                                        "< 3 months", "< 1 year", "< 3 years", "older"};
+        return labels[bucket];
+    }
+    
+    static int ageBucket(std::int64_t mtime, std::int64_t now) {
+        static const std::int64_t limits[] = {86400, 7 * 86400, 30 * 86400, 91 * 86400, 365 * 86400, 3 * 365 * 86400};
+        if (mtime > now) {
+            return 0;
+        }
+        int bucket = 1;
+        while (bucket < kAgeBuckets - 1 && now - mtime >= limits[bucket - 1]) {
+            bucket++;
+        }
+        return bucket;
+    }
+};
+
+// Keep the `limit` largest items in a min-heap (smallest on top)
+template <typename Item>
+void pushBounded(std::vector<Item>& heap, Item item, size_t limit) {
+    auto greater = [](const Item& a, const Item& b) { return a.first > b.first; };
+    if (heap.size() < limit) {
+        heap.push_back(std::move(item));
+        std::push_heap(heap.begin(), heap.end(), greater);
+    } else if (item.first > heap.front().first) {
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        heap.back() = std::move(item);
+        std::push_heap(heap.begin(), heap.end(), greater);
+    }
+}
+
+// Parallel reduction over a FileTable: each task folds a range of chunks into its
+// own TableStatistics through FileTable::forEachFact (no chunk is decoded), the
+// partials are merged, and directory totals are rolled up once, level by level.
+class StatisticsBuilder {
+private:
+    using ParentBytes = std::unordered_map<std::string, std::uint64_t>;
+    
+    static void scanChunks(const FileTable& table, size_t begin, size_t end, const std::vector<char>* only,
+                           std::int64_t now, TableStatistics& stats, ParentBytes& parents) {
+        std::uint32_t lastUid = UINT32_MAX, lastGid = UINT32_MAX;
+        TableStatistics::Bucket* owner = nullptr;
+        TableStatistics::Bucket* group = nullptr;
+        std::string extension, parent;
+        std::uint64_t parentBytes = 0;  // bytes of the current run of siblings, added to `parents` when it ends
+        
+        for (size_t c = begin; c < end; c++) {
+            table.forEachFact(c, [&](size_t row, const FileTable::RowFacts& facts) {
+                if (only && (row >= only->size() || !(*only)[row])) {
+                    return;
+                }
+                stats.rows++;
+                std::uint64_t bytes = facts.isExtraLink ? 0 : facts.allocatedSize;
+                (facts.isDirectory ? stats.directories : stats.files).add(bytes);
+                stats.ages[TableStatistics::ageBucket(facts.mtime, now)].add(bytes);
+                if (facts.uid != lastUid) {
+                    lastUid = facts.uid;
+                    owner = &stats.owners[facts.uid];
+                }
+                owner->add(bytes);
+                if (facts.gid != lastGid) {
+                    lastGid = facts.gid;
+                    group = &stats.groups[facts.gid];
+                }
+                group->add(bytes);
                 
-                case 3: // Permissions
-                {
-                    // Parse permissions string (e.g., "drwxr-xr-x")
-                    if (newValue.length() != 10) {
-                        if (logger) {
-                            logger->logUnreadableFile(filePath, "chmod", "Invalid permissions format: " + newValue);
-                        }
-                        return false;
-                    }
-                    
-                    mode_t mode = 0;
-                    
-                    // Owner permissions
-                    if (newValue[1] == 'r') mode |= S_IRUSR;
-                    if (newValue[2] == 'w') mode |= S_IWUSR;
-                    if (newValue[3] == 'x') mode |= S_IXUSR;
-                    
-                    // Group permissions
-                    if (newValue[4] == 'r') mode |= S_IRGRP;
-                    if (newValue[5] == 'w') mode |= S_IWGRP;
-                    if (newValue[6] == 'x') mode |= S_IXGRP;
-                    
-                    // Others permissions
-                    if (newValue[7] == 'r') mode |= S_IROTH;
-                    if (newValue[8] == 'w') mode |= S_IWOTH;
-                    if (newValue[9] == 'x' || newValue[9] == 't') mode |= S_IXOTH;
-                    
-                    // Sticky bit
-                    if (newValue[9] == 't' || newValue[9] == 'T') mode |= S_ISVTX;
-                    
-                    if (chmod(filePath.c_str(), mode) == -1) {
-                        if (logger) {
-                            logger->logUnreadableFile(filePath, "chmod", std::string("chmod failed: ") + strerror(errno));
+                size_t slash = facts.name.rfind('/');
+                std::string_view base = slash == std::string_view::npos ? facts.name : facts.name.substr(slash + 1);
+                if (!facts.isDirectory) {
+                    stats.sizes[TableStatistics::sizeBucket(facts.actualSize)].add(bytes);
+                    size_t dot = base.rfind('.');
+                    extension.clear();
+                    if (dot != std::string_view::npos && dot > 0 && base.size() - dot <= 16) {
+                        for (char ch : base.substr(dot + 1)) {
+                            extension.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(ch))));
                         }
-                        return false;
                     }
-                    
-                    if (logger) {
-                        logger->logFileModification(filePath, "chmod", "Changed permissions to: " + newValue);
+                    stats.extensions[extension].add(bytes);
+                    pushBounded(stats.largestFiles, std::make_pair(bytes, row), TableStatistics::kTop);
+                }
+                
+                // Siblings are mostly adjacent in table order
+                std::string_view dir = slash == std::string_view::npos ? std::string_view() : facts.name.substr(0, slash == 0 ? 1 : slash);
+                if (dir != parent) {
+                    if (parentBytes > 0) {
+                        parents[parent] += parentBytes;
                     }
-                    
-                    return reloadSingleFile(filePath);
+                    parent.assign(dir.data(), dir.size());
+                    parentBytes = 0;
+                }
+                parentBytes += bytes;
+            });
+        }
+        if (parentBytes > 0) {
+            parents[parent] += parentBytes;
+        }
+    }
+    
+    static void merge(TableStatistics& into, TableStatistics& from) {
+        into.rows += from.rows;
+        into.files.merge(from.files);
+        into.directories.merge(from.directories);
+        for (int b = 0; b < TableStatistics::kSizeBuckets; b++) {
+            into.sizes[b].merge(from.sizes[b]);
+        }
+        for (int b = 0; b < TableStatistics::kAgeBuckets; b++) {
+            into.ages[b].merge(from.ages[b]);
+        }
+        for (const auto& [key, bucket] : from.extensions) {
+            into.extensions[key].merge(bucket);
+        }
+        for (const auto& [key, bucket] : from.owners) {
+            into.owners[key].merge(bucket);
+        }
+        for (const auto& [key, bucket] : from.groups) {
+            into.groups[key].merge(bucket);
+        }
+        for (const auto& item : from.largestFiles) {
+            pushBounded(into.largestFiles, item, TableStatistics::kTop);
+        }
+    }
+    
+    // Direct bytes per directory -> bytes of the whole subtree, deepest level first,
+    // so every directory is added to its parent exactly once
+    static void rollUpDirectories(ParentBytes& totals, const std::string& root, TableStatistics& stats) {
+        std::vector<std::vector<ParentBytes::value_type*>> levels;
+        auto enqueue = [&](ParentBytes::value_type* entry) {
+            size_t depth = static_cast<size_t>(std::count(entry->first.begin(), entry->first.end(), '/'));
+            if (levels.size() <= depth) {
+                levels.resize(depth + 1);
+            }
+            levels[depth].push_back(entry);
+        };
+        for (auto& entry : totals) {
+            enqueue(&entry);
+        }
+        for (size_t depth = levels.size(); depth-- > 0;) {
+            // By index: "/" has as many slashes as its children and joins the level being walked
+            for (size_t k = 0; k < levels[depth].size(); k++) {
+                ParentBytes::value_type* entry = levels[depth][k];
+                const std::string& path = entry->first;
+                if (path.size() <= root.size()) {
+                    continue;  // the scan root and above
+                }
+                size_t slash = path.rfind('/');
+                std::string parentPath = path.substr(0, slash == 0 ? 1 : slash);
+                auto [it, inserted] = totals.try_emplace(parentPath, 0);  // node addresses survive rehashing
+                it->second += entry->second;
+                if (inserted) {
+                    enqueue(&*it);
+                }
+                pushBounded(stats.largestDirectories, std::make_pair(entry->second, path), TableStatistics::kTop);
+            }
+        }
+    }
+
+public:
+    // Statistics of the rows of `table`, or of the rows flagged in `only` (the selection)
+    static TableStatistics build(const FileTable& table, const std::string& root, const std::vector<char>* only = nullptr) {
+        size_t chunkCount = table.chunkCount();
+        size_t threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+        size_t tasks = std::max<size_t>(1, std::min(chunkCount, threads * 4));
+        std::vector<TableStatistics> partial(tasks);
+        std::vector<ParentBytes> parents(tasks);
+        std::int64_t now = static_cast<std::int64_t>(time(nullptr));
+        {
+            ThreadPool pool(std::min(threads, tasks));
+            for (size_t t = 0; t < tasks; t++) {
+                size_t begin = t * chunkCount / tasks;
+                size_t end = (t + 1) * chunkCount / tasks;
+                pool.submit([&, t, begin, end] { scanChunks(table, begin, end, only, now, partial[t], parents[t]); });
+            }
+            pool.waitIdle();
+        }
+        
+        TableStatistics stats = std::move(partial[0]);
+        ParentBytes totals = std::move(parents[0]);
+        for (size_t t = 1; t < tasks; t++) {
+            merge(stats, partial[t]);
+            for (const auto& [path, bytes] : parents[t]) {
+                totals[path] += bytes;
+            }
+        }
+        rollUpDirectories(totals, root, stats);
+        
+        auto largestFirst = [](const auto& a, const auto& b) { return a.first > b.first; };
+        std::sort(stats.largestFiles.begin(), stats.largestFiles.end(), largestFirst);
+        std::sort(stats.largestDirectories.begin(), stats.largestDirectories.end(), largestFirst);
+        return stats;
+    }
+};
+
+// uid/gid -> name through getpwuid_r/getgrgid_r; every id is looked up once
+class OwnerNames {
+private:
+    std::unordered_map<uid_t, std::string> users;
+    std::unordered_map<gid_t, std::string> groups;
+    std::vector<char> buffer;
+    
+    // Calls lookup(buffer) until the buffer is big enough; returns its result
+    template <typename Lookup>
+    bool withBuffer(Lookup&& lookup) {
+        if (buffer.empty()) {
+            long suggested = sysconf(_SC_GETPW_R_SIZE_MAX);
+            buffer.resize(suggested > 0 ? static_cast<size_t>(suggested) : 16384);
+        }
+        for (;;) {
+            int error = lookup(buffer);
+            if (error != ERANGE || buffer.size() >= (1 << 20)) {
+                return error == 0;
+            }
+            buffer.resize(buffer.size() * 2);
+        }
+    }
+
+public:
+    const std::string& user(uid_t uid) {
+        auto it = users.find(uid);
+        if (it != users.end()) {
+            return it->second;
+        }
+        struct passwd entry;
+        struct passwd* found = nullptr;
+        bool ok = withBuffer([&](std::vector<char>& space) {
+            return getpwuid_r(uid, &entry, space.data(), space.size(), &found);
+        });
+        return users[uid] = ok && found ? found->pw_name : std::to_string(uid);
+    }
+    
+    const std::string& group(gid_t gid) {
+        auto it = groups.find(gid);
+        if (it != groups.end()) {
+            return it->second;
+        }
+        struct group entry;
+        struct group* found = nullptr;
+        bool ok = withBuffer([&](std::vector<char>& space) {
+            return getgrgid_r(gid, &entry, space.data(), space.size(), &found);
+        });
+        return groups[gid] = ok && found ? found->gr_name : std::to_string(gid);
+    }
+};
+
+// Directory tree of a FileTable for the treemap: node 0 is the scan root, node
+// i + 1 is row i. Sizes are whole-subtree allocated bytes (hardlinks once).
+// Children are kept in one array (CSR) and sorted by size only when first laid out.
+class SizeTree {
+public:
+    struct Node {
+        std::uint64_t bytes = 0;
+        std::uint32_t parent = 0;
+        std::uint16_t extension = 0;  // hash of the lower-case extension, 0 = none
+        std::uint8_t age = 0;         // TableStatistics::ageBucket of mtime
+        std::uint8_t isDirectory = 0;
+    };
+    
+    static std::uint32_t rowOf(std::uint32_t node) { return node - 1; }
+
+private:
+    std::vector<Node> nodes;
+    std::vector<std::uint32_t> childStart;  // children of n: childList[childStart[n] .. childStart[n + 1])
+    std::vector<std::uint32_t> childList;
+    std::vector<char> sorted;
+    
+    static std::uint16_t extensionKey(std::string_view name) {
+        size_t slash = name.rfind('/');
+        std::string_view base = slash == std::string_view::npos ? name : name.substr(slash + 1);
+        size_t dot = base.rfind('.');
+        if (dot == std::string_view::npos || dot == 0 || base.size() - dot > 16) {
+            return 0;
+        }
+        std::uint32_t hash = 2166136261u;  // FNV-1a
+        for (char ch : base.substr(dot + 1)) {
+            hash = (hash ^ static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(ch)))) * 16777619u;
+        }
+        return static_cast<std::uint16_t>((hash ^ (hash >> 16)) | 1);
+    }
+
+public:
+    // One pass to find parents, one to group children, one post-order pass to add up sizes
+    void build(const FileTable& table, const std::string& root) {
+        size_t count = table.size();
+        nodes.assign(count + 1, Node());
+        nodes[0].isDirectory = 1;
+        
+        std::string rootPath = root.size() > 1 && root.back() == '/' ? root.substr(0, root.size() - 1) : root;
+        std::unordered_map<std::string, std::uint32_t> directories;
+        directories.emplace(rootPath, 0);
+        table.forEachName([&](size_t row, std::string_view name) {
+            if (table.isDirectoryAt(row)) {
+                directories.emplace(std::string(name), static_cast<std::uint32_t>(row + 1));
+            }
+        });
+        
+        std::int64_t now = static_cast<std::int64_t>(time(nullptr));
+        std::string lastParent;
+        std::uint32_t lastParentNode = 0;
+        for (size_t c = 0; c < table.chunkCount(); c++) {
+            table.forEachFact(c, [&](size_t row, const FileTable::RowFacts& facts) {
+                Node& node = nodes[row + 1];
+                node.bytes = facts.isExtraLink ? 0 : facts.allocatedSize;
+                node.isDirectory = facts.isDirectory;
+                node.age = static_cast<std::uint8_t>(TableStatistics::ageBucket(facts.mtime, now));
+                node.extension = facts.isDirectory ? 0 : extensionKey(facts.name);
+                
+                size_t slash = facts.name.rfind('/');
+                std::string_view parent = slash == std::string_view::npos ? std::string_view() : facts.name.substr(0, slash == 0 ? 1 : slash);
+                if (parent != lastParent) {
+                    lastParent.assign(parent.data(), parent.size());
+                    auto it = directories.find(lastParent);
+                    lastParentNode = it != directories.end() ? it->second : 0;  // outside the tree: under the root
+                }
+                node.parent = lastParentNode;
+            });
+        }
+        
+        childStart.assign(nodes.size() + 1, 0);
+        for (size_t n = 1; n < nodes.size(); n++) {
+            childStart[nodes[n].parent + 1]++;
+        }
+        for (size_t n = 0; n < nodes.size(); n++) {
+            childStart[n + 1] += childStart[n];
+        }
+        childList.assign(nodes.size() - 1, 0);
+        std::vector<std::uint32_t> fill(childStart.begin(), childStart.end() - 1);
+        for (size_t n = 1; n < nodes.size(); n++) {
+            childList[fill[nodes[n].parent]++] = static_cast<std::uint32_t>(n);
+        }
+        sorted.assign(nodes.size(), 0);
+        
+        // Post-order without recursion: a node is added to its parent after all of its children
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> stack{{0, childStart[0]}};
+        while (!stack.empty()) {
+            auto& [node, next] = stack.back();
+            if (next < childStart[node + 1]) {
+                std::uint32_t child = childList[next++];
+                stack.push_back({child, childStart[child]});
+            } else {
+                std::uint32_t done = node;
+                stack.pop_back();
+                if (!stack.empty()) {
+                    nodes[stack.back().first].bytes += nodes[done].bytes;
+                }
+            }
+        }
+    }
+    
+    bool empty() const { return nodes.empty(); }
+    const Node& node(std::uint32_t n) const { return nodes[n]; }
+    
+    // Children, largest first (sorted on the first call for each node)
+    std::pair<const std::uint32_t*, const std::uint32_t*> children(std::uint32_t n) {
+        std::uint32_t* begin = childList.data() + childStart[n];
+        std::uint32_t* end = childList.data() + childStart[n + 1];
+        if (!sorted[n]) {
+            std::sort(begin, end, [this](std::uint32_t a, std::uint32_t b) { return nodes[a].bytes > nodes[b].bytes; });
+            sorted[n] = 1;
+        }
+        return {begin, end};
+    }
+};
+
+// Squarified treemap (Bruls, Huizing, van Wijk) over a SizeTree. Only what resolves
+// to pixels is laid out: a directory is entered only if its rectangle can show
+// something, and the children too small to see are drawn as one filler rectangle.
+// The layout of every zoom level is cached, so zooming back out costs nothing.
+class TreemapView {
+public:
+    enum class ColorMode { Extension, Age };
+    
+    struct Cell {
+        sf::FloatRect rect;
+        std::uint32_t node;  // kFiller for the small children of a directory
+        std::uint16_t depth;
+    };
+    static constexpr std::uint32_t kFiller = UINT32_MAX;
+
+private:
+    static constexpr float kMinArea = 4.0f;   // px^2; anything smaller joins the filler
+    static constexpr float kInset = 1.0f;     // gap around the children of a directory
+    static constexpr float kMinNested = 6.0f; // side a directory needs before its children are drawn
+    static constexpr size_t kCachedLayouts = 16;
+    
+    struct Layout {
+        std::uint32_t root;
+        sf::Vector2f size;
+        std::vector<Cell> cells;
+    };
+    
+    SizeTree tree;
+    std::vector<std::uint32_t> zoomPath{0};
+    sf::FloatRect viewport;
+    ColorMode colorMode = ColorMode::Extension;
+    std::deque<Layout> layouts;  // most recent first
+    sf::VertexArray vertices{sf::PrimitiveType::Triangles};
+    
+    void layoutChildren(std::uint32_t parent, sf::FloatRect rect, std::uint16_t depth, std::vector<Cell>& out) {
+        auto [begin, end] = tree.children(parent);
+        double total = 0;
+        for (const std::uint32_t* it = begin; it != end; ++it) {
+            total += static_cast<double>(tree.node(*it).bytes);
+        }
+        if (total <= 0 || rect.size.x < 1 || rect.size.y < 1) {
+            return;
+        }
+        double scale = static_cast<double>(rect.size.x) * rect.size.y / total;
+        double x = rect.position.x, y = rect.position.y, w = rect.size.x, h = rect.size.y;
+        
+        const std::uint32_t* i = begin;
+        while (i != end) {
+            double first = static_cast<double>(tree.node(*i).bytes) * scale;
+            if (first < kMinArea || w < 1 || h < 1) {
+                out.push_back({sf::FloatRect({float(x), float(y)}, {float(w), float(h)}), kFiller, depth});
+                return;
+            }
+            // Grow the row while its worst aspect ratio keeps improving
+            double side = std::min(w, h);
+            double rowArea = 0, worst = std::numeric_limits<double>::infinity();
+            const std::uint32_t* rowEnd = i;
+            while (rowEnd != end) {
+                double area = static_cast<double>(tree.node(*rowEnd).bytes) * scale;
+                if (area < kMinArea) {
+                    break;
                 }
-                
-                default:
-                    if (logger) {
-                        logger->logUnreadableFile(filePath, "update_metadata", 
-                            "Cannot modify column " + std::to_string(columnIndex) + " (read-only)");
-                    }
-                    return false;
+                double sum = rowArea + area;
+                double ratio = std::max(side * side * first / (sum * sum), sum * sum / (side * side * area));
+                if (ratio > worst) {
+                    break;
+                }
+                worst = ratio;
+                rowArea = sum;
+                ++rowEnd;
+            }
+            
+            double thickness = rowArea / side;
+            double offset = 0;
+            for (const std::uint32_t* it = i; it != rowEnd; ++it) {
+                double length = static_cast<double>(tree.node(*it).bytes) * scale / thickness;
+                sf::FloatRect cell = w >= h ? sf::FloatRect({float(x), float(y + offset)}, {float(thickness), float(length)})
+                                            : sf::FloatRect({float(x + offset), float(y)}, {float(length), float(thickness)});
+                offset += length;
+                place(*it, cell, depth, out);
+            }
+            if (w >= h) {
+                x += thickness;
+                w -= thickness;
+            } else {
+                y += thickness;
+                h -= thickness;
+            }
+            i = rowEnd;
+        }
+    }
+    
+    void place(std::uint32_t node, sf::FloatRect rect, std::uint16_t depth, std::vector<Cell>& out) {
+        out.push_back({rect, node, depth});
+        if (tree.node(node).isDirectory && rect.size.x >= kMinNested && rect.size.y >= kMinNested) {
+            sf::FloatRect inner({rect.position.x + kInset, rect.position.y + kInset},
+                                {rect.size.x - 2 * kInset, rect.size.y - 2 * kInset});
+            layoutChildren(node, inner, static_cast<std::uint16_t>(depth + 1), out);
+        }
+    }
+    
+    const Layout& currentLayout() {
+        std::uint32_t root = zoomPath.back();
+        for (auto it = layouts.begin(); it != layouts.end(); ++it) {
+            if (it->root == root && it->size == viewport.size) {
+                if (it != layouts.begin()) {
+                    layouts.push_front(std::move(*it));
+                    layouts.erase(std::next(it));
+                }
+                return layouts.front();
+            }
+        }
+        Layout layout{root, viewport.size, {}};
+        layoutChildren(root, sf::FloatRect({0, 0}, viewport.size), 0, layout.cells);
+        layouts.push_front(std::move(layout));
+        if (layouts.size() > kCachedLayouts) {
+            layouts.pop_back();
+        }
+        return layouts.front();
+    }
+    
+    sf::Color colorOf(const Cell& cell) const {
+        if (cell.node == kFiller) {
+            return sf::Color(70, 70, 70);
+        }
+        const SizeTree::Node& node = tree.node(cell.node);
+        if (node.isDirectory) {
+            std::uint8_t shade = static_cast<std::uint8_t>(std::max(25, 55 - 5 * cell.depth));
+            return sf::Color(shade, shade, shade);
+        }
+        if (colorMode == ColorMode::Age) {
+            // Recent = green, through yellow, to old = dark red
+            static const sf::Color palette[TableStatistics::kAgeBuckets] = {
+                {120, 120, 255}, {80, 220, 100}, {140, 220, 80}, {200, 210, 70},
+                {230, 170, 60}, {220, 110, 50}, {180, 60, 40}, {110, 35, 30}};
+            return palette[node.age];
+        }
+        if (node.extension == 0) {
+            return sf::Color(150, 150, 150);
+        }
+        // Hue from the extension hash, fixed saturation and value
+        float hue = static_cast<float>(node.extension % 360);
+        float c = 0.85f * 0.55f;
+        float xPart = c * (1 - std::fabs(std::fmod(hue / 60.0f, 2.0f) - 1));
+        float m = 0.85f - c;
+        float r = 0, g = 0, b = 0;
+        switch (static_cast<int>(hue / 60)) {
+            case 0: r = c; g = xPart; break;
+            case 1: r = xPart; g = c; break;
+            case 2: g = c; b = xPart; break;
+            case 3: g = xPart; b = c; break;
+            case 4: r = xPart; b = c; break;
+            default: r = c; b = xPart; break;
+        }
+        return sf::Color(static_cast<std::uint8_t>((r + m) * 255), static_cast<std::uint8_t>((g + m) * 255),
+                         static_cast<std::uint8_t>((b + m) * 255));
+    }
+    
+    void rebuildVertices() {
+        const Layout& layout = currentLayout();
+        vertices.clear();
+        for (const Cell& cell : layout.cells) {
+            sf::Color color = colorOf(cell);
+            sf::Vector2f a = viewport.position + cell.rect.position;
+            sf::Vector2f b = a + cell.rect.size;
+            sf::Vector2f corners[6] = {a, {b.x, a.y}, b, a, b, {a.x, b.y}};
+            for (const sf::Vector2f& corner : corners) {
+                vertices.append(sf::Vertex{corner, color, {}});
+            }
+        }
+    }
+
+public:
+    void build(const FileTable& table, const std::string& root) {
+        tree.build(table, root);
+        zoomPath.assign(1, 0);
+        layouts.clear();
+        rebuildVertices();
+    }
+    
+    void setViewport(sf::FloatRect area) {
+        viewport = area;
+        if (!tree.empty()) {
+            rebuildVertices();
+        }
+    }
+    
+    void toggleColorMode() {
+        colorMode = colorMode == ColorMode::Extension ? ColorMode::Age : ColorMode::Extension;
+        rebuildVertices();
+    }
+    
+    ColorMode getColorMode() const { return colorMode; }
+    const sf::VertexArray& getVertices() const { return vertices; }
+    const std::vector<Cell>& cells() { return currentLayout().cells; }
+    std::uint32_t zoomRoot() const { return zoomPath.back(); }
+    const SizeTree::Node& node(std::uint32_t n) const { return tree.node(n); }
+    
+    // Deepest cell under a window position, or nullptr
+    const Cell* cellAt(sf::Vector2f point) {
+        const std::vector<Cell>& all = currentLayout().cells;
+        sf::Vector2f local = point - viewport.position;
+        for (auto it = all.rbegin(); it != all.rend(); ++it) {  // children come after their parent
+            if (it->rect.contains(local)) {
+                return &*it;
+            }
+        }
+        return nullptr;
+    }
+    
+    // Zoom into the directory under the point that is a direct child of the current root
+    bool zoomIn(sf::Vector2f point) {
+        const Cell* cell = cellAt(point);
+        if (!cell || cell->node == kFiller) {
+            return false;
+        }
+        std::uint32_t node = cell->node;
+        while (tree.node(node).parent != zoomPath.back()) {
+            node = tree.node(node).parent;
+        }
+        if (!tree.node(node).isDirectory) {
+            return false;
+        }
+        zoomPath.push_back(node);
+        rebuildVertices();
+        return true;
+    }
+    
+    bool zoomOut() {
+        if (zoomPath.size() == 1) {
+            return false;
+        }
+        zoomPath.pop_back();
+        rebuildVertices();
+        return true;
+    }
+};
+
+// One entry of a saved scan. Paths are relative to the snapshot root so two
+// snapshots of the same tree compare equal even if it was mounted elsewhere.
+struct SnapshotEntry {
+    std::string path;
+    std::uint64_t size = 0;
+    std::uint64_t allocated = 0;
+    std::int64_t mtime = 0;
+    std::uint32_t mode = 0;
+};
+
+// Source of entries in ascending byte order of path
+class SnapshotEntryStream {
+public:
+    virtual ~SnapshotEntryStream() = default;
+    virtual bool next(SnapshotEntry& entry) = 0;
+};
+
+// Snapshot file: "TBLSNAP2", u32 rootLength, root, then per entry
+// varint shared, varint suffixLength, suffix, u64 size, u64 allocated, i64 mtime, u32 mode,
+// where the path is the first `shared` bytes of the previous path plus the suffix.
+// Version 1 ("TBLSNAP1") stored u32 pathLength and the whole path; it is still read.
+// Entries must be added in path order; the file is written sequentially.
+class SnapshotWriter {
+private:
+    BufferedFileWriter out;
+    std::string previousPath;
+    
+    void appendU32(std::uint32_t value) { out.append(&value, sizeof(value)); }
+    void appendU64(std::uint64_t value) { out.append(&value, sizeof(value)); }
+    
+    void appendVarint(size_t value) {
+        char bytes[10];
+        size_t n = 0;
+        for (; value >= 0x80; value >>= 7) {
+            bytes[n++] = static_cast<char>(value | 0x80);
+        }
+        bytes[n++] = static_cast<char>(value);
+        out.append(bytes, n);
+    }
+
+public:
+    bool open(const std::string& path, const std::string& root) {
+        if (!out.open(path)) {
+            return false;
+        }
+        out.append("TBLSNAP2", 8);
+        appendU32(static_cast<std::uint32_t>(root.size()));
+        out.append(root);
+        previousPath.clear();
+        return true;
+    }
+    
+    void add(const SnapshotEntry& entry) {
+        size_t shared = 0;
+        size_t limit = std::min(previousPath.size(), entry.path.size());
+        while (shared < limit && previousPath[shared] == entry.path[shared]) {
+            shared++;
+        }
+        appendVarint(shared);
+        appendVarint(entry.path.size() - shared);
+        out.append(entry.path.data() + shared, entry.path.size() - shared);
+        previousPath = entry.path;
+        appendU64(entry.size);
+        appendU64(entry.allocated);
+        appendU64(static_cast<std::uint64_t>(entry.mtime));
+        appendU32(entry.mode);
+    }
+    
+    bool finish() {
+        return out.close();
+    }
+};
+
+// Streams a snapshot file through a fixed buffer; memory does not depend on its size
+class SnapshotReader : public SnapshotEntryStream {
+private:
+    // Bound for a single field when the size of the input is unknown (a pipe)
+    static constexpr std::uint64_t kMaxUnsizedField = std::uint64_t(16) << 20;
+    
+    int fd = -1;
+    std::vector<char> buffer;
+    size_t begin = 0;
+    size_t end = 0;
+    std::uint64_t fileSize = UINT64_MAX;  // regular files only
+    std::uint64_t bytesRead = 0;
+    std::string rootPath;
+    bool frontCoded = false;  // TBLSNAP2
+    std::string previousPath;
+    bool truncated = false;
+    
+    // Make at least `count` bytes available at buffer[begin]. Lengths come from the
+    // file, so one that runs past its end is corruption, not a reason to allocate.
+    bool fill(size_t count) {
+        if (end - begin >= count) {
+            return true;
+        }
+        std::uint64_t missing = count - (end - begin);
+        std::uint64_t left = fileSize == UINT64_MAX ? kMaxUnsizedField : fileSize - std::min(fileSize, bytesRead);
+        if (missing > left) {
+            return false;
+        }
+        if (count > buffer.size()) {
+            buffer.resize(count);
+        }
+        std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+        while (end < count) {
+            ssize_t n = read(fd, buffer.data() + end, buffer.size() - end);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            end += static_cast<size_t>(n);
+            bytesRead += static_cast<std::uint64_t>(n);
+        }
+        return true;
+    }
+    
+    template <typename T>
+    bool take(T& value) {
+        if (!fill(sizeof(T))) {
+            return false;
+        }
+        std::memcpy(&value, buffer.data() + begin, sizeof(T));
+        begin += sizeof(T);
+        return true;
+    }
+    
+    bool takeString(std::string& value, size_t length) {
+        if (!fill(length)) {
+            return false;
+        }
+        value.assign(buffer.data() + begin, length);
+        begin += length;
+        return true;
+    }
+    
+    bool takeVarint(size_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            std::uint8_t byte = 0;
+            if (!take(byte)) {
+                return false;
+            }
+            value |= static_cast<size_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    bool takePath(std::string& path) {
+        if (!frontCoded) {
+            std::uint32_t length = 0;
+            return take(length) && takeString(path, length);
+        }
+        size_t shared = 0, suffix = 0;
+        if (!takeVarint(shared) || !takeVarint(suffix) || shared > previousPath.size() || !fill(suffix)) {
+            return false;
+        }
+        previousPath.resize(shared);
+        previousPath.append(buffer.data() + begin, suffix);
+        begin += suffix;
+        path = previousPath;
+        return true;
+    }
+
+public:
+    SnapshotReader() : buffer(1 << 20) {}
+    
+    ~SnapshotReader() override {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+    
+    bool open(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return false;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        struct stat statBuf;
+        if (fstat(fd, &statBuf) == 0 && S_ISREG(statBuf.st_mode)) {
+            fileSize = static_cast<std::uint64_t>(statBuf.st_size);
+        }
+        
+        std::string magic;
+        std::uint32_t rootLength = 0;
+        if (!takeString(magic, 8) || (magic != "TBLSNAP1" && magic != "TBLSNAP2")) {
+            return false;
+        }
+        frontCoded = magic == "TBLSNAP2";
+        return take(rootLength) && takeString(rootPath, rootLength);
+    }
+    
+    const std::string& root() const {
+        return rootPath;
+    }
+    
+    // Whether next() stopped at a cut-off or malformed entry instead of the end of
+    // the file; a diff against such a snapshot would report its lost tail as changes
+    bool damaged() const {
+        return truncated;
+    }
+    
+    bool next(SnapshotEntry& entry) override {
+        if (begin == end && !fill(1)) {
+            return false;
+        }
+        std::uint64_t mtime = 0;
+        if (!takePath(entry.path) || !take(entry.size) || !take(entry.allocated) || !take(mtime) || !take(entry.mode)) {
+            truncated = true;
+            return false;
+        }
+        entry.mtime = static_cast<std::int64_t>(mtime);
+        return true;
+    }
+};
+
+// Presents an in-memory table (any order) as a path-ordered stream
+class TableEntryStream : public SnapshotEntryStream {
+private:
+    static constexpr size_t kStreamChunks = 8;  // the two blocks advance independently
+    const FileTable& files;
+    std::vector<size_t> order;
+    size_t position = 0;
+    size_t rootLength;
+
+public:
+    TableEntryStream(const FileTable& table, const std::string& root)
+        : files(table), rootLength(root.size() + (root.back() == '/' ? 0 : 1)) {
+        // A freshly scanned table is two sorted blocks (directories, then files):
+        // merging them is linear. Anything else (e.g. after renames) is sorted.
+        size_t directories = 0;
+        bool blocksSorted = true;
+        std::string previous;
+        files.forEachName([&](size_t row, std::string_view name) {
+            bool isDirectory = files.isDirectoryAt(row);
+            if (isDirectory && directories != row) {
+                blocksSorted = false;
+            }
+            if (isDirectory) {
+                directories++;
+            }
+            if (row != directories && row != 0 && name < previous) {
+                blocksSorted = false;
+            }
+            previous.assign(name.data(), name.size());
+        });
+        
+        std::string left, right;
+        order.reserve(files.size());
+        if (blocksSorted) {
+            size_t a = 0, b = directories;
+            while (a < directories || b < files.size()) {
+                bool takeLeft = b >= files.size() || (a < directories && files.nameAt(a, left) < files.nameAt(b, right));
+                order.push_back(takeLeft ? a++ : b++);
+            }
+        } else {
+            for (size_t i = 0; i < files.size(); i++) {
+                order.push_back(i);
+            }
+            std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return files.nameAt(a, left) < files.nameAt(b, right); });
+        }
+    }
+    
+    bool next(SnapshotEntry& entry) override {
+        if (position >= order.size()) {
+            return false;
+        }
+        files.trimResident(kStreamChunks);  // no row of the table is referenced between calls
+        const FileInfo& info = files[order[position++]];
+        entry.path = info.name.size() > rootLength ? info.name.substr(rootLength) : info.name;
+        entry.size = info.actualSize;
+        entry.allocated = info.allocatedSize;
+        entry.mtime = info.mtime;
+        entry.mode = info.mode;
+        return true;
+    }
+};
+
+bool saveSnapshot(const FileTable& files, const std::string& root, const std::string& path) {
+    SnapshotWriter writer;
+    if (!writer.open(path, root)) {
+        return false;
+    }
+    TableEntryStream stream(files, root);
+    SnapshotEntry entry;
+    while (stream.next(entry)) {
+        writer.add(entry);
+    }
+    return writer.finish();
+}
+
+enum class DiffStatus { Added, Removed, Modified, Grown, DirectoryDelta };
+
+struct DiffChange {
+    DiffStatus status;
+    SnapshotEntry before;  // empty for Added
+    SnapshotEntry after;   // empty for Removed
+};
+
+// Net size change below one directory (recursively)
+struct DirectoryDelta {
+    std::string path;  // "" is the snapshot root
+    std::int64_t bytes = 0;
+    size_t changes = 0;
+};
+
+// Linear merge of two path-ordered streams. Changes are reported through a
+// callback as they are found, so only the per-directory totals are kept.
+class SnapshotDiff {
+private:
+    std::unordered_map<std::string, DirectoryDelta> directories;
+    
+    void addToAncestors(const std::string& path, std::int64_t delta) {
+        size_t slash = path.size();
+        for (;;) {
+            slash = slash == 0 ? std::string::npos : path.rfind('/', slash - 1);
+            std::string dir = slash == std::string::npos ? "" : path.substr(0, slash);
+            DirectoryDelta& totals = directories[dir];
+            totals.bytes += delta;
+            totals.changes++;
+            if (slash == std::string::npos) {
+                break;
+            }
+        }
+    }
+
+public:
+    void run(SnapshotEntryStream& before, SnapshotEntryStream& after, const std::function<void(const DiffChange&)>& onChange) {
+        directories.clear();
+        DiffChange change;
+        SnapshotEntry a, b;
+        bool hasA = before.next(a);
+        bool hasB = after.next(b);
+        
+        while (hasA || hasB) {
+            int order = !hasA ? 1 : !hasB ? -1 : a.path.compare(b.path);
+            if (order < 0) {
+                change.status = DiffStatus::Removed;
+                change.before = a;
+                change.after = SnapshotEntry();
+                addToAncestors(a.path, -static_cast<std::int64_t>(a.size));
+                onChange(change);
+                hasA = before.next(a);
+            } else if (order > 0) {
+                change.status = DiffStatus::Added;
+                change.before = SnapshotEntry();
+                change.after = b;
+                addToAncestors(b.path, static_cast<std::int64_t>(b.size));
+                onChange(change);
+                hasB = after.next(b);
+            } else {
+                // A directory's own size and mtime change whenever its contents do; that is noise
+                bool isDir = S_ISDIR(a.mode) && S_ISDIR(b.mode);
+                if (!isDir && (a.size != b.size || a.mtime != b.mtime || a.mode != b.mode)) {
+                    change.status = b.size > a.size ? DiffStatus::Grown : DiffStatus::Modified;
+                    change.before = a;
+                    change.after = b;
+                    addToAncestors(b.path, static_cast<std::int64_t>(b.size) - static_cast<std::int64_t>(a.size));
+                    onChange(change);
+                }
+                hasA = before.next(a);
+                hasB = after.next(b);
+            }
+        }
+    }
+    
+    // Directories with a net change, largest absolute change first
+    std::vector<DirectoryDelta> directoryDeltas() const {
+        std::vector<DirectoryDelta> result;
+        result.reserve(directories.size());
+        for (const auto& [path, totals] : directories) {
+            DirectoryDelta delta = totals;
+            delta.path = path;
+            result.push_back(std::move(delta));
+        }
+        std::sort(result.begin(), result.end(), [](const DirectoryDelta& x, const DirectoryDelta& y) {
+            std::int64_t ax = x.bytes < 0 ? -x.bytes : x.bytes;
+            std::int64_t ay = y.bytes < 0 ? -y.bytes : y.bytes;
+            return ax != ay ? ax > ay : x.path < y.path;
+        });
+        return result;
+    }
+};
+
+const char* diffStatusName(DiffStatus status) {
+    switch (status) {
+        case DiffStatus::Added: return "added";
+        case DiffStatus::Removed: return "removed";
+        case DiffStatus::Modified: return "modified";
+        case DiffStatus::Grown: return "grown";
+        case DiffStatus::DirectoryDelta: return "dir total";
+    }
+    return "";
+}
+
+std::string formatByteDelta(std::int64_t bytes) {
+    return (bytes > 0 ? "+" : "") + std::to_string(bytes);
+}
+
+// Text report of a diff: one line per change, then the directories that changed most
+void printSnapshotDiff(SnapshotEntryStream& before, SnapshotEntryStream& after, size_t topDirectories = 20) {
+    SnapshotDiff diff;
+    size_t counts[4] = {};
+    diff.run(before, after, [&](const DiffChange& change) {
+        counts[static_cast<int>(change.status)]++;
+        switch (change.status) {
+            case DiffStatus::Added:
+                std::cout << "+ " << change.after.path << " " << change.after.size << "\n";
+                break;
+            case DiffStatus::Removed:
+                std::cout << "- " << change.before.path << " " << change.before.size << "\n";
+                break;
+            default:
+                std::cout << (change.status == DiffStatus::Grown ? "> " : "~ ") << change.after.path << " "
+                          << change.before.size << " -> " << change.after.size << "\n";
+        }
+    });
+    
+    std::cout << "Added: " << counts[0] << ", removed: " << counts[1] << ", modified: " << counts[2]
+              << ", grown: " << counts[3] << "\n";
+    auto deltas = diff.directoryDeltas();
+    for (size_t i = 0; i < deltas.size() && i < topDirectories; i++) {
+        std::cout << formatByteDelta(deltas[i].bytes) << "\t" << (deltas[i].path.empty() ? "." : deltas[i].path)
+                  << " (" << deltas[i].changes << " changes)\n";
+    }
+    std::cout << std::flush;
+}
+
+// ---------------------------------------------------------------------------
+// Scan daemon: one process owns the index and serves it over a Unix socket.
+//
+// Frames in both directions are a u32 payload length followed by the payload.
+// Integers are in host byte order (both ends are on the same machine).
+// Request payloads start with an IndexRequest byte, replies with a status byte
+// (0 = ok, otherwise an error message follows as str16).
+//   Hello   u8 version -> u8 version. Must be the first request of a connection;
+//           a daemon closes the connection on any other version.
+//   Status  -> u64 generation, i64 scannedAt, u64 rows, u64 apparent, u64 unique,
+//              u64 sharedExtents, u64 extraLinks, u8 scanning, str16 root
+//   Query   u8 sort, u8 descending, u64 offset, u32 limit, str16 filter
+//           -> u64 generation, u64 matched, u32 count, count x row
+//   Rescan  u8 wait -> u64 generation (after the new scan is published if wait)
+//   Open    -> u64 generation, u64 rows, u64 apparent, u64 unique, u64 sharedExtents,
+//              u64 extraLinks; the reply carries a descriptor (SCM_RIGHTS) of the
+//              generation's sealed memory file in PagedRows layout, which the viewer maps
+// A row is u64 size, u64 allocated, i64 mtime, u32 mtimeNsec, u32 mode,
+// u32 links, u8 flags (1 = directory, 2 = extra hardlink), u64 device,
+// u64 inode, u32 uid, u32 gid, str16 path. str16 is a u16 byte length and the bytes.
+// ---------------------------------------------------------------------------
+
+enum class IndexRequest : std::uint8_t { Status = 1, Query = 2, Rescan = 3, Open = 4, Hello = 5 };
+
+// Bumped whenever a request, a reply or the row layout changes (2: rows carry uid/gid)
+constexpr std::uint8_t kIndexProtocolVersion = 2;
+
+// Table order is the scan's own order (directories first, then path): no sort at all
+enum class IndexSortKey : std::uint8_t { Table = 0, Path, Name, Size, Allocated, Mtime };
+
+bool parseIndexSortKey(const std::string& text, IndexSortKey& key) {
+    static const std::pair<const char*, IndexSortKey> names[] = {
+        {"table", IndexSortKey::Table}, {"path", IndexSortKey::Path}, {"name", IndexSortKey::Name},
+        {"size", IndexSortKey::Size}, {"allocated", IndexSortKey::Allocated}, {"mtime", IndexSortKey::Mtime}};
+    for (const auto& [name, value] : names) {
+        if (text == name) {
+            key = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool writeFully(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool readFully(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t got = recv(fd, data, size, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        data += got;
+        size -= got;
+    }
+    return true;
+}
+
+bool sendFrame(int fd, const std::string& payload) {
+    std::uint32_t length = static_cast<std::uint32_t>(payload.size());
+    return writeFully(fd, reinterpret_cast<const char*>(&length), sizeof(length)) &&
+           writeFully(fd, payload.data(), payload.size());
+}
+
+bool receiveFrame(int fd, std::string& payload, std::uint32_t maxSize) {
+    std::uint32_t length = 0;
+    if (!readFully(fd, reinterpret_cast<char*>(&length), sizeof(length)) || length > maxSize) {
+        return false;
+    }
+    payload.resize(length);
+    return readFully(fd, payload.data(), length);
+}
+
+// A frame with a descriptor attached to its first byte
+bool sendFrameWithDescriptor(int fd, const std::string& payload, int passed) {
+    std::uint32_t length = static_cast<std::uint32_t>(payload.size());
+    iovec part{&length, sizeof(length)};
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &passed, sizeof(int));
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent <= 0) {
+        return false;
+    }
+    return writeFully(fd, reinterpret_cast<const char*>(&length) + sent, sizeof(length) - sent) &&
+           writeFully(fd, payload.data(), payload.size());
+}
+
+// receiveFrame that also takes a descriptor sent along with the frame (-1 if none)
+bool receiveFrame(int fd, std::string& payload, std::uint32_t maxSize, int& passed) {
+    passed = -1;
+    std::uint32_t length = 0;
+    size_t got = 0;
+    while (got < sizeof(length)) {
+        iovec part{reinterpret_cast<char*>(&length) + got, sizeof(length) - got};
+        char control[CMSG_SPACE(sizeof(int))];
+        msghdr message{};
+        message.msg_iov = &part;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        ssize_t n = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS && passed == -1) {
+                std::memcpy(&passed, CMSG_DATA(header), sizeof(int));
+            }
+        }
+        got += static_cast<size_t>(n);
+    }
+    if (got == sizeof(length) && length <= maxSize) {
+        payload.resize(length);
+        if (readFully(fd, payload.data(), length)) {
+            return true;
+        }
+    }
+    if (passed >= 0) {
+        close(passed);
+        passed = -1;
+    }
+    return false;
+}
+
+// The daemon side. A refresher thread rescans into a new table and publishes it
+// as a whole; every client gets its own thread and reads whichever generation is
+// current when its request arrives. A published table is a sealed memory file in
+// PagedRows layout: any thread may read it, it stays valid for as long as a request
+// still uses it, and viewers map the same pages instead of copying the rows.
+class IndexServer {
+private:
+    struct Generation {
+        std::shared_ptr<const PagedRows> rows;
+        SpaceTotals totals;
+        std::uint64_t number = 0;
+        time_t scannedAt = 0;
+    };
+    
+    // Row order of the last query of one connection, so paging through it is cheap
+    struct QueryCache {
+        std::uint64_t generation = 0;
+        IndexSortKey sort = IndexSortKey::Table;
+        bool descending = false;
+        std::string filter;
+        bool valid = false;
+        std::vector<std::uint32_t> order;
+    };
+    
+    struct Client {
+        int fd;
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+    
+    static constexpr std::uint32_t kMaxRequest = 64 * 1024;
+    static constexpr std::uint32_t kMaxPageRows = 65536;
+    
+    std::string root;
+    ScanOptions options;
+    std::string socketPath;
+    std::chrono::seconds refreshInterval;
+    
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::shared_ptr<const Generation> current;
+    bool scanning = false;
+    bool rescanRequested = false;
+    std::atomic<bool> stopping{false};
+    
+    std::shared_ptr<const Generation> snapshot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return current;
+    }
+    
+    void refreshLoop() {
+        std::uint64_t number = 0;
+        while (!stopping) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                scanning = true;
+                rescanRequested = false;
             }
-        } catch (const std::exception& e) {
-            if (logger) {
-                logger->logUnreadableFile(filePath, "update_metadata", e.what());
+            auto started = std::chrono::steady_clock::now();
+            auto next = std::make_shared<Generation>();
+            {
+                FileManager manager(root, nullptr, options);
+                next->rows = PagedRows::fromTable(manager.getFiles());
+                next->totals = manager.getSpaceTotals();
+            }
+            if (!next->rows) {
+                std::cerr << "Cannot publish the index: " << strerror(errno) << std::endl;
+            }
+            next->scannedAt = time(nullptr);
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+            
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!stopping && next->rows) {
+                next->number = ++number;
+                std::cout << "Published generation " << next->number << ": " << next->rows->size() << " entries in "
+                          << elapsed.count() << "ms" << std::endl;
+                current = std::move(next);
+            }
+            scanning = false;
+            changed.notify_all();
+            
+            auto wake = [this] { return stopping || rescanRequested; };
+            if (refreshInterval.count() > 0) {
+                changed.wait_for(lock, refreshInterval, wake);
+            } else {
+                changed.wait(lock, wake);
             }
-            return false;
         }
     }
     
-    void interruptScan() { scanInterrupted = true; }
-    
-    void loadFilesRecursive(const std::string& path, std::queue<std::pair<std::string, int>>& dirsToProcess, int currentDepth = 0) {
-        // Check for interruption
-        if (scanInterrupted) {
-            return;
-        }
-        
-        DIR* dir = opendir(path.c_str());
+    void buildOrder(const Generation& generation, QueryCache& cache) {
+        const PagedRows& rows = *generation.rows;
+        cache.order.clear();
         
-        if (!dir) {
-            if (logger) {
-                logger->logUnreadableFile(path, "opendir", std::string("Failed to open directory: ") + strerror(errno));
+        // Patterns with a '/' match the path below the root, others the name (like the S prompt)
+        std::optional<GlobPattern> pattern;
+        bool byPath = cache.filter.find('/') != std::string::npos;
+        if (!cache.filter.empty()) {
+            pattern.emplace(cache.filter);
+        }
+        for (size_t i = 0; i < rows.size(); i++) {
+            if (pattern) {
+                std::string_view path = rows.path(i);
+                std::string_view subject;
+                if (byPath) {
+                    subject = path.size() > root.size() ? path.substr(root.size() + (root.back() == '/' ? 0 : 1)) : std::string_view();
+                } else {
+                    size_t slash = path.rfind('/');
+                    subject = slash == std::string_view::npos ? path : path.substr(slash + 1);
+                }
+                if (!pattern->matches(subject)) {
+                    continue;
+                }
             }
-            return;
+            cache.order.push_back(static_cast<std::uint32_t>(i));
         }
         
-        // Get filesystem block size for this directory
-        std::uintmax_t blockSize = getFilesystemBlockSize(path);
+        auto nameOf = [&](std::uint32_t row) {
+            std::string_view path = rows.path(row);
+            size_t slash = path.rfind('/');
+            return slash == std::string_view::npos ? path : path.substr(slash + 1);
+        };
+        // Sort keys are the leading fields of a record: size, allocated, mtime
+        struct Keys {
+            std::uint64_t size;
+            std::uint64_t allocated;
+            std::int64_t mtime;
+        };
+        auto keysOf = [&](std::uint32_t row) {
+            WireReader fields(rows.record(row));
+            Keys keys;
+            keys.size = fields.get<std::uint64_t>();
+            keys.allocated = fields.get<std::uint64_t>();
+            keys.mtime = fields.get<std::int64_t>();
+            return keys;
+        };
+        auto less = [&](std::uint32_t a, std::uint32_t b) {
+            switch (cache.sort) {
+                case IndexSortKey::Table: return a < b;
+                case IndexSortKey::Path: return rows.path(a) < rows.path(b);
+                case IndexSortKey::Name: {
+                    int byName = nameOf(a).compare(nameOf(b));
+                    return byName != 0 ? byName < 0 : rows.path(a) < rows.path(b);
+                }
+                default: break;
+            }
+            Keys x = keysOf(a), y = keysOf(b);
+            switch (cache.sort) {
+                case IndexSortKey::Size:
+                    return x.size != y.size ? x.size < y.size : rows.path(a) < rows.path(b);
+                case IndexSortKey::Allocated:
+                    return x.allocated != y.allocated ? x.allocated < y.allocated : rows.path(a) < rows.path(b);
+                default:
+                    return x.mtime != y.mtime ? x.mtime < y.mtime : rows.path(a) < rows.path(b);
+            }
+        };
+        if (cache.sort != IndexSortKey::Table) {
+            std::sort(cache.order.begin(), cache.order.end(), less);
+        }
+        if (cache.descending) {
+            std::reverse(cache.order.begin(), cache.order.end());
+        }
+        cache.generation = generation.number;
+        cache.valid = true;
+    }
+    
+    std::string handleQuery(WireReader& request, QueryCache& cache) {
+        auto sort = static_cast<IndexSortKey>(request.get<std::uint8_t>());
+        bool descending = request.get<std::uint8_t>() != 0;
+        std::uint64_t offset = request.get<std::uint64_t>();
+        std::uint32_t limit = std::min(request.get<std::uint32_t>(), kMaxPageRows);
+        std::string filter = request.getString();
+        if (!request.ok() || sort > IndexSortKey::Mtime) {
+            return errorReply("malformed query");
+        }
         
-        // Pre-allocate space to avoid frequent reallocations
-        std::vector<FileInfo> localFiles;
-        localFiles.reserve(1000);  // Reserve space for efficiency
+        auto generation = snapshot();
+        if (!generation) {
+            return errorReply("first scan has not finished yet");
+        }
+        if (!cache.valid || cache.generation != generation->number || cache.sort != sort ||
+            cache.descending != descending || cache.filter != filter) {
+            cache.sort = sort;
+            cache.descending = descending;
+            cache.filter = std::move(filter);
+            buildOrder(*generation, cache);
+        }
         
-        struct dirent* entry;
-        while ((entry = readdir(dir)) != nullptr && !scanInterrupted) {
-            // Skip . and ..
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                continue;
-            }
-            
-            std::string fullPath = path + "/" + entry->d_name;
-            struct stat statBuf;
-            
-            // Use lstat instead of stat for better performance (doesn't follow symlinks)
-            if (lstat(fullPath.c_str(), &statBuf) == -1) {
-                if (logger) {
-                    logger->logUnreadableFile(fullPath, "lstat", std::string("lstat failed: ") + strerror(errno));
+        WireWriter reply;
+        reply.put<std::uint8_t>(0);
+        reply.put<std::uint64_t>(generation->number);
+        reply.put<std::uint64_t>(cache.order.size());
+        size_t first = std::min<std::uint64_t>(offset, cache.order.size());
+        size_t count = std::min<size_t>(limit, cache.order.size() - first);
+        reply.put<std::uint32_t>(static_cast<std::uint32_t>(count));
+        for (size_t i = first; i < first + count; i++) {
+            std::string_view record = generation->rows->record(cache.order[i]);  // already in row layout
+            reply.putBytes(record.data(), record.size());
+        }
+        return reply.data();
+    }
+    
+    std::string handleStatus() {
+        auto generation = snapshot();
+        bool busy;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy = scanning;
+        }
+        WireWriter reply;
+        reply.put<std::uint8_t>(0);
+        reply.put<std::uint64_t>(generation ? generation->number : 0);
+        reply.put<std::int64_t>(generation ? generation->scannedAt : 0);
+        reply.put<std::uint64_t>(generation ? generation->rows->size() : 0);
+        SpaceTotals totals = generation ? generation->totals : SpaceTotals();
+        reply.put<std::uint64_t>(totals.apparentBytes);
+        reply.put<std::uint64_t>(totals.uniqueBytes);
+        reply.put<std::uint64_t>(totals.sharedExtentBytes);
+        reply.put<std::uint64_t>(totals.extraLinks);
+        reply.put<std::uint8_t>(busy);
+        reply.putString(root);
+        return reply.data();
+    }
+    
+    std::string handleRescan(WireReader& request) {
+        bool wait = request.get<std::uint8_t>() != 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        // A scan already running started before this request; the one after it counts
+        std::uint64_t target = (current ? current->number : 0) + (scanning ? 2 : 1);
+        rescanRequested = true;
+        changed.notify_all();
+        if (wait) {
+            changed.wait(lock, [&] { return stopping || (current && current->number >= target); });
+        }
+        WireWriter reply;
+        reply.put<std::uint8_t>(0);
+        reply.put<std::uint64_t>(current ? current->number : 0);
+        return reply.data();
+    }
+    
+    // `opened` keeps the generation, and so the descriptor in `passed`, alive until it is sent
+    std::string handleOpen(std::shared_ptr<const Generation>& opened, int& passed) {
+        opened = snapshot();
+        if (!opened) {
+            return errorReply("first scan has not finished yet");
+        }
+        WireWriter reply;
+        reply.put<std::uint8_t>(0);
+        reply.put<std::uint64_t>(opened->number);
+        reply.put<std::uint64_t>(opened->rows->size());
+        reply.put<std::uint64_t>(opened->totals.apparentBytes);
+        reply.put<std::uint64_t>(opened->totals.uniqueBytes);
+        reply.put<std::uint64_t>(opened->totals.sharedExtentBytes);
+        reply.put<std::uint64_t>(opened->totals.extraLinks);
+        passed = opened->rows->descriptor();
+        return reply.data();
+    }
+    
+    static std::string errorReply(const std::string& message) {
+        WireWriter reply;
+        reply.put<std::uint8_t>(1);
+        reply.putString(message);
+        return reply.data();
+    }
+    
+    // Ok only for a client that speaks this daemon's protocol version
+    static std::string handleHello(WireReader& request, bool& greeted) {
+        std::uint8_t version = request.get<std::uint8_t>();
+        if (!request.ok() || version != kIndexProtocolVersion) {
+            return errorReply("protocol version " + std::to_string(version) + " is not supported; the daemon speaks version " +
+                              std::to_string(kIndexProtocolVersion));
+        }
+        greeted = true;
+        WireWriter reply;
+        reply.put<std::uint8_t>(0);
+        reply.put<std::uint8_t>(kIndexProtocolVersion);
+        return reply.data();
+    }
+    
+    void serveClient(int fd) {
+        QueryCache cache;
+        std::string payload;
+        bool greeted = false;
+        while (!stopping && receiveFrame(fd, payload, kMaxRequest)) {
+            WireReader request(payload);
+            auto kind = static_cast<IndexRequest>(request.get<std::uint8_t>());
+            if (!greeted) {
+                // Anything else first comes from a client older than the handshake
+                std::string reply = kind == IndexRequest::Hello ? handleHello(request, greeted)
+                                                                : errorReply("the daemon expects a Hello request first; upgrade the client");
+                if (!sendFrame(fd, reply) || !greeted) {
+                    break;
                 }
                 continue;
             }
-            
-            FileInfo info;
-            info.name = fullPath;
-            info.isDirectory = S_ISDIR(statBuf.st_mode);
-            
-            // Get actual and allocated file sizes
-            info.actualSize = statBuf.st_size;
-            if (info.isDirectory) {
-                // For directories, just use the directory entry size (don't calculate recursive size)
-                info.allocatedSize = calculateAllocatedSize(statBuf.st_size, blockSize);
-                info.size = formatSizeInfo(info.actualSize, info.allocatedSize);
-                
-                // Add directory to queue for recursive processing if accessible
-                if (access(fullPath.c_str(), R_OK | X_OK) == 0) {
-                    dirsToProcess.push({fullPath, currentDepth + 1});
-                } else if (logger) {
-                    logger->logUnreadableFile(fullPath, "subdirectory_access_test", std::string("access denied: ") + strerror(errno));
-                }
-            } else {
-                // Regular file or other file type
-                info.allocatedSize = calculateAllocatedSize(statBuf.st_size, blockSize);
-                info.size = formatSizeInfo(info.actualSize, info.allocatedSize);
+            std::string reply;
+            std::shared_ptr<const Generation> opened;
+            int passed = -1;
+            switch (kind) {
+                case IndexRequest::Status: reply = handleStatus(); break;
+                case IndexRequest::Query: reply = handleQuery(request, cache); break;
+                case IndexRequest::Rescan: reply = handleRescan(request); break;
+                case IndexRequest::Open: reply = handleOpen(opened, passed); break;
+                default: reply = errorReply("unknown request");
+            }
+            if (!(passed >= 0 ? sendFrameWithDescriptor(fd, reply, passed) : sendFrame(fd, reply))) {
+                break;
             }
-            
-            // Get file modification time
-            info.date = formatDate(statBuf.st_mtime, logger.get(), fullPath);
-            
-            // Simplified permissions (reuse stat data)
-            info.permissions = getFilePermissionsFromStat(statBuf);
-            
-            localFiles.push_back(std::move(info));
         }
-        
-        closedir(dir);
-        
-        // Batch append to main files vector
-        files.insert(files.end(), std::make_move_iterator(localFiles.begin()), 
-                     std::make_move_iterator(localFiles.end()));
+    }
+
+public:
+    IndexServer(std::string root, ScanOptions opts, std::string socketPath, std::chrono::seconds refreshInterval)
+        : root(std::move(root)), options(std::move(opts)), socketPath(std::move(socketPath)),
+          refreshInterval(refreshInterval) {
+        options.cancel = &stopping;
     }
     
-    void loadFiles() {
-        files.clear();
+    // Serves until `stop` becomes true (checked twice a second)
+    bool run(const std::atomic<bool>& stop) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path)) {
+            std::cerr << "Socket path too long: " << socketPath << std::endl;
+            return false;
+        }
+        std::strcpy(address.sun_path, socketPath.c_str());
         
-        // Check if directory exists and is accessible
-        struct stat statBuf;
-        if (stat(directoryPath.c_str(), &statBuf) == -1) {
-            if (logger) {
-                logger->logUnreadableFile(directoryPath, "directory_exists_check", std::string("stat failed: ") + strerror(errno));
-            }
-            return;
+        int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener < 0) {
+            std::cerr << "socket failed: " << strerror(errno) << std::endl;
+            return false;
         }
         
-        if (!S_ISDIR(statBuf.st_mode)) {
-            if (logger) {
-                logger->logUnreadableFile(directoryPath, "directory_type_check", "Not a directory");
+        // Only a socket nobody answers on is left over from a daemon that did not exit
+        // cleanly; anything else at the path is not ours to remove
+        struct stat existing;
+        if (lstat(socketPath.c_str(), &existing) == 0) {
+            std::string problem;
+            if (!S_ISSOCK(existing.st_mode)) {
+                problem = "exists and is not a socket";
+            } else {
+                int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                bool live = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+                bool stale = !live && errno == ECONNREFUSED;
+                if (probe >= 0) {
+                    close(probe);
+                }
+                if (live) {
+                    problem = "address in use: another daemon is serving on it";
+                } else if (!stale || unlink(socketPath.c_str()) != 0) {
+                    problem = std::string("cannot replace the stale socket: ") + strerror(errno);
+                }
+            }
+            if (!problem.empty()) {
+                std::cerr << "Cannot listen on " << socketPath << ": " << problem << std::endl;
+                close(listener);
+                return false;
             }
-            return;
         }
         
-        // Test basic directory access
-        if (access(directoryPath.c_str(), R_OK | X_OK) != 0) {
-            if (logger) {
-                logger->logUnreadableFile(directoryPath, "directory_access_test", std::string("access denied: ") + strerror(errno));
-            }
-            std::cerr << "Cannot access directory: " << directoryPath << " - " << strerror(errno) << std::endl;
-            return;
+        // The index lists a tree only this user may be able to read: the socket is ours alone
+        mode_t previousMask = umask(0077);
+        bool bound = bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        umask(previousMask);
+        struct stat boundSocket{};
+        if (!bound || listen(listener, 16) != 0 || lstat(socketPath.c_str(), &boundSocket) != 0) {
+            std::cerr << "Cannot listen on " << socketPath << ": " << strerror(errno) << std::endl;
+            close(listener);
+            return false;
         }
+        std::cout << "Serving " << root << " on " << socketPath << std::endl;
         
-        try {
-            std::cout << "Scanning directory tree: " << directoryPath << std::endl;
-            
-            // Pre-allocate memory for better performance
-            files.reserve(10000);  // Reserve space for 10k files initially
-            
-            // Use queue-based approach to handle recursion and catch all permission errors
-            std::queue<std::pair<std::string, int>> dirsToProcess;
-            dirsToProcess.push({directoryPath, 0});
-            
-            int processedDirs = 0;
-            auto startTime = std::chrono::steady_clock::now();
+        std::thread refresher(&IndexServer::refreshLoop, this);
+        std::vector<std::unique_ptr<Client>> clients;
+        
+        while (!stop) {
+            pollfd pending{listener, POLLIN, 0};
+            int ready = poll(&pending, 1, 500);
             
-            while (!dirsToProcess.empty() && !scanInterrupted) {
-                auto [currentDir, depth] = dirsToProcess.front();
-                dirsToProcess.pop();
-                processedDirs++;
-                
-                // Handle window events every 10 directories to prevent "not responding" dialog
-                if (window && processedDirs % 10 == 0) {
-                    while (auto eventOpt = window->pollEvent()) {
-                        if (!eventOpt) break;
-                        const sf::Event& event = *eventOpt;
-                        
-                        if (event.is<sf::Event::Closed>()) {
-                            scanInterrupted = true;
-                            break;
-                        }
-                        
-                        if (event.is<sf::Event::KeyPressed>()) {
-                            if(const auto* keyPressed = event.getIf<sf::Event::KeyPressed>()){
-                                if (keyPressed->scancode == sf::Keyboard::Scancode::Escape) {
-                                    scanInterrupted = true;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    
-                    // Update window display to show we're still alive
-                    if (window->isOpen()) {
-                        window->clear(sf::Color::Black);
-                        
-                        // Show progress text
-                        sf::Font font;
-                        if (font.openFromFile("assets/Sansation-Regular.ttf")) {
-                            sf::Text progressText(font, "Scanning: " + std::to_string(processedDirs) + 
-                                                " dirs, " + std::to_string(files.size()) + " files\nPress ESC to stop", 24);
-                            progressText.setFillColor(sf::Color::White);
-                            progressText.setPosition(sf::Vector2f(50, 50));
-                            window->draw(progressText);
-                        }
-                        
-                        window->display();
-                    }
-                }
-                
-                // Progress feedback every 100 directories for console output
-                if (processedDirs % 100 == 0) {
-                    auto currentTime = std::chrono::steady_clock::now();
-                    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime).count();
-                    std::cout << "\rProcessed " << processedDirs << " directories, found " << files.size() 
-                              << " files, depth " << depth << " (" << elapsed << "ms) [Press ESC to stop]" << std::flush;
-                }
-                
-                try {
-                    loadFilesRecursive(currentDir, dirsToProcess, depth);
-                } catch (const std::exception& e) {
-                    if (logger) {
-                        logger->logUnreadableFile(currentDir, "directory_processing", e.what());
-                    }
+            // Reap connections that have closed
+            for (auto it = clients.begin(); it != clients.end();) {
+                if ((*it)->done) {
+                    (*it)->thread.join();
+                    close((*it)->fd);
+                    it = clients.erase(it);
+                } else {
+                    ++it;
                 }
             }
-            
-            auto endTime = std::chrono::steady_clock::now();
-            auto totalTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
-            
-            if (scanInterrupted) {
-                std::cout << "\rScan interrupted: " << processedDirs << " directories, " << files.size() 
-                          << " files in " << totalTime << "ms (partial results)" << std::endl;
-            } else {
-                std::cout << "\rScan complete: " << processedDirs << " directories, " << files.size() 
-                          << " files in " << totalTime << "ms" << std::endl;
+            if (ready <= 0) {
+                continue;
+            }
+            int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+            ucred peer{};
+            socklen_t peerSize = sizeof(peer);
+            if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &peerSize) != 0 || (peer.uid != geteuid() && peer.uid != 0)) {
+                std::cerr << "Refused a connection from uid " << peer.uid << std::endl;
+                close(fd);
+                continue;
+            }
+            auto client = std::make_unique<Client>();
+            client->fd = fd;
+            Client* raw = client.get();
+            client->thread = std::thread([this, raw] {
+                serveClient(raw->fd);
+                raw->done = true;
+            });
+            clients.push_back(std::move(client));
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            changed.notify_all();
+        }
+        for (auto& client : clients) {
+            shutdown(client->fd, SHUT_RDWR);  // wakes a client thread blocked in recv
+            client->thread.join();
+            close(client->fd);
+        }
+        refresher.join();
+        close(listener);
+        struct stat now;
+        if (lstat(socketPath.c_str(), &now) == 0 && now.st_dev == boundSocket.st_dev && now.st_ino == boundSocket.st_ino) {
+            unlink(socketPath.c_str());  // still the socket we bound, not a successor's
+        }
+        return true;
+    }
+};
+
+struct IndexStatus {
+    std::uint64_t generation = 0;
+    time_t scannedAt = 0;
+    std::uint64_t rows = 0;
+    SpaceTotals totals;
+    bool scanning = false;
+    std::string root;
+};
+
+struct IndexQuery {
+    IndexSortKey sort = IndexSortKey::Table;
+    bool descending = false;
+    std::uint64_t offset = 0;
+    std::uint32_t limit = 1000;
+    std::string filter;
+};
+
+struct IndexPage {
+    std::uint64_t generation = 0;
+    std::uint64_t matched = 0;
+    std::vector<FileInfo> rows;  // display strings already formatted
+};
+
+// The viewer/script side of the protocol. One request at a time per connection.
+class IndexClient {
+private:
+    int fd = -1;
+    std::string socketPath;
+    std::string error;
+    
+    // A connection given up on mid-reply is reopened for the next request
+    bool ensureConnected() {
+        return fd >= 0 || (!socketPath.empty() && connect(socketPath));
+    }
+    
+    void disconnect() {
+        close(fd);
+        fd = -1;
+    }
+    
+    // `passed` receives a descriptor sent with the reply (the caller closes it)
+    bool roundTrip(const WireWriter& request, std::string& reply, int* passed = nullptr) {
+        if (!ensureConnected()) {
+            return false;
+        }
+        int received = -1;
+        if (!sendFrame(fd, request.data()) || !receiveFrame(fd, reply, UINT32_MAX, received)) {
+            disconnect();  // what is left of the reply would be read as the next one
+            error = "connection to the index daemon lost";
+            return false;
+        }
+        WireReader status(reply);
+        if (status.get<std::uint8_t>() != 0) {
+            error = status.getString();
+            if (received >= 0) {
+                close(received);
+            }
+            return false;
+        }
+        if (passed) {
+            *passed = received;
+        } else if (received >= 0) {
+            close(received);
+        }
+        return true;
+    }
+
+public:
+    IndexClient() = default;
+    IndexClient(const IndexClient&) = delete;
+    IndexClient& operator=(const IndexClient&) = delete;
+    
+    ~IndexClient() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    
+    bool connect(const std::string& path) {
+        socketPath = path;
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path)) {
+            error = "socket path too long";
+            return false;
+        }
+        std::strcpy(address.sun_path, socketPath.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            error = std::string("cannot connect to ") + socketPath + ": " + strerror(errno);
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+            return false;
+        }
+        
+        // Rows are only parsed once both ends agree on the protocol version
+        WireWriter hello;
+        hello.put(IndexRequest::Hello);
+        hello.put<std::uint8_t>(kIndexProtocolVersion);
+        std::string reply;
+        if (!roundTrip(hello, reply)) {
+            if (error == "unknown request") {
+                error = "the daemon at " + socketPath + " is older than this client (no Hello request)";
             }
-            
-            // Сортировка: сначала каталоги, потом файлы
-            std::cout << "Sorting files..." << std::flush;
-            std::sort(files.begin(), files.end(), [](const FileInfo& a, const FileInfo& b) {
-                if (a.isDirectory != b.isDirectory) {
-                    return a.isDirectory > b.isDirectory;
-                }
-                return a.name < b.name;
-            });
-            std::cout << " done!" << std::endl;
-            
-        } catch (const std::exception& e) {
-            if (logger) {
-                logger->logUnreadableFile(directoryPath, "general_error", e.what());
+            if (fd >= 0) {
+                disconnect();
             }
-            std::cerr << "Error reading directory: " << e.what() << std::endl;
+            return false;
         }
+        return true;
     }
     
-    const std::vector<FileInfo>& getFiles() const {
-        return files;
+    bool status(IndexStatus& out) {
+        WireWriter request;
+        request.put(IndexRequest::Status);
+        std::string reply;
+        if (!roundTrip(request, reply)) {
+            return false;
+        }
+        WireReader fields(reply);
+        fields.get<std::uint8_t>();
+        out.generation = fields.get<std::uint64_t>();
+        out.scannedAt = static_cast<time_t>(fields.get<std::int64_t>());
+        out.rows = fields.get<std::uint64_t>();
+        out.totals.apparentBytes = fields.get<std::uint64_t>();
+        out.totals.uniqueBytes = fields.get<std::uint64_t>();
+        out.totals.sharedExtentBytes = fields.get<std::uint64_t>();
+        out.totals.extraLinks = fields.get<std::uint64_t>();
+        out.scanning = fields.get<std::uint8_t>() != 0;
+        out.root = fields.getString();
+        if (!fields.ok()) {
+            error = "malformed status reply";
+            return false;
+        }
+        return true;
     }
     
-    size_t getFileCount() const {
-        return files.size();
+    bool query(const IndexQuery& query, IndexPage& page) {
+        WireWriter request;
+        request.put(IndexRequest::Query);
+        request.put(query.sort);
+        request.put<std::uint8_t>(query.descending);
+        request.put<std::uint64_t>(query.offset);
+        request.put<std::uint32_t>(query.limit);
+        request.putString(query.filter);
+        std::string reply;
+        if (!roundTrip(request, reply)) {
+            return false;
+        }
+        WireReader fields(reply);
+        fields.get<std::uint8_t>();
+        page.generation = fields.get<std::uint64_t>();
+        page.matched = fields.get<std::uint64_t>();
+        std::uint32_t count = fields.get<std::uint32_t>();
+        page.rows.clear();
+        page.rows.reserve(count);
+        for (std::uint32_t i = 0; i < count && fields.ok(); i++) {
+            FileInfo info = fields.getRow();
+            formatDisplayFields(info);
+            page.rows.push_back(std::move(info));
+        }
+        if (!fields.ok()) {
+            error = "malformed query reply";
+            return false;
+        }
+        return true;
     }
     
-    std::string getLogFilePath() const {
-        return logger ? logger->getLogFilePath() : "";
+    // The current generation, mapped from the daemon's own memory file: no row is
+    // copied, and only the chunks that are looked at are decoded
+    bool open(std::shared_ptr<const PagedRows>& rows, std::uint64_t& generation, SpaceTotals& totals) {
+        WireWriter request;
+        request.put(IndexRequest::Open);
+        std::string reply;
+        int passed = -1;
+        if (!roundTrip(request, reply, &passed)) {
+            return false;
+        }
+        WireReader fields(reply);
+        fields.get<std::uint8_t>();
+        generation = fields.get<std::uint64_t>();
+        std::uint64_t count = fields.get<std::uint64_t>();
+        totals.apparentBytes = fields.get<std::uint64_t>();
+        totals.uniqueBytes = fields.get<std::uint64_t>();
+        totals.sharedExtentBytes = fields.get<std::uint64_t>();
+        totals.extraLinks = fields.get<std::uint64_t>();
+        
+        // Only a sealed file cannot shrink under the mapping (which would be SIGBUS)
+        constexpr int kRequiredSeals = F_SEAL_SHRINK | F_SEAL_WRITE;
+        int seals = passed >= 0 ? fcntl(passed, F_GET_SEALS) : -1;
+        if (!fields.ok() || seals < 0 || (seals & kRequiredSeals) != kRequiredSeals) {
+            if (passed >= 0) {
+                close(passed);
+            }
+            error = "malformed open reply";
+            return false;
+        }
+        rows = PagedRows::map(passed);
+        if (!rows || rows->size() != count) {
+            rows = nullptr;
+            error = "cannot map the index";
+            return false;
+        }
+        return true;
     }
     
-    bool isLoggingEnabled() const {
-        return logger ? logger->isLoggingEnabled() : false;
+    // Ask for a fresh scan. With `wait`, returns once it is published; the socket
+    // is polled so keepWaiting() can pump a UI meanwhile (false gives up waiting).
+    bool rescan(bool wait, const std::function<bool()>& keepWaiting = nullptr) {
+        WireWriter request;
+        request.put(IndexRequest::Rescan);
+        request.put<std::uint8_t>(wait);
+        if (!ensureConnected()) {
+            return false;
+        }
+        if (!sendFrame(fd, request.data())) {
+            disconnect();
+            error = "connection to the index daemon lost";
+            return false;
+        }
+        while (keepWaiting) {
+            pollfd reply{fd, POLLIN, 0};
+            if (poll(&reply, 1, 100) > 0) {
+                break;
+            }
+            if (!keepWaiting()) {
+                // The reply is still coming; this connection cannot be reused for it
+                disconnect();
+                error = "stopped waiting for the rescan";
+                return false;
+            }
+        }
+        std::string reply;
+        if (!receiveFrame(fd, reply, UINT32_MAX)) {
+            disconnect();
+            error = "connection to the index daemon lost";
+            return false;
+        }
+        return true;
+    }
+    
+    const std::string& lastError() const {
+        return error;
+    }
+};
+
+// Rasterizes code points seen during the scan a few at a time per frame, for every
+// font and character size in use, so a page of non-Latin names never has to fill
+// the glyph atlas in one go. sf::Font is not thread-safe and its pages are GL
+// textures, so the "background" work runs on the UI thread under a time budget.
+class GlyphWarmer {
+public:
+    struct Target {
+        const sf::Font* font;
+        unsigned int characterSize;
+    };
+
+private:
+    std::vector<Target> targets;
+    std::vector<char32_t> pending;
+    size_t next = 0;
+
+public:
+    // Start over, e.g. after a rescan or a font/size change
+    void reset(std::vector<Target> newTargets, const CodePointSet& codePoints) {
+        targets = std::move(newTargets);
+        pending.clear();
+        pending.reserve(codePoints.size());
+        codePoints.forEach([this](char32_t cp) { pending.push_back(cp); });
+        next = 0;
+    }
+    
+    // Returns true while work remains
+    bool warmFor(std::chrono::microseconds budget) {
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        while (next < pending.size()) {
+            for (const Target& target : targets) {
+                (void)target.font->getGlyph(pending[next], target.characterSize, false, 0);
+            }
+            next++;
+            if ((next & 7) == 0 && std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+        }
+        return next < pending.size();
+    }
+    
+    size_t remaining() const {
+        return pending.size() - next;
+    }
+};
+
+// Decoded sf::String per displayed text, so repainting a page does not decode
+// UTF-8 again. Bounded: cleared when it grows past a few pages' worth.
+class DisplayTextCache {
+private:
+    std::unordered_map<std::string, sf::String> entries;
+    static constexpr size_t kMaxEntries = 8192;
+
+public:
+    const sf::String& get(const std::string& utf8) {
+        auto it = entries.find(utf8);
+        if (it != entries.end()) {
+            return it->second;
+        }
+        if (entries.size() >= kMaxEntries) {
+            entries.clear();
+        }
+        return entries.emplace(utf8, utf8ToSfString(utf8)).first->second;
+    }
+};
+
+// Horizontal advance of every glyph of one (font, character size), so measuring a
+// string is a sum of table lookups instead of laying out an sf::Text and asking
+// for its bounds. ASCII is a flat array filled up front; other code points are
+// asked from the font once. Kerning is left out: it is a pixel or two per pair
+// and the cell padding absorbs it.
+class GlyphAdvanceTable {
+private:
+    const sf::Font* font;
+    unsigned int characterSize;
+    std::array<float, 128> ascii{};
+    std::unordered_map<char32_t, float> other;
+
+public:
+    GlyphAdvanceTable(const sf::Font& font, unsigned int characterSize)
+        : font(&font), characterSize(characterSize) {
+        for (char32_t c = 0; c < 128; c++) {
+            ascii[c] = font.getGlyph(c, characterSize, false, 0).advance;
+        }
+    }
+    
+    float advance(char32_t cp) {
+        if (cp < 128) {
+            return ascii[cp];
+        }
+        auto it = other.find(cp);
+        if (it == other.end()) {
+            it = other.emplace(cp, font->getGlyph(cp, characterSize, false, 0).advance).first;
+        }
+        return it->second;
+    }
+    
+    float width(std::string_view utf8) {
+        const char* p = utf8.data();
+        const char* end = p + utf8.size();
+        float total = 0.0f;
+        while (p < end) {
+            // ASCII runs: four independent sums so the loop is not one long dependency chain
+            float lanes[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            while (end - p >= 4 && ((p[0] | p[1] | p[2] | p[3]) & 0x80) == 0) {
+                lanes[0] += ascii[static_cast<unsigned char>(p[0])];
+                lanes[1] += ascii[static_cast<unsigned char>(p[1])];
+                lanes[2] += ascii[static_cast<unsigned char>(p[2])];
+                lanes[3] += ascii[static_cast<unsigned char>(p[3])];
+                p += 4;
+            }
+            total += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            if (p < end) {
+                total += advance(decodeUtf8(p, end));
+            }
+        }
+        return total;
+    }
+};
+
+// One advance table per (font, size) in use. Fonts are owned by FontManager and
+// never unloaded, so the pointers stay valid as keys.
+class TextMeasurer {
+private:
+    std::map<std::pair<const sf::Font*, unsigned int>, GlyphAdvanceTable> tables;
+
+public:
+    GlyphAdvanceTable& table(const sf::Font& font, unsigned int characterSize) {
+        auto key = std::make_pair(&font, characterSize);
+        auto it = tables.find(key);
+        if (it == tables.end()) {
+            it = tables.emplace(key, GlyphAdvanceTable(font, characterSize)).first;
+        }
+        return it->second;
     }
 };
 
-// >>> Helper: Truncate string with ellipsis
-std::string truncate(const std::string& str, size_t maxLen = 35) {
-    if (str.length() <= maxLen) return str;
-    return str.substr(0, maxLen - 3) + "...";
+enum class Ellipsis { End, Middle };
+
+// >>> Helper: Truncate string with ellipsis so it fits maxWidth pixels.
+// Middle keeps both ends, which is what matters in a path.
+std::string truncateToWidth(const std::string& str, float maxWidth, GlyphAdvanceTable& advances,
+                            Ellipsis mode = Ellipsis::End) {
+    if (advances.width(str) <= maxWidth) {
+        return str;
+    }
+    static const std::string dots = "...";
+    float budget = maxWidth - advances.width(dots);
+    if (budget <= 0.0f) {
+        return "";
+    }
+    
+    // Head: whole code points from the front while they fit
+    float headBudget = mode == Ellipsis::Middle ? budget / 2.0f : budget;
+    const char* begin = str.data();
+    const char* end = begin + str.size();
+    const char* head = begin;
+    float used = 0.0f;
+    while (head < end) {
+        const char* next = head;
+        float w = advances.advance(decodeUtf8(next, end));
+        if (used + w > headBudget) {
+            break;
+        }
+        used += w;
+        head = next;
+    }
+    if (mode == Ellipsis::End) {
+        return str.substr(0, head - begin) + dots;
+    }
+    
+    // Tail: whole code points from the back with what the head left over
+    const char* tail = end;
+    while (tail > head) {
+        const char* start = tail - 1;
+        while (start > head && (static_cast<unsigned char>(*start) & 0xC0) == 0x80) {
+            start--;  // never split a UTF-8 sequence
+        }
+        const char* p = start;
+        float w = advances.advance(decodeUtf8(p, end));
+        if (used + w > budget) {
+            break;
+        }
+        used += w;
+        tail = start;
+    }
+    return str.substr(0, head - begin) + dots + str.substr(tail - begin);
 }
 
 enum class HAlign { Left, Center, Right };
 enum class VAlign { Top, Center, Bottom };
 
+// What the table currently lists
+enum class TableView { Files, Duplicates, Mounts, Diff, Statistics };
+
+// Fonts of assets/*.ttf. A font file is opened the first time its index is used
+// and then kept: every user holds a shared_ptr to the one sf::Font per file, so
+// nothing copies fonts and their glyph pages survive switching back and forth.
+class FontManager {
+private:
+    struct Entry {
+        std::string path;
+        std::shared_ptr<const sf::Font> font;
+        bool failed = false;
+    };
+    std::vector<Entry> entries;
+    std::shared_ptr<const sf::Font> fallbackFont;
+    std::string fallbackPath;
+    
+    static std::shared_ptr<const sf::Font> open(const std::string& path) {
+        auto font = std::make_shared<sf::Font>();
+        if (!font->openFromFile(path)) {
+            return nullptr;
+        }
+        return font;
+    }
+
+public:
+    explicit FontManager(const fs::path& directory) : fallbackPath((directory / "Sansation-Regular.ttf").string()) {
+        std::error_code ec;
+        if (fs::is_directory(directory, ec)) {
+            for (const auto& entry : fs::directory_iterator(directory, ec)) {
+                if (entry.path().extension() == ".ttf") {
+                    entries.push_back(Entry{entry.path().string(), nullptr, false});
+                }
+            }
+        }
+    }
+    
+    size_t size() const {
+        return entries.size();
+    }
+    
+    bool empty() const {
+        return entries.empty();
+    }
+    
+    // Font by index, opened on first use; the default font if the index is out
+    // of range or the file cannot be opened. nullptr only if nothing loads.
+    std::shared_ptr<const sf::Font> get(size_t index) {
+        if (index < entries.size() && !entries[index].failed) {
+            Entry& entry = entries[index];
+            if (!entry.font) {
+                entry.font = open(entry.path);
+                entry.failed = !entry.font;
+            }
+            if (entry.font) {
+                return entry.font;
+            }
+        }
+        return fallback();
+    }
+    
+    std::shared_ptr<const sf::Font> fallback() {
+        if (!fallbackFont) {
+            fallbackFont = open(fallbackPath);
+        }
+        return fallbackFont;
+    }
+};
+
 // Configuration structure for runtime menu
 struct AppConfig {
     int m = 20;                           // rows
@@ -790,17 +8506,29 @@ struct AppConfig {
 };
 
 // Menu system for runtime configuration
+// What a configuration change invalidates; each menu item maps to the
+// smallest set, so e.g. a color change never re-lays out the table
+enum LayoutDirty : unsigned {
+    DirtyNone = 0,
+    DirtyFonts = 1u << 0,       // font choice: texts are rebuilt against the new font
+    DirtyTextSize = 1u << 1,    // character sizes, text positions, glyph warming
+    DirtyGeometry = 1u << 2,    // rows/columns/frame: pagination, cells and grid
+    DirtyGrid = 1u << 3,        // line width, line/border color: grid shapes only
+    DirtyTextColor = 1u << 4,   // fill colors of the existing texts only
+    DirtyBackground = 1u << 5,  // read directly when the frame is cleared
+};
+
 class ConfigMenu {
 private:
     AppConfig& config;
-    std::vector<sf::Font>& fonts;
+    FontManager& fonts;
     bool isVisible = false;
     int selectedIndex = 0;
     std::vector<std::string> menuItems;
-    sf::Font menuFont;
+    std::shared_ptr<const sf::Font> menuFont;
     
 public:
-    ConfigMenu(AppConfig& cfg, std::vector<sf::Font>& fontsRef) : config(cfg), fonts(fontsRef) {
+    ConfigMenu(AppConfig& cfg, FontManager& fontsRef) : config(cfg), fonts(fontsRef) {
         menuItems = {
             "Rows (m): ",
             "Columns (n): ",
@@ -819,16 +8547,15 @@ public:
         };
         
         // Load menu font (use default if available)
-        if (!fonts.empty()) {
-            menuFont = fonts[0];
-        }
+        menuFont = fonts.get(0);
     }
     
     void toggle() { isVisible = !isVisible; }
     bool getVisible() const { return isVisible; }
     
-    void handleInput(sf::Keyboard::Scancode key) {
-        if (!isVisible) return;
+    // Returns the LayoutDirty flags of whatever the key changed
+    unsigned handleInput(sf::Keyboard::Scancode key) {
+        if (!isVisible) return DirtyNone;
         
         switch(key) {
             case sf::Keyboard::Scancode::Up:
@@ -838,11 +8565,9 @@ public:
                 selectedIndex = (selectedIndex + 1) % menuItems.size();
                 break;
             case sf::Keyboard::Scancode::Left:
-                adjustValue(-1);
-                break;
+                return adjustValue(-1);
             case sf::Keyboard::Scancode::Right:
-                adjustValue(1);
-                break;
+                return adjustValue(1);
             case sf::Keyboard::Scancode::Enter:
                 if (selectedIndex == menuItems.size() - 1) { // Close Menu
                     isVisible = false;
@@ -854,55 +8579,57 @@ public:
             default:
                 break;
         }
+        return DirtyNone;
     }
     
 private:
-    void adjustValue(int delta) {
+    unsigned adjustValue(int delta) {
         switch(selectedIndex) {
             case 0: // Rows
                 config.m = std::max(5, std::min(50, config.m + delta));
-                break;
+                return DirtyGeometry;
             case 1: // Columns
                 config.n = std::max(2, std::min(10, config.n + delta));
-                break;
+                return DirtyGeometry;
             case 2: // Frame Size
                 config.frameSize = std::max(0.0f, std::min(20.0f, config.frameSize + delta));
-                break;
+                return DirtyGeometry;
             case 3: // Line Size
                 config.lineSize = std::max(0.5f, std::min(10.0f, config.lineSize + delta * 0.5f));
-                break;
+                return DirtyGrid;
             case 4: // Font Index
                 if (!fonts.empty()) {
                     config.currentFontIndex = (config.currentFontIndex + delta + fonts.size()) % fonts.size();
                 }
-                break;
+                return DirtyFonts;
             case 5: // Header Font Index
                 if (!fonts.empty()) {
                     config.currentFontHeaderIndex = (config.currentFontHeaderIndex + delta + fonts.size()) % fonts.size();
                 }
-                break;
+                return DirtyFonts;
             case 6: // Font Size
                 config.fontSize = std::max(0.5f, std::min(5.0f, config.fontSize + delta * 0.1f));
-                break;
+                return DirtyTextSize;
             case 7: // Background Color
                 cycleColor(config.bgColor, delta);
-                break;
+                return DirtyBackground;
             case 8: // Text Color
                 cycleColor(config.textColor, delta);
-                break;
+                return DirtyTextColor;
             case 9: // Border Color
                 cycleColor(config.borderColor, delta);
-                break;
+                return DirtyGrid;
             case 10: // Line Color
                 cycleColor(config.lineColor, delta);
-                break;
+                return DirtyGrid;
             case 11: // Directory Color
                 cycleColor(config.dirColor, delta);
-                break;
+                return DirtyTextColor;
             case 12: // Page Info Color
                 cycleColor(config.pageInfoColor, delta);
-                break;
+                return DirtyTextColor;
         }
+        return DirtyNone;
     }
     
     void cycleColor(sf::Color& color, int delta) {
@@ -947,15 +8674,19 @@ public:
         menuBg.setOutlineColor(sf::Color::White);
         window.draw(menuBg);
         
+        if (!menuFont) {
+            return;
+        }
+        
         // Title
-        sf::Text title(menuFont, "Configuration Menu", 20);
+        sf::Text title(*menuFont, "Configuration Menu", 20);
         title.setFillColor(sf::Color::White);
         title.setPosition(sf::Vector2f(menuX + 10, menuY + 10));
         window.draw(title);
         
         // Menu items
         for (size_t i = 0; i < menuItems.size(); i++) {
-            sf::Text item(menuFont, getMenuItemText(i), 16);
+            sf::Text item(*menuFont, getMenuItemText(i), 16);
             item.setFillColor(i == selectedIndex ? sf::Color::Yellow : sf::Color::White);
             item.setPosition(sf::Vector2f(menuX + 10, menuY + 40 + i * 30));
             window.draw(item);
@@ -1035,35 +8766,339 @@ void setTextPosition(sf::Text& text, const sf::FloatRect& bounds, HAlign hAlign
     text.setPosition(sf::Vector2f(x, y));
 }
 
+// "512M", "2G", "65536" (K/M/G/T are powers of 1024)
+bool parseByteSize(const std::string& text, std::uintmax_t& bytes) {
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;  // strtoull would take "-1" as 2^64-1
+    }
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str() || errno != 0) {
+        return false;
+    }
+    std::string suffix(end);
+    static const std::string units = "KMGT";
+    if (suffix.empty()) {
+        bytes = value;
+        return true;
+    }
+    size_t unit = units.find(static_cast<char>(std::toupper(static_cast<unsigned char>(suffix[0]))));
+    if (unit == std::string::npos || (suffix.size() > 1 && suffix.substr(1) != "B" && suffix.substr(1) != "iB")) {
+        return false;
+    }
+    int shift = static_cast<int>(10 * (unit + 1));
+    if (value > (UINTMAX_MAX >> shift)) {
+        return false;  // "99999999T" would wrap around
+    }
+    bytes = static_cast<std::uintmax_t>(value) << shift;
+    return true;
+}
+
+// A plain decimal count no larger than maximum; strtoull alone would take "-1" as 2^64-1
+bool parseCount(const char* text, unsigned long long maximum, unsigned long long& value) {
+    if (!std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoull(text, &end, 10);
+    return *end == '\0' && errno != ERANGE && value <= maximum;
+}
+
 int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <dir> [m rows] [n cols] [frame size] [bgcolor hex] [linecolor hex] [line size] [font index] [border hex] [text hex] [font size]\n";
+    // Long options may appear anywhere; everything else keeps its positional meaning
+    ScanOptions scanOptions;
+    auto exclusions = std::make_shared<ExclusionMatcher>();
+    bool headless = false;
+    std::string exportPath;
+    std::string exportFormat;
+    std::string snapshotPath;
+    std::string diffBasePath;
+    std::string diffAgainstPath;
+    std::string servePath;
+    std::string connectPath;
+    long refreshSeconds = 600;
+    IndexQuery indexQuery;
+    std::vector<std::string> args;
+    // Options that take a value; one given last would otherwise be read as the directory
+    static const std::set<std::string> valueOptions = {
+        "--exclude", "--include", "--rules-file", "--export", "--export-format", "--save-snapshot",
+        "--diff", "--diff-against", "--memory-limit", "--spill-dir", "--serve", "--refresh-interval",
+        "--connect", "--sort", "--filter", "--offset", "--limit", "--polite-rate"};
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!hasValue && valueOptions.count(arg)) {
+            std::cerr << arg << " needs a value" << std::endl;
+            return 1;
+        }
+        if ((arg == "--exclude" || arg == "--include") && hasValue) {
+            exclusions->addRule(argv[++i], arg == "--include");
+        } else if (arg == "--rules-file" && hasValue) {
+            std::string rulesPath = argv[++i];
+            if (!exclusions->loadRulesFile(rulesPath)) {
+                std::cerr << "Cannot read rules file: " << rulesPath << std::endl;
+                return 1;
+            }
+        } else if (arg == "--export" && hasValue) {
+            exportPath = argv[++i];
+        } else if (arg == "--export-format" && hasValue) {
+            exportFormat = argv[++i];
+        } else if (arg == "--save-snapshot" && hasValue) {
+            snapshotPath = argv[++i];
+        } else if (arg == "--diff" && hasValue) {
+            diffBasePath = argv[++i];
+        } else if (arg == "--diff-against" && hasValue) {
+            diffAgainstPath = argv[++i];
+        } else if (arg == "--memory-limit" && hasValue) {
+            std::string limit = argv[++i];
+            if (!parseByteSize(limit, scanOptions.memoryLimit)) {
+                std::cerr << "Invalid memory limit: " << limit << " (e.g. 512M, 4G)" << std::endl;
+                return 1;
+            }
+            constexpr std::uintmax_t kMinimumLimit = std::uintmax_t(16) << 20;
+            if (scanOptions.memoryLimit < kMinimumLimit) {
+                std::cerr << "Memory limit raised to 16M" << std::endl;
+                scanOptions.memoryLimit = kMinimumLimit;
+            }
+        } else if (arg == "--spill-dir" && hasValue) {
+            scanOptions.spillDirectory = argv[++i];
+        } else if (arg == "--serve" && hasValue) {
+            servePath = argv[++i];
+        } else if (arg == "--refresh-interval" && hasValue) {
+            const char* text = argv[++i];
+            unsigned long long seconds = 0;
+            if (!parseCount(text, std::numeric_limits<long>::max(), seconds)) {
+                std::cerr << "Invalid --refresh-interval: " << text << " (seconds, 0 rescans only on request)" << std::endl;
+                return 1;
+            }
+            refreshSeconds = static_cast<long>(seconds);
+        } else if (arg == "--connect" && hasValue) {
+            connectPath = argv[++i];
+        } else if (arg == "--sort" && hasValue) {
+            std::string key = argv[++i];
+            if (!parseIndexSortKey(key, indexQuery.sort)) {
+                std::cerr << "Unknown sort key: " << key << " (expected table, path, name, size, allocated or mtime)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--desc") {
+            indexQuery.descending = true;
+        } else if (arg == "--filter" && hasValue) {
+            indexQuery.filter = argv[++i];
+        } else if (arg == "--offset" && hasValue) {
+            const char* text = argv[++i];
+            unsigned long long offset = 0;
+            if (!parseCount(text, std::numeric_limits<std::uint64_t>::max(), offset)) {
+                std::cerr << "Invalid --offset: " << text << " (a row number)" << std::endl;
+                return 1;
+            }
+            indexQuery.offset = offset;
+        } else if (arg == "--limit" && hasValue) {
+            const char* text = argv[++i];
+            unsigned long long limit = 0;
+            if (!parseCount(text, std::numeric_limits<std::uint32_t>::max(), limit)) {
+                std::cerr << "Invalid --limit: " << text << " (a row count up to " << std::numeric_limits<std::uint32_t>::max() << ")" << std::endl;
+                return 1;
+            }
+            indexQuery.limit = static_cast<std::uint32_t>(limit);
+        } else if (arg == "--human-readable" || arg == "-h") {
+            FormatEngine::setHumanReadable(true);
+        } else if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--reflinks") {
+            scanOptions.reflinkAccounting = true;
+        } else if (arg == "--one-file-system" || arg == "-x") {
+            scanOptions.oneFileSystem = true;
+        } else if (arg == "--scan-pseudo-fs") {
+            scanOptions.skipPseudoFs = false;
+        } else if (arg == "--skip-network-fs") {
+            scanOptions.skipNetworkFs = true;
+        } else if (arg == "--inode-order") {
+            scanOptions.inodeOrder = true;
+        } else if (arg == "--polite") {
+            if (scanOptions.politeRate == 0) {
+                scanOptions.politeRate = 500;
+            }
+        } else if (arg == "--polite-rate" && hasValue) {
+            const char* text = argv[++i];
+            char* end = nullptr;
+            errno = 0;
+            scanOptions.politeRate = std::strtod(text, &end);
+            if (end == text || *end != '\0' || errno == ERANGE || !std::isfinite(scanOptions.politeRate) ||
+                scanOptions.politeRate <= 0) {
+                std::cerr << "Invalid --polite-rate: " << text << " (a positive number of operations per second)" << std::endl;
+                return 1;
+            }
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (scanOptions.politeRate > 0 && !PoliteIo::enable()) {
+        std::cerr << "Polite mode: cannot set the idle I/O class (" << strerror(errno) << "), only throttling" << std::endl;
+    }
+    int argCount = static_cast<int>(args.size());
+    
+    if (!exclusions->empty()) {
+        exclusions->compile();
+        scanOptions.exclusions = exclusions;
+    }
+    
+    // Two saved snapshots: no scan is needed
+    if (!diffBasePath.empty() && !diffAgainstPath.empty()) {
+        SnapshotReader before, after;
+        if (!before.open(diffBasePath) || !after.open(diffAgainstPath)) {
+            std::cerr << "Cannot read snapshot: " << (before.root().empty() ? diffBasePath : diffAgainstPath) << std::endl;
+            return 1;
+        }
+        printSnapshotDiff(before, after);
+        if (before.damaged() || after.damaged()) {
+            std::cerr << "Snapshot is truncated or corrupt: " << (before.damaged() ? diffBasePath : diffAgainstPath) << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    
+    // Rows come from a scan daemon instead of a local scan
+    std::unique_ptr<IndexClient> indexClient;
+    IndexStatus served;
+    if (!connectPath.empty()) {
+        indexClient = std::make_unique<IndexClient>();
+        if (!indexClient->connect(connectPath) || !indexClient->status(served)) {
+            std::cerr << "Index daemon: " << indexClient->lastError() << std::endl;
+            return 1;
+        }
+        while (served.generation == 0) {
+            std::cout << "\rWaiting for the first scan of " << served.root << "..." << std::flush;
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            if (!indexClient->status(served)) {
+                std::cerr << "Index daemon: " << indexClient->lastError() << std::endl;
+                return 1;
+            }
+        }
+    }
+    
+    // Scripted query: one page (or --limit 0 for everything) as tab-separated lines
+    if (indexClient && headless) {
+        IndexQuery page = indexQuery;
+        std::uint64_t remaining = indexQuery.limit == 0 ? UINT64_MAX : indexQuery.limit;
+        IndexPage result;
+        do {
+            page.limit = static_cast<std::uint32_t>(std::min<std::uint64_t>(remaining, 65536));
+            if (!indexClient->query(page, result)) {
+                std::cerr << "Index daemon: " << indexClient->lastError() << std::endl;
+                return 1;
+            }
+            for (const FileInfo& row : result.rows) {
+                std::cout << row.permissions << '\t' << row.actualSize << '\t' << row.allocatedSize << '\t'
+                          << row.date << '\t' << row.name << '\n';
+            }
+            page.offset += result.rows.size();
+            remaining -= result.rows.size();
+        } while (remaining > 0 && !result.rows.empty() && page.offset < result.matched);
+        std::cerr << result.matched << " matching entries (generation " << result.generation << ")" << std::endl;
+        return 0;
+    }
+    
+    if (argCount < 2 && !indexClient) {
+        std::cerr << "Usage: " << args[0] << " [-h|--human-readable] [--memory-limit SIZE [--spill-dir DIR]] [--serve SOCKET [--refresh-interval SECONDS]] [--connect SOCKET [--headless --sort KEY --desc --filter GLOB --offset N --limit N]] [--save-snapshot FILE] [--diff OLD [--diff-against NEW]] [--reflinks] [-x|--one-file-system] [--inode-order] [--polite [--polite-rate OPS]] [--scan-pseudo-fs] [--skip-network-fs] [--exclude PATTERN]... [--include PATTERN]... [--rules-file FILE] [--headless] [--export FILE] [--export-format csv|ndjson|columnar] <dir> [m rows] [n cols] [frame size] [bgcolor hex] [linecolor hex] [line size] [font index] [border hex] [text hex] [font size]\n";
         std::cerr << "Optimized for fast scanning like 'ls -lR'. Shows ALL files recursively with no depth limits.\n";
-        std::cerr << "Controls: Arrow keys/PgUp/PgDn = navigate, R = rescan, M = menu, L = show log info, ESC = interrupt scan\n";
+        std::cerr << "Controls: Arrow keys/PgUp/PgDn = navigate, R = rescan, M = menu, L = show log info, D = duplicates, H = checksum all, O = mounts, E = export, F = snapshot diff, Ctrl+click/Shift+click/Ctrl+A/S = select, U = clear selection, C/N = batch chmod/rename, ESC = interrupt scan\n";
         return 1;
     }
     
-    std::string targetDirectory = argv[1];
-    fs::path absPath = fs::canonical(targetDirectory);
-    std::string absoluteDirectory = absPath.string();
+    std::string absoluteDirectory;
+    if (indexClient) {
+        absoluteDirectory = served.root;  // a positional directory only keeps the other positions in place
+    } else {
+        std::string targetDirectory = args[1];
+        fs::path absPath = fs::canonical(targetDirectory);
+        absoluteDirectory = absPath.string();
+    }
     
     // Initialize configuration with command line arguments or defaults
     AppConfig config;
-    config.m = (argc >= 3) ? std::stoi(argv[2]) : 20;                        // m (rows)
-    config.n = (argc >= 4) ? std::stoi(argv[3]) : 4;                         // n        
-    config.frameSize = (argc >= 5) ? std::stoi(argv[4]) : 5.0f;              // frame size (border size)
+    config.m = (argCount >= 3) ? std::stoi(args[2]) : 20;                        // m (rows)
+    config.n = (argCount >= 4) ? std::stoi(args[3]) : 4;                         // n        
+    config.frameSize = (argCount >= 5) ? std::stoi(args[4]) : 5.0f;              // frame size (border size)
+    
+    if (argCount >= 6) ColorParse::hexToColor(args[5], config.bgColor);
+    if (argCount >= 7) ColorParse::hexToColor(args[6], config.lineColor);
+    
+    config.lineSize = argCount >= 8 ? std::stof(args[7]) : 2.f;                  // line size
+    config.currentFontIndex = argCount >= 9 ? std::stoi(args[8]) : 1;            // font index
+    config.currentFontHeaderIndex = argCount >= 10 ? std::stoi(args[9]) : 2;     // font index
     
-    if (argc >= 6) ColorParse::hexToColor(argv[5], config.bgColor);
-    if (argc >= 7) ColorParse::hexToColor(argv[6], config.lineColor);
+    if (argCount >= 11) ColorParse::hexToColor(args[10], config.borderColor);
+    if (argCount >= 12) ColorParse::hexToColor(args[11], config.textColor);
     
-    config.lineSize = argc >= 8 ? std::stof(argv[7]) : 2.f;                  // line size
-    config.currentFontIndex = argc >= 9 ? std::stoi(argv[8]) : 1;            // font index
-    config.currentFontHeaderIndex = argc >= 10 ? std::stoi(argv[9]) : 2;     // font index
+    config.fontSize = argCount >= 13 ? std::stof(args[12]) : 1.5f;               // font size multiplier
     
-    if (argc >= 11) ColorParse::hexToColor(argv[10], config.borderColor);
-    if (argc >= 12) ColorParse::hexToColor(argv[11], config.textColor);
+    if (!exportFormat.empty() && exportFormat != "csv" && exportFormat != "ndjson" && exportFormat != "columnar") {
+        std::cerr << "Unknown export format: " << exportFormat << " (expected csv, ndjson or columnar)" << std::endl;
+        return 1;
+    }
+    
+    // Rows go to the export file directory by directory while the scan runs
+    std::shared_ptr<ExportSink> scanExport;
+    if (!exportPath.empty()) {
+        scanExport = createExportSink(exportPath, exportFormat);
+        if (!scanExport) {
+            std::cerr << "Cannot create export file: " << exportPath << std::endl;
+            return 1;
+        }
+        scanOptions.exportSink = scanExport;
+    }
+    
+    // Daemon: keep the index fresh and answer queries until SIGINT/SIGTERM
+    if (!servePath.empty()) {
+        static std::atomic<bool> stopRequested{false};
+        auto onSignal = [](int) { stopRequested = true; };
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+        IndexServer server(absoluteDirectory, scanOptions, servePath, std::chrono::seconds(refreshSeconds));
+        return server.run(stopRequested) ? 0 : 1;
+    }
     
-    config.fontSize = argc >= 13 ? std::stof(argv[12]) : 1.5f;               // font size multiplier
+    // Headless: scan (and export) without opening a window
+    if (headless) {
+        // Exporting alone needs no table in memory; snapshots and diffs do
+        scanOptions.retainEntries = !scanExport || !snapshotPath.empty() || !diffBasePath.empty();
+        FileManager manager(absoluteDirectory, nullptr, scanOptions);
+        
+        if (!snapshotPath.empty()) {
+            if (!saveSnapshot(manager.getFiles(), absoluteDirectory, snapshotPath)) {
+                std::cerr << "Failed to write snapshot: " << snapshotPath << std::endl;
+                return 1;
+            }
+            std::cout << "Saved snapshot of " << manager.getFiles().size() << " entries to " << snapshotPath << std::endl;
+        }
+        if (!diffBasePath.empty()) {
+            SnapshotReader before;
+            if (!before.open(diffBasePath)) {
+                std::cerr << "Cannot read snapshot: " << diffBasePath << std::endl;
+                return 1;
+            }
+            TableEntryStream after(manager.getFiles(), absoluteDirectory);
+            printSnapshotDiff(before, after);
+            if (before.damaged()) {
+                std::cerr << "Snapshot is truncated or corrupt: " << diffBasePath << std::endl;
+                return 1;
+            }
+        }
+        
+        if (scanExport) {
+            if (!scanExport->finish()) {
+                std::cerr << "Failed to write export file: " << exportPath << std::endl;
+                return 1;
+            }
+            std::cout << "Exported " << scanExport->getRowCount() << " entries to " << exportPath << std::endl;
+        }
+        const SpaceTotals& space = manager.getSpaceTotals();
+        std::cout << "Entries: " << manager.getScannedCount() << ", apparent: " << space.apparentBytes
+                  << " bytes, unique: " << space.uniqueBytes << " bytes" << std::endl;
+        return 0;
+    }
 
     auto desktop = sf::VideoMode::getDesktopMode();
     unsigned int width = desktop.size.x;
@@ -1071,46 +9106,18 @@ int main(int argc, char** argv) {
 
     sf::RenderWindow window(desktop, "", sf::State::Fullscreen);
 
-    // Загрузка шрифтов
-    std::vector<sf::Font> fonts;
-    std::vector<std::string> fontNames;
-    if (fs::exists("assets") && fs::is_directory("assets")) {
-        for (const auto& entry : fs::directory_iterator("assets")) {
-            if (entry.path().extension() == ".ttf") {
-                sf::Font f;
-                if (f.openFromFile(entry.path().string())) {
-                    fonts.push_back(std::move(f));
-                    fontNames.push_back(entry.path().filename().string());
-                }
-            }
-        }
-    }
-
-    sf::Font font;
-    sf::Font Headerfont;
+    // Загрузка шрифтов (по требованию)
+    FontManager fonts("assets");
+    std::shared_ptr<const sf::Font> font;
+    std::shared_ptr<const sf::Font> Headerfont;
 
-    // Function to update fonts based on current indices
+    // Function to update fonts based on current indices: only swaps shared handles
     auto updateFonts = [&]() {
-        if (!fonts.empty() && config.currentFontIndex < fonts.size()) {
-            font = fonts[config.currentFontIndex];
-        } else {
-            // Попытка загрузить системный шрифт
-            fs::path defaultFont = fs::path("assets") / "Sansation-Regular.ttf";
-            if (!font.openFromFile(defaultFont.string())) {
-                std::cerr << "Warning: Could not load font\n";
-                return false;
-            }
-        }
-        
-        if (!fonts.empty() && config.currentFontHeaderIndex < fonts.size()) {
-            Headerfont = fonts[config.currentFontHeaderIndex];
-        } else {
-            // Попытка загрузить системный шрифт
-            fs::path defaultFont = fs::path("assets") / "Sansation-Regular.ttf";
-            if (!Headerfont.openFromFile(defaultFont.string())) {
-                std::cerr << "Warning: Could not load font\n";
-                return false;
-            }
+        font = fonts.get(config.currentFontIndex);
+        Headerfont = fonts.get(config.currentFontHeaderIndex);
+        if (!font || !Headerfont) {
+            std::cerr << "Warning: Could not load font\n";
+            return false;
         }
         return true;
     };
@@ -1127,7 +9134,9 @@ int main(int argc, char** argv) {
     auto preloadGlyphs = [&]() {
         unsigned int charSize = static_cast<unsigned int>(16 * config.fontSize);
         for (char c : commonChars) {
-            (void)font.getGlyph(c, charSize, false, 0);
+            (void)font->getGlyph(c, charSize, false, 0);       // cells
+            (void)font->getGlyph(c, charSize - 2, false, 0);   // page info
+            (void)Headerfont->getGlyph(c, charSize + 4, false, 0);
         }
     };
     preloadGlyphs();
@@ -1142,12 +9151,14 @@ int main(int argc, char** argv) {
 
     auto [cellWidth, cellHeight] = recalculateLayout();
     
-    //2048
-    
-    float cellNameWidth = 1250.0f;
-    float cellSizeWidth = 366.0f; 
-    float cellDateWidth = 216.0f; 
-    float cellPermWidth = 216.0f; 
+    // Set from the data by autoSizeColumns; hidden columns are 0 wide
+    float cellNameWidth = 0.0f;
+    float cellSizeWidth = 0.0f; 
+    float cellDateWidth = 0.0f; 
+    float cellPermWidth = 0.0f; 
+    float cellSumWidth = 0.0f;   // optional checksum column (n >= 5)
+    float cellLinkWidth = 0.0f;  // optional link count column (n >= 6)
+    const float cellPadding = 2 * 10.0f + 6.0f;  // setTextPosition padding on both sides and a gap
 
     auto calcCellWidthByNumber = [&](int j){
         switch (j)
@@ -1157,21 +9168,102 @@ int main(int argc, char** argv) {
             case 1: return cellNameWidth + cellSizeWidth;
             case 2: return cellNameWidth + cellSizeWidth + cellDateWidth;
             case 3: return cellNameWidth + cellSizeWidth + cellDateWidth + cellPermWidth;
+            case 4: return cellNameWidth + cellSizeWidth + cellDateWidth + cellPermWidth + cellSumWidth;
+            case 5: return cellNameWidth + cellSizeWidth + cellDateWidth + cellPermWidth + cellSumWidth + cellLinkWidth;
         }
-        return cellNameWidth + cellSizeWidth + cellDateWidth + cellPermWidth;
+        return cellNameWidth + cellSizeWidth + cellDateWidth + cellPermWidth + cellSumWidth + cellLinkWidth;
+    };
+    
+    auto columnWidth = [&](int j) {
+        return calcCellWidthByNumber(j) - calcCellWidthByNumber(j - 1);
     };
 
-    // Загрузка файлов (no depth limits - show all files)
-    std::cout << "Scanning all files recursively (no depth limit)..." << std::endl;
+    // The daemon's current generation, mapped rather than copied
+    auto openServedIndex = [&]() -> std::unique_ptr<FileManager> {
+        std::shared_ptr<const PagedRows> rows;
+        std::uint64_t generation = 0;
+        if (!indexClient->open(rows, generation, served.totals)) {
+            std::cerr << "Index daemon: " << indexClient->lastError() << std::endl;
+            return nullptr;
+        }
+        std::cout << "Mapped " << rows->size() << " entries (generation " << generation << ") from " << connectPath << std::endl;
+        return std::make_unique<FileManager>(absoluteDirectory, std::move(rows), served.totals);
+    };
     
-    std::unique_ptr<FileManager> fileManagerPtr = std::make_unique<FileManager>(absoluteDirectory, &window);
+    // The viewer reads the table from the UI thread only, so it can keep it front-coded
+    scanOptions.compactNames = true;
+    
+    // Загрузка файлов (no depth limits - show all files)
+    std::unique_ptr<FileManager> fileManagerPtr;
+    if (indexClient) {
+        fileManagerPtr = openServedIndex();
+        if (!fileManagerPtr) {
+            return 1;
+        }
+    } else {
+        std::cout << "Scanning all files recursively (no depth limit)..." << std::endl;
+        fileManagerPtr = std::make_unique<FileManager>(absoluteDirectory, &window, scanOptions, fonts.fallback());
+    }
     auto files = fileManagerPtr->getFiles();
     
+    // Decoded chunks a paged table may keep: a quarter of the limit at ~256 bytes per row
+    const size_t residentChunks = std::max<size_t>(8, scanOptions.memoryLimit / 4 / (FileTable::kChunkRows * 256));
+    
+    if (scanExport) {
+        if (scanExport->finish()) {
+            std::cout << "Exported " << scanExport->getRowCount() << " entries to " << exportPath << std::endl;
+        } else {
+            std::cerr << "Failed to write export file: " << exportPath << std::endl;
+        }
+        scanOptions.exportSink = nullptr;  // rescans do not overwrite the export
+    }
+    
+    if (!snapshotPath.empty()) {
+        if (saveSnapshot(files, absoluteDirectory, snapshotPath)) {
+            std::cout << "Saved snapshot of " << files.size() << " entries to " << snapshotPath << std::endl;
+        } else {
+            std::cerr << "Failed to write snapshot: " << snapshotPath << std::endl;
+        }
+    }
+    
+    // Content checksums survive rescans; the on-disk cache survives restarts
+    ChecksumService checksums(fileManagerPtr->getSharedLogger());
+    
     // Inform user about logging
     if (fileManagerPtr->isLoggingEnabled()) {
         std::cout << "Logging unreadable files to: " << fileManagerPtr->getLogFilePath() << std::endl;
     }
     
+    TableView currentView = TableView::Files;
+    
+    // Duplicate view: files holds the rows of all groups, rowGroups[i] is the group of row i
+    DuplicateReport duplicateReport;
+    std::vector<size_t> rowGroups;
+    
+    // Diff view: rowStatus[i] is the kind of change shown in row i
+    std::vector<DiffStatus> rowStatus;
+    
+    // Multi-selection for batch operations (Files view only)
+    std::vector<char> selectedRows;
+    size_t selectedCount = 0;
+    int selectionAnchor = -1;
+    auto resetSelection = [&]() {
+        selectedRows.assign(files.size(), 0);
+        selectedCount = 0;
+        selectionAnchor = -1;
+    };
+    auto setSelected = [&](size_t row, bool on) {
+        if (row < selectedRows.size() && (selectedRows[row] != 0) != on) {
+            selectedRows[row] = on;
+            on ? selectedCount++ : selectedCount--;
+        }
+    };
+    resetSelection();
+    
+    // Copy, move or delete of the selection running in the background (one at a time)
+    std::unique_ptr<FileJob> fileJob;
+    auto lastFileJobPoll = std::chrono::steady_clock::now();
+    
     // Пагинация
     int currentPage = 0;
     auto calculatePagination = [&]() {
@@ -1184,20 +9276,27 @@ int main(int argc, char** argv) {
 
     std::vector<sf::Text> headers;
     std::vector<sf::Text> cells;
+    DisplayTextCache displayText;  // decoded cell strings
+    GlyphWarmer glyphWarmer;
 
     // Function to update headers
+    const std::vector<std::string> columnTitles = {absoluteDirectory, "Size (data/allocated)", "Date", "Permissions", "Checksum (XXH64)", "Links"};
+    TextMeasurer measurer;
+
     auto updateHeaders = [&]() {
         headers.clear();
-        std::vector<std::string> headersNames = {absoluteDirectory, "Size (data/allocated)", "Date", "Permissions"};
         unsigned int charSize = static_cast<unsigned int>(16 * config.fontSize);
+        GlyphAdvanceTable& advances = measurer.table(*Headerfont, charSize + 4);
         
-        for (int j = 0; j < std::min(config.n, 4); j++) {
-            sf::Text t(Headerfont, headersNames[j], config.fontSize);
+        for (int j = 0; j < std::min(config.n, 6); j++) {
+            std::string title = truncateToWidth(columnTitles[j], columnWidth(j) - cellPadding, advances,
+                                                j == 0 ? Ellipsis::Middle : Ellipsis::End);
+            sf::Text t(*Headerfont, utf8ToSfString(title), config.fontSize);
             t.setFillColor(config.textColor);
             t.setCharacterSize(charSize + 4);
             
             float cellWidtht = calcCellWidthByNumber(j-1);
-            float x = j < 4 ? config.frameSize + cellWidtht : config.frameSize + cellWidtht + j * cellWidth;
+            float x = j < 6 ? config.frameSize + cellWidtht : config.frameSize + cellWidtht + j * cellWidth;
             sf::FloatRect cellBounds(
                 sf::Vector2f(x, config.frameSize),
                 sf::Vector2f(cellWidtht, cellHeight)
@@ -1215,15 +9314,87 @@ int main(int argc, char** argv) {
         unsigned int charSize = static_cast<unsigned int>(16 * config.fontSize);
 
         for (int i = 0; i < itemsPerPage; ++i) {
-            sf::Text t(font, "", charSize);
+            sf::Text t(*font, "", charSize);
             t.setFillColor(config.textColor);
             cells.push_back(std::move(t));
         }
     };
 
+    // Mount, diff and statistics rows carry a descriptive label or a path rather than a bare name
+    auto labelRows = [&]() {
+        return currentView == TableView::Mounts || currentView == TableView::Diff || currentView == TableView::Statistics;
+    };
+    auto nameText = [&](const FileInfo& fileInfo) {
+        return labelRows() ? fileInfo.name : fs::path(fileInfo.name).filename().string();
+    };
+    
+    auto linksText = [](const FileInfo& fileInfo) {
+        // "+" marks a hardlink whose inode was already counted by an earlier row
+        return std::to_string(fileInfo.linkCount) + (fileInfo.isExtraLink ? " +" : "");
+    };
+    
+    // Every column but Name is as wide as the widest of its sampled values (or its
+    // title); Name gets the rest of the screen. A strided sample of the table keeps
+    // this independent of the number of rows.
+    auto autoSizeColumns = [&]() {
+        constexpr size_t kSampleRows = 2048;
+        unsigned int charSize = static_cast<unsigned int>(16 * config.fontSize);
+        GlyphAdvanceTable& cellAdvances = measurer.table(*font, charSize);
+        GlyphAdvanceTable& headerAdvances = measurer.table(*Headerfont, charSize + 4);
+        
+        float widest[6] = {};
+        for (int j = 1; j < 6; j++) {
+            widest[j] = headerAdvances.width(columnTitles[j]);
+        }
+        widest[4] = std::max(widest[4], cellAdvances.width("0123456789abcdef"));  // XXH64 in hex
+        // Whole chunks spread over the table, so a paged table decodes only a few of them
+        constexpr size_t kSampleChunks = 16;
+        size_t chunkCount = files.chunkCount();
+        size_t picked = std::min(chunkCount, kSampleChunks);
+        for (size_t k = 0; k < picked; k++) {
+            const std::vector<FileInfo>& rows = files.chunk(k * chunkCount / picked);
+            size_t step = std::max<size_t>(1, rows.size() / (kSampleRows / kSampleChunks));
+            for (size_t r = 0; r < rows.size(); r += step) {
+                const FileInfo& fileInfo = rows[r];
+                widest[1] = std::max(widest[1], cellAdvances.width(fileInfo.size));
+                widest[2] = std::max(widest[2], cellAdvances.width(fileInfo.date));
+                widest[3] = std::max(widest[3], cellAdvances.width(fileInfo.permissions));
+                widest[5] = std::max(widest[5], cellAdvances.width(linksText(fileInfo)));
+            }
+        }
+        
+        int shown = std::min(config.n, 6);
+        float* columns[6] = {&cellNameWidth, &cellSizeWidth, &cellDateWidth, &cellPermWidth, &cellSumWidth, &cellLinkWidth};
+        float available = width - config.frameSize * 2.0f;
+        float rest = available;
+        for (int j = 1; j < 6; j++) {
+            *columns[j] = j < shown ? std::ceil(widest[j] + cellPadding) : 0.0f;
+            rest -= *columns[j];
+        }
+        cellNameWidth = std::max(rest, available / 4.0f);
+    };
+    
+    auto cellColor = [&](int fileIndex) {
+        if (currentView == TableView::Duplicates && fileIndex < (int)rowGroups.size()) {
+            // Alternate colors so neighbouring groups are distinguishable
+            return rowGroups[fileIndex] % 2 ? config.dirColor : config.textColor;
+        }
+        if (currentView == TableView::Diff && fileIndex < (int)rowStatus.size()) {
+            switch (rowStatus[fileIndex]) {
+                case DiffStatus::Added: return sf::Color(80, 200, 120);
+                case DiffStatus::Removed: return sf::Color(230, 90, 90);
+                case DiffStatus::Modified: return sf::Color(230, 200, 80);
+                case DiffStatus::Grown: return sf::Color(240, 150, 60);
+                case DiffStatus::DirectoryDelta: return config.dirColor;
+            }
+        }
+        return files[fileIndex].isDirectory ? config.dirColor : config.textColor;
+    };
+
     auto updateCells = [&](int page) {
         int startIndex = page * itemsPerPage;
         unsigned int charSize = static_cast<unsigned int>(16 * config.fontSize);
+        GlyphAdvanceTable& advances = measurer.table(*font, charSize);
         
         // Update cell character size
         for (auto& cell : cells) {
@@ -1245,19 +9416,37 @@ int main(int argc, char** argv) {
                 std::string text;
                 
                 switch (j) {
-                    case 0: text = truncate(fs::path(fileInfo.name).filename().string()); break;
+                    case 0: text = nameText(fileInfo); break;
                     case 1: text = fileInfo.size; break;
                     case 2: text = fileInfo.date; break;
                     case 3: text = fileInfo.permissions; break;
+                    case 4:
+                    {
+                        // Computed lazily: only rows that are on screen get hashed
+                        bool unreadable = false;
+                        if (auto sum = checksums.request(fileInfo, &unreadable)) {
+                            text = ChecksumService::toHex(*sum);
+                        } else if (S_ISREG(fileInfo.mode)) {
+                            text = unreadable ? "unreadable" : "...";
+                        }
+                        break;
+                    }
+                    case 5: text = linksText(fileInfo); break;
                     default: text = "";
                 }
+                if (j < 6) {
+                    // Paths keep both ends; everything else loses its tail
+                    bool path = j == 0 && labelRows();
+                    text = truncateToWidth(text, columnWidth(j) - cellPadding, advances,
+                                           path ? Ellipsis::Middle : Ellipsis::End);
+                }
                 
                 auto& t = cells[idx];
-                t.setString(text);
-                t.setFillColor(fileInfo.isDirectory ? config.dirColor : config.textColor);
+                t.setString(displayText.get(text));
+                t.setFillColor(cellColor(fileIndex));
                 
                 float cellWidtht = calcCellWidthByNumber(j-1);
-                float x = j < 4 ? config.frameSize + cellWidtht : config.frameSize + cellWidtht + j * cellWidth;
+                float x = j < 6 ? config.frameSize + cellWidtht : config.frameSize + cellWidtht + j * cellWidth;
                 sf::FloatRect cellBounds(
                     sf::Vector2f(x, config.frameSize + (i + 1) * cellHeight),
                     sf::Vector2f(cellWidtht, cellHeight)
@@ -1268,67 +9457,856 @@ int main(int argc, char** argv) {
         }
     };
 
-    sf::Text pageInfo(font, "", config.fontSize);
-
-    auto updatePageInfo = [&]() {
+    sf::Text pageInfo(*font, "", config.fontSize);
+
+    auto updatePageInfo = [&]() {
+        std::ostringstream oss;
+        oss << "Page " << (currentPage + 1) << "/" << totalPages
+            << " | Files: " << files.size();
+        
+        const SpaceTotals& space = fileManagerPtr->getSpaceTotals();
+        oss << " | Apparent: " << space.apparentBytes << " | Unique: " << space.uniqueBytes << " bytes";
+        if (space.extraLinks > 0) {
+            oss << " (" << space.extraLinks << " hardlinks)";
+        }
+        if (space.sharedExtentBytes > 0) {
+            oss << " | Shared extents: " << space.sharedExtentBytes;
+        }
+        
+        if (checksums.pendingCount() > 0) {
+            oss << " | Checksums pending: " << checksums.pendingCount();
+        }
+        
+        if (selectedCount > 0) {
+            oss << " | Selected: " << selectedCount;
+        }
+        
+        if (fileJob) {
+            oss << " | " << fileJob->progressText();
+        }
+        
+        if (currentView == TableView::Duplicates) {
+            oss << " | Duplicate groups: " << duplicateReport.groups.size()
+                << " | Redundant files: " << duplicateReport.duplicateFiles
+                << " | Reclaimable: " << duplicateReport.reclaimableBytes << " bytes";
+        }
+        
+        // Add logging information if available
+        if (fileManagerPtr->isLoggingEnabled()) {
+            oss << " | Log: " << fs::path(fileManagerPtr->getLogFilePath()).filename().string();
+        }
+            //<< " | Dir: " << truncate(targetDirectory, 50);
+        
+        unsigned int charSize = static_cast<unsigned int>(16 * config.fontSize);
+        sf::Text t(*font, utf8ToSfString(oss.str()), charSize - 2);
+        t.setFillColor(config.pageInfoColor);
+        
+        sf::FloatRect cellBounds(
+            sf::Vector2f(0, height - 40),
+            sf::Vector2f(width, 40)
+        );
+
+        setTextPosition(t, cellBounds, HAlign::Center, VAlign::Center);
+        pageInfo = t;
+    };
+
+    // Non-ASCII characters of the scanned names are rasterized a little every frame
+    auto restartGlyphWarming = [&]() {
+        unsigned int charSize = static_cast<unsigned int>(16 * config.fontSize);
+        glyphWarmer.reset({{font.get(), charSize}, {font.get(), charSize - 2}, {Headerfont.get(), charSize + 4}},
+                          fileManagerPtr->getCodePoints());
+    };
+
+    // Borders and grid lines, rebuilt only when geometry, line size or their colors change
+    std::vector<sf::RectangleShape> gridShapes;
+    auto rebuildGrid = [&]() {
+        gridShapes.clear();
+        
+        sf::RectangleShape topBorder(sf::Vector2f(width, (float)config.frameSize));
+        topBorder.setPosition(sf::Vector2f(0, 0));
+        topBorder.setFillColor(config.borderColor);
+        gridShapes.push_back(topBorder);
+
+        sf::RectangleShape bottomBorder(sf::Vector2f(width, (float)config.frameSize));
+        bottomBorder.setPosition(sf::Vector2f(0, (float)height - config.frameSize));
+        bottomBorder.setFillColor(config.borderColor);
+        gridShapes.push_back(bottomBorder);
+        
+        sf::RectangleShape leftBorder(sf::Vector2f((float)config.frameSize, height));
+        leftBorder.setPosition(sf::Vector2f(0, (float)config.frameSize));
+        leftBorder.setFillColor(config.borderColor);
+        gridShapes.push_back(leftBorder);
+        
+        sf::RectangleShape rightBorder(sf::Vector2f((float)config.frameSize, height));
+        rightBorder.setPosition(sf::Vector2f(width - config.frameSize, (float)config.frameSize));
+        rightBorder.setFillColor(config.borderColor);
+        gridShapes.push_back(rightBorder);
+
+        for (int i = 1; i < config.m; i++) {
+            sf::RectangleShape line({(float)width - config.frameSize * 2, (float)config.lineSize});
+            line.setFillColor(config.lineColor);
+            float y = config.frameSize + i * cellHeight;
+            line.setPosition(sf::Vector2f(config.frameSize, y));
+            gridShapes.push_back(line);
+        }
+
+        for (int j = 1; j <= config.n; j++) {
+            sf::RectangleShape vline({(float)config.lineSize, (float)height - config.frameSize * 2});
+            vline.setFillColor(config.lineColor);
+            float cellCalcWidth = calcCellWidthByNumber(j-1);
+            float x = j <= 6 ? config.frameSize + cellCalcWidth : config.frameSize + cellCalcWidth + j * cellWidth;
+            vline.setPosition(sf::Vector2f(x, config.frameSize));
+            gridShapes.push_back(vline);
+        }
+    };
+    
+    // New colors on the texts that already exist; nothing is re-laid out
+    auto recolorTexts = [&]() {
+        for (auto& t : headers) {
+            t.setFillColor(config.textColor);
+        }
+        int startIndex = currentPage * itemsPerPage;
+        for (int i = 0; i < config.m - 1; i++) {
+            int fileIndex = startIndex + i;
+            for (int j = 0; j < config.n && fileIndex < (int)files.size(); j++) {
+                int idx = i * config.n + j;
+                if (idx < (int)cells.size()) {
+                    cells[idx].setFillColor(cellColor(fileIndex));
+                }
+            }
+        }
+        pageInfo.setFillColor(config.pageInfoColor);
+    };
+
+    // Function to refresh everything when config changes
+    auto refreshAll = [&]() {
+        updateFonts();
+        preloadGlyphs();
+        restartGlyphWarming();
+        autoSizeColumns();
+        auto [newCellWidth, newCellHeight] = recalculateLayout();
+        cellWidth = newCellWidth;
+        cellHeight = newCellHeight;
+        auto [newItemsPerPage, newTotalPages] = calculatePagination();
+        itemsPerPage = newItemsPerPage;
+        totalPages = newTotalPages;
+        
+        // Adjust current page if necessary
+        if (currentPage >= totalPages && totalPages > 0) {
+            currentPage = totalPages - 1;
+        }
+        
+        updateHeaders();
+        initializeCells();
+        updateCells(currentPage);
+        updatePageInfo();
+        rebuildGrid();
+    };
+    
+    // Redo only what a ConfigMenu change invalidated (see LayoutDirty)
+    auto applyConfigChange = [&](unsigned dirty) {
+        if (dirty & DirtyGeometry) {
+            refreshAll();  // pagination and every cell position depend on it
+            return;
+        }
+        if (dirty & DirtyFonts) {
+            updateFonts();
+            preloadGlyphs();
+            restartGlyphWarming();
+        }
+        if (dirty & (DirtyFonts | DirtyTextSize)) {
+            if (dirty & DirtyTextSize) {
+                preloadGlyphs();
+                restartGlyphWarming();
+            }
+            // Existing texts keep their strings; sf::Text is rebuilt only for a new font
+            autoSizeColumns();
+            updateHeaders();
+            if (dirty & DirtyFonts) {
+                initializeCells();
+            }
+            updateCells(currentPage);
+            updatePageInfo();
+        }
+        if (dirty & (DirtyFonts | DirtyTextSize | DirtyGrid)) {
+            rebuildGrid();  // column widths follow the text
+        }
+        if (dirty & DirtyTextColor) {
+            recolorTexts();
+        }
+        // DirtyBackground: config.bgColor is read when the frame is cleared
+    };
+
+    // Draw a full-screen progress message while a long job runs on worker threads.
+    // Returns false when the user asks to stop (ESC or closing the window).
+    auto showProgress = [&](const std::string& message) {
+        bool keepGoing = true;
+        while (auto eventOpt = window.pollEvent()) {
+            const sf::Event& event = *eventOpt;
+            if (event.is<sf::Event::Closed>()) {
+                keepGoing = false;
+            }
+            if (const auto* keyPressed = event.getIf<sf::Event::KeyPressed>()) {
+                if (keyPressed->scancode == sf::Keyboard::Scancode::Escape) {
+                    keepGoing = false;
+                }
+            }
+        }
+        
+        window.clear(sf::Color::Black);
+        sf::Text progressText(*font, utf8ToSfString(message + "\nPress ESC to stop"), 24);
+        progressText.setFillColor(sf::Color::White);
+        progressText.setPosition(sf::Vector2f(50, 50));
+        window.draw(progressText);
+        window.display();
+        return keepGoing;
+    };
+    
+    // Function to rescan directory
+    auto rescanDirectory = [&]() {
+        if (indexClient) {
+            // The daemon scans; the viewer waits for the new generation and fetches it
+            std::string message = "Index daemon is rescanning " + absoluteDirectory + "...";
+            if (!indexClient->rescan(true, [&]() { return showProgress(message); })) {
+                std::cout << "Rescan: " << indexClient->lastError() << std::endl;
+                return;
+            }
+            auto fetched = openServedIndex();
+            if (!fetched) {
+                return;
+            }
+            fileManagerPtr = std::move(fetched);
+        } else {
+            std::cout << "Rescanning directory (no depth limit)..." << std::endl;
+            
+            // Create new FileManager instance
+            fileManagerPtr = std::make_unique<FileManager>(absoluteDirectory, &window, scanOptions, fonts.fallback());
+        }
+        files = fileManagerPtr->getFiles();
+        checksums.setLogger(fileManagerPtr->getSharedLogger());
+        currentView = TableView::Files;
+        currentPage = 0;
+        resetSelection();
+        refreshAll();
+    };
+    
+    // Back to the plain listing from any other view
+    auto showScannedFiles = [&]() {
+        files = fileManagerPtr->getFiles();
+        currentView = TableView::Files;
+        currentPage = 0;
+        resetSelection();
+        refreshAll();
+    };
+    
+    // Switch the table between the scanned files and the duplicate groups
+    auto toggleDuplicates = [&]() {
+        if (currentView == TableView::Duplicates) {
+            showScannedFiles();
+            return;
+        }
+        
+        std::cout << "Searching for duplicate files..." << std::endl;
+        const auto& scanned = fileManagerPtr->getFiles();
+        DuplicateFinder finder(fileManagerPtr->getLogger());
+        duplicateReport = finder.find(scanned, [&](const DuplicateProgress& progress) {
+            std::ostringstream oss;
+            oss << progress.stage << ": " << progress.done << "/" << progress.total
+                << " files, " << progress.bytesHashed / (1024 * 1024) << " MiB read";
+            return showProgress(oss.str());
+        });
+        
+        if (duplicateReport.cancelled) {
+            std::cout << "Duplicate search cancelled" << std::endl;
+            refreshAll();
+            return;
+        }
+        
+        std::vector<FileInfo> rows;
+        rowGroups.clear();
+        for (size_t g = 0; g < duplicateReport.groups.size(); g++) {
+            for (size_t row : duplicateReport.groups[g].rows) {
+                rows.push_back(scanned[row]);
+                rowGroups.push_back(g);
+            }
+        }
+        
+        std::cout << "Found " << duplicateReport.groups.size() << " duplicate groups, "
+                  << duplicateReport.reclaimableBytes << " bytes reclaimable" << std::endl;
+        
+        files = FileTable(std::move(rows));
+        currentView = TableView::Duplicates;
+        currentPage = 0;
+        refreshAll();
+    };
+    
+    // One row per filesystem reached by the scan, including skipped mounts
+    auto toggleMounts = [&]() {
+        if (currentView == TableView::Mounts) {
+            showScannedFiles();
+            return;
+        }
+        
+        std::vector<FileInfo> rows;
+        for (const MountSummary& mount : fileManagerPtr->getMountSummaries()) {
+            FileInfo row;
+            row.name = mount.mountPoint + " [" + mount.fsType + "]";
+            if (!mount.skipReason.empty()) {
+                row.name += " - skipped: " + mount.skipReason;
+            }
+            row.isDirectory = mount.skipReason.empty();
+            row.actualSize = mount.allocatedBytes;
+            row.allocatedSize = mount.allocatedBytes;
+            row.size = std::to_string(mount.allocatedBytes);
+            row.date = std::to_string(mount.entries) + " entries";
+            row.permissions = mount.skipReason.empty() ? "scanned" : "skipped";
+            row.device = mount.device;
+            rows.push_back(std::move(row));
+        }
+        
+        files = FileTable(std::move(rows));
+        currentView = TableView::Mounts;
+        currentPage = 0;
+        refreshAll();
+    };
+
+    // Changes since the --diff snapshot: directory totals first, then entries in path order
+    auto toggleDiff = [&]() {
+        if (currentView == TableView::Diff) {
+            showScannedFiles();
+            return;
+        }
+        if (diffBasePath.empty()) {
+            std::cout << "No snapshot to compare with (start with --diff FILE)" << std::endl;
+            return;
+        }
+        SnapshotReader before;
+        if (!before.open(diffBasePath)) {
+            std::cout << "Cannot read snapshot: " << diffBasePath << std::endl;
+            return;
+        }
+        TableEntryStream after(fileManagerPtr->getFiles(), absoluteDirectory);
+        
+        std::vector<FileInfo> changes;
+        std::vector<DiffStatus> changeStatus;
+        SnapshotDiff diff;
+        diff.run(before, after, [&](const DiffChange& change) {
+            const SnapshotEntry& entry = change.status == DiffStatus::Removed ? change.before : change.after;
+            FileInfo row;
+            row.name = entry.path;
+            row.isDirectory = S_ISDIR(entry.mode);
+            row.actualSize = entry.size;
+            row.allocatedSize = entry.allocated;
+            row.mode = entry.mode;
+            row.mtime = entry.mtime;
+            if (change.status == DiffStatus::Modified || change.status == DiffStatus::Grown) {
+                row.size = std::to_string(change.before.size) + " -> " + std::to_string(change.after.size);
+            } else {
+                row.size = std::to_string(entry.size);
+            }
+            row.date = formatDate(static_cast<time_t>(entry.mtime));
+            row.permissions = diffStatusName(change.status);
+            changes.push_back(std::move(row));
+            changeStatus.push_back(change.status);
+        });
+        if (before.damaged()) {
+            std::cout << "Snapshot is truncated or corrupt: " << diffBasePath << std::endl;
+            return;
+        }
+        
+        std::vector<FileInfo> rows;
+        rowStatus.clear();
+        for (const DirectoryDelta& delta : diff.directoryDeltas()) {
+            if (delta.bytes == 0) {
+                continue;
+            }
+            FileInfo row;
+            row.name = (delta.path.empty() ? "." : delta.path) + "/";
+            row.isDirectory = true;
+            row.size = formatByteDelta(delta.bytes);
+            row.date = std::to_string(delta.changes) + " changes";
+            row.permissions = diffStatusName(DiffStatus::DirectoryDelta);
+            rows.push_back(std::move(row));
+            rowStatus.push_back(DiffStatus::DirectoryDelta);
+        }
+        std::cout << "Diff against " << diffBasePath << ": " << changes.size() << " changed entries, "
+                  << rows.size() << " directories with a net size change" << std::endl;
+        rows.insert(rows.end(), std::make_move_iterator(changes.begin()), std::make_move_iterator(changes.end()));
+        rowStatus.insert(rowStatus.end(), changeStatus.begin(), changeStatus.end());
+        
+        files = FileTable(std::move(rows));
+        currentView = TableView::Diff;
+        currentPage = 0;
+        refreshAll();
+    };
+
+    // Statistics of the scanned table, or of the selection when there is one:
+    // one section per aggregate, a row per bucket (bytes, entries, share of bytes)
+    OwnerNames ownerNames;
+    auto toggleStatistics = [&]() {
+        if (currentView == TableView::Statistics) {
+            showScannedFiles();
+            return;
+        }
+        const FileTable& scanned = fileManagerPtr->getFiles();
+        const std::vector<char>* only = currentView == TableView::Files && selectedCount > 0 ? &selectedRows : nullptr;
+        
+        auto started = std::chrono::steady_clock::now();
+        TableStatistics stats = StatisticsBuilder::build(scanned, absoluteDirectory, only);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+        std::cout << "Statistics over " << stats.rows << (only ? " selected" : "") << " entries in " << elapsed.count() << "ms" << std::endl;
+        
+        std::uint64_t totalBytes = std::max<std::uint64_t>(1, stats.files.bytes + stats.directories.bytes);
+        std::vector<FileInfo> rows;
+        auto section = [&](const std::string& title) {
+            FileInfo row;
+            row.name = title;
+            row.isDirectory = true;
+            rows.push_back(std::move(row));
+        };
+        auto line = [&](const std::string& label, const TableStatistics::Bucket& bucket) {
+            FileInfo row;
+            row.name = label;
+            row.isDirectory = false;
+            row.actualSize = bucket.bytes;
+            row.allocatedSize = bucket.bytes;
+            row.size = formatSizeInfo(bucket.bytes, bucket.bytes);
+            row.date = std::to_string(bucket.count) + " entries";
+            char share[16];
+            snprintf(share, sizeof(share), "%.1f%%", 100.0 * static_cast<double>(bucket.bytes) / static_cast<double>(totalBytes));
+            row.permissions = share;
+            rows.push_back(std::move(row));
+        };
+        // The largest `TableStatistics::kTop` entries of a map, by bytes
+        auto topOf = [](const auto& map) {
+            std::vector<std::pair<std::uint64_t, typename std::decay_t<decltype(map)>::key_type>> heap;
+            for (const auto& [key, bucket] : map) {
+                pushBounded(heap, std::make_pair(bucket.bytes, key), TableStatistics::kTop);
+            }
+            std::sort(heap.begin(), heap.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+            return heap;
+        };
+        auto humanSize = [](std::uint64_t bytes) {
+            char buf[24];
+            return std::string(buf, FormatEngine::writeHumanSize(bytes, buf));
+        };
+        
+        section(only ? "Selection" : "Summary");
+        line("Files", stats.files);
+        line("Directories", stats.directories);
+        
+        section("Size of files (log2 buckets)");
+        for (int b = 0; b < TableStatistics::kSizeBuckets; b++) {
+            if (stats.sizes[b].count == 0) {
+                continue;
+            }
+            std::string label = b == 0 ? "empty"
+                              : b == TableStatistics::kSizeBuckets - 1 ? ">= " + humanSize(std::uint64_t(1) << (b - 1))
+                              : humanSize(std::uint64_t(1) << (b - 1)) + " .. " + humanSize((std::uint64_t(1) << b) - 1);
+            line(label, stats.sizes[b]);
+        }
+        
+        section("Modified");
+        for (int b = 0; b < TableStatistics::kAgeBuckets; b++) {
+            if (stats.ages[b].count > 0) {
+                line(TableStatistics::ageLabel(b), stats.ages[b]);
+            }
+        }
+        
+        section("Extensions by bytes");
+        for (const auto& [bytes, extension] : topOf(stats.extensions)) {
+            line(extension.empty() ? "(none)" : "." + extension, stats.extensions[extension]);
+        }
+        
+        section("Largest files");
+        std::string scratch;
+        for (const auto& [bytes, row] : stats.largestFiles) {
+            line(std::string(scanned.nameAt(row, scratch)), TableStatistics::Bucket{1, bytes});
+        }
+        
+        section("Largest directories (whole subtree)");
+        for (const auto& [bytes, path] : stats.largestDirectories) {
+            line(path, TableStatistics::Bucket{0, bytes});
+            rows.back().date.clear();
+        }
+        
+        section("Owners");
+        for (const auto& [bytes, uid] : topOf(stats.owners)) {
+            line(ownerNames.user(uid) + " (" + std::to_string(uid) + ")", stats.owners[uid]);
+        }
+        
+        section("Groups");
+        for (const auto& [bytes, gid] : topOf(stats.groups)) {
+            line(ownerNames.group(gid) + " (" + std::to_string(gid) + ")", stats.groups[gid]);
+        }
+        
+        files = FileTable(std::move(rows));
+        currentView = TableView::Statistics;
+        currentPage = 0;
+        refreshAll();
+    };
+
+    // Treemap of the scanned table, drawn instead of the table while active
+    TreemapView treemap;
+    bool treemapActive = false;
+    std::vector<sf::Text> treemapLabels;
+    sf::Text treemapInfo(*font, "", config.fontSize);
+    std::string treemapHover;
+    
+    auto updateTreemapInfo = [&]() {
+        const FileTable& scanned = fileManagerPtr->getFiles();
+        std::string scratch;
+        std::uint32_t root = treemap.zoomRoot();
         std::ostringstream oss;
-        oss << "Page " << (currentPage + 1) << "/" << totalPages
-            << " | Files: " << files.size();
-        
-        // Add logging information if available
-        if (fileManagerPtr->isLoggingEnabled()) {
-            oss << " | Log: " << fs::path(fileManagerPtr->getLogFilePath()).filename().string();
+        oss << (root == 0 ? absoluteDirectory : std::string(scanned.nameAt(SizeTree::rowOf(root), scratch)))
+            << " | " << formatSizeInfo(treemap.node(root).bytes, treemap.node(root).bytes)
+            << " | Colors: " << (treemap.getColorMode() == TreemapView::ColorMode::Extension ? "extension" : "age");
+        if (!treemapHover.empty()) {
+            oss << " | " << treemapHover;
         }
-            //<< " | Dir: " << truncate(targetDirectory, 50);
+        oss << " | Click: zoom in, right click/Backspace: out, X: colors, T: table";
         
         unsigned int charSize = static_cast<unsigned int>(16 * config.fontSize);
-        sf::Text t(font, oss.str(), charSize - 2);
-        t.setFillColor(config.pageInfoColor);
-        
-        sf::FloatRect cellBounds(
-            sf::Vector2f(0, height - 40),
-            sf::Vector2f(width, 40)
-        );
-
-        setTextPosition(t, cellBounds, HAlign::Center, VAlign::Center);
-        pageInfo = t;
+        GlyphAdvanceTable& advances = measurer.table(*font, charSize - 2);
+        treemapInfo = sf::Text(*font, utf8ToSfString(truncateToWidth(oss.str(), width - 20.0f, advances, Ellipsis::Middle)), charSize - 2);
+        treemapInfo.setFillColor(config.pageInfoColor);
+        setTextPosition(treemapInfo, sf::FloatRect(sf::Vector2f(0, height - 40), sf::Vector2f(width, 40)), HAlign::Center, VAlign::Center);
+    };
+    
+    // Names on the top-level rectangles that have room for them
+    auto rebuildTreemapLabels = [&]() {
+        treemapLabels.clear();
+        const FileTable& scanned = fileManagerPtr->getFiles();
+        unsigned int charSize = static_cast<unsigned int>(14 * config.fontSize);
+        GlyphAdvanceTable& advances = measurer.table(*font, charSize);
+        std::string scratch;
+        for (const TreemapView::Cell& cell : treemap.cells()) {
+            if (cell.depth != 0 || cell.node == TreemapView::kFiller || cell.rect.size.x < 40 || cell.rect.size.y < charSize + 6.0f) {
+                continue;
+            }
+            std::string_view path = scanned.nameAt(SizeTree::rowOf(cell.node), scratch);
+            std::string name(path.substr(path.rfind('/') + 1));
+            sf::Text label(*font, utf8ToSfString(truncateToWidth(name, cell.rect.size.x - 6, advances, Ellipsis::End)), charSize);
+            label.setFillColor(sf::Color::White);
+            label.setPosition(sf::Vector2f(config.frameSize + cell.rect.position.x + 3, config.frameSize + cell.rect.position.y + 1));
+            treemapLabels.push_back(std::move(label));
+        }
+    };
+    
+    auto treemapChanged = [&]() {
+        treemapHover.clear();
+        rebuildTreemapLabels();
+        updateTreemapInfo();
+    };
+    
+    auto toggleTreemap = [&]() {
+        if (treemapActive) {
+            treemapActive = false;
+            refreshAll();
+            return;
+        }
+        showProgress("Building treemap...");
+        auto started = std::chrono::steady_clock::now();
+        treemap.build(fileManagerPtr->getFiles(), absoluteDirectory);
+        treemap.setViewport(sf::FloatRect(sf::Vector2f((float)config.frameSize, (float)config.frameSize),
+                                          sf::Vector2f(width - config.frameSize * 2.0f, height - config.frameSize - 40.0f)));
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+        std::cout << "Treemap of " << fileManagerPtr->getFiles().size() << " entries in " << elapsed.count() << "ms, "
+                  << treemap.cells().size() << " rectangles" << std::endl;
+        treemapActive = true;
+        treemapChanged();
+    };
+    
+    auto describeTreemapCell = [&](const TreemapView::Cell* cell) {
+        if (!cell) {
+            return std::string();
+        }
+        std::uint64_t total = std::max<std::uint64_t>(1, treemap.node(treemap.zoomRoot()).bytes);
+        if (cell->node == TreemapView::kFiller) {
+            return std::string("smaller entries");
+        }
+        std::string scratch;
+        std::uint64_t bytes = treemap.node(cell->node).bytes;
+        char share[16];
+        snprintf(share, sizeof(share), "%.1f%%", 100.0 * static_cast<double>(bytes) / static_cast<double>(total));
+        return std::string(fileManagerPtr->getFiles().nameAt(SizeTree::rowOf(cell->node), scratch)) + " " +
+               formatSizeInfo(bytes, bytes) + " (" + share + ")";
     };
 
-    // Function to refresh everything when config changes
-    auto refreshAll = [&]() {
-        updateFonts();
-        preloadGlyphs();
-        auto [newCellWidth, newCellHeight] = recalculateLayout();
-        cellWidth = newCellWidth;
-        cellHeight = newCellHeight;
-        auto [newItemsPerPage, newTotalPages] = calculatePagination();
-        itemsPerPage = newItemsPerPage;
-        totalPages = newTotalPages;
-        
-        // Adjust current page if necessary
-        if (currentPage >= totalPages && totalPages > 0) {
-            currentPage = totalPages - 1;
+    // Run a chmod/rename over the selected rows and patch just those rows of the view
+    auto runBatch = [&](const BatchOperation& op) {
+        std::vector<size_t> rows;
+        rows.reserve(selectedCount);
+        for (size_t i = 0; i < selectedRows.size(); i++) {
+            if (selectedRows[i]) {
+                rows.push_back(i);
+            }
         }
+        showProgress(op.describe() + " on " + std::to_string(rows.size()) + " entries...");
         
-        updateHeaders();
-        initializeCells();
+        auto started = std::chrono::steady_clock::now();
+        BatchResult result = fileManagerPtr->applyBatch(rows, op);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+        std::cout << op.describe() << ": " << result.succeeded << " done, " << result.failed << " failed, "
+                  << result.unchanged << " unchanged in " << elapsed.count() << "ms" << std::endl;
+        
+        files = fileManagerPtr->getFiles();  // shares every chunk the batch did not touch
         updateCells(currentPage);
         updatePageInfo();
     };
     
-    // Function to rescan directory
-    auto rescanDirectory = [&]() {
-        std::cout << "Rescanning directory (no depth limit)..." << std::endl;
-        
-        // Create new FileManager instance
-        fileManagerPtr = std::make_unique<FileManager>(absoluteDirectory, &window);
+    // Rows changed on disk by a file operation: the table follows, the selection is dropped
+    // because row numbers move
+    auto adoptTableEdit = [&](const TableEdit& edit) {
+        if (!fileManagerPtr->applyEdit(edit)) {
+            return;
+        }
+        if (treemapActive) {
+            toggleTreemap();  // its rectangles hold row numbers of the table before the edit
+        }
+        if (currentView != TableView::Files) {
+            return;  // other views pick the new table up when they return to the listing
+        }
         files = fileManagerPtr->getFiles();
-        currentPage = 0;
-        refreshAll();
+        resetSelection();
+        std::tie(itemsPerPage, totalPages) = calculatePagination();
+        currentPage = std::max(0, std::min(currentPage, totalPages - 1));
+        updateCells(currentPage);
+        updatePageInfo();
+    };
+    
+    // A selected directory brings its contents: selected rows inside it are not handled twice
+    auto selectedSubtrees = [&]() {
+        std::vector<std::string> paths;
+        for (size_t i = 0; i < selectedRows.size(); i++) {
+            if (selectedRows[i]) {
+                paths.push_back(files[i].name);
+            }
+        }
+        return subtreeKeys(std::move(paths));
+    };
+    
+    // Copy or move the selected rows into a directory (relative to the scanned one)
+    auto startTransfer = [&](TransferJob::Kind kind, std::string destination) {
+        if (destination.empty()) {
+            return;
+        }
+        if (destination[0] != '/') {
+            destination = (absoluteDirectory.back() == '/' ? absoluteDirectory : absoluteDirectory + "/") + destination;
+        }
+        while (destination.size() > 1 && destination.back() == '/') {
+            destination.pop_back();
+        }
+        
+        std::vector<std::string> keys = selectedSubtrees();
+        std::vector<SubtreeTotals> expected = fileManagerPtr->measureSubtrees(keys);
+        std::vector<TransferJob::Source> sources;
+        for (size_t i = 0; i < keys.size(); i++) {
+            sources.push_back({keys[i].substr(0, keys[i].size() - 1), expected[i]});
+        }
+        
+        std::cout << (kind == TransferJob::Kind::Copy ? "Copying " : "Moving ") << sources.size()
+                  << " entries to " << destination << std::endl;
+        fileJob = std::make_unique<TransferJob>(kind, std::move(sources), destination, fileManagerPtr->getSharedLogger());
+        lastFileJobPoll = std::chrono::steady_clock::now();
+        resetSelection();
+        updatePageInfo();
+    };
+    
+    InputPrompt prompt;
+    
+    // Dry run from the table: what deleting the selection removes, asked before anything goes
+    std::vector<std::string> deleteRoots;
+    SubtreeTotals deleteTotals;
+    auto planDelete = [&]() {
+        std::vector<std::string> keys = selectedSubtrees();
+        deleteTotals = SubtreeTotals();
+        deleteRoots.clear();
+        std::vector<SubtreeTotals> totals = fileManagerPtr->measureSubtrees(keys);
+        for (size_t i = 0; i < keys.size(); i++) {
+            deleteRoots.push_back(keys[i].substr(0, keys[i].size() - 1));
+            std::cout << "  " << deleteRoots.back() << ": " << totals[i].entries << " entries, "
+                      << formatSizeInfo(totals[i].bytes, totals[i].allocatedBytes) << std::endl;
+            deleteTotals.entries += totals[i].entries;
+            deleteTotals.bytes += totals[i].bytes;
+            deleteTotals.allocatedBytes += totals[i].allocatedBytes;
+        }
+        std::ostringstream label;
+        label << "Delete " << deleteRoots.size() << " selected (" << deleteTotals.entries << " entries, "
+              << formatSizeInfo(deleteTotals.bytes, deleteTotals.allocatedBytes) << ")? Type yes";
+        prompt.open(InputPrompt::Purpose::Delete, label.str());
+    };
+    
+    auto startDelete = [&]() {
+        std::cout << "Deleting " << deleteRoots.size() << " entries" << std::endl;
+        fileJob = std::make_unique<DeleteJob>(std::move(deleteRoots), deleteTotals, fileManagerPtr->getSharedLogger());
+        deleteRoots.clear();
+        lastFileJobPoll = std::chrono::steady_clock::now();
+        resetSelection();
+        updatePageInfo();
+    };
+    
+    auto submitPrompt = [&]() {
+        switch (prompt.purpose) {
+            case InputPrompt::Purpose::SelectPattern:
+            {
+                // Patterns with a '/' match the path below the scanned directory, others the name
+                GlobPattern pattern(prompt.value);
+                bool byPath = prompt.value.find('/') != std::string::npos;
+                size_t rootLength = absoluteDirectory.size() + (absoluteDirectory.back() == '/' ? 0 : 1);
+                for (size_t i = 0; i < files.size(); i++) {
+                    std::string_view name(files[i].name);
+                    std::string_view subject = byPath ? (name.size() > rootLength ? name.substr(rootLength) : name)
+                                                      : name.substr(name.rfind('/') + 1);
+                    if (pattern.matches(subject)) {
+                        setSelected(i, true);
+                    }
+                }
+                updatePageInfo();
+                break;
+            }
+            case InputPrompt::Purpose::BatchChmod:
+            {
+                BatchOperation op;
+                if (!parsePermissionString(prompt.value, op.mode)) {
+                    std::cout << "Invalid permissions: " << prompt.value << std::endl;
+                    break;
+                }
+                runBatch(op);
+                break;
+            }
+            case InputPrompt::Purpose::BatchRename:
+                if (!prompt.value.empty()) {
+                    runBatch(BatchOperation::rename(prompt.value));
+                }
+                break;
+            case InputPrompt::Purpose::Copy:
+                startTransfer(TransferJob::Kind::Copy, prompt.value);
+                break;
+            case InputPrompt::Purpose::Move:
+                startTransfer(TransferJob::Kind::Move, prompt.value);
+                break;
+            case InputPrompt::Purpose::Delete:
+                if (prompt.value == "yes") {
+                    startDelete();
+                } else {
+                    std::cout << "Delete cancelled" << std::endl;
+                }
+                break;
+            case InputPrompt::Purpose::None:
+                break;
+        }
+        prompt.reset();
     };
 
+    // Preview pane over the right part of the table (P): the file of the last clicked row.
+    // Only the visible lines are asked for; FilePreview reads them in the background.
+    FilePreview preview;
+    FilePreview::View previewView;
+    bool previewOpen = false;
+    size_t previewRow = SIZE_MAX;
+    size_t previewFirstLine = 0;
+    std::string previewPath;  // what the row held when it was asked for
+    std::vector<sf::Text> previewTexts;
+    
+    auto previewArea = [&]() {
+        float left = std::floor(width * 0.45f);
+        return sf::FloatRect(sf::Vector2f(left, (float)config.frameSize),
+                             sf::Vector2f(width - config.frameSize - left, height - config.frameSize * 2.0f - 40.0f));
+    };
+    auto previewCharSize = [&]() {
+        return static_cast<unsigned int>(14 * config.fontSize);
+    };
+    auto previewLineCount = [&]() {
+        float lineHeight = std::ceil(previewCharSize() * 1.3f);
+        return static_cast<size_t>(std::max(1.0f, previewArea().size.y / lineHeight - 1.0f));  // the title takes a line
+    };
+    
+    auto requestPreview = [&]() {
+        if (previewRow < files.size()) {
+            previewPath = files[previewRow].name;
+            preview.show(previewPath, previewFirstLine, previewLineCount());
+        }
+    };
+    
+    auto rebuildPreviewTexts = [&]() {
+        previewTexts.clear();
+        if (previewRow >= files.size()) {
+            return;
+        }
+        sf::FloatRect area = previewArea();
+        unsigned int charSize = previewCharSize();
+        float lineHeight = std::ceil(charSize * 1.3f);
+        GlyphAdvanceTable& advances = measurer.table(*font, charSize);
+        const std::string& path = files[previewRow].name;
+        
+        std::ostringstream title;
+        title << path;
+        if (previewView.path != path) {
+            title << " | loading...";
+        } else if (previewView.mode == FilePreview::Mode::Message) {
+            title << " | " << previewView.message;
+        } else {
+            title << " | " << formatSizeInfo(previewView.size, previewView.size)
+                  << (previewView.mode == FilePreview::Mode::Hex ? " | hex" : " | text");
+            if (!previewView.lines.empty()) {
+                title << " | lines " << previewView.firstLine + 1 << "-" << previewView.firstLine + previewView.lines.size()
+                      << " of " << previewView.knownLines << (previewView.complete ? "" : "+");
+            }
+        }
+        sf::Text heading(*font, utf8ToSfString(truncateToWidth(title.str(), area.size.x - 12, advances, Ellipsis::Middle)), charSize);
+        heading.setFillColor(config.dirColor);
+        heading.setPosition(sf::Vector2f(area.position.x + 6, area.position.y + 2));
+        previewTexts.push_back(std::move(heading));
+        
+        if (previewView.path != path) {
+            return;
+        }
+        for (size_t i = 0; i < previewView.lines.size(); i++) {
+            sf::Text line(*font, utf8ToSfString(truncateToWidth(previewView.lines[i], area.size.x - 12, advances, Ellipsis::End)), charSize);
+            line.setFillColor(config.textColor);
+            line.setPosition(sf::Vector2f(area.position.x + 6, area.position.y + 2 + (i + 1) * lineHeight));
+            previewTexts.push_back(std::move(line));
+        }
+    };
+    
+    // A new row replaces the file being read; the loader drops it as soon as it notices
+    auto previewSelect = [&](size_t row) {
+        if (row != previewRow) {
+            previewRow = row;
+            previewFirstLine = 0;
+            requestPreview();
+            rebuildPreviewTexts();
+        }
+    };
+    
+    auto scrollPreview = [&](long delta) {
+        long first = static_cast<long>(previewFirstLine) + delta;
+        previewFirstLine = static_cast<size_t>(std::max(0L, first));
+        requestPreview();
+    };
+    
+    auto togglePreview = [&]() {
+        previewOpen = !previewOpen;
+        if (previewOpen) {
+            size_t row = selectionAnchor >= 0 ? static_cast<size_t>(selectionAnchor) : static_cast<size_t>(currentPage * itemsPerPage);
+            previewRow = SIZE_MAX;
+            previewSelect(row);
+        }
+    };
+    
+    // Mount, diff and statistics rows are labels, not files: leaving the listing closes the pane
+    auto closePreviewOnLabels = [&]() {
+        if (previewOpen && labelRows()) {
+            previewOpen = false;
+        }
+    };
+    
     // Initial setup
     refreshAll();
+    if (!diffBasePath.empty()) {
+        toggleDiff();
+    }
 
     // Cell editing state
     CellEditState editState;
@@ -1337,22 +10315,70 @@ int main(int argc, char** argv) {
         while (auto eventOpt = window.pollEvent()) {
             if (!eventOpt) break;
             const sf::Event& event = *eventOpt;
+            closePreviewOnLabels();  // an earlier event of this batch may have switched views
             
             if (event.is<sf::Event::Closed>()) {
                 window.close();
             }
             
+            // The treemap takes the mouse and a few keys of its own until T goes back to the table
+            if (treemapActive) {
+                if (const auto* keyPressed = event.getIf<sf::Event::KeyPressed>()) {
+                    if (keyPressed->scancode == sf::Keyboard::Scancode::T) {
+                        toggleTreemap();
+                    } else if (keyPressed->scancode == sf::Keyboard::Scancode::X) {
+                        treemap.toggleColorMode();
+                        updateTreemapInfo();
+                    } else if (keyPressed->scancode == sf::Keyboard::Scancode::Backspace ||
+                               keyPressed->scancode == sf::Keyboard::Scancode::Escape) {
+                        if (treemap.zoomOut()) {
+                            treemapChanged();
+                        }
+                    }
+                } else if (const auto* pressed = event.getIf<sf::Event::MouseButtonPressed>()) {
+                    sf::Vector2f point(static_cast<float>(pressed->position.x), static_cast<float>(pressed->position.y));
+                    if (pressed->button == sf::Mouse::Button::Left ? treemap.zoomIn(point) : treemap.zoomOut()) {
+                        treemapChanged();
+                    }
+                } else if (const auto* moved = event.getIf<sf::Event::MouseMoved>()) {
+                    sf::Vector2f point(static_cast<float>(moved->position.x), static_cast<float>(moved->position.y));
+                    std::string hover = describeTreemapCell(treemap.cellAt(point));
+                    if (hover != treemapHover) {
+                        treemapHover = hover;
+                        updateTreemapInfo();
+                    }
+                }
+                continue;
+            }
+            
+            // Handle text input of the prompt
+            if (prompt.isActive() && event.is<sf::Event::TextEntered>()) {
+                if (const auto* textEntered = event.getIf<sf::Event::TextEntered>()) {
+                    char c = textEntered->unicode < 128 ? static_cast<char>(textEntered->unicode) : 0;
+                    if (prompt.skipNextChar) {
+                        prompt.skipNextChar = false;
+                    } else if (c == '\b') {
+                        popUtf8(prompt.value);
+                    } else if (c == '\r' || c == '\n') {
+                        submitPrompt();
+                    } else if ((c >= 32 && c < 127) || textEntered->unicode >= 160) {
+                        appendUtf8(prompt.value, textEntered->unicode);
+                    }
+                }
+            }
+            
             // Handle text input during editing
             if (editState.isEditing && event.is<sf::Event::TextEntered>()) {
                 if (const auto* textEntered = event.getIf<sf::Event::TextEntered>()) {
-                    if (textEntered->unicode < 128) {
+                    // Names may be in any script: non-ASCII input is stored as UTF-8
+                    if (textEntered->unicode >= 160) {
+                        appendUtf8(editState.currentValue, textEntered->unicode);
+                    } else if (textEntered->unicode < 128) {
                         char c = static_cast<char>(textEntered->unicode);
                         
                         // Handle backspace
                         if (c == '\b') {
-                            if (!editState.currentValue.empty()) {
-                                editState.currentValue.pop_back();
-                            }
+                            popUtf8(editState.currentValue);
                         }
                         // Handle enter - save changes
                         else if (c == '\r' || c == '\n') {
@@ -1367,7 +10393,9 @@ int main(int argc, char** argv) {
                                         std::cout << "Successfully updated " << fileInfo.name << std::endl;
                                         // Refresh the files list
                                         files = fileManagerPtr->getFiles();
+                                        currentView = TableView::Files;
                                         updateCells(currentPage);
+                                        updatePageInfo();
                                     } else {
                                         std::cout << "Failed to update " << fileInfo.name << std::endl;
                                     }
@@ -1395,13 +10423,20 @@ int main(int argc, char** argv) {
                         continue;
                     }
                     
+                    // The prompt takes all keys until Enter or Escape
+                    if (prompt.isActive()) {
+                        prompt.skipNextChar = false;
+                        if (keyPressed->scancode == sf::Keyboard::Scancode::Escape) {
+                            prompt.reset();
+                        }
+                        continue;
+                    }
+                    
                     // Handle menu first if it's open
                     if (configMenu.getVisible()) {
-                        configMenu.handleInput(keyPressed->scancode);
-                        
-                        // Refresh display if menu is still open (values might have changed)
-                        if (configMenu.getVisible()) {
-                            refreshAll();
+                        unsigned dirty = configMenu.handleInput(keyPressed->scancode);
+                        if (dirty != DirtyNone) {
+                            applyConfigChange(dirty);
                         }
                         continue; // Don't process other keys while menu is open
                     }
@@ -1434,8 +10469,115 @@ int main(int argc, char** argv) {
                     }
                     // Reset
                     else if (keyPressed->scancode == sf::Keyboard::Scancode::R) {
-                        // Перезагрузка файлов
-                        rescanDirectory();
+                        if (fileJob) {
+                            std::cout << "Wait for the running file operation (Escape stops it) before rescanning" << std::endl;
+                        } else {
+                            // Перезагрузка файлов
+                            rescanDirectory();
+                        }
+                    }
+                    // Checksum every file of the table in the background
+                    else if (keyPressed->scancode == sf::Keyboard::Scancode::H) {
+                        checksums.requestAll(files);
+                        if (config.n < 5) {
+                            config.n = 5;  // make the checksum column visible
+                        }
+                        refreshAll();
+                    }
+                    // Find duplicate files / back to the full listing
+                    else if (keyPressed->scancode == sf::Keyboard::Scancode::D) {
+                        toggleDuplicates();
+                    }
+                    // Per-filesystem summary / back to the full listing
+                    else if (keyPressed->scancode == sf::Keyboard::Scancode::O) {
+                        toggleMounts();
+                    }
+                    // Changes since the --diff snapshot / back to the full listing
+                    else if (keyPressed->scancode == sf::Keyboard::Scancode::F) {
+                        toggleDiff();
+                    }
+                    // Statistics of the table (or the selection) / back to the full listing
+                    else if (keyPressed->scancode == sf::Keyboard::Scancode::I) {
+                        toggleStatistics();
+                    }
+                    // Treemap of the scanned table (T again returns to the table)
+                    else if (keyPressed->scancode == sf::Keyboard::Scancode::T) {
+                        if (fileJob) {
+                            std::cout << "Wait for the running file operation (Escape stops it) before opening the treemap" << std::endl;
+                        } else {
+                            toggleTreemap();
+                        }
+                    }
+                    // Preview pane for the last clicked row; Page Up/Down, Home and End scroll it
+                    else if (keyPressed->scancode == sf::Keyboard::Scancode::P && !labelRows()) {
+                        togglePreview();
+                    }
+                    else if (previewOpen && keyPressed->scancode == sf::Keyboard::Scancode::PageDown) {
+                        scrollPreview(static_cast<long>(previewLineCount()));
+                    }
+                    else if (previewOpen && keyPressed->scancode == sf::Keyboard::Scancode::PageUp) {
+                        scrollPreview(-static_cast<long>(previewLineCount()));
+                    }
+                    else if (previewOpen && keyPressed->scancode == sf::Keyboard::Scancode::Home) {
+                        previewFirstLine = 0;
+                        requestPreview();
+                    }
+                    else if (previewOpen && keyPressed->scancode == sf::Keyboard::Scancode::End) {
+                        previewFirstLine = SIZE_MAX / 2;  // the loader answers with the last page
+                        requestPreview();
+                    }
+                    // Export the rows of the current view
+                    else if (keyPressed->scancode == sf::Keyboard::Scancode::E) {
+                        std::string format = exportFormat.empty() ? "csv" : exportFormat;
+                        std::string path = "table_export." + std::string(format == "columnar" ? "tcol" : format);
+                        auto sink = createExportSink(path, format);
+                        if (sink) {
+                            for (size_t c = 0; c < files.chunkCount(); c++) {
+                                sink->writeRows(files.chunk(c).data(), files.chunk(c).size());
+                                files.trimResident(residentChunks);
+                            }
+                        }
+                        if (sink && sink->finish()) {
+                            std::cout << "Exported " << files.size() << " rows to " << path << std::endl;
+                        } else {
+                            std::cout << "Failed to export to " << path << std::endl;
+                        }
+                    }
+                    // Selection: Ctrl+A = all rows, S = by pattern, U = none
+                    else if (currentView == TableView::Files && keyPressed->control &&
+                             keyPressed->scancode == sf::Keyboard::Scancode::A) {
+                        for (size_t i = 0; i < files.size(); i++) {
+                            setSelected(i, true);
+                        }
+                        updatePageInfo();
+                    }
+                    else if (currentView == TableView::Files && keyPressed->scancode == sf::Keyboard::Scancode::S) {
+                        prompt.open(InputPrompt::Purpose::SelectPattern, "Select matching (glob)");
+                    }
+                    else if (keyPressed->scancode == sf::Keyboard::Scancode::U) {
+                        resetSelection();
+                        updatePageInfo();
+                    }
+                    // Batch operations on the selection
+                    else if (selectedCount > 0 && keyPressed->scancode == sf::Keyboard::Scancode::C) {
+                        prompt.open(InputPrompt::Purpose::BatchChmod, "chmod " + std::to_string(selectedCount) + " entries (rwxr-xr-x or 755)");
+                    }
+                    else if (selectedCount > 0 && keyPressed->scancode == sf::Keyboard::Scancode::N) {
+                        prompt.open(InputPrompt::Purpose::BatchRename, "Rename " + std::to_string(selectedCount) + " entries (old/new or template, * = name)");
+                    }
+                    // Copy / move the selection into a directory, in the background
+                    else if (selectedCount > 0 && !fileJob && keyPressed->scancode == sf::Keyboard::Scancode::Y) {
+                        prompt.open(InputPrompt::Purpose::Copy, "Copy " + std::to_string(selectedCount) + " entries to directory");
+                    }
+                    else if (selectedCount > 0 && !fileJob && keyPressed->scancode == sf::Keyboard::Scancode::V) {
+                        prompt.open(InputPrompt::Purpose::Move, "Move " + std::to_string(selectedCount) + " entries to directory");
+                    }
+                    else if (selectedCount > 0 && !fileJob && keyPressed->scancode == sf::Keyboard::Scancode::Delete) {
+                        planDelete();
+                    }
+                    else if (fileJob && keyPressed->scancode == sf::Keyboard::Scancode::Escape) {
+                        fileJob->cancel();
+                        updatePageInfo();
                     }
                     // Show log info
                     else if (keyPressed->scancode == sf::Keyboard::Scancode::L) {
@@ -1449,7 +10591,8 @@ int main(int argc, char** argv) {
             }
 
             // Handle mouse clicks for cell editing
-            if (event.is<sf::Event::MouseButtonPressed>() && !configMenu.getVisible() && !editState.isEditing) {
+            if (event.is<sf::Event::MouseButtonPressed>() && !configMenu.getVisible() && !editState.isEditing &&
+                !prompt.isActive() && !labelRows()) {
                 if (const auto* mouseButtonPressed = event.getIf<sf::Event::MouseButtonPressed>()) {
                     if (mouseButtonPressed->button == sf::Mouse::Button::Left) {
                         sf::Vector2i mousePos = sf::Mouse::getPosition(window);
@@ -1474,9 +10617,46 @@ int main(int argc, char** argv) {
                                 column = 2;
                             } else if (relativeX < cellNameWidth + cellSizeWidth + cellDateWidth + cellPermWidth) {
                                 column = 3;
+                            } else if (relativeX < cellNameWidth + cellSizeWidth + cellDateWidth + cellPermWidth + cellSumWidth) {
+                                column = 4;
+                            } else if (relativeX < cellNameWidth + cellSizeWidth + cellDateWidth + cellPermWidth + cellSumWidth + cellLinkWidth) {
+                                column = 5;
                             }
                             
-                            if (row >= 0 && row < config.m - 1 && column >= 0) {
+                            bool toggleSelect = sf::Keyboard::isKeyPressed(sf::Keyboard::Scancode::LControl) ||
+                                                sf::Keyboard::isKeyPressed(sf::Keyboard::Scancode::RControl);
+                            bool rangeSelect = sf::Keyboard::isKeyPressed(sf::Keyboard::Scancode::LShift) ||
+                                               sf::Keyboard::isKeyPressed(sf::Keyboard::Scancode::RShift);
+                            int clickedIndex = currentPage * itemsPerPage + row;
+                            
+                            // The preview pane covers the table on its side
+                            if (previewOpen && mousePos.x >= previewArea().position.x) {
+                                continue;
+                            }
+                            
+                            // Ctrl+click toggles a row, Shift+click selects from the last toggled row
+                            if ((toggleSelect || rangeSelect) && currentView == TableView::Files &&
+                                row >= 0 && row < config.m - 1 && clickedIndex < (int)files.size()) {
+                                if (rangeSelect && selectionAnchor >= 0) {
+                                    for (int i = std::min(selectionAnchor, clickedIndex); i <= std::max(selectionAnchor, clickedIndex); i++) {
+                                        setSelected(i, true);
+                                    }
+                                } else {
+                                    setSelected(clickedIndex, !selectedRows[clickedIndex]);
+                                    selectionAnchor = clickedIndex;
+                                }
+                                if (previewOpen) {
+                                    previewSelect(clickedIndex);
+                                }
+                                updatePageInfo();
+                            }
+                            // With the preview open a click picks the row to show instead of editing it
+                            else if (previewOpen && row >= 0 && row < config.m - 1) {
+                                if (clickedIndex < (int)files.size()) {
+                                    previewSelect(clickedIndex);
+                                }
+                            }
+                            else if (row >= 0 && row < config.m - 1 && column >= 0) {
                                 int fileIndex = currentPage * itemsPerPage + row;
                                 
                                 if (fileIndex < (int)files.size()) {
@@ -1516,6 +10696,12 @@ int main(int argc, char** argv) {
                     // Don't handle mouse wheel if menu is open or editing
                     if (configMenu.getVisible() || editState.isEditing) continue;
                     
+                    // Over the preview pane the wheel scrolls the file, three lines a notch
+                    if (previewOpen && mouseWheelScrolled->position.x >= previewArea().position.x) {
+                        scrollPreview(mouseWheelScrolled->delta > 0 ? -3 : 3);
+                        continue;
+                    }
+                    
                     if (mouseWheelScrolled->wheel == sf::Mouse::Wheel::Vertical) {
                         if (mouseWheelScrolled->delta > 0) {
                             // Прокрутка вверх
@@ -1537,54 +10723,100 @@ int main(int argc, char** argv) {
             }
         }
 
-        window.clear(config.bgColor);
-
-        sf::RectangleShape topBorder(sf::Vector2f(width, (float)config.frameSize));
-        topBorder.setPosition(sf::Vector2f(0, 0));
-        topBorder.setFillColor(config.borderColor);
-        window.draw(topBorder);
-
-        sf::RectangleShape bottomBorder(sf::Vector2f(width, (float)config.frameSize));
-        bottomBorder.setPosition(sf::Vector2f(0, (float)height - config.frameSize));
-        bottomBorder.setFillColor(config.borderColor);
-        window.draw(bottomBorder);
+        // Pick up checksums finished by background workers
+        if (checksums.takeUpdates()) {
+            updateCells(currentPage);
+            updatePageInfo();
+        }
         
-        sf::RectangleShape leftBorder(sf::Vector2f((float)config.frameSize, height));
-        leftBorder.setPosition(sf::Vector2f(0, (float)config.frameSize));
-        leftBorder.setFillColor(config.borderColor);
-        window.draw(leftBorder);
+        // A running copy/move/delete: the table follows it a few times a second, rows
+        // appearing and disappearing as the operation gets to them
+        if (fileJob) {
+            auto now = std::chrono::steady_clock::now();
+            bool finished = fileJob->isDone();
+            if (finished || now - lastFileJobPoll >= std::chrono::milliseconds(500)) {
+                lastFileJobPoll = now;
+                adoptTableEdit(fileJob->takeEdit());
+                if (finished) {
+                    std::cout << fileJob->summary() << std::endl;
+                    fileJob.reset();
+                }
+                updatePageInfo();
+            }
+        }
         
-        sf::RectangleShape rightBorder(sf::Vector2f((float)config.frameSize, height));
-        rightBorder.setPosition(sf::Vector2f(width - config.frameSize, (float)config.frameSize));
-        rightBorder.setFillColor(config.borderColor);
-        window.draw(rightBorder);
+        // Lines read by the preview loader since the last frame
+        closePreviewOnLabels();
+        if (preview.takeUpdate(previewView) && previewOpen) {
+            if (previewView.mode == FilePreview::Mode::Text || previewView.mode == FilePreview::Mode::Hex) {
+                previewFirstLine = previewView.firstLine;  // clamped at the end of the file
+            }
+            rebuildPreviewTexts();
+        }
+        // A rescan, sort or edit may have put another file in the previewed row
+        if (previewOpen && previewRow < files.size() && files[previewRow].name != previewPath) {
+            previewFirstLine = 0;
+            requestPreview();
+            rebuildPreviewTexts();
+        }
+        
+        // A slice of glyph rasterization per frame
+        glyphWarmer.warmFor(std::chrono::microseconds(2000));
+        
+        // Tables paged from disk keep only a few decoded chunks between frames
+        files.trimResident(residentChunks);
+        fileManagerPtr->getFiles().trimResident(residentChunks);
 
-        for (int i = 1; i < config.m; i++) {
-            sf::RectangleShape line({(float)width - config.frameSize * 2, (float)config.lineSize});
-            line.setFillColor(config.lineColor);
-            float y = config.frameSize + i * cellHeight;
-            line.setPosition(sf::Vector2f(config.frameSize, y));
-            window.draw(line);
+        window.clear(config.bgColor);
+        
+        if (treemapActive) {
+            window.draw(treemap.getVertices());
+            for (const auto& label : treemapLabels) {
+                window.draw(label);
+            }
+            window.draw(treemapInfo);
+            window.display();
+            continue;
         }
 
-        for (int j = 1; j <= config.n; j++) {
-            sf::RectangleShape vline({(float)config.lineSize, (float)height - config.frameSize * 2});
-            vline.setFillColor(config.lineColor);
-            float cellWidtht = calcCellWidthByNumber(j-1);
-            float cellCalcWidth = calcCellWidthByNumber(j-1);
-            float x = j <= 4 ? config.frameSize + cellCalcWidth : config.frameSize + cellCalcWidth + j * cellWidth;
-            vline.setPosition(sf::Vector2f(x, config.frameSize));
-            window.draw(vline);
+        for (const auto& shape : gridShapes) {
+            window.draw(shape);
         }
 
         for (auto& t : headers) {
             window.draw(t);
         }
         
+        // Highlight selected rows under their text
+        if (selectedCount > 0) {
+            for (int i = 0; i < config.m - 1; i++) {
+                size_t fileIndex = currentPage * itemsPerPage + i;
+                if (fileIndex < selectedRows.size() && selectedRows[fileIndex]) {
+                    sf::RectangleShape highlight(sf::Vector2f(width - config.frameSize * 2, cellHeight));
+                    highlight.setPosition(sf::Vector2f(config.frameSize, config.frameSize + (i + 1) * cellHeight));
+                    highlight.setFillColor(sf::Color(100, 100, 200, 80));
+                    window.draw(highlight);
+                }
+            }
+        }
+        
         for (auto& t : cells) {
             window.draw(t);
         }
         
+        if (previewOpen) {
+            sf::FloatRect area = previewArea();
+            sf::RectangleShape pane(area.size);
+            pane.setPosition(area.position);
+            pane.setFillColor(config.bgColor);
+            pane.setOutlineColor(config.lineColor);
+            pane.setOutlineThickness(std::max(1.0f, static_cast<float>(config.lineSize)));
+            window.draw(pane);
+            for (const auto& t : previewTexts) {
+                window.draw(t);
+            }
+        }
+        
         // Draw editing overlay if editing
         if (editState.isEditing && editState.row >= 0 && editState.column >= 0) {
             // Calculate cell bounds
@@ -1594,6 +10826,8 @@ int main(int argc, char** argv) {
                 case 1: cellWidtht = cellSizeWidth; break;
                 case 2: cellWidtht = cellDateWidth; break;
                 case 3: cellWidtht = cellPermWidth; break;
+                case 4: cellWidtht = cellSumWidth; break;
+                case 5: cellWidtht = cellLinkWidth; break;
             }
             
             float cellX = config.frameSize + calcCellWidthByNumber(editState.column - 1);
@@ -1609,7 +10843,7 @@ int main(int argc, char** argv) {
             
             // Draw edited text
             unsigned int charSize = static_cast<unsigned int>(16 * config.fontSize);
-            sf::Text editText(font, editState.currentValue, charSize);
+            sf::Text editText(*font, utf8ToSfString(editState.currentValue), charSize);
             editText.setFillColor(sf::Color::White);
             
             sf::FloatRect cellBounds(
@@ -1629,12 +10863,19 @@ int main(int argc, char** argv) {
             }
             
             // Draw instruction text at bottom
-            sf::Text instructions(font, "Editing: Enter to save, Escape to cancel", static_cast<unsigned int>(14 * config.fontSize));
+            sf::Text instructions(*font, "Editing: Enter to save, Escape to cancel", static_cast<unsigned int>(14 * config.fontSize));
             instructions.setFillColor(sf::Color::Yellow);
             instructions.setPosition(sf::Vector2f(config.frameSize + 10, height - 60));
             window.draw(instructions);
         }
         
+        if (prompt.isActive()) {
+            sf::Text promptText(*font, utf8ToSfString(prompt.label + ": " + prompt.value + "_"), static_cast<unsigned int>(14 * config.fontSize));
+            promptText.setFillColor(sf::Color::Yellow);
+            promptText.setPosition(sf::Vector2f(config.frameSize + 10, height - 60));
+            window.draw(promptText);
+        }
+        
         // Рисуем информацию о странице
         window.draw(pageInfo);
 
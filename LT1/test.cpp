@@ -1,490 +1,847 @@
-#include <SFML/Graphics.hpp>
-#include <iostream>
-#include <string>
-#include <sstream>
-#include <filesystem>
-#include <optional>
-#include <cstdint>
-#include <algorithm>
-
-namespace fs = std::filesystem;
-
-struct ColorParse {
-    static bool hexToColor(const std::string& hex, sf::Color& out) {
-        if (hex.size() != 7 || hex[0] != '#') return false;
-        unsigned int r, g, b;
-        std::istringstream(hex.substr(1, 2)) >> std::hex >> r;
-        std::istringstream(hex.substr(3, 2)) >> std::hex >> g;
-        std::istringstream(hex.substr(5, 2)) >> std::hex >> b;
-        out = sf::Color(
-            static_cast<std::uint8_t>(r),
-            static_cast<std::uint8_t>(g),
-            static_cast<std::uint8_t>(b)
-        );
-        return true;
-    }
-};
+// Unit tests for the parts of main.cpp that work without a window.
+// g++ -std=c++17 -O2 -pthread test.cpp -o table_tests -lsfml-graphics -lsfml-window -lsfml-system && ./table_tests
+#define main table_app_main
+#include "main.cpp"
+#undef main
+
+#include <random>
+
+static int checksRun = 0;
+static int checksFailed = 0;
+
+#define CHECK(condition)                                                                  \
+    do {                                                                                  \
+        checksRun++;                                                                      \
+        if (!(condition)) {                                                               \
+            checksFailed++;                                                               \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+        }                                                                                 \
+    } while (0)
+
+// Files the tests write go here; main removes it at the end
+static std::string scratchDirectory;
+
+std::string scratchPath(const std::string& name) {
+    return scratchDirectory + "/" + name;
+}
 
-struct FileInfo {
-    std::string name;
-    std::string size;
-    std::string date;
-    std::string permissions;
-    bool isDirectory;
-};
+std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
 
-// Функция для получения прав доступа к файлу
-std::string getFilePermissions(const fs::path& path) {
-    try {
-        auto perms = fs::status(path).permissions();
-        std::string result;
-        
-        // Владелец
-        result += (perms & fs::perms::owner_read) != fs::perms::none ? "r" : "-";
-        result += (perms & fs::perms::owner_write) != fs::perms::none ? "w" : "-";
-        result += (perms & fs::perms::owner_exec) != fs::perms::none ? "x" : "-";
-        
-        // Группа
-        result += (perms & fs::perms::group_read) != fs::perms::none ? "r" : "-";
-        result += (perms & fs::perms::group_write) != fs::perms::none ? "w" : "-";
-        result += (perms & fs::perms::group_exec) != fs::perms::none ? "x" : "-";
-        
-        // Остальные
-        result += (perms & fs::perms::others_read) != fs::perms::none ? "r" : "-";
-        result += (perms & fs::perms::others_write) != fs::perms::none ? "w" : "-";
-        result += (perms & fs::perms::others_exec) != fs::perms::none ? "x" : "-";
-        
-        return result;
-    } catch (...) {
-        return "----------";
+void writeFile(const std::string& path, const std::string& bytes) {
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+void testGlobPattern() {
+    struct Case {
+        const char* pattern;
+        const char* text;
+        bool matches;
+    };
+    static const Case cases[] = {
+        // '*' stays within one path component
+        {"*.log", "build.log", true},
+        {"*.log", "build.log.1", false},
+        {"*", "", true},
+        {"a*b", "ab", true},
+        {"a*b", "a/b", false},
+        {"src/*.cpp", "src/main.cpp", true},
+        {"src/*.cpp", "src/ui/main.cpp", false},
+        // "**/" spans zero or more directories, "**" anything
+        {"**/cache", "cache", true},
+        {"**/cache", "a/b/cache", true},
+        {"**/cache", "a/bcache", false},
+        {"src/**/test.cpp", "src/test.cpp", true},
+        {"src/**/test.cpp", "src/a/b/test.cpp", true},
+        {"src/**", "src/a/b", true},
+        {"src/**", "lib/a", false},
+        // '?' is one character other than '/'
+        {"?.txt", "a.txt", true},
+        {"?.txt", "ab.txt", false},
+        {"a?b", "a/b", false},
+        // Classes, ranges and negation
+        {"[abc].o", "b.o", true},
+        {"[abc].o", "d.o", false},
+        {"file[0-9]", "file7", true},
+        {"file[0-9]", "filex", false},
+        {"[!a-c]x", "dx", true},
+        {"[!a-c]x", "bx", false},
+        {"[^a]", "b", true},
+        {"[^a]", "a", false},
+        {"a[!x]b", "a/b", false},
+        {"[]]", "]", true},
+        {"[!]]", "a", true},
+        {"[!]]", "]", false},
+        // Escapes
+        {"\\*", "*", true},
+        {"\\*", "a", false},
+        // Malformed brackets are literal text
+        {"[", "[", true},
+        {"[abc", "[abc", true},
+        {"[abc", "a", false},
+        {"[!]", "[!]", true},
+        {"[^]", "[^]", true},
+        {"[!]abc", "[!]abc", true},
+        {"[]", "[]", true},
+    };
+    for (const Case& c : cases) {
+        bool matched = GlobPattern(c.pattern).matches(c.text);
+        if (matched != c.matches) {
+            std::cerr << "  glob \"" << c.pattern << "\" on \"" << c.text << "\": expected " << c.matches << std::endl;
+        }
+        CHECK(matched == c.matches);
     }
 }
 
-// Функция для форматирования даты
-std::string formatDate(const fs::file_time_type& ftime) {
-    auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
-        ftime - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
-    std::time_t cftime = std::chrono::system_clock::to_time_t(sctp);
-    std::tm* tm = std::localtime(&cftime);
-    
-    std::ostringstream oss;
-    oss << std::setfill('0') << std::setw(2) << tm->tm_mday << "."
-        << std::setfill('0') << std::setw(2) << (tm->tm_mon + 1) << "."
-        << (tm->tm_year + 1900);
-    
-    return oss.str();
+void testExclusionMatcher() {
+    using Decision = ExclusionMatcher::Decision;
+    ExclusionMatcher matcher;
+    matcher.addRule("# comment");
+    matcher.addRule("");
+    matcher.addRule("*.tmp");
+    matcher.addRule("!keep.tmp");
+    matcher.addRule("build/");
+    matcher.addRule("/top.txt");
+    matcher.addRule("docs/*.pdf");
+    matcher.addRule("**/node_modules");
+    matcher.addRule("cache*");
+    matcher.addRule("report-[0-9].csv");
+    matcher.compile();
+    CHECK(!matcher.empty());
+    CHECK(matcher.needsRelativePath());
+
+    // Unanchored rules match the name at any depth
+    CHECK(matcher.match("a/b/x.tmp", "x.tmp", false) == Decision::Exclude);
+    CHECK(matcher.match("x.tmpl", "x.tmpl", false) == Decision::None);
+    // A later '!' rule wins over an earlier exclude
+    CHECK(matcher.match("a/keep.tmp", "keep.tmp", false) == Decision::Include);
+    // A trailing '/' limits the rule to directories
+    CHECK(matcher.match("src/build", "build", true) == Decision::Exclude);
+    CHECK(matcher.match("src/build", "build", false) == Decision::None);
+    // A leading or inner '/' anchors the rule to the scan root
+    CHECK(matcher.match("top.txt", "top.txt", false) == Decision::Exclude);
+    CHECK(matcher.match("sub/top.txt", "top.txt", false) == Decision::None);
+    CHECK(matcher.match("docs/a.pdf", "a.pdf", false) == Decision::Exclude);
+    CHECK(matcher.match("x/docs/a.pdf", "a.pdf", false) == Decision::None);
+    CHECK(matcher.match("docs/sub/a.pdf", "a.pdf", false) == Decision::None);
+    // "**/name" is the same as "name"
+    CHECK(matcher.match("node_modules", "node_modules", true) == Decision::Exclude);
+    CHECK(matcher.match("a/b/node_modules", "node_modules", true) == Decision::Exclude);
+    // Prefix table and general name globs
+    CHECK(matcher.match("x/cache-1", "cache-1", false) == Decision::Exclude);
+    CHECK(matcher.match("x/mycache", "mycache", false) == Decision::None);
+    CHECK(matcher.match("report-7.csv", "report-7.csv", false) == Decision::Exclude);
+    CHECK(matcher.match("report-x.csv", "report-x.csv", false) == Decision::None);
+
+    // --include forces an include rule without the '!'
+    ExclusionMatcher forced;
+    forced.addRule("*.iso");
+    forced.addRule("linux.iso", true);
+    forced.compile();
+    CHECK(!forced.needsRelativePath());
+    CHECK(forced.match("", "debian.iso", false) == Decision::Exclude);
+    CHECK(forced.match("", "linux.iso", false) == Decision::Include);
+
+    // Malformed brackets do not break compilation or matching of other rules
+    ExclusionMatcher malformed;
+    malformed.addRule("[!]");
+    malformed.addRule("data[");
+    malformed.addRule("*.bak");
+    malformed.compile();
+    CHECK(malformed.match("", "[!]", false) == Decision::Exclude);
+    CHECK(malformed.match("", "data[", false) == Decision::Exclude);
+    CHECK(malformed.match("", "a.bak", false) == Decision::Exclude);
+    CHECK(malformed.match("", "data", false) == Decision::None);
+
+    ExclusionMatcher none;
+    none.compile();
+    CHECK(none.empty());
+    CHECK(none.match("a", "a", false) == Decision::None);
+}
+
+SnapshotEntry snapshotEntry(const std::string& path, std::uint64_t size, std::int64_t mtime, std::uint32_t mode = S_IFREG | 0644) {
+    SnapshotEntry entry;
+    entry.path = path;
+    entry.size = size;
+    entry.allocated = (size + 4095) / 4096 * 4096;
+    entry.mtime = mtime;
+    entry.mode = mode;
+    return entry;
 }
 
-class FileManager {
+bool sameEntry(const SnapshotEntry& a, const SnapshotEntry& b) {
+    return a.path == b.path && a.size == b.size && a.allocated == b.allocated && a.mtime == b.mtime && a.mode == b.mode;
+}
+
+class VectorEntryStream : public SnapshotEntryStream {
 private:
-    std::vector<FileInfo> files;
-    std::string directoryPath;
-    
+    std::vector<SnapshotEntry> entries;
+    size_t position = 0;
+
 public:
-    FileManager(const std::string& path) : directoryPath(path) {
-        loadFiles();
-    }
+    explicit VectorEntryStream(std::vector<SnapshotEntry> rows) : entries(std::move(rows)) {}
     
-    void loadFiles() {
-        files.clear();
-        try {
-            if (fs::exists(directoryPath) && fs::is_directory(directoryPath)) {
-                for (const auto& entry : fs::recursive_directory_iterator(directoryPath)) {
-                    FileInfo info;
-                    info.name = entry.path().string();
-                    info.isDirectory = entry.is_directory();
-                    
-                    if (info.isDirectory) {
-                        info.size = "<DIR>";
-                    } else {
-                        try {
-                            auto fileSize = fs::file_size(entry.path());
-                            info.size = std::to_string(fileSize);
-                        } catch (...) {
-                            info.size = "0";
-                        }
-                    }
-                    
-                    try {
-                        auto ftime = fs::last_write_time(entry.path());
-                        info.date = formatDate(ftime);
-                    } catch (...) {
-                        info.date = "01.01.1970";
-                    }
-                    
-                    info.permissions = getFilePermissions(entry.path());
-                    
-                    files.push_back(info);
-                }
-                
-                // Сортировка: сначала каталоги, потом файлы
-                std::sort(files.begin(), files.end(), [](const FileInfo& a, const FileInfo& b) {
-                    if (a.isDirectory != b.isDirectory) {
-                        return a.isDirectory > b.isDirectory;
-                    }
-                    return a.name < b.name;
-                });
-            }
-        } catch (const std::exception& e) {
-            std::cerr << "Error reading directory: " << e.what() << std::endl;
+    bool next(SnapshotEntry& entry) override {
+        if (position >= entries.size()) {
+            return false;
         }
-    }
-    
-    const std::vector<FileInfo>& getFiles() const {
-        return files;
-    }
-    
-    size_t getFileCount() const {
-        return files.size();
+        entry = entries[position++];
+        return true;
     }
 };
-// >>> Helper: Truncate string with ellipsis
-std::string truncate(const std::string& str, size_t maxLen = 35) {
-    if (str.length() <= maxLen) return str;
-    return str.substr(0, maxLen - 3) + "...";
-}
-
-enum class HAlign { Left, Center, Right };
-enum class VAlign { Top, Center, Bottom };
-
-void setTextPosition(sf::Text& text, const sf::FloatRect& bounds, HAlign hAlign = HAlign::Center, VAlign vAlign = VAlign::Center, float hPadding = 0.0f, float vPadding = 0.0f) {
-    auto localBounds = text.getLocalBounds();
 
-    float x = 0.0f;
-    float y = 0.0f;
+std::vector<SnapshotEntry> readSnapshot(SnapshotReader& reader) {
+    std::vector<SnapshotEntry> entries;
+    SnapshotEntry entry;
+    while (reader.next(entry)) {
+        entries.push_back(entry);
+    }
+    return entries;
+}
 
-    // Horizontal alignment
-    switch (hAlign) {
-        case HAlign::Left:
-            x = bounds.position.x + hPadding - localBounds.position.x;
-            break;
-        case HAlign::Center:
-            x = bounds.position.x + bounds.size.x / 2.0f - localBounds.position.x - localBounds.size.x / 2.0f;
-            break;
-        case HAlign::Right:
-            x = bounds.position.x + bounds.size.x - hPadding - localBounds.position.x - localBounds.size.x;
-            break;
+bool writeSnapshot(const std::string& path, const std::string& root, const std::vector<SnapshotEntry>& entries) {
+    SnapshotWriter writer;
+    if (!writer.open(path, root)) {
+        return false;
+    }
+    for (const SnapshotEntry& entry : entries) {
+        writer.add(entry);
     }
+    return writer.finish();
+}
 
-    // Vertical alignment
-    switch (vAlign) {
-        case VAlign::Top:
-            y = bounds.position.y + vPadding - localBounds.position.y;
-            break;
-        case VAlign::Center:
-            y = bounds.position.y + bounds.size.y / 2.0f - localBounds.position.y - localBounds.size.y / 2.0f;
-            break;
-        case VAlign::Bottom:
-            y = bounds.position.y + bounds.size.y - vPadding - localBounds.size.y - localBounds.position.y;
-            break;
+// The version 1 layout, which only older builds write
+void writeSnapshotV1(const std::string& path, const std::string& root, const std::vector<SnapshotEntry>& entries) {
+    std::string bytes = "TBLSNAP1";
+    auto appendRaw = [&](const auto& value) { bytes.append(reinterpret_cast<const char*>(&value), sizeof(value)); };
+    appendRaw(static_cast<std::uint32_t>(root.size()));
+    bytes += root;
+    for (const SnapshotEntry& entry : entries) {
+        appendRaw(static_cast<std::uint32_t>(entry.path.size()));
+        bytes += entry.path;
+        appendRaw(entry.size);
+        appendRaw(entry.allocated);
+        appendRaw(entry.mtime);
+        appendRaw(entry.mode);
     }
+    writeFile(path, bytes);
+}
 
-    text.setPosition(sf::Vector2f(x, y));
+// Path-ordered entries with shared prefixes, a path longer than one varint byte and a negative mtime
+std::vector<SnapshotEntry> sampleSnapshotEntries() {
+    return {
+        snapshotEntry("a", 4096, 1700000000, S_IFDIR | 0755),
+        snapshotEntry("a/b.txt", 12, 1700000001),
+        snapshotEntry("a/bb.txt", 0, 1700000002),
+        snapshotEntry("a/c/" + std::string(300, 'x'), 1ULL << 40, -86400),
+        snapshotEntry("a/c/y", 7, 0, S_IFLNK | 0777),
+        snapshotEntry("b", 3, 1700000003, S_IFREG | 04755),
+    };
 }
 
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <dir> [m rows] [n cols] [frame size] [bgcolor hex] [linecolor hex] [line size] [font index] [border hex] [text hex] [font size]\n";
-        return 1;
+void testSnapshotRoundTrip() {
+    const std::vector<SnapshotEntry> entries = sampleSnapshotEntries();
+    
+    for (bool frontCoded : {true, false}) {
+        std::string path = scratchPath(frontCoded ? "v2.snap" : "v1.snap");
+        if (frontCoded) {
+            CHECK(writeSnapshot(path, "/data/root", entries));
+            CHECK(readFile(path).compare(0, 8, "TBLSNAP2") == 0);
+        } else {
+            writeSnapshotV1(path, "/data/root", entries);
+        }
+        SnapshotReader reader;
+        CHECK(reader.open(path));
+        CHECK(reader.root() == "/data/root");
+        std::vector<SnapshotEntry> read = readSnapshot(reader);
+        CHECK(!reader.damaged());
+        CHECK(read.size() == entries.size());
+        for (size_t i = 0; i < read.size() && i < entries.size(); i++) {
+            CHECK(sameEntry(read[i], entries[i]));
+        }
     }
     
-    std::string targetDirectory = argv[1];
-    int m = (argc >= 3) ? std::stoi(argv[2]) : 20;                        // m (rows)
-    int n = (argc >= 4) ? std::stoi(argv[3]) : 4;                                            // n        
-    float frameSize = (argc >= 5) ? std::stoi(argv[4]) : 10.0f;             // frame size (border size)
+    // Front coding stores shared prefixes once
+    CHECK(readFile(scratchPath("v2.snap")).size() < readFile(scratchPath("v1.snap")).size());
     
-    sf::Color borderColor = sf::Color::Red;                               // border color
-    sf::Color textColor = sf::Color::Red;                                 // text color
-    sf::Color bgColor = sf::Color::Black;                                 // bg color
-    sf::Color lineColor = sf::Color::White;                               // line color
-    sf::Color dirColor = sf::Color::Cyan;                               // line color
-    sf::Color pageInfoColor = sf::Color::Green;                               // line color
+    // No entries at all
+    CHECK(writeSnapshot(scratchPath("empty.snap"), "/", {}));
+    SnapshotReader empty;
+    CHECK(empty.open(scratchPath("empty.snap")));
+    CHECK(readSnapshot(empty).empty());
+    CHECK(!empty.damaged());
     
-    if (argc >= 6) ColorParse::hexToColor(argv[5], bgColor);
-    if (argc >= 7) ColorParse::hexToColor(argv[6], lineColor);
+    // A scanned table (directories first, each block sorted) comes out in path order
+    auto row = [](const std::string& name, std::uintmax_t size, bool isDirectory) {
+        FileInfo info{};
+        info.name = name;
+        info.isDirectory = isDirectory;
+        info.actualSize = size;
+        info.allocatedSize = size;
+        info.mode = isDirectory ? S_IFDIR | 0755 : S_IFREG | 0644;
+        info.mtime = 1600000000;
+        return info;
+    };
+    std::vector<FileInfo> rows = {row("/r/d", 0, true), row("/r/d/e", 0, true), row("/r/a.txt", 1, false),
+                                  row("/r/d/e/f", 2, false), row("/r/d/z", 3, false), row("/r/e", 4, false)};
+    FileTable table(std::move(rows));
+    CHECK(saveSnapshot(table, "/r", scratchPath("table.snap")));
+    SnapshotReader fromTable;
+    CHECK(fromTable.open(scratchPath("table.snap")));
+    std::vector<std::string> paths;
+    for (const SnapshotEntry& entry : readSnapshot(fromTable)) {
+        paths.push_back(entry.path);
+    }
+    CHECK((paths == std::vector<std::string>{"a.txt", "d", "d/e", "d/e/f", "d/z", "e"}));
+}
+
+void testSnapshotRejection() {
+    const std::vector<SnapshotEntry> entries = sampleSnapshotEntries();
+    std::string path = scratchPath("good.snap");
+    CHECK(writeSnapshot(path, "/root", entries));
+    const std::string good = readFile(path);
+    const size_t headerBytes = 8 + 4 + std::string("/root").size();
+    
+    SnapshotReader missing;
+    CHECK(!missing.open(scratchPath("does-not-exist.snap")));
     
-    float lineSize = argc >= 8 ? std::stof(argv[7]) : 2.f;               // line size
-    size_t currentFontIndex = argc >= 9 ? std::stoi(argv[8]) : 1;         // font index
+    std::string badMagic = good;
+    badMagic[7] = '9';
+    writeFile(path, badMagic);
+    SnapshotReader wrongVersion;
+    CHECK(!wrongVersion.open(path));
     
-    if (argc >= 10) ColorParse::hexToColor(argv[9], borderColor);
-    if (argc >= 11) ColorParse::hexToColor(argv[10], textColor);
+    // Root length pointing past the end of the file
+    std::string longRoot = good.substr(0, headerBytes);
+    std::uint32_t hugeLength = 1u << 30;
+    std::memcpy(&longRoot[8], &hugeLength, sizeof(hugeLength));
+    writeFile(path, longRoot);
+    SnapshotReader badRoot;
+    CHECK(!badRoot.open(path));
     
-    float fontSize = argc >= 12 ? std::stof(argv[11]) : 1.5f ;               // font size multiplier
-    unsigned int charSize = static_cast<unsigned int>(16 * fontSize);      // Base size 16
-
-    auto desktop = sf::VideoMode::getDesktopMode();
-    unsigned int width = desktop.size.x;
-    unsigned int height = desktop.size.y - 37;
-
-    sf::RenderWindow window(desktop, "", sf::State::Fullscreen);
-
-    // Загрузка шрифтов
-    std::vector<sf::Font> fonts;
-    std::vector<std::string> fontNames;
-    if (fs::exists("assets") && fs::is_directory("assets")) {
-        for (const auto& entry : fs::directory_iterator("assets")) {
-            if (entry.path().extension() == ".ttf") {
-                sf::Font f;
-                if (f.openFromFile(entry.path().string())) {
-                    fonts.push_back(std::move(f));
-                    fontNames.push_back(entry.path().filename().string());
-                }
-            }
+    // Every cut inside the header fails to open; every cut after it reads a prefix
+    // of the entries, and a cut that is not on an entry boundary is reported
+    size_t boundaries = 0;
+    for (size_t length = 0; length < good.size(); length++) {
+        writeFile(path, good.substr(0, length));
+        SnapshotReader reader;
+        bool opened = reader.open(path);
+        CHECK(opened == (length >= headerBytes));
+        if (!opened) {
+            continue;
+        }
+        std::vector<SnapshotEntry> read = readSnapshot(reader);
+        CHECK(read.size() < entries.size());
+        for (size_t i = 0; i < read.size() && i < entries.size(); i++) {
+            CHECK(sameEntry(read[i], entries[i]));
+        }
+        if (!reader.damaged()) {
+            boundaries++;
         }
     }
+    CHECK(boundaries == entries.size());  // after the header and after each entry but the last
+    
+    // A shared prefix longer than the previous path
+    std::string badPrefix = good;
+    badPrefix[headerBytes] = 5;
+    writeFile(path, badPrefix);
+    SnapshotReader prefixReader;
+    CHECK(prefixReader.open(path));
+    CHECK(readSnapshot(prefixReader).empty());
+    CHECK(prefixReader.damaged());
+    
+    // A suffix length far beyond the file is corruption, not an allocation
+    std::string badSuffix = good.substr(0, headerBytes);
+    badSuffix += std::string("\x00\xff\xff\xff\xff\x0f", 6);
+    writeFile(path, badSuffix);
+    SnapshotReader suffixReader;
+    CHECK(suffixReader.open(path));
+    CHECK(readSnapshot(suffixReader).empty());
+    CHECK(suffixReader.damaged());
+}
 
-    sf::Font font;
-    if (!fonts.empty() && currentFontIndex < fonts.size()) {
-        font = fonts[currentFontIndex];
-    } else {
-        // Попытка загрузить системный шрифт
-        fs::path defaultFont = fs::path("assets") / "Sansation-Regular.ttf";
-        if (!font.openFromFile(defaultFont.string())) {
-            std::cerr << "Warning: Could not load font\n";
-            return 1;
+void testSnapshotDiff() {
+    const std::uint32_t dir = S_IFDIR | 0755;
+    std::vector<SnapshotEntry> before = {
+        snapshotEntry("a", 4096, 100, dir),
+        snapshotEntry("a/edit.txt", 50, 100),
+        snapshotEntry("a/gone.txt", 100, 100),
+        snapshotEntry("a/grow.txt", 10, 100),
+        snapshotEntry("a/same.txt", 10, 100),
+        snapshotEntry("a/sub", 4096, 100, dir),
+        snapshotEntry("a/sub/shrink", 300, 100),
+        snapshotEntry("top", 5, 100),
+    };
+    std::vector<SnapshotEntry> after = {
+        snapshotEntry("a", 8192, 200, dir),          // a directory's own size and mtime are noise
+        snapshotEntry("a/edit.txt", 50, 200),        // same size, new mtime
+        snapshotEntry("a/grow.txt", 25, 100),
+        snapshotEntry("a/new.txt", 7, 200),
+        snapshotEntry("a/same.txt", 10, 100),
+        snapshotEntry("a/sub", 4096, 100, dir),
+        snapshotEntry("a/sub/shrink", 200, 200),
+        snapshotEntry("top", 5, 100, S_IFREG | 0755),  // mode only
+        snapshotEntry("zz", 1, 200),
+    };
+    
+    struct Expected {
+        DiffStatus status;
+        const char* path;
+    };
+    const std::vector<Expected> expected = {
+        {DiffStatus::Modified, "a/edit.txt"}, {DiffStatus::Removed, "a/gone.txt"},
+        {DiffStatus::Grown, "a/grow.txt"},    {DiffStatus::Added, "a/new.txt"},
+        {DiffStatus::Modified, "a/sub/shrink"}, {DiffStatus::Modified, "top"},
+        {DiffStatus::Added, "zz"},
+    };
+    
+    // The same merge from memory and from saved snapshots
+    CHECK(writeSnapshot(scratchPath("before.snap"), "/t", before));
+    CHECK(writeSnapshot(scratchPath("after.snap"), "/t", after));
+    for (bool fromFiles : {false, true}) {
+        VectorEntryStream memoryBefore(before), memoryAfter(after);
+        SnapshotReader fileBefore, fileAfter;
+        CHECK(fileBefore.open(scratchPath("before.snap")) && fileAfter.open(scratchPath("after.snap")));
+        SnapshotEntryStream& a = fromFiles ? static_cast<SnapshotEntryStream&>(fileBefore) : memoryBefore;
+        SnapshotEntryStream& b = fromFiles ? static_cast<SnapshotEntryStream&>(fileAfter) : memoryAfter;
+        
+        SnapshotDiff diff;
+        std::vector<DiffChange> changes;
+        diff.run(a, b, [&](const DiffChange& change) { changes.push_back(change); });
+        CHECK(changes.size() == expected.size());
+        for (size_t i = 0; i < changes.size() && i < expected.size(); i++) {
+            const SnapshotEntry& entry = changes[i].status == DiffStatus::Removed ? changes[i].before : changes[i].after;
+            CHECK(changes[i].status == expected[i].status);
+            CHECK(entry.path == expected[i].path);
+        }
+        if (changes.size() == expected.size()) {
+            CHECK(changes[1].after.path.empty() && changes[1].before.size == 100);
+            CHECK(changes[2].before.size == 10 && changes[2].after.size == 25);
+            CHECK(changes[3].before.path.empty() && changes[3].after.size == 7);
+        }
+        
+        // Totals per directory, recursively, largest absolute change first
+        std::vector<DirectoryDelta> deltas = diff.directoryDeltas();
+        CHECK(deltas.size() == 3);
+        if (deltas.size() == 3) {
+            CHECK(deltas[0].path == "a" && deltas[0].bytes == -178 && deltas[0].changes == 5);
+            CHECK(deltas[1].path == "" && deltas[1].bytes == -177 && deltas[1].changes == 7);
+            CHECK(deltas[2].path == "a/sub" && deltas[2].bytes == -100 && deltas[2].changes == 1);
         }
     }
+    
+    // Identical inputs produce nothing
+    VectorEntryStream same1(before), same2(before);
+    SnapshotDiff unchanged;
+    size_t changeCount = 0;
+    unchanged.run(same1, same2, [&](const DiffChange&) { changeCount++; });
+    CHECK(changeCount == 0);
+    CHECK(unchanged.directoryDeltas().empty());
+}
 
-    // >>> Pre-cache common glyphs to reduce runtime pressure
-    std::string commonChars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789 _-./:()[]{}<>";
-    for (char c : commonChars) {
-        (void)font.getGlyph(c, charSize, false, 0);
+void testFrontCodedNames() {
+    // A full 4096-row chunk: shared prefixes, repeats, a name that is a prefix of
+    // the one before it, empty and long names, and names that share nothing
+    std::vector<std::string> names;
+    for (size_t i = 0; names.size() < FileTable::kChunkRows; i++) {
+        std::string directory = "/home/user/project/dir" + std::to_string(i / 50);
+        switch (i % 7) {
+            case 0: names.push_back(directory); break;
+            case 1: names.push_back(directory + "/file" + std::to_string(i)); break;
+            case 2: names.push_back(names.back()); break;
+            case 3: names.push_back(directory + "/f"); break;
+            case 4: names.push_back(i % 91 == 4 ? std::string() : "/other/\xc3\xa9t\xc3\xa9" + std::to_string(i)); break;
+            case 5: names.push_back(directory + "/" + std::string(130 + i % 300, 'n')); break;
+            default: names.push_back("z" + std::to_string(i)); break;
+        }
     }
-
-    float cellWidth = (width - frameSize * 2) / static_cast<float>(n);
-    float cellHeight = (height - frameSize * 2) / static_cast<float>(m);
-
-    // Загрузка файлов
-    FileManager fileManager(targetDirectory);
-    const auto& files = fileManager.getFiles();
     
-    // Пагинация
-    int currentPage = 0;
-    int itemsPerPage = (m - 1) * n; // Первая строка для заголовков
-    int totalPages = (files.size() + itemsPerPage - 1) / itemsPerPage;
-
-    std::vector<sf::Text> headers;
-
-    {
-        std::vector<std::string> headersNames = {"Name", "Size (bytes)", "Date", "Permissions"};
-        
-        for (int j = 0; j < std::min(n, 4); j++) {
-            sf::Text t(font, headersNames[j], fontSize);
-            t.setFillColor(textColor);
-            t.setCharacterSize(charSize + 4);
-            
-            //t.setPosition(sf::Vector2f(cx, cy));
-            
-            sf::FloatRect cellBounds(
-                sf::Vector2f(frameSize + j * cellWidth,frameSize),
-                sf::Vector2f(cellWidth,cellHeight)
-            );
-
-            setTextPosition(t,cellBounds,HAlign::Center,VAlign::Center);
-
-            headers.push_back(t);
+    FrontCodedNames coded;
+    for (const std::string& name : names) {
+        coded.add(name);
+    }
+    coded.shrink();
+    CHECK(coded.size() == names.size());
+    
+    // Every block restart and its neighbours, then every name
+    std::string out = "stale";
+    for (size_t block = 0; block < names.size(); block += FrontCodedNames::kBlockNames) {
+        for (size_t i : {block, block + 1, block + FrontCodedNames::kBlockNames - 1}) {
+            coded.get(i, out);
+            CHECK(out == names[i]);
         }
-    };
-
-    std::vector<sf::Text> cells;
+    }
+    size_t mismatches = 0;
+    for (size_t i = names.size(); i-- > 0;) {
+        coded.get(i, out);
+        mismatches += out != names[i];
+    }
+    CHECK(mismatches == 0);
+    size_t visited = 0;
+    mismatches = 0;
+    coded.forEach([&](size_t i, const std::string& name) {
+        mismatches += i != visited || name != names[i];
+        visited++;
+    });
+    CHECK(mismatches == 0);
+    CHECK(visited == names.size());
+    CHECK(coded.memoryBytes() > 0);
+    
+    // Counts that end on either side of a block boundary
+    for (size_t total : {size_t(1), FrontCodedNames::kBlockNames - 1, FrontCodedNames::kBlockNames,
+                         FrontCodedNames::kBlockNames + 1, 2 * FrontCodedNames::kBlockNames}) {
+        FrontCodedNames small;
+        for (size_t i = 0; i < total; i++) {
+            small.add(names[i]);
+        }
+        CHECK(small.size() == total);
+        small.get(total - 1, out);
+        CHECK(out == names[total - 1]);
+    }
+}
 
-    cells.clear();
-    cells.reserve(itemsPerPage); // optional optimization
+FileInfo tableRow(size_t id) {
+    FileInfo info{};
+    info.name = "/t/d" + std::to_string(id / 40) + "/f" + std::to_string(id);
+    info.isDirectory = id % 40 == 0;
+    info.actualSize = id * 3;
+    info.allocatedSize = id * 4;
+    info.inode = id + 1;
+    info.mode = info.isDirectory ? S_IFDIR | 0755 : S_IFREG | 0644;
+    info.mtime = static_cast<time_t>(1600000000 + id);
+    return info;
+}
 
-    for (int i = 0; i < itemsPerPage; ++i) {
-        sf::Text t(font,"", charSize);
-        t.setFillColor(textColor);
-        cells.push_back(std::move(t));
+// Every way of reading the table agrees with the plain vector it should hold
+bool tableMatches(const FileTable& table, const std::vector<FileInfo>& model) {
+    if (table.size() != model.size()) {
+        return false;
+    }
+    bool same = true;
+    std::string scratch;
+    size_t expectedRow = 0;
+    table.forEachName([&](size_t row, std::string_view name) {
+        same = same && row == expectedRow && row < model.size() && name == model[row].name;
+        expectedRow++;
+    });
+    same = same && expectedRow == model.size();
+    expectedRow = 0;
+    for (size_t c = 0; c < table.chunkCount(); c++) {
+        table.forEachFact(c, [&](size_t row, const FileTable::RowFacts& facts) {
+            same = same && row == expectedRow && row < model.size() && facts.name == model[row].name &&
+                   facts.actualSize == model[row].actualSize && facts.allocatedSize == model[row].allocatedSize &&
+                   facts.isDirectory == model[row].isDirectory && facts.mtime == model[row].mtime;
+            expectedRow++;
+        });
+    }
+    same = same && expectedRow == model.size();
+    for (size_t i = 0; i < model.size() && same; i++) {
+        same = table.nameAt(i, scratch) == model[i].name && table.isDirectoryAt(i) == model[i].isDirectory;
+    }
+    for (size_t i = 0; i < model.size() && same; i++) {
+        const FileInfo& row = table[i];
+        same = row.name == model[i].name && row.actualSize == model[i].actualSize && row.inode == model[i].inode &&
+               row.mode == model[i].mode && row.mtime == model[i].mtime;
     }
+    return same;
+}
 
-    auto updateCells = [&](int page) {
-        int startIndex = page * itemsPerPage;
-        cells.clear();
-        cells.reserve(itemsPerPage);
-        
-        for (int i = 0; i < itemsPerPage; ++i) {
-            sf::Text t(font,"", charSize);
-            t.setFillColor(textColor);
-            cells.push_back(std::move(t));
+// What FileTable::splice promises, on a plain vector
+void spliceModel(std::vector<FileInfo>& model, const std::vector<std::pair<size_t, size_t>>& removed,
+                 const std::vector<std::pair<size_t, FileInfo>>& added) {
+    std::vector<FileInfo> result;
+    size_t nextRemoved = 0, nextAdded = 0;
+    for (size_t i = 0; i <= model.size(); i++) {
+        while (nextAdded < added.size() && added[nextAdded].first <= i) {
+            result.push_back(added[nextAdded++].second);
+        }
+        if (i == model.size()) {
+            break;
         }
+        while (nextRemoved < removed.size() && removed[nextRemoved].second <= i) {
+            nextRemoved++;
+        }
+        if (nextRemoved == removed.size() || i < removed[nextRemoved].first) {
+            result.push_back(model[i]);
+        }
+    }
+    model = std::move(result);
+}
 
-        for (int i = 0; i < m - 1; i++) {
-            for (int j = 0; j < n; j++) {
-                int idx = i * n + j;
-                int fileIndex = startIndex + idx;
-
-                if (fileIndex >= (int)files.size()) {
-                    cells[idx].setString(""); // hide unused
-                    continue;
-                }
-                const FileInfo& fileInfo = files[fileIndex];
-                std::string text;
-                
-                switch (j) {
-                    case 0: text = truncate(fs::path(fileInfo.name).filename().string()); break;
-                    case 1: text = fileInfo.size; break;
-                    case 2: text = fileInfo.date; break;
-                    case 3: text = fileInfo.permissions; break;
-                    default: text = "";
-                }
-                
-                auto& t = cells[idx];
-                t.setString(text);
-                t.setFillColor(fileInfo.isDirectory ? dirColor : textColor);
-                
-                //t.setOrigin(sf::Vector2f(bounds.position.x + bounds.size.x / 2.f,
-
-                sf::FloatRect cellBounds(
-                    sf::Vector2f(frameSize + j * cellWidth,frameSize + (i + 1) * cellHeight),
-                    sf::Vector2f(cellWidth,cellHeight)
-                );
-
-                setTextPosition(t,cellBounds,HAlign::Center,VAlign::Center);
-
-                cells.push_back(t);
-            }
+void testFileTableEdits() {
+    const size_t chunk = FileTable::kChunkRows;
+    size_t nextId = 0;
+    std::vector<FileInfo> model;
+    for (; nextId < 3 * chunk + 100; nextId++) {
+        model.push_back(tableRow(nextId));
+    }
+    std::vector<FileInfo> rows = model;
+    FileTable table(std::move(rows));
+    CHECK(table.chunkCount() == 4);
+    CHECK(tableMatches(table, model));
+    table.compact();
+    CHECK(tableMatches(table, model));
+    
+    auto edit = [&](const std::vector<std::pair<size_t, size_t>>& removed, const std::vector<size_t>& positions) {
+        std::vector<std::pair<size_t, FileInfo>> added;
+        for (size_t position : positions) {
+            added.emplace_back(position, tableRow(nextId++));
         }
+        spliceModel(model, removed, added);
+        table.splice(removed, std::move(added));
     };
+    
+    // Removals and insertions at chunk edges, inside removed ranges and at both ends
+    edit({{10, 20}, {chunk - 1, chunk + 1}, {2 * chunk + 5, 2 * chunk + 6}}, {0, 15, chunk, chunk, 3 * chunk, model.size()});
+    CHECK(tableMatches(table, model));
+    table.compact();  // packs only the rebuilt chunks; the others stay shared
+    CHECK(tableMatches(table, model));
+    
+    // One chunk outgrows kChunkRows and is split
+    edit({}, std::vector<size_t>(chunk + 500, chunk + 7));
+    CHECK(table.chunkCount() >= 6);
+    CHECK(tableMatches(table, model));
+    table.compact();
+    CHECK(tableMatches(table, model));
+    
+    // A whole chunk and more disappears
+    edit({{chunk / 2, 2 * chunk + chunk / 2}}, {});
+    CHECK(tableMatches(table, model));
+    
+    // Random edits over a mix of packed and decoded chunks
+    std::mt19937 random(43);
+    for (int round = 0; round < 20; round++) {
+        std::vector<std::pair<size_t, size_t>> removed;
+        for (size_t at = random() % 300; at + 1 < model.size(); at += 1 + random() % 3000) {
+            size_t end = std::min(model.size(), at + 1 + random() % 200);
+            removed.emplace_back(at, end);
+            at = end;
+        }
+        std::vector<size_t> positions;
+        for (int k = static_cast<int>(random() % 50); k > 0; k--) {
+            positions.push_back(random() % (model.size() + 1));
+        }
+        std::sort(positions.begin(), positions.end());
+        edit(removed, positions);
+        if (round % 3 == 0) {
+            table.compact();
+        }
+        CHECK(tableMatches(table, model));
+        (void)table[model.size() / 2];  // decodes one chunk between rounds
+    }
+    
+    // Emptied and filled again
+    edit({{0, model.size()}}, {});
+    CHECK(table.empty());
+    CHECK(tableMatches(table, model));
+    edit({}, {0, 0, 0});
+    CHECK(tableMatches(table, model));
+}
 
-    sf::Text pageInfo(font, "", fontSize);
-
-    auto updatePageInfo = [&]() {
-        std::ostringstream oss;
-        oss << "Page " << (currentPage + 1) << "/" << totalPages
-            << " | Files: " << files.size()
-            << " | Dir: " << truncate(targetDirectory, 50);
-        
-        sf::Text t(font, oss.str(), charSize - 2);
-        t.setFillColor(pageInfoColor);
-        
-        auto bounds = t.getLocalBounds();
-        t.setOrigin(sf::Vector2f(bounds.position.x / 2.f, bounds.position.y / 2.f));
-        t.setPosition(sf::Vector2f(width / 2.f, height - 20));
-
-        sf::FloatRect cellBounds(
-            sf::Vector2f(0, height - 40),
-            sf::Vector2f(width, 40)
-        );
-
-        setTextPosition(t,cellBounds,HAlign::Center,VAlign::Center);
+void testFormatSizes() {
+    struct Case {
+        std::uint64_t bytes;
+        const char* human;
     };
-
-    // Initial render
-    updateCells(currentPage);
-    updatePageInfo();
-
-    while (window.isOpen()) {
-        while (auto eventOpt = window.pollEvent()) {
-            if (!eventOpt) break;
-            const sf::Event& event = *eventOpt;
-            
-            if (event.is<sf::Event::Closed>()) {
-                window.close();
-            }
-            
-            if (event.is<sf::Event::KeyPressed>()) {
-                if(const auto* keyPressed = event.getIf<sf::Event::KeyPressed>()){
-                    if (keyPressed->scancode == sf::Keyboard::Scancode::Right || keyPressed->scancode == sf::Keyboard::Scancode::Down) {
-                        if (currentPage < totalPages - 1) {
-                            currentPage++;
-                            updateCells(currentPage);
-                            updatePageInfo();
-                        }
-                    }
-                    else if (keyPressed->scancode == sf::Keyboard::Scancode::Left || keyPressed->scancode == sf::Keyboard::Scancode::Up) {
-                        if (currentPage > 0) {
-                            currentPage--;
-                            updateCells(currentPage);
-                            updatePageInfo();
-                        }
-                    }
-                    // Reset
-                    else if (keyPressed->scancode == sf::Keyboard::Scancode::R) {
-                        // Перезагрузка файлов
-                        fileManager.loadFiles();
-                        currentPage = 0;
-                        totalPages = (fileManager.getFileCount() + itemsPerPage - 1) / itemsPerPage;
-                        updateCells(currentPage);
-                        updatePageInfo();
-                    }
-                }   
-            }
-
-            if (event.is<sf::Event::MouseWheelScrolled>()) {
-                if (const auto* mouseWheelScrolled = event.getIf<sf::Event::MouseWheelScrolled>())
-                {
-                    if (mouseWheelScrolled->wheel == sf::Mouse::Wheel::Vertical) {
-                        if (mouseWheelScrolled->delta > 0) {
-                            // Прокрутка вверх
-                            if (currentPage > 0) {
-                                currentPage--;
-                                updateCells(currentPage);
-                                updatePageInfo();
-                            }
-                        } else {
-                            // Прокрутка вниз
-                            if (currentPage < totalPages - 1) {
-                                currentPage++;
-                                updateCells(currentPage);
-                                updatePageInfo();
-                            }
-                        }
-                    }
-                }
-            }
+    static const Case cases[] = {
+        {0, "0"},
+        {1023, "1023"},
+        {1024, "1.0K"},
+        {1025, "1.1K"},           // rounded up, like ls
+        {1536, "1.5K"},
+        {10239, "10K"},
+        {10240, "10K"},
+        {10241, "11K"},
+        {1047552, "1023K"},       // 1023.0K
+        {1047553, "1.0M"},        // 1023.001K rounds up to 1024K, which carries into M
+        {1048575, "1.0M"},
+        {1048576, "1.0M"},
+        {1572864, "1.5M"},
+        {1073741824, "1.0G"},
+        {1099511627776, "1.0T"},
+        {UINT64_MAX, "16E"},
+    };
+    char buf[32];
+    for (const Case& c : cases) {
+        std::string human(buf, FormatEngine::writeHumanSize(c.bytes, buf));
+        if (human != c.human) {
+            std::cerr << "  size " << c.bytes << ": \"" << human << "\", expected \"" << c.human << "\"" << std::endl;
         }
+        CHECK(human == c.human);
+        CHECK(human.size() <= 6);
+        CHECK(std::string(buf, FormatEngine::writeUnsigned(c.bytes, buf)) == std::to_string(c.bytes));
+    }
+    
+    CHECK(formatSizeInfo(1023, 1024) == "1023/1024");
+    FormatEngine::setHumanReadable(true);
+    CHECK(formatSizeInfo(1023, 1024) == "1023/1.0K");
+    CHECK(formatSizeInfo(1047553, 1048576) == "1.0M/1.0M");
+    FormatEngine::setHumanReadable(false);
+    CHECK(formatSizeInfo(UINT64_MAX, 0) == "18446744073709551615/0");
+}
 
-        window.clear(bgColor);
-
-        sf::RectangleShape topBorder(sf::Vector2f(width, (float)frameSize));
-        topBorder.setPosition(sf::Vector2f(0, 0));
-        topBorder.setFillColor(borderColor);
-        window.draw(topBorder);
-
-        sf::RectangleShape bottomBorder(sf::Vector2f(width, (float)frameSize));
-        bottomBorder.setPosition(sf::Vector2f(0, (float)height - frameSize));
-        bottomBorder.setFillColor(borderColor);
-        window.draw(bottomBorder);
-        
-        sf::RectangleShape leftBorder(sf::Vector2f((float)frameSize, height));
-        leftBorder.setPosition(sf::Vector2f(0, (float)frameSize));
-        leftBorder.setFillColor(borderColor);
-        window.draw(leftBorder);
-        
-        sf::RectangleShape rightBorder(sf::Vector2f((float)frameSize, height));
-        rightBorder.setPosition(sf::Vector2f(width - frameSize, (float)frameSize));
-        rightBorder.setFillColor(borderColor);
-        window.draw(rightBorder);
-
-        for (int i = 1; i < m; i++) {
-            sf::RectangleShape line({(float)width - frameSize * 2, (float)lineSize});
-            line.setFillColor(lineColor);
-            float y = frameSize + i * cellHeight;
-            line.setPosition(sf::Vector2f(frameSize,y));
-            window.draw(line);
+void testFormatDates() {
+    // Fixed zones without tzdata: UTC, and central Europe with its DST rules
+    auto useZone = [](const char* zone) {
+        setenv("TZ", zone, 1);
+        tzset();
+        FormatEngine::refreshClock();
+    };
+    useZone("UTC0");
+    
+    time_t now = time(nullptr);
+    struct tm today;
+    gmtime_r(&now, &today);
+    int year = today.tm_year + 1900;
+    
+    // Dates of the current year show the time, others the year; later this year is still "this year"
+    struct tm endOfYear{};
+    endOfYear.tm_year = year - 1900;
+    endOfYear.tm_mon = 11;
+    endOfYear.tm_mday = 31;
+    endOfYear.tm_hour = 23;
+    endOfYear.tm_min = 59;
+    time_t lastMinute = timegm(&endOfYear);
+    struct tm startOfYear{};
+    startOfYear.tm_year = year - 1900;
+    startOfYear.tm_mday = 1;
+    time_t firstSecond = timegm(&startOfYear);
+    
+    struct Case {
+        time_t mtime;
+        std::string text;
+    };
+    const std::vector<Case> cases = {
+        {0, "Jan  1  1970"},
+        {-1, "Dec 31  1969"},
+        {-2208988800, "Jan  1  1900"},
+        {951782400, "Feb 29  2000"},
+        {4102444799, "Dec 31  2099"},
+        {4102444800, "Jan  1  2100"},
+        {253402300799, "Dec 31  9999"},
+        {firstSecond, "Jan  1 00:00"},
+        {lastMinute, "Dec 31 23:59"},
+        {firstSecond - 1, "Dec 31  " + std::to_string(year - 1)},
+        {lastMinute + 60, "Jan  1  " + std::to_string(year + 1)},
+    };
+    for (const Case& c : cases) {
+        std::string text = formatDate(c.mtime);
+        if (text != c.text) {
+            std::cerr << "  date " << c.mtime << ": \"" << text << "\", expected \"" << c.text << "\"" << std::endl;
         }
-
-        for (int j = 1; j < n; j++) {
-            sf::RectangleShape vline({(float)lineSize, (float)height - frameSize * 2});
-            vline.setFillColor(lineColor);
-            float x = frameSize + j * cellWidth;
-            vline.setPosition(sf::Vector2f(x, frameSize));
-            window.draw(vline);
+        CHECK(text == c.text);
+        CHECK(text.size() == 12);
+    }
+    
+    // Days on which the offset changes go through localtime_r, the others use the cached
+    // offset. Only dates of the current year show the clock, so take this year's switches.
+    useZone("CET-1CEST,M3.5.0,M10.5.0/3");
+    auto lastSunday = [&](int month) {
+        struct tm day{};
+        day.tm_year = year - 1900;
+        day.tm_mon = month;
+        day.tm_mday = 31;
+        time_t t = timegm(&day);
+        gmtime_r(&t, &day);
+        return t - day.tm_wday * 86400;
+    };
+    time_t spring = lastSunday(2), autumn = lastSunday(9);
+    const time_t zoned[] = {
+        spring + 1800,           // 00:30 UTC = 01:30 CET
+        spring + 5400,           // 01:30 UTC = 03:30 CEST, the skipped hour
+        spring - 86400 + 43200,  // the day before
+        autumn + 1800,           // 00:30 UTC = 02:30 CEST
+        autumn + 5400,           // 01:30 UTC = 02:30 CET, the repeated hour
+        autumn + 86400 + 43200,  // the day after
+        firstSecond + 43200,     // winter
+        spring + 90 * 86400,     // summer
+    };
+    for (time_t mtime : zoned) {
+        struct tm local;
+        localtime_r(&mtime, &local);
+        char expected[16];
+        strftime(expected, sizeof(expected), "%b %e %H:%M", &local);
+        std::string text = formatDate(mtime);
+        if (text != expected) {
+            std::cerr << "  date " << mtime << " in CET: \"" << text << "\", expected \"" << expected << "\"" << std::endl;
         }
+        CHECK(text == expected);
+    }
+    CHECK(formatDate(spring + 5400).substr(7) == "03:30");
+    CHECK(formatDate(autumn + 1800) == formatDate(autumn + 5400));
+    useZone("UTC0");
+}
 
-        for (auto& t : headers) {
-            window.draw(t);
-        }
-        
-        for (auto& t : cells) {
-            window.draw(t);
+void testFormatPermissions() {
+    struct Case {
+        mode_t mode;
+        const char* text;
+    };
+    static const Case cases[] = {
+        {S_IFREG | 0644, "-rw-r--r--"},
+        {S_IFDIR | 0755, "drwxr-xr-x"},
+        {S_IFLNK | 0777, "lrwxrwxrwx"},
+        {S_IFREG | 0, "----------"},
+        {S_IFREG | 04755, "-rwsr-xr-x"},
+        {S_IFREG | 04644, "-rwSr--r--"},
+        {S_IFREG | 02755, "-rwxr-sr-x"},
+        {S_IFREG | 02745, "-rwxr-Sr-x"},
+        {S_IFDIR | 01777, "drwxrwxrwt"},
+        {S_IFDIR | 01770, "drwxrwx--T"},
+        {S_IFREG | 07777, "-rwsrwsrwt"},
+        {S_IFREG | 07000, "---S--S--T"},
+        {S_IFCHR | 0620, "crw--w----"},
+        {S_IFBLK | 0660, "brw-rw----"},
+        {S_IFIFO | 0600, "prw-------"},
+        {S_IFSOCK | 0755, "srwxr-xr-x"},
+    };
+    for (const Case& c : cases) {
+        char buf[10];
+        std::string text(buf, FormatEngine::writePermissions(c.mode, buf));
+        if (text != c.text) {
+            std::cerr << "  mode " << std::oct << c.mode << std::dec << ": \"" << text << "\", expected \"" << c.text << "\"" << std::endl;
         }
-        
-        // Рисуем информацию о странице
-        window.draw(pageInfo);
+        CHECK(text == c.text);
+    }
+    
+    // Editing a cell parses the displayed string back to the same bits
+    size_t mismatches = 0;
+    for (mode_t bits = 0; bits < 010000; bits++) {
+        char buf[10];
+        std::string text(buf, FormatEngine::writePermissions(S_IFREG | bits, buf));
+        mode_t parsed = 0;
+        mismatches += !parsePermissionString(text, parsed) || parsed != bits;
+    }
+    CHECK(mismatches == 0);
+    mode_t parsed = 0;
+    CHECK(parsePermissionString("4755", parsed) && parsed == 04755);
+    CHECK(!parsePermissionString("rwxr-xr-x", parsed));
+}
 
-        window.display();
+int main() {
+    char scratchTemplate[] = "/tmp/table_tests.XXXXXX";
+    if (!mkdtemp(scratchTemplate)) {
+        std::cerr << "Cannot create a scratch directory: " << strerror(errno) << std::endl;
+        return 1;
     }
+    scratchDirectory = scratchTemplate;
+    
+    testGlobPattern();
+    testExclusionMatcher();
+    testSnapshotRoundTrip();
+    testSnapshotRejection();
+    testSnapshotDiff();
+    testFrontCodedNames();
+    testFileTableEdits();
+    testFormatSizes();
+    testFormatDates();
+    testFormatPermissions();
+    
+    std::error_code ignored;
+    fs::remove_all(scratchDirectory, ignored);
 
-    return 0;
-}
\ No newline at end of file
+    std::cout << checksRun - checksFailed << "/" << checksRun << " checks passed" << std::endl;
+    return checksFailed == 0 ? 0 : 1;
+}